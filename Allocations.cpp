@@ -0,0 +1,92 @@
+#include "Allocations.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+// Zero initialised, so that they may be counted into before any constructor has run
+static std::atomic<unsigned long long> g_allocations;
+static std::atomic<unsigned long long> g_bytes;
+static thread_local unsigned long long g_threadAllocations = 0;
+static thread_local unsigned long long g_threadBytes = 0;
+
+AllocationCount CAllocations::GetTotal()
+{
+	AllocationCount count;
+	count.allocations = g_allocations.load(std::memory_order_relaxed);
+	count.bytes = g_bytes.load(std::memory_order_relaxed);
+	return count;
+}
+
+AllocationCount CAllocations::GetThreadTotal()
+{
+	AllocationCount count;
+	count.allocations = g_threadAllocations;
+	count.bytes = g_threadBytes;
+	return count;
+}
+
+void CAllocations::Count(size_t bytes)
+{
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	g_bytes.fetch_add(bytes, std::memory_order_relaxed);
+	g_threadAllocations++;
+	g_threadBytes += bytes;
+}
+
+#if ALLOCATION_TRACKING
+// Every form but the aligned ones, which are rare here and are left to the library uncounted
+void *operator new(size_t size)
+{
+	CAllocations::Count(size);
+	void *p = malloc(size ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	CAllocations::Count(size);
+	return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept
+{
+	free(p);
+}
+#endif
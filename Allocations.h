@@ -0,0 +1,29 @@
+#pragma once
+#include "Common.h"
+
+// Define as 0 to leave the global operator new and delete alone
+#ifndef ALLOCATION_TRACKING
+#define ALLOCATION_TRACKING 1
+#endif
+
+struct AllocationCount
+{
+	unsigned long long allocations;
+	unsigned long long bytes;
+};
+
+// Counts the heap allocations made through operator new, which replaces the global one while ALLOCATION_TRACKING is set.
+// Each thread counts its own as well as the total, so that a profiler zone can take the allocations made inside it (see
+// CProfiler) and the benchmark can check that a steady frame makes none.  Allocations made with malloc directly, as by
+// the driver and the C libraries, are not seen.  Counting costs two relaxed atomic adds and two thread local adds.
+class CAllocations
+{
+public:
+	// Since the process started
+	static AllocationCount GetTotal();
+	// Made by the calling thread
+	static AllocationCount GetThreadTotal();
+
+	// Used by operator new
+	static void Count(size_t bytes);
+};
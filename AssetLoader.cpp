@@ -0,0 +1,64 @@
+#include "AssetLoader.h"
+#include "HighResolutionTimer.h"
+#include "Profiler.h"
+
+CAssetLoader::CAssetLoader(CJobSystem *pJobSystem)
+{
+	m_pJobSystem = pJobSystem;
+	m_numQueued = 0;
+	m_numFinished = 0;
+}
+
+CAssetLoader::~CAssetLoader()
+{}
+
+void CAssetLoader::Queue(const std::function<void()> &load, const std::function<void()> &upload)
+{
+	m_numQueued++;
+	m_pJobSystem->Submit([this, load, upload] {
+		{
+			PROFILE_ZONE("Load asset");
+			load();
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_uploads.push_back(upload);
+	});
+}
+
+void CAssetLoader::ProcessUploads(double budgetMilliseconds)
+{
+	CHighResolutionTimer timer;
+	timer.Start();
+
+	do {
+		std::function<void()> upload;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_uploads.empty())
+				return;
+			upload = m_uploads.front();
+			m_uploads.pop_front();
+		}
+
+		{
+			PROFILE_ZONE("Upload asset");
+			upload();
+		}
+		m_numFinished++;
+	} while (timer.Elapsed() < budgetMilliseconds);
+}
+
+bool CAssetLoader::IsFinished()
+{
+	return m_numFinished == m_numQueued;
+}
+
+int CAssetLoader::GetNumQueued()
+{
+	return m_numQueued;
+}
+
+int CAssetLoader::GetNumFinished()
+{
+	return m_numFinished;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "Common.h"
+#include "JobSystem.h"
+#include <atomic>
+#include <deque>
+
+// Loads assets in two stages: file I/O, decoding and processing run on the job system's workers, and the resulting
+// GPU uploads are queued for the GL thread, which drains them a few at a time each frame within a time budget.
+class CAssetLoader
+{
+public:
+	CAssetLoader(CJobSystem *pJobSystem);
+	~CAssetLoader();
+
+	// Run load on a worker; once it completes, upload runs on the GL thread in a later call to ProcessUploads
+	void Queue(const std::function<void()> &load, const std::function<void()> &upload);
+
+	// Run pending uploads until budgetMilliseconds is used up (at least one upload runs if any is pending)
+	void ProcessUploads(double budgetMilliseconds);
+
+	bool IsFinished();
+	int GetNumQueued();
+	int GetNumFinished();
+
+private:
+	CJobSystem *m_pJobSystem;
+	std::mutex m_mutex;
+	std::deque<std::function<void()> > m_uploads;
+	std::atomic<int> m_numQueued;
+	std::atomic<int> m_numFinished;
+};
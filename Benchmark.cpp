@@ -0,0 +1,367 @@
+#include "Benchmark.h"
+#include "HighResolutionTimer.h"
+#include "RenderStats.h"
+#include "Log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// The game's camera views, driven one after the other
+#define BENCHMARK_CAMERA_VIEWS 3
+// Timestamps at the start and end of a frame, and the primitives it generated
+#define BENCHMARK_QUERIES_PER_FRAME 3
+
+CBenchmark::CBenchmark()
+{
+	ParseCommandLine(0, NULL, m_options);
+	m_trackLength = 0.0f;
+	m_frame = 0;
+	m_numFrames = 0;
+	m_pTimer = NULL;
+	m_recording = false;
+}
+
+CBenchmark::~CBenchmark()
+{
+	Release();
+}
+
+bool CBenchmark::ParseCommandLine(int argc, char **argv, BenchmarkOptions &options)
+{
+	options.reportFilename.clear();
+	options.baselineFilename.clear();
+	options.threshold = 0.1f;
+	options.framesPerView = 600;
+	options.warmupFrames = 60;
+	options.width = 1280;
+	options.height = 720;
+	options.maxAllocations = 0;
+	options.layout = "single";
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		string name = argv[i];
+		const char *pValue = argv[i + 1];
+		if (name == "--benchmark")
+			options.reportFilename = pValue;
+		else if (name == "--baseline")
+			options.baselineFilename = pValue;
+		else if (name == "--threshold")
+			options.threshold = (float)atof(pValue);
+		else if (name == "--frames")
+			options.framesPerView = std::max(1, atoi(pValue));
+		else if (name == "--warmup")
+			options.warmupFrames = std::max(0, atoi(pValue));
+		else if (name == "--size")
+			sscanf(pValue, "%dx%d", &options.width, &options.height);
+		else if (name == "--max-allocations")
+			options.maxAllocations = atoi(pValue);
+		else if (name == "--layout")
+			options.layout = pValue;
+		else
+			LogMessage("Unknown option %s", name.c_str());
+	}
+	return !options.reportFilename.empty();
+}
+
+void CBenchmark::Create(const BenchmarkOptions &options, float trackLength)
+{
+	Release();
+	m_options = options;
+	m_trackLength = trackLength;
+	m_frame = 0;
+	m_numFrames = BENCHMARK_CAMERA_VIEWS * options.framesPerView;
+	m_frames.clear();
+	m_frames.reserve(m_numFrames);
+	m_failedChecks.clear();
+
+	m_queries.resize(BENCHMARK_QUERIES_PER_FRAME * m_numFrames);
+	glGenQueries((GLsizei)m_queries.size(), &m_queries[0]);
+	m_pTimer = new CHighResolutionTimer;
+
+	LogMessage("Benchmark: %d frames in each of %d views, after %d to warm up", options.framesPerView,
+		BENCHMARK_CAMERA_VIEWS, options.warmupFrames);
+}
+
+void CBenchmark::Release()
+{
+	if (!m_queries.empty()) {
+		glDeleteQueries((GLsizei)m_queries.size(), &m_queries[0]);
+		m_queries.clear();
+	}
+	delete m_pTimer;
+	m_pTimer = NULL;
+	m_recording = false;
+}
+
+// The warm up drives the start of the first view's lap
+int CBenchmark::GetCameraView()
+{
+	int index = m_frame - m_options.warmupFrames;
+	if (index < 0)
+		return 0;
+	return std::min(index / m_options.framesPerView, BENCHMARK_CAMERA_VIEWS - 1);
+}
+
+float CBenchmark::GetDistance()
+{
+	int index = m_frame - m_options.warmupFrames;
+	if (index < 0)
+		index = m_frame;
+	return m_trackLength * (index % m_options.framesPerView) / m_options.framesPerView;
+}
+
+void CBenchmark::BeginFrame()
+{
+	int index = m_frame - m_options.warmupFrames;
+	m_recording = index >= 0 && index < m_numFrames;
+	CRenderStats::Reset();
+	if (!m_recording)
+		return;
+
+	GLuint *pQueries = &m_queries[BENCHMARK_QUERIES_PER_FRAME * index];
+	glQueryCounter(pQueries[0], GL_TIMESTAMP);
+	glBeginQuery(GL_PRIMITIVES_GENERATED, pQueries[2]);
+	m_allocationsAtStart = CAllocations::GetThreadTotal();
+	m_pTimer->Start();
+}
+
+void CBenchmark::EndFrame(bool paged, double latencyMilliseconds)
+{
+	if (m_recording) {
+		int index = m_frame - m_options.warmupFrames;
+		GLuint *pQueries = &m_queries[BENCHMARK_QUERIES_PER_FRAME * index];
+		glEndQuery(GL_PRIMITIVES_GENERATED);
+		glQueryCounter(pQueries[1], GL_TIMESTAMP);
+
+		BenchmarkFrame frame;
+		frame.cameraView = GetCameraView();
+		frame.cpuMilliseconds = m_pTimer->Elapsed();
+		frame.gpuMilliseconds = 0.0;
+		frame.latencyMilliseconds = latencyMilliseconds;
+		frame.drawCalls = CRenderStats::GetDrawCalls();
+		frame.stateChanges = CRenderStats::GetStateChanges();
+		frame.primitives = 0;
+		frame.allocations = (int)(CAllocations::GetThreadTotal().allocations - m_allocationsAtStart.allocations);
+		frame.paged = paged;
+		m_frames.push_back(frame);
+		m_recording = false;
+	}
+	m_frame++;
+}
+
+bool CBenchmark::IsFinished()
+{
+	return m_frame >= m_options.warmupFrames + m_numFrames;
+}
+
+void CBenchmark::AddCheck(const char *pName, bool passed)
+{
+	LogMessage("Benchmark: %s check %s", pName, passed ? "passed" : "FAILED");
+	if (!passed)
+		m_failedChecks.push_back(pName);
+}
+
+int CBenchmark::Finish()
+{
+	// Every result is ready once the GPU has finished
+	glFinish();
+	for (unsigned int i = 0; i < m_frames.size(); i++) {
+		GLuint *pQueries = &m_queries[BENCHMARK_QUERIES_PER_FRAME * i];
+		GLuint64 start = 0, end = 0, primitives = 0;
+		glGetQueryObjectui64v(pQueries[0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(pQueries[1], GL_QUERY_RESULT, &end);
+		glGetQueryObjectui64v(pQueries[2], GL_QUERY_RESULT, &primitives);
+		m_frames[i].gpuMilliseconds = end > start ? (end - start) / 1.0e6 : 0.0;
+		m_frames[i].primitives = primitives;
+	}
+
+	if (!WriteReport())
+		return 1;
+	bool passed = CheckAllocations();
+	for (unsigned int i = 0; i < m_failedChecks.size(); i++) {
+		LogMessage("Benchmark: %s check failed", m_failedChecks[i].c_str());
+		passed = false;
+	}
+	if (!m_options.baselineFilename.empty())
+		passed = Compare() && passed;
+	return passed ? 0 : 2;
+}
+
+// Nearest rank percentiles
+CBenchmark::Statistics CBenchmark::Summarise(vector<double> values)
+{
+	Statistics statistics = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+	if (values.empty())
+		return statistics;
+
+	std::sort(values.begin(), values.end());
+	double total = 0.0;
+	for (unsigned int i = 0; i < values.size(); i++)
+		total += values[i];
+	size_t last = values.size() - 1;
+	statistics.mean = total / values.size();
+	statistics.p50 = values[(size_t)(0.50 * last + 0.5)];
+	statistics.p95 = values[(size_t)(0.95 * last + 0.5)];
+	statistics.p99 = values[(size_t)(0.99 * last + 0.5)];
+	statistics.maximum = values[last];
+	return statistics;
+}
+
+// One object of statistics per measure, over the frames of a view, or all of them for a view of -1
+void CBenchmark::AppendSummary(string &json, const char *pName, int cameraView)
+{
+	vector<double> measures[7];
+	int numPaged = 0;
+	for (unsigned int i = 0; i < m_frames.size(); i++) {
+		const BenchmarkFrame &frame = m_frames[i];
+		if (cameraView >= 0 && frame.cameraView != cameraView)
+			continue;
+		if (frame.paged)
+			numPaged++;
+		measures[0].push_back(frame.cpuMilliseconds);
+		measures[1].push_back(frame.gpuMilliseconds);
+		measures[2].push_back(frame.drawCalls);
+		measures[3].push_back(frame.stateChanges);
+		measures[4].push_back((double)frame.primitives);
+		measures[5].push_back(frame.allocations);
+		measures[6].push_back(frame.latencyMilliseconds);
+	}
+	const char *names[7] = { "cpuMilliseconds", "gpuMilliseconds", "drawCalls", "stateChanges", "primitives", "allocations",
+		"latencyMilliseconds" };
+
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "\t\"%s\": {\n\t\t\"frames\": %d,\n\t\t\"pagedFrames\": %d,\n", pName,
+		(int)measures[0].size(), numPaged);
+	json += buffer;
+	for (int i = 0; i < 7; i++) {
+		Statistics statistics = Summarise(measures[i]);
+		snprintf(buffer, sizeof(buffer),
+			"\t\t\"%s\": { \"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f }%s\n",
+			names[i], statistics.mean, statistics.p50, statistics.p95, statistics.p99, statistics.maximum, i < 6 ? "," : "");
+		json += buffer;
+	}
+	json += "\t}";
+}
+
+bool CBenchmark::WriteReport()
+{
+	const char *pRenderer = (const char*)glGetString(GL_RENDERER);
+	string renderer = pRenderer ? pRenderer : "";
+	renderer.erase(std::remove(renderer.begin(), renderer.end(), '"'), renderer.end());
+
+	char buffer[256];
+	string json = "{\n\t\"renderer\": \"" + renderer + "\",\n";
+	snprintf(buffer, sizeof(buffer), "\t\"width\": %d,\n\t\"height\": %d,\n", m_options.width, m_options.height);
+	json += buffer;
+	json += "\t\"layout\": \"" + m_options.layout + "\",\n";
+	AppendSummary(json, "overall", -1);
+	for (int v = 0; v < BENCHMARK_CAMERA_VIEWS; v++) {
+		snprintf(buffer, sizeof(buffer), "view%d", v);
+		json += ",\n";
+		AppendSummary(json, buffer, v);
+	}
+	json += "\n}\n";
+
+	FILE *pFile = fopen(m_options.reportFilename.c_str(), "wb");
+	if (pFile == NULL) {
+		LogMessage("Benchmark: could not write %s", m_options.reportFilename.c_str());
+		return false;
+	}
+	fwrite(json.data(), 1, json.size(), pFile);
+	fclose(pFile);
+
+	LogMessage("Benchmark: wrote %s", m_options.reportFilename.c_str());
+	return true;
+}
+
+// Find the number after each key in turn, so that {"view1", "gpuMilliseconds", "p95"} finds that view's p95.  Reports
+// are only ever written by WriteReport, so this need not parse JSON in general.
+bool CBenchmark::FindNumber(const string &json, const vector<string> &keys, double &value)
+{
+	size_t position = 0;
+	for (unsigned int i = 0; i < keys.size(); i++) {
+		position = json.find("\"" + keys[i] + "\"", position);
+		if (position == string::npos)
+			return false;
+		position += keys[i].size() + 2;
+	}
+	position = json.find(':', position);
+	if (position == string::npos)
+		return false;
+	value = atof(json.c_str() + position + 1);
+	return true;
+}
+
+// Fail on a p95 frame time, CPU or GPU, over the whole run or in any view, more than the threshold over the baseline's,
+// or missing from either report
+bool CBenchmark::Compare()
+{
+	std::ifstream baselineFile(m_options.baselineFilename.c_str(), std::ios::binary);
+	std::ifstream reportFile(m_options.reportFilename.c_str(), std::ios::binary);
+	if (!baselineFile || !reportFile) {
+		LogMessage("Benchmark: could not read %s", m_options.baselineFilename.c_str());
+		return false;
+	}
+	std::stringstream baselineStream, reportStream;
+	baselineStream << baselineFile.rdbuf();
+	reportStream << reportFile.rdbuf();
+	string baseline = baselineStream.str();
+	string report = reportStream.str();
+
+	const char *sections[1 + BENCHMARK_CAMERA_VIEWS] = { "overall", "view0", "view1", "view2" };
+	const char *measures[2] = { "cpuMilliseconds", "gpuMilliseconds" };
+	bool passed = true;
+	for (int s = 0; s < 1 + BENCHMARK_CAMERA_VIEWS; s++) {
+		for (int m = 0; m < 2; m++) {
+			vector<string> keys;
+			keys.push_back(sections[s]);
+			keys.push_back(measures[m]);
+			keys.push_back("p95");
+			double before = 0.0, after = 0.0;
+			bool inBaseline = FindNumber(baseline, keys, before);
+			bool inReport = FindNumber(report, keys, after);
+			if (!inBaseline || !inReport) {
+				// A stat that was renamed or dropped must not pass unchecked
+				LogMessage("Benchmark: %s %s p95 missing from %s  FAILED", sections[s], measures[m],
+					inBaseline ? "the report" : m_options.baselineFilename.c_str());
+				passed = false;
+				continue;
+			}
+
+			bool regressed = after > before * (1.0 + m_options.threshold);
+			LogMessage("Benchmark: %s %s p95 %.3f -> %.3f%s", sections[s], measures[m], before, after,
+				regressed ? "  REGRESSED" : "");
+			passed = passed && !regressed;
+		}
+	}
+	LogMessage("Benchmark: %s against %s (threshold %.0f%%)", passed ? "passed" : "failed",
+		m_options.baselineFilename.c_str(), 100.0f * m_options.threshold);
+	return passed;
+}
+
+// Once warmed up, a frame should reuse the memory of the frames before it.  Frames that page terrain tiles in are left
+// out, as paging allocates.  The first few frames over the limit are logged; a profiler trace of the run shows which
+// zones allocated.
+bool CBenchmark::CheckAllocations()
+{
+	if (m_options.maxAllocations < 0)
+		return true;
+
+	int numOver = 0, numPaged = 0;
+	for (unsigned int i = 0; i < m_frames.size(); i++) {
+		if (m_frames[i].paged) {
+			numPaged++;
+			continue;
+		}
+		if (m_frames[i].allocations <= m_options.maxAllocations)
+			continue;
+		if (numOver < 10)
+			LogMessage("Benchmark: frame %d made %d allocations", m_options.warmupFrames + (int)i, m_frames[i].allocations);
+		numOver++;
+	}
+	LogMessage("Benchmark: %d of %d steady frames made more than %d allocations", numOver,
+		(int)m_frames.size() - numPaged, m_options.maxAllocations);
+	return numOver == 0;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "Common.h"
+#include "Allocations.h"
+
+class CHighResolutionTimer;
+
+// Set from the command line:  --benchmark report.json [--baseline baseline.json] [--threshold 0.1] [--frames 600]
+// [--warmup 60] [--size 1280x720] [--max-allocations 0] [--layout single|two|four|mirror]
+struct BenchmarkOptions
+{
+	string reportFilename;					// Empty to play the game normally
+	string baselineFilename;				// Compare the run with this earlier report, if set
+	float threshold;						// Fraction a p95 may grow by over the baseline's before the run fails
+	int framesPerView;						// Frames to drive one lap in each camera view
+	int warmupFrames;						// Run unrecorded once loaded, so that caches and the driver settle
+	int width;
+	int height;
+	int maxAllocations;						// Fail a run with a steady recorded frame that allocates more, unless negative
+	string layout;							// Views drawn each frame, as named by CViewLayout
+};
+
+struct BenchmarkFrame
+{
+	int cameraView;
+	double cpuMilliseconds;					// From the start of Update to the end of Present
+	double gpuMilliseconds;					// Between timestamps at the same two points
+	double latencyMilliseconds;				// From the start of the frame, as input is read, to the refresh it is shown at
+	int drawCalls;
+	int stateChanges;
+	unsigned long long primitives;			// Generated by every draw, including the template's uncounted classes
+	int allocations;						// Heap allocations on the main thread; the workers' loads are not counted
+	bool paged;								// Terrain tiles were paged in, so the frame is not a steady one
+};
+
+// Drives the game along a fixed script and records what each frame costs.  The script runs one lap in each camera view
+// in turn, at a fixed distance per frame, so every run renders the same frames whatever the frame rate.  Timer and
+// primitive queries are only read once the run ends, so that measuring never stalls the pipeline.  The report is JSON
+// with the mean, percentiles and maximum of each measure, over the whole run and for each view.
+class CBenchmark
+{
+public:
+	CBenchmark();
+	~CBenchmark();
+
+	// Returns false if the command line does not ask for a benchmark
+	static bool ParseCommandLine(int argc, char **argv, BenchmarkOptions &options);
+
+	void Create(const BenchmarkOptions &options, float trackLength);
+	void Release();
+
+	// Where the script has the car for the next frame
+	int GetCameraView();
+	float GetDistance();
+
+	void BeginFrame();
+	void EndFrame(bool paged, double latencyMilliseconds);
+	bool IsFinished();
+
+	// Record the result of a check made during the run, which fails the run if it did not pass
+	void AddCheck(const char *pName, bool passed);
+
+	// Read the queries, write the report and compare it with the baseline.  Returns the process exit code: 0 if the run
+	// passed, 1 if the report could not be written, 2 if it regressed, a frame allocated more than it may or a check
+	// failed.
+	int Finish();
+
+private:
+	struct Statistics
+	{
+		double mean;
+		double p50;
+		double p95;
+		double p99;
+		double maximum;
+	};
+
+	static Statistics Summarise(vector<double> values);
+	void AppendSummary(string &json, const char *pName, int cameraView);
+	bool WriteReport();
+	bool Compare();
+	bool CheckAllocations();
+	static bool FindNumber(const string &json, const vector<string> &keys, double &value);
+
+	BenchmarkOptions m_options;
+	float m_trackLength;
+	int m_frame;							// Including the warm up
+	int m_numFrames;
+	vector<BenchmarkFrame> m_frames;
+	vector<GLuint> m_queries;				// Per recorded frame:  start and end timestamps, then primitives generated
+	CHighResolutionTimer *m_pTimer;
+	AllocationCount m_allocationsAtStart;
+	vector<string> m_failedChecks;
+	bool m_recording;
+};
@@ -1,4 +1,9 @@
 #include "CatmullRom.h"
+#include "RenderStats.h"
+#include "Profiler.h"
+#include "ResourceManager.h"
+#include "FileSystem.h"
+#include "Log.h"
 #define _USE_MATH_DEFINES
 #include <math.h>
 
@@ -7,10 +12,19 @@
 CCatmullRom::CCatmullRom()
 {
 	m_vertexCount = 0;
+	m_trackVertexBuffer = 0;
+	m_pTrackGenerator = NULL;
+	m_pTexture = NULL;
+	m_trackPending = false;
+	m_trackWidth = 0.0f;
+	m_trackSamples = 0;
+	m_offsetRevision = 0;
 }
 
 CCatmullRom::~CCatmullRom()
-{}
+{
+	CResourceManager::ReleaseTexture(m_pTexture);
+}
 
 // Perform Catmull Rom spline interpolation between four points, interpolating the space between p1 and p2
 glm::vec3 CCatmullRom::Interpolate(glm::vec3 &p0, glm::vec3 &p1, glm::vec3 &p2, glm::vec3 &p3, float t)
@@ -244,6 +258,7 @@ void CCatmullRom::CreateOffsetCurves()
 			m_rightOffsetPoints.push_back(r);
 		//}
 	}
+	m_offsetRevision++;
 	// Generate two VAOs called m_vaoLeftOffsetCurve and m_vaoRightOffsetCurve, each with a VBO, and get the offset curve points on the graphics card
 	// Note it is possible to only use one VAO / VBO with all the points instead.
 
@@ -315,11 +330,12 @@ void CCatmullRom::CreateOffsetCurves()
 void CCatmullRom::CreateTrack(string Directory,string filename)
 {
 	
-	m_texture.Load(Directory + filename);
-	m_texture.SetSamplerObjectParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	m_texture.SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
-	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
+	CResourceManager::ReleaseTexture(m_pTexture);
+	m_pTexture = CResourceManager::AcquireTexture(JoinPath(Directory, filename));
+	if (m_pTrackGenerator) {
+		CreateGeneratedTrack();
+		return;
+	}
 	// Generate a VAO called m_vaoTrack and a VBO to get the offset curve points and indices on the graphics card
 	//Generate a VAO
 	//Generate VAO and bind it
@@ -333,59 +349,19 @@ void CCatmullRom::CreateTrack(string Directory,string filename)
 	
 	
 	std::vector<GLuint> indices;
-	glm::vec3 normal(0.0f, 1.0f, 0.0f);
-
-	for (unsigned int i = 0; i < m_centrelinePoints.size(); i++) {
-		vbo_t.AddData(&m_leftOffsetPoints[i], sizeof(glm::vec3));
-		
-		
-		//Texture Coord
-		if (m_xCount % 2 == 0) {
+	vector<MeshVertex> vertices;
+	BuildTrackStrip(m_leftOffsetPoints, m_rightOffsetPoints, vertices, indices);
+	m_vertexCount = (unsigned int)indices.size();
 
-			vbo_t.AddData(&glm::vec2(0.0f, 0.0f), sizeof(glm::vec2));
-			vbo_t.AddData(&normal, sizeof(glm::vec3));
-
-		}else {
-			vbo_t.AddData(&glm::vec2(0.0f, 1.0f), sizeof(glm::vec2));
-			vbo_t.AddData(&normal, sizeof(glm::vec3));
-		}
-		indices.push_back(m_vertexCount);
-		vbo_t.AddData(&m_rightOffsetPoints[i], sizeof(glm::vec3));
-		m_vertexCount++;
-
-		//Texture Coord
-		if (m_xCount % 2 == 0) {
-			
-			vbo_t.AddData(&glm::vec2(1.0f, 0.0f), sizeof(glm::vec2));
-			vbo_t.AddData(&normal, sizeof(glm::vec3));
-		}
-		else {
-			vbo_t.AddData(&glm::vec2(1.0f, 1.0f), sizeof(glm::vec2));
-			vbo_t.AddData(&normal, sizeof(glm::vec3));
-		}
-		indices.push_back(m_vertexCount);
-		m_vertexCount++;
-		m_xCount++;
-	}
-	vbo_t.AddData(&m_leftOffsetPoints[0], sizeof(glm::vec3));
-	vbo_t.AddData(&glm::vec2(0.0f, 0.0f), sizeof(glm::vec2));
-	vbo_t.AddData(&normal, sizeof(glm::vec3));
-	indices.push_back(m_vertexCount);
-	m_vertexCount++;
-	vbo_t.AddData(&m_rightOffsetPoints[0], sizeof(glm::vec3));
-	vbo_t.AddData(&glm::vec2(1.0f, 0.0f), sizeof(glm::vec2));
-	vbo_t.AddData(&normal, sizeof(glm::vec3));
-	indices.push_back(m_vertexCount);
-	m_vertexCount++;
-	vbo_t.AddData(&m_leftOffsetPoints[1], sizeof(glm::vec3));
-	vbo_t.AddData(&glm::vec2(0.0f, 1.0f), sizeof(glm::vec2));
-	vbo_t.AddData(&normal, sizeof(glm::vec3));
+	// The track is flat, so its normal is not stored, and its positions are snorm16 within the track's bounds
+	vector<BYTE> packedVertices;
+	m_trackFormat.Create(&vertices[0], (unsigned int)vertices.size(), VERTEX_POSITION_SNORM16, VERTEX_NORMAL_CONSTANT);
+	m_trackFormat.Pack(&vertices[0], (unsigned int)vertices.size(), packedVertices);
+	vbo_t.AddData(&packedVertices[0], (UINT)packedVertices.size());
 
 	// Upload the VBO to the GPU
 	vbo_t.UploadDataToGPU(GL_STATIC_DRAW);
 
-	GLsizei r_stride = sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec3);
-	
 	//Create Buffers for indices and bind it
 	glGenBuffers(1, &m_vaoIndices);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_vaoIndices);
@@ -394,19 +370,156 @@ void CCatmullRom::CreateTrack(string Directory,string filename)
 	//pass indices to GPU
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() *sizeof(GLuint), &indices[0],GL_STATIC_DRAW);
 
-	// Vertex positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, r_stride, 0);
-	// Texture coordinates
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, r_stride, (void*)sizeof(glm::vec3));
-	// Normal vectors
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, r_stride, (void*)(sizeof(glm::vec3)+ sizeof(glm::vec2)));
+	// Vertex positions, texture coordinates and normal vectors
+	m_trackFormat.SetAttributes();
 
 }
 
 
+// A triangle strip between the offset curves, with the texture repeating every other sample, closed by the first
+// sample again and the left edge of the second
+void CCatmullRom::BuildTrackStrip(const vector<glm::vec3> &left, const vector<glm::vec3> &right, vector<MeshVertex> &vertices,
+	vector<GLuint> &indices)
+{
+	glm::vec3 normal(0.0f, 1.0f, 0.0f);
+	for (unsigned int i = 0; i < left.size(); i++) {
+		float v = i % 2 == 0 ? 0.0f : 1.0f;
+		MeshVertex leftVertex = { left[i], glm::vec2(0.0f, v), normal };
+		MeshVertex rightVertex = { right[i], glm::vec2(1.0f, v), normal };
+		indices.push_back((GLuint)vertices.size());
+		vertices.push_back(leftVertex);
+		indices.push_back((GLuint)vertices.size());
+		vertices.push_back(rightVertex);
+	}
+	MeshVertex closing[3] = {
+		{ left[0], glm::vec2(0.0f, 0.0f), normal },
+		{ right[0], glm::vec2(1.0f, 0.0f), normal },
+		{ left[1], glm::vec2(0.0f, 1.0f), normal },
+	};
+	indices.push_back((GLuint)vertices.size());
+	indices.push_back((GLuint)vertices.size() + 1);
+	vertices.insert(vertices.end(), closing, closing + 3);
+}
+
+
+void CCatmullRom::SetTrackGenerator(CTrackGenerator *pGenerator)
+{
+	m_pTrackGenerator = pGenerator;
+}
+
+// Empty buffers in a VAO, filled by UpdateTrack once RebuildTrack has set the width and number of samples.  The
+// control points are those UniformlySampleControlPoints sampled the centreline from.
+void CCatmullRom::CreateGeneratedTrack()
+{
+	glGenVertexArrays(1, &m_vaoTrack);
+	glBindVertexArray(m_vaoTrack);
+	glGenBuffers(1, &m_trackVertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_trackVertexBuffer);
+	glGenBuffers(1, &m_vaoIndices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_vaoIndices);
+
+	// The same format as CreateTrack's; RebuildTrack sets the bounds, which the attributes do not depend on
+	m_trackFormat.Create(glm::vec3(0.0f), glm::vec3(0.0f), VERTEX_POSITION_SNORM16, VERTEX_NORMAL_CONSTANT,
+		glm::vec3(0.0f, 1.0f, 0.0f));
+	m_trackFormat.SetAttributes();
+	glBindVertexArray(0);
+
+	m_pTrackGenerator->SetControlPoints(m_controlPoints, m_distances);
+	m_vertexCount = 0;
+}
+
+// The same edges the track generator writes, sampled the same way, for the objects placed along them and for the
+// bounds the positions are packed within
+void CCatmullRom::ComputeOffsetPoints()
+{
+	m_leftOffsetPoints.clear();
+	m_rightOffsetPoints.clear();
+	float spacing = m_distances.back() / m_trackSamples;
+	glm::vec3 p, pNext, up;
+	for (int i = 0; i < m_trackSamples; i++) {
+		Sample(i * spacing, p, up);
+		Sample(((i + 1) % m_trackSamples) * spacing, pNext, up);
+		glm::vec3 N = glm::normalize(glm::cross(glm::normalize(pNext - p), glm::vec3(0, 1, 0)));
+		m_leftOffsetPoints.push_back(p - 0.5f * m_trackWidth * N);
+		m_rightOffsetPoints.push_back(p + 0.5f * m_trackWidth * N);
+	}
+	m_offsetRevision++;
+
+	glm::vec3 minimum = m_leftOffsetPoints[0], maximum = m_leftOffsetPoints[0];
+	for (int i = 0; i < m_trackSamples; i++) {
+		minimum = glm::min(minimum, glm::min(m_leftOffsetPoints[i], m_rightOffsetPoints[i]));
+		maximum = glm::max(maximum, glm::max(m_leftOffsetPoints[i], m_rightOffsetPoints[i]));
+	}
+	m_trackFormat.Create(minimum, maximum, VERTEX_POSITION_SNORM16, VERTEX_NORMAL_CONSTANT, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void CCatmullRom::RebuildTrack(float width, int numSamples)
+{
+	if (m_pTrackGenerator == NULL || numSamples < 2 || (width == m_trackWidth && numSamples == m_trackSamples))
+		return;
+	m_trackWidth = width;
+	m_trackSamples = numSamples;
+	m_trackPending = true;
+	ComputeOffsetPoints();
+}
+
+// The compute shader binds its own program, so this runs outside the main shader's draws
+bool CCatmullRom::UpdateTrack()
+{
+	if (!m_trackPending || !m_pTrackGenerator->IsReady())
+		return false;
+	PROFILE_GPU_ZONE("Generate track");
+	m_vertexCount = m_pTrackGenerator->Generate(m_trackWidth, m_trackSamples, m_trackFormat, m_trackVertexBuffer, m_vaoIndices);
+	m_trackPending = false;
+	return m_vertexCount > 0;
+}
+
+// Read the generated track back and compare it with the strip CreateTrack would build from the same offset curves.
+// The GPU interpolates the spline in its own order of operations, so positions may differ by a few snorm16 steps.
+// This waits for the GPU, so it is only for checks such as a benchmark's.
+bool CCatmullRom::CheckGeneratedTrack()
+{
+	if (m_pTrackGenerator == NULL || m_vertexCount == 0)
+		return false;
+
+	vector<MeshVertex> vertices;
+	vector<GLuint> indices;
+	BuildTrackStrip(m_leftOffsetPoints, m_rightOffsetPoints, vertices, indices);
+	vector<BYTE> expectedVertices;
+	m_trackFormat.Pack(&vertices[0], (unsigned int)vertices.size(), expectedVertices);
+	if (vertices.size() != CTrackGenerator::GetNumVertices(m_trackSamples) || indices.size() != m_vertexCount) {
+		LogMessage("Generated track has %u indices, expected %u", m_vertexCount, (unsigned int)indices.size());
+		return false;
+	}
+
+	vector<BYTE> generatedVertices(expectedVertices.size());
+	vector<GLuint> generatedIndices(indices.size());
+	glBindBuffer(GL_COPY_READ_BUFFER, m_trackVertexBuffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, generatedVertices.size(), &generatedVertices[0]);
+	glBindBuffer(GL_COPY_READ_BUFFER, m_vaoIndices);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, generatedIndices.size() * sizeof(GLuint), &generatedIndices[0]);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	if (generatedIndices != indices) {
+		LogMessage("Generated track indices differ from the CPU's");
+		return false;
+	}
+	const int POSITION_TOLERANCE = 4;
+	unsigned int numShorts = (unsigned int)expectedVertices.size() / sizeof(short);
+	unsigned int shortsPerVertex = m_trackFormat.GetStride() / sizeof(short);
+	for (unsigned int i = 0; i < numShorts; i++) {
+		// Positions are the first four shorts of a vertex; texture coordinates must match exactly
+		int tolerance = i % shortsPerVertex < 4 ? POSITION_TOLERANCE : 0;
+		int expected = ((short*)&expectedVertices[0])[i], generated = ((short*)&generatedVertices[0])[i];
+		if (abs(expected - generated) > tolerance) {
+			LogMessage("Generated track vertex %u differs from the CPU's: %d, expected %d", i / shortsPerVertex, generated, expected);
+			return false;
+		}
+	}
+	return true;
+}
+
+
 void CCatmullRom::RenderCentreline()
 {
 	// Bind the VAO m_vaoCentreline and render it
@@ -414,6 +527,8 @@ void CCatmullRom::RenderCentreline()
 	glBindVertexArray(m_vaoCentreline);
 	glDrawArrays(GL_POINTS, 0, m_centrelinePoints.size());
 	glDrawArrays(GL_LINE_LOOP, 0, m_centrelinePoints.size());
+	CRenderStats::AddStateChanges();
+	CRenderStats::AddDrawCalls(2);
 	
 	
 }
@@ -431,6 +546,8 @@ void CCatmullRom::RenderOffsetCurves()
 	glBindVertexArray(m_vaoRightOffsetCurve);
 	glDrawArrays(GL_LINE_STRIP, 0, m_rightOffsetPoints.size());
 	glDrawArrays(GL_POINTS, 0, m_rightOffsetPoints.size());
+	CRenderStats::AddStateChanges(2);
+	CRenderStats::AddDrawCalls(4);
 
 }
 
@@ -439,8 +556,12 @@ void CCatmullRom::RenderTrack()
 {
 	// Bind the VAO m_vaoTrack and render it
 	glBindVertexArray(m_vaoTrack);
-	m_texture.Bind();
+	if (m_pTexture)
+		m_pTexture->Bind();
+	m_trackFormat.SetConstantAttributes();
 	glDrawElements(GL_TRIANGLE_STRIP, m_vertexCount, GL_UNSIGNED_INT, 0);
+	CRenderStats::AddStateChanges();
+	CRenderStats::AddDrawCalls();
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 }
 
@@ -449,4 +570,34 @@ int CCatmullRom::CurrentLap(float d)
 	
 	return (int)(d / m_distances.back());
 
-}
\ No newline at end of file
+}
+
+float CCatmullRom::GetLength()
+{
+	return m_distances.back();
+}
+
+const vector<glm::vec3> &CCatmullRom::GetCentrelinePoints()
+{
+	return m_centrelinePoints;
+}
+
+const vector<glm::vec3> &CCatmullRom::GetLeftOffsetPoints()
+{
+	return m_leftOffsetPoints;
+}
+
+const vector<glm::vec3> &CCatmullRom::GetRightOffsetPoints()
+{
+	return m_rightOffsetPoints;
+}
+
+unsigned int CCatmullRom::GetOffsetRevision()
+{
+	return m_offsetRevision;
+}
+
+glm::mat4 CCatmullRom::GetTrackDecodeMatrix()
+{
+	return m_trackFormat.GetDecodeMatrix();
+}
@@ -1,8 +1,10 @@
 #pragma once
 #include "Common.h"
-#include "vertexBufferObject.h"
-#include "vertexBufferObjectIndexed.h"
-#include "Texture.h"
+#include "VertexBufferObject.h"
+#include "VertexBufferObjectIndexed.h"
+#include "CompiledTexture.h"
+#include "VertexFormat.h"
+#include "TrackGenerator.h"
 
 
 class CCatmullRom
@@ -17,28 +19,47 @@ public:
 	void CreateOffsetCurves();
 	void RenderOffsetCurves();
 
+	// With a track generator, CreateTrack only uploads the control points, and UpdateTrack builds the track on the GPU
+	void SetTrackGenerator(CTrackGenerator *pGenerator);
 	void CreateTrack(string Directory, string filename);
+	void RebuildTrack(float width, int numSamples);	// Generated tracks only; call after CreateTrack
+	bool UpdateTrack();						// Call before the shaders are bound for the frame.  True if it generated the track.
+	bool CheckGeneratedTrack();				// Compare the generated track with the CPU's.  Stalls on the GPU.
 	void RenderTrack();
+	glm::mat4 GetTrackDecodeMatrix();		// Apply to the modelview matrix before RenderTrack
 
 	int CurrentLap(float d); // Return the currvent lap (starting from 0) based on distance along the control curve.
 
 	bool Sample(float d, glm::vec3 &p,  glm::vec3 &up); // Return a point on the centreline based on a certain distance along the control curve.
+	float GetLength(); // Return the length of one lap along the control curve.
+	const vector<glm::vec3> &GetCentrelinePoints();
+
+	// The edges of the track, kept on the CPU for generated tracks too
+	const vector<glm::vec3> &GetLeftOffsetPoints();
+	const vector<glm::vec3> &GetRightOffsetPoints();
+	unsigned int GetOffsetRevision();		// Changes whenever the offset curves do
 
 private:
 
 	void SetControlPoints();
 	void ComputeLengthsAlongControlPoints();
 	void UniformlySampleControlPoints(int numSamples);
+	void CreateGeneratedTrack();
+	static void BuildTrackStrip(const vector<glm::vec3> &left, const vector<glm::vec3> &right, vector<MeshVertex> &vertices,
+		vector<GLuint> &indices);
+	void ComputeOffsetPoints();
 	glm::vec3 Interpolate(glm::vec3 &p0, glm::vec3 &p1, glm::vec3 &p2, glm::vec3 &p3, float t);
 
 
 	vector<float> m_distances;
-	CTexture m_texture;
+	CCompiledTexture *m_pTexture;			// Held from the resource manager
 
 	GLuint m_vaoCentreline;
 	GLuint m_vaoLeftOffsetCurve;
 	GLuint m_vaoRightOffsetCurve;
 	GLuint m_vaoTrack;
+	GLuint m_trackVertexBuffer;				// Generated tracks only; otherwise the VBO belongs to CreateTrack
+	CPackedVertexFormat m_trackFormat;
 
 	//new
 	GLuint m_vaoIndices;
@@ -50,11 +71,16 @@ private:
 
 	vector<glm::vec3> m_leftOffsetPoints;	// Left offset curve points
 	vector<glm::vec3> m_rightOffsetPoints;	// Right offset curve points
+	unsigned int m_offsetRevision;
 
 
 	unsigned int m_vertexCount;				// Number of vertices in the track VBO
 	unsigned int m_leftCount;
 	unsigned int m_rightCount;
 	unsigned int m_indicesCount;
-	unsigned int m_xCount;
+
+	CTrackGenerator *m_pTrackGenerator;
+	bool m_trackPending;					// The generated track is out of date
+	float m_trackWidth;
+	int m_trackSamples;
 };
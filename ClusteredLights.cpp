@@ -0,0 +1,213 @@
+#include "ClusteredLights.h"
+#include "Profiler.h"
+#include "FrameArena.h"
+#include <algorithm>
+
+CClusteredLights::CClusteredLights()
+{
+	m_tilesX = 0;
+	m_tilesY = 0;
+	m_numSlices = 0;
+	m_maxLights = 0;
+	m_sliceScale = 0.0f;
+	m_sliceBias = 0.0f;
+	for (int i = 0; i < 3; i++) {
+		m_buffers[i] = 0;
+		m_capacities[i] = 0;
+	}
+}
+
+CClusteredLights::~CClusteredLights()
+{
+	Release();
+}
+
+void CClusteredLights::Create(int tilesX, int tilesY, int numSlices, int maxLights)
+{
+	Release();
+	m_tilesX = tilesX;
+	m_tilesY = tilesY;
+	m_numSlices = numSlices;
+	m_maxLights = maxLights;
+	m_cells.assign(2 * tilesX * tilesY * numSlices, 0);
+	glGenBuffers(3, m_buffers);
+}
+
+void CClusteredLights::Release()
+{
+	if (m_buffers[0])
+		glDeleteBuffers(3, m_buffers);
+	for (int i = 0; i < 3; i++) {
+		m_buffers[i] = 0;
+		m_capacities[i] = 0;
+	}
+	m_lights.clear();
+}
+
+int CClusteredLights::AddLight(const glm::vec3 &position, const glm::vec3 &colour, float radius)
+{
+	Light light;
+	light.enabled = true;
+	m_lights.push_back(light);
+	SetLight((int)m_lights.size() - 1, position, colour, radius);
+	return (int)m_lights.size() - 1;
+}
+
+void CClusteredLights::SetLight(int id, const glm::vec3 &position, const glm::vec3 &colour, float radius)
+{
+	m_lights[id].position = position;
+	m_lights[id].colour = colour;
+	m_lights[id].radius = radius;
+}
+
+void CClusteredLights::SetEnabled(int id, bool enabled)
+{
+	m_lights[id].enabled = enabled;
+}
+
+int CClusteredLights::GetNumLights()
+{
+	return (int)m_lights.size();
+}
+
+int CClusteredLights::GetNumVisibleLights()
+{
+	return (int)m_visibleLights.size();
+}
+
+int CClusteredLights::GetNumLightIndices()
+{
+	return (int)m_indices.size();
+}
+
+// Depth slices are spaced exponentially, so that clusters are roughly as deep as they are wide
+int CClusteredLights::GetSlice(float depth)
+{
+	int slice = (int)floor(log(depth) * m_sliceScale + m_sliceBias);
+	return glm::clamp(slice, 0, m_numSlices - 1);
+}
+
+void CClusteredLights::Build(const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix, int viewportWidth, int viewportHeight,
+	int viewportX, int viewportY)
+{
+	PROFILE_ZONE("Cluster lights");
+	// Recover the near and far planes and the field of view from the projection
+	float nearPlane = projectionMatrix[3][2] / (projectionMatrix[2][2] - 1.0f);
+	float farPlane = projectionMatrix[3][2] / (projectionMatrix[2][2] + 1.0f);
+	float scaleX = projectionMatrix[0][0];
+	float scaleY = projectionMatrix[1][1];
+	m_sliceScale = m_numSlices / log(farPlane / nearPlane);
+	m_sliceBias = -m_sliceScale * log(nearPlane);
+
+	// Cull the lights against the frustum and find the range of clusters each one overlaps.  The range comes from the
+	// light's bounding box, projected at whichever end of its depth range gives the widest extent on screen.
+	m_visibleLights.clear();
+	m_lightMin.clear();
+	m_lightMax.clear();
+	for (unsigned int i = 0; i < m_lights.size() && (int)m_visibleLights.size() < m_maxLights; i++) {
+		const Light &light = m_lights[i];
+		if (!light.enabled)
+			continue;
+
+		glm::vec3 p = glm::vec3(viewMatrix * glm::vec4(light.position, 1.0f));
+		float r = light.radius;
+		float depth = -p.z;
+		if (depth + r < nearPlane || depth - r > farPlane)
+			continue;
+		float minDepth = std::max(depth - r, nearPlane);
+		float maxDepth = std::min(depth + r, farPlane);
+
+		float minX = (p.x - r) * scaleX / (p.x - r < 0.0f ? minDepth : maxDepth);
+		float maxX = (p.x + r) * scaleX / (p.x + r > 0.0f ? minDepth : maxDepth);
+		float minY = (p.y - r) * scaleY / (p.y - r < 0.0f ? minDepth : maxDepth);
+		float maxY = (p.y + r) * scaleY / (p.y + r > 0.0f ? minDepth : maxDepth);
+		if (minX > 1.0f || maxX < -1.0f || minY > 1.0f || maxY < -1.0f)
+			continue;
+
+		m_lightMin.push_back(glm::clamp((int)floor((minX * 0.5f + 0.5f) * m_tilesX), 0, m_tilesX - 1));
+		m_lightMin.push_back(glm::clamp((int)floor((minY * 0.5f + 0.5f) * m_tilesY), 0, m_tilesY - 1));
+		m_lightMin.push_back(GetSlice(minDepth));
+		m_lightMax.push_back(glm::clamp((int)floor((maxX * 0.5f + 0.5f) * m_tilesX), 0, m_tilesX - 1));
+		m_lightMax.push_back(glm::clamp((int)floor((maxY * 0.5f + 0.5f) * m_tilesY), 0, m_tilesY - 1));
+		m_lightMax.push_back(GetSlice(maxDepth));
+
+		GpuLight gpuLight;
+		gpuLight.positionRadius = glm::vec4(p, r);
+		gpuLight.colour = glm::vec4(light.colour, 1.0f);
+		m_visibleLights.push_back(gpuLight);
+	}
+
+	// Count the lights in each cluster, turn the counts into offsets, then fill in the index list
+	unsigned int numClusters = m_tilesX * m_tilesY * m_numSlices;
+	for (unsigned int c = 0; c < numClusters; c++)
+		m_cells[2 * c + 1] = 0;
+	for (unsigned int i = 0; i < m_visibleLights.size(); i++) {
+		for (int z = m_lightMin[3 * i + 2]; z <= m_lightMax[3 * i + 2]; z++)
+			for (int y = m_lightMin[3 * i + 1]; y <= m_lightMax[3 * i + 1]; y++)
+				for (int x = m_lightMin[3 * i]; x <= m_lightMax[3 * i]; x++)
+					m_cells[2 * ((z * m_tilesY + y) * m_tilesX + x) + 1]++;
+	}
+
+	unsigned int offset = 0;
+	for (unsigned int c = 0; c < numClusters; c++) {
+		m_cells[2 * c] = offset;
+		offset += m_cells[2 * c + 1];
+		m_cells[2 * c + 1] = 0;
+	}
+
+	m_indices.resize(offset);
+	for (unsigned int i = 0; i < m_visibleLights.size(); i++) {
+		for (int z = m_lightMin[3 * i + 2]; z <= m_lightMax[3 * i + 2]; z++)
+			for (int y = m_lightMin[3 * i + 1]; y <= m_lightMax[3 * i + 1]; y++)
+				for (int x = m_lightMin[3 * i]; x <= m_lightMax[3 * i]; x++) {
+					unsigned int *pCell = &m_cells[2 * ((z * m_tilesY + y) * m_tilesX + x)];
+					m_indices[pCell[0] + pCell[1]++] = i;
+				}
+	}
+
+	GpuGridHeader header;
+	header.tilesX = m_tilesX;
+	header.tilesY = m_tilesY;
+	header.numSlices = m_numSlices;
+	header.numLights = (int)m_visibleLights.size();
+	header.tileWidth = (float)viewportWidth / m_tilesX;
+	header.tileHeight = (float)viewportHeight / m_tilesY;
+	header.sliceScale = m_sliceScale;
+	header.sliceBias = m_sliceBias;
+	header.originX = (float)viewportX;
+	header.originY = (float)viewportY;
+	header.padding[0] = header.padding[1] = 0.0f;
+
+	// The grid buffer is the header followed by the cells
+	size_t headerSize = sizeof(GpuGridHeader);
+	size_t cellsSize = m_cells.size() * sizeof(unsigned int);
+	BYTE *pGrid = CFrameArena::Allocate<BYTE>(headerSize + cellsSize);
+	memcpy(pGrid, &header, headerSize);
+	memcpy(pGrid + headerSize, &m_cells[0], cellsSize);
+
+	Upload(m_buffers[0], m_visibleLights.empty() ? NULL : &m_visibleLights[0], m_visibleLights.size() * sizeof(GpuLight), m_capacities[0]);
+	Upload(m_buffers[1], pGrid, headerSize + cellsSize, m_capacities[1]);
+	Upload(m_buffers[2], m_indices.empty() ? NULL : &m_indices[0], m_indices.size() * sizeof(unsigned int), m_capacities[2]);
+}
+
+// Orphan the buffer each frame, so that the upload does not wait for the previous frame's draws
+void CClusteredLights::Upload(GLuint buffer, const void *pData, size_t size, size_t &capacity)
+{
+	if (size > capacity)
+		capacity = std::max(size, 2 * capacity);
+	if (capacity == 0)
+		capacity = 16;						// A zero sized buffer cannot be bound
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	if (size > 0)
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, pData);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void CClusteredLights::Bind()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_LIGHTS_BINDING, m_buffers[0]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_GRID_BINDING, m_buffers[1]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_INDICES_BINDING, m_buffers[2]);
+}
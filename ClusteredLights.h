@@ -0,0 +1,88 @@
+#pragma once
+#include "Common.h"
+
+// Shader storage buffer binding points, matching resources\shaders\clusteredLights.glsl
+#define CLUSTER_LIGHTS_BINDING 0
+#define CLUSTER_GRID_BINDING 1
+#define CLUSTER_INDICES_BINDING 2
+
+// Point lights for clustered forward shading.  Every frame, Build sorts the enabled lights into a grid of clusters that
+// divides the view frustum into screen tiles and exponentially spaced depth slices, and uploads the grid and a list of the
+// lights touching each cluster to shader storage buffers.  A fragment then only loops over the lights of its own cluster,
+// so the cost of shading stays about the same however many lights the scene has.
+class CClusteredLights
+{
+public:
+	CClusteredLights();
+	~CClusteredLights();
+
+	void Create(int tilesX = 16, int tilesY = 9, int numSlices = 24, int maxLights = 1024);
+	void Release();
+
+	// Lights are in world coordinates and have no effect beyond their radius.  Returns the id used by the other methods.
+	int AddLight(const glm::vec3 &position, const glm::vec3 &colour, float radius);
+	void SetLight(int id, const glm::vec3 &position, const glm::vec3 &colour, float radius);
+	void SetEnabled(int id, bool enabled);
+	int GetNumLights();
+
+	// Bin the lights for a camera.  The projection must be a perspective one.  For a viewport that does not start at the
+	// corner of the framebuffer, give its corner too.  Each Build uploads into fresh buffers, so a frame with several
+	// views can build and bind for each in turn.
+	void Build(const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix, int viewportWidth, int viewportHeight,
+		int viewportX = 0, int viewportY = 0);
+	void Bind();
+
+	int GetNumVisibleLights();
+	int GetNumLightIndices();
+
+private:
+	struct Light
+	{
+		glm::vec3 position;
+		glm::vec3 colour;
+		float radius;
+		bool enabled;
+	};
+
+	// Layouts of the shader storage buffers (std430)
+	struct GpuLight
+	{
+		glm::vec4 positionRadius;			// View space position and radius
+		glm::vec4 colour;
+	};
+
+	struct GpuGridHeader
+	{
+		int tilesX;
+		int tilesY;
+		int numSlices;
+		int numLights;
+		float tileWidth;					// In pixels
+		float tileHeight;
+		float sliceScale;					// slice = log(depth) * sliceScale + sliceBias
+		float sliceBias;
+		float originX;						// Of the viewport, in pixels
+		float originY;
+		float padding[2];
+	};
+
+	int GetSlice(float depth);
+	void Upload(GLuint buffer, const void *pData, size_t size, size_t &capacity);
+
+	vector<Light> m_lights;
+	int m_tilesX;
+	int m_tilesY;
+	int m_numSlices;
+	int m_maxLights;
+	float m_sliceScale;
+	float m_sliceBias;
+
+	vector<GpuLight> m_visibleLights;
+	vector<unsigned int> m_cells;			// Offset and count of each cluster in m_indices
+	vector<unsigned int> m_indices;
+	vector<int> m_lightMin;					// Cluster range of each visible light, as x, y, slice
+	vector<int> m_lightMax;
+
+	GLuint m_buffers[3];
+	size_t m_capacities[3];
+};
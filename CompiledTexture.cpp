@@ -0,0 +1,163 @@
+#include "CompiledTexture.h"
+#include "Log.h"
+#include "RenderStats.h"
+
+CCompiledTexture::CCompiledTexture()
+{
+	m_textureID = 0;
+	m_samplerObjectID = 0;
+	m_width = 0;
+	m_height = 0;
+	m_compiled = false;
+	m_gpuBytes = 0;
+	m_bindCount = 0;
+}
+
+CCompiledTexture::~CCompiledTexture()
+{
+	Release();
+}
+
+bool CCompiledTexture::Load(const string &path, bool generateMipMaps)
+{
+	CTextureData data;
+	data.Load(path);
+	return Create(data, generateMipMaps);
+}
+
+// Upload prepared texture data; runs on the GL thread
+bool CCompiledTexture::Create(CTextureData &data, bool generateMipMaps)
+{
+	ReleaseImage();
+
+	if (data.IsCompiled() && CTextureCache::IsFormatSupported(data.GetFormat())) {
+		const vector<TextureLevel> &levels = data.GetLevels();
+		GLenum internalFormat = CTextureCache::GetInternalFormat(data.GetFormat());
+
+		CreateObjects();
+		glBindTexture(GL_TEXTURE_2D, m_textureID);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+		for (unsigned int i = 0; i < levels.size(); i++) {
+			if (data.GetFormat() == TEXTURE_FORMAT_RGBA8)
+				glTexImage2D(GL_TEXTURE_2D, i, internalFormat, levels[i].width, levels[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, levels[i].pData);
+			else
+				glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, levels[i].width, levels[i].height, 0, levels[i].size, levels[i].pData);
+			m_gpuBytes += levels[i].size;
+		}
+
+		m_width = levels[0].width;
+		m_height = levels[0].height;
+		m_compiled = true;
+		return true;
+	}
+
+	if (data.IsCompiled()) {
+		LogMessage("Texture format of %s not supported, decoding the source", data.GetPath().c_str());
+		data.LoadSource();
+	}
+
+	CImageData &image = data.GetImage();
+	if (image.GetBits() == NULL) {
+		ReportError("Error loading texture", data.GetPath().c_str());
+		return false;
+	}
+
+	CreateFromData(image.GetBits(), image.GetWidth(), image.GetHeight(), image.GetBPP(), image.GetFormat(), generateMipMaps);
+	return true;
+}
+
+// Create a texture from raw BGR(A) data
+void CCompiledTexture::CreateFromData(const BYTE *pData, int width, int height, int bpp, GLenum format, bool generateMipMaps)
+{
+	ReleaseImage();
+
+	CreateObjects();
+	glBindTexture(GL_TEXTURE_2D, m_textureID);
+	if (format == GL_RGBA || format == GL_BGRA)
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, format, GL_UNSIGNED_BYTE, pData);
+	else if (format == GL_RGB || format == GL_BGR)
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, pData);
+	else
+		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pData);
+	if (generateMipMaps)
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+	m_width = width;
+	m_height = height;
+	m_compiled = false;
+	// Drivers keep RGB as RGBA, and a full mip chain adds a third
+	m_gpuBytes = 4 * (size_t)width * height;
+	if (generateMipMaps)
+		m_gpuBytes += m_gpuBytes / 3;
+}
+
+void CCompiledTexture::CreateObjects()
+{
+	glGenTextures(1, &m_textureID);
+	if (m_samplerObjectID == 0)
+		glGenSamplers(1, &m_samplerObjectID);
+}
+
+void CCompiledTexture::Bind(int textureUnit)
+{
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	glBindTexture(GL_TEXTURE_2D, m_textureID);
+	glBindSampler(textureUnit, m_samplerObjectID);
+	CRenderStats::AddStateChanges();
+	m_bindCount++;
+}
+
+void CCompiledTexture::SetSamplerObjectParameter(GLenum parameter, GLenum value)
+{
+	glSamplerParameteri(m_samplerObjectID, parameter, value);
+}
+
+void CCompiledTexture::SetSamplerObjectParameterf(GLenum parameter, float value)
+{
+	glSamplerParameterf(m_samplerObjectID, parameter, value);
+}
+
+int CCompiledTexture::GetWidth()
+{
+	return m_width;
+}
+
+int CCompiledTexture::GetHeight()
+{
+	return m_height;
+}
+
+bool CCompiledTexture::IsCompiled()
+{
+	return m_compiled;
+}
+
+size_t CCompiledTexture::GetGpuBytes()
+{
+	return m_gpuBytes;
+}
+
+unsigned int CCompiledTexture::GetBindCount()
+{
+	return m_bindCount;
+}
+
+void CCompiledTexture::ReleaseImage()
+{
+	if (m_textureID)
+		glDeleteTextures(1, &m_textureID);
+	m_textureID = 0;
+	m_width = 0;
+	m_height = 0;
+	m_compiled = false;
+	m_gpuBytes = 0;
+}
+
+void CCompiledTexture::Release()
+{
+	ReleaseImage();
+	if (m_samplerObjectID)
+		glDeleteSamplers(1, &m_samplerObjectID);
+	m_samplerObjectID = 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "Common.h"
+#include "TextureCache.h"
+
+// A 2D texture with a sampler object, used like CTexture.  Load prefers the offline-compiled container of the image, whose
+// mip levels are uploaded straight from the mapped file in their compressed format.  Without one (or if the driver lacks
+// the format), the source image is decoded and its mipmaps are generated at runtime, as CTexture does.
+class CCompiledTexture
+{
+public:
+	CCompiledTexture();
+	~CCompiledTexture();
+
+	bool Load(const string &path, bool generateMipMaps = true);
+	bool Create(CTextureData &data, bool generateMipMaps = true);
+	void CreateFromData(const BYTE *pData, int width, int height, int bpp, GLenum format, bool generateMipMaps = false);
+
+	void Bind(int textureUnit = 0);
+	void SetSamplerObjectParameter(GLenum parameter, GLenum value);
+	void SetSamplerObjectParameterf(GLenum parameter, float value);
+
+	int GetWidth();
+	int GetHeight();
+	bool IsCompiled();
+	// Bytes of the image and its mip levels in video memory
+	size_t GetGpuBytes();
+	// Counts every Bind, so that CResourceManager can tell which textures are in use
+	unsigned int GetBindCount();
+
+	// Free the image, keeping the sampler and its parameters for when it is created again
+	void ReleaseImage();
+	void Release();
+
+private:
+	void CreateObjects();
+
+	GLuint m_textureID;
+	GLuint m_samplerObjectID;
+	int m_width;
+	int m_height;
+	bool m_compiled;
+	size_t m_gpuBytes;
+	unsigned int m_bindCount;
+};
@@ -1,18 +1,19 @@
 #pragma once
 #include "Common.h"
-#include "Texture.h"
-#include "VertexBufferObject.h"
-// Class for generating a unit cube
+#include "CompiledTexture.h"
+#include "Primitives.h"
+// Class for rendering a textured wall section, a 10 x 1 x 0.2 box from the primitive library.  Render draws a row of
+// sections in one instanced draw, which the main shader spaces out with its wallShift feature.
 class CCube
 {
 public:
 	CCube();
 	~CCube();
-	void Create(string filename);
-	void Render();
+	void Create(string filename, CPrimitiveLibrary *pLibrary);
+	void Render(int numInstances = 1);
 	void Release();
 private:
-	GLuint m_vao;
-	CVertexBufferObject m_vbo;
-	CTexture m_texture;
+	CPrimitiveLibrary *m_pLibrary;
+	int m_box;
+	CCompiledTexture *m_pTexture;			// Held from the resource manager
 };
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "DynamicResolution.h"
+#include "Profiler.h"
+#include <algorithm>
+
+// The scale moves towards the budget by at most these steps a frame, faster down than up so that a spike is cut short
+#define DYNAMIC_RESOLUTION_STEP_DOWN 0.1f
+#define DYNAMIC_RESOLUTION_STEP_UP 0.02f
+// Within this fraction of the budget the scale is left alone, so that it does not hunt
+#define DYNAMIC_RESOLUTION_DEADBAND 0.1f
+
+CDynamicResolution::CDynamicResolution()
+{
+	m_fbo = 0;
+	m_colour = 0;
+	m_depth = 0;
+	for (int i = 0; i < DYNAMIC_RESOLUTION_QUERIES; i++) {
+		m_queries[i] = 0;
+		m_pending[i] = false;
+	}
+	m_frame = 0;
+	m_width = 0;
+	m_height = 0;
+	m_scale = 1.0f;
+	m_minScale = 0.5f;
+	m_maxScale = 1.0f;
+	m_budget = 14.0f;
+	m_gpuMilliseconds = 0.0f;
+}
+
+CDynamicResolution::~CDynamicResolution()
+{
+	Release();
+}
+
+void CDynamicResolution::Create(int width, int height, float budgetMilliseconds, float minScale, float maxScale)
+{
+	Release();
+	m_width = std::max(width, 1);
+	m_height = std::max(height, 1);
+	m_budget = budgetMilliseconds;
+	m_minScale = minScale;
+	m_maxScale = maxScale;
+	m_scale = maxScale;
+	m_gpuMilliseconds = 0.0f;
+
+	glGenQueries(DYNAMIC_RESOLUTION_QUERIES, m_queries);
+	CreateTargets();
+}
+
+void CDynamicResolution::CreateTargets()
+{
+	glGenTextures(1, &m_colour);
+	glBindTexture(GL_TEXTURE_2D, m_colour);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glGenRenderbuffers(1, &m_depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_width, m_height);
+
+	glGenFramebuffers(1, &m_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colour, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void CDynamicResolution::ReleaseTargets()
+{
+	if (m_fbo) glDeleteFramebuffers(1, &m_fbo);
+	if (m_colour) glDeleteTextures(1, &m_colour);
+	if (m_depth) glDeleteRenderbuffers(1, &m_depth);
+	m_fbo = m_colour = m_depth = 0;
+}
+
+void CDynamicResolution::Resize(int width, int height)
+{
+	width = std::max(width, 1);
+	height = std::max(height, 1);
+	if (m_fbo == 0 || (width == m_width && height == m_height))
+		return;
+	m_width = width;
+	m_height = height;
+	ReleaseTargets();
+	CreateTargets();
+}
+
+void CDynamicResolution::Release()
+{
+	ReleaseTargets();
+	if (m_queries[0]) {
+		glDeleteQueries(DYNAMIC_RESOLUTION_QUERIES, m_queries);
+		for (int i = 0; i < DYNAMIC_RESOLUTION_QUERIES; i++) {
+			m_queries[i] = 0;
+			m_pending[i] = false;
+		}
+	}
+}
+
+// Read every finished query, oldest first, and move the scale by the last.  The area drawn goes with the square of the
+// scale, so the scale that would just meet the budget is the square root of the ratio of budget to time.
+void CDynamicResolution::UpdateScale()
+{
+	bool measured = false;
+	for (int i = 1; i <= DYNAMIC_RESOLUTION_QUERIES; i++) {
+		int query = (m_frame + i) % DYNAMIC_RESOLUTION_QUERIES;
+		if (!m_pending[query])
+			continue;
+		GLint available = 0;
+		glGetQueryObjectiv(m_queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(m_queries[query], GL_QUERY_RESULT, &nanoseconds);
+		m_pending[query] = false;
+		float milliseconds = (float)(nanoseconds / 1.0e6);
+		m_gpuMilliseconds = m_gpuMilliseconds == 0.0f ? milliseconds : 0.8f * m_gpuMilliseconds + 0.2f * milliseconds;
+		measured = true;
+	}
+	if (!measured || m_gpuMilliseconds <= 0.0f)
+		return;
+
+	float error = m_gpuMilliseconds / m_budget - 1.0f;
+	if (fabs(error) < DYNAMIC_RESOLUTION_DEADBAND)
+		return;
+	float target = m_scale * sqrt(m_budget / m_gpuMilliseconds);
+	target = std::min(std::max(target, m_scale - DYNAMIC_RESOLUTION_STEP_DOWN), m_scale + DYNAMIC_RESOLUTION_STEP_UP);
+	m_scale = std::min(std::max(target, m_minScale), m_maxScale);
+}
+
+void CDynamicResolution::Begin()
+{
+	UpdateScale();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glViewport(0, 0, GetWidth(), GetHeight());
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// A query still pending after a full ring is dropped rather than waited for
+	int query = m_frame % DYNAMIC_RESOLUTION_QUERIES;
+	glBeginQuery(GL_TIME_ELAPSED, m_queries[query]);
+	m_pending[query] = true;
+}
+
+void CDynamicResolution::Bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glViewport(0, 0, GetWidth(), GetHeight());
+}
+
+void CDynamicResolution::End()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	m_frame++;
+
+	PROFILE_GPU_ZONE("Upscale");
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, GetWidth(), GetHeight(), 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, m_width, m_height);
+}
+
+int CDynamicResolution::GetWidth()
+{
+	return std::max(1, (int)(m_width * m_scale + 0.5f));
+}
+
+int CDynamicResolution::GetHeight()
+{
+	return std::max(1, (int)(m_height * m_scale + 0.5f));
+}
+
+float CDynamicResolution::GetScale()
+{
+	return m_scale;
+}
+
+float CDynamicResolution::GetGpuMilliseconds()
+{
+	return m_gpuMilliseconds;
+}
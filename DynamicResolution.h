@@ -0,0 +1,53 @@
+#pragma once
+#include "Common.h"
+
+// Timer queries in flight, so that reading a result never waits for the GPU
+#define DYNAMIC_RESOLUTION_QUERIES 4
+
+// Renders the 3D scene into an offscreen framebuffer at a scale of the window's resolution, and upscales it to the window
+// before the HUD is drawn.  The scene's GPU time is measured with timer queries, and the scale follows it each frame to
+// keep the scene within a frame budget: down quickly when over budget, and back up slowly when there is time to spare.
+// The framebuffer is the window's size, and only its lower left corner is drawn to, so changing the scale costs nothing.
+class CDynamicResolution
+{
+public:
+	CDynamicResolution();
+	~CDynamicResolution();
+
+	void Create(int width, int height, float budgetMilliseconds = 14.0f, float minScale = 0.5f, float maxScale = 1.0f);
+	void Resize(int width, int height);
+	void Release();
+
+	// Update the scale from the latest GPU time, then bind the framebuffer and set the viewport for the scene
+	void Begin();
+	// Upscale the scene to the window, and leave the window's framebuffer bound with a full viewport
+	void End();
+	// Bind the framebuffer again with the scene's viewport, after drawing somewhere else between Begin and End
+	void Bind();
+
+	// The size of the scene's viewport this frame
+	int GetWidth();
+	int GetHeight();
+	float GetScale();
+	float GetGpuMilliseconds();			// Smoothed
+
+private:
+	void CreateTargets();
+	void ReleaseTargets();
+	void UpdateScale();
+
+	GLuint m_fbo;
+	GLuint m_colour;
+	GLuint m_depth;
+	GLuint m_queries[DYNAMIC_RESOLUTION_QUERIES];
+	bool m_pending[DYNAMIC_RESOLUTION_QUERIES];
+	int m_frame;
+
+	int m_width;						// Of the window
+	int m_height;
+	float m_scale;
+	float m_minScale;
+	float m_maxScale;
+	float m_budget;						// Milliseconds
+	float m_gpuMilliseconds;
+};
@@ -0,0 +1,39 @@
+#include "FileSystem.h"
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+#include <errno.h>
+#include <stdio.h>
+
+string JoinPath(const string &directory, const string &filename)
+{
+	if (directory.empty())
+		return filename;
+	string::size_type end = directory.find_last_not_of("\\/");
+	if (end == string::npos)
+		return "/" + filename;
+	return directory.substr(0, end + 1) + "/" + filename;
+}
+
+bool MakeDirectory(const string &path)
+{
+#ifdef _WIN32
+	int result = _mkdir(path.c_str());
+#else
+	int result = mkdir(path.c_str(), 0755);
+#endif
+	return result == 0 || errno == EEXIST;
+}
+
+bool ReplaceFile(const string &source, const string &destination)
+{
+#ifdef _WIN32
+	// rename will not replace an existing file on Windows
+	return MoveFileExA(source.c_str(), destination.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(source.c_str(), destination.c_str()) == 0;
+#endif
+}
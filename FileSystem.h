@@ -0,0 +1,12 @@
+#pragma once
+#include "Common.h"
+
+// File name handling that works on Windows and off it.  Paths are written with '/', which Windows also accepts.
+
+// The file in a directory, e.g. JoinPath("resources/cache", "a.glprog").  A trailing separator on the directory is
+// allowed, of either kind.
+string JoinPath(const string &directory, const string &filename);
+// Create a directory, if it is not there already.  Its parent must exist.
+bool MakeDirectory(const string &path);
+// Rename a file over another, which may already exist
+bool ReplaceFile(const string &source, const string &destination);
@@ -0,0 +1,68 @@
+#include "FrameArena.h"
+#include "Log.h"
+
+BYTE *CFrameArena::m_pMemory = NULL;
+size_t CFrameArena::m_size = 0;
+size_t CFrameArena::m_used = 0;
+size_t CFrameArena::m_overflowSize = 0;
+vector<BYTE*> CFrameArena::m_overflow;
+
+void CFrameArena::Create(size_t size)
+{
+	Release();
+	m_pMemory = new BYTE[size];
+	m_size = size;
+	m_used = 0;
+	m_overflow.reserve(16);
+}
+
+void CFrameArena::Release()
+{
+	for (unsigned int i = 0; i < m_overflow.size(); i++)
+		delete[] m_overflow[i];
+	m_overflow.clear();
+	m_overflowSize = 0;
+	delete[] m_pMemory;
+	m_pMemory = NULL;
+	m_size = 0;
+	m_used = 0;
+}
+
+void CFrameArena::Reset()
+{
+	if (!m_overflow.empty()) {
+		size_t size = m_size;
+		while (size < m_used + m_overflowSize)
+			size = size ? 2 * size : FRAME_ARENA_SIZE;
+		LogMessage("Frame arena grown from %u to %u KB", (unsigned int)(m_size >> 10), (unsigned int)(size >> 10));
+		Create(size);
+	}
+	m_used = 0;
+}
+
+void *CFrameArena::Allocate(size_t size, size_t alignment)
+{
+	// The alignment is a power of two, applied to the address rather than the offset
+	size_t base = (size_t)m_pMemory;
+	size_t offset = ((base + m_used + alignment - 1) & ~(alignment - 1)) - base;
+	if (m_pMemory != NULL && offset + size <= m_size) {
+		m_used = offset + size;
+		return m_pMemory + offset;
+	}
+
+	// new[] aligns only to the largest fundamental type, so allow for moving the block on
+	BYTE *pBlock = new BYTE[size + alignment];
+	m_overflow.push_back(pBlock);
+	m_overflowSize += size + alignment;
+	return (void*)(((size_t)pBlock + alignment - 1) & ~(alignment - 1));
+}
+
+size_t CFrameArena::GetSize()
+{
+	return m_size;
+}
+
+size_t CFrameArena::GetUsed()
+{
+	return m_used + m_overflowSize;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "Common.h"
+
+// Default size; the arena grows to the largest frame it has seen
+#define FRAME_ARENA_SIZE (1 << 20)
+
+// A linear allocator for data that lives no longer than a frame, such as vertices gathered for an upload.  Allocating
+// moves a pointer on, and Reset at the start of each frame frees everything at once.  A frame that needs more than the
+// arena holds takes the rest from the heap, and the arena is grown at the next Reset so that later frames do not.
+// Main thread only.
+class CFrameArena
+{
+public:
+	static void Create(size_t size = FRAME_ARENA_SIZE);
+	static void Release();
+	static void Reset();
+
+	// Uninitialised memory, valid until the next Reset
+	static void *Allocate(size_t size, size_t alignment = 16);
+	template <typename T> static T *Allocate(size_t count)
+	{
+		return (T*)Allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+	}
+
+	static size_t GetSize();
+	static size_t GetUsed();
+
+private:
+	static BYTE *m_pMemory;
+	static size_t m_size;
+	static size_t m_used;
+	static size_t m_overflowSize;			// Bytes taken from the heap this frame
+	static vector<BYTE*> m_overflow;
+};
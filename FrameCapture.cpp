@@ -0,0 +1,396 @@
+#include "FrameCapture.h"
+#include "Profiler.h"
+#include "Log.h"
+#include <FreeImage.h>
+#include <algorithm>
+#include <stdio.h>
+
+CFrameCapture::CFrameCapture()
+{
+	for (int i = 0; i < FRAME_CAPTURE_BUFFERS; i++) {
+		m_slots[i].buffer = 0;
+		m_slots[i].fence = NULL;
+		m_slots[i].state = SLOT_FREE;
+		m_slots[i].pPixels = NULL;
+	}
+	m_width = 0;
+	m_height = 0;
+	m_framesPerSecond = 60;
+	m_recording = false;
+	m_closePending = false;
+	m_frame = 0;
+	m_numDropped = 0;
+	m_stopping = false;
+	m_videoLength = 0;
+	m_pVideo = NULL;
+	m_videoWidth = 0;
+	m_videoHeight = 0;
+	m_lastVideoFrame = -1;
+}
+
+CFrameCapture::~CFrameCapture()
+{
+	Release();
+}
+
+void CFrameCapture::Create(int width, int height)
+{
+	Release();
+	m_width = width;
+	m_height = height;
+	m_reading.reserve(FRAME_CAPTURE_BUFFERS);
+	m_queue.reserve(FRAME_CAPTURE_BUFFERS + 1);
+	CreateBuffers();
+
+	m_stopping = false;
+	m_encoder = std::thread(&CFrameCapture::EncoderLoop, this);
+}
+
+void CFrameCapture::Release()
+{
+	if (!m_encoder.joinable())
+		return;
+
+	StopRecording();
+	Flush();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	m_encoder.join();
+
+	DeleteBuffers();
+	m_screenshotFilename.clear();
+}
+
+void CFrameCapture::CreateBuffers()
+{
+	for (int i = 0; i < FRAME_CAPTURE_BUFFERS; i++) {
+		glGenBuffers(1, &m_slots[i].buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_slots[i].buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)m_width * m_height * 4, NULL, GL_STREAM_READ);
+		m_slots[i].state = SLOT_FREE;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void CFrameCapture::DeleteBuffers()
+{
+	for (int i = 0; i < FRAME_CAPTURE_BUFFERS; i++) {
+		if (m_slots[i].buffer)
+			glDeleteBuffers(1, &m_slots[i].buffer);
+		m_slots[i].buffer = 0;
+	}
+}
+
+void CFrameCapture::Screenshot(const string &filename)
+{
+	m_screenshotFilename = filename;
+}
+
+void CFrameCapture::StartRecording(const string &filename, int framesPerSecond)
+{
+	StopRecording();
+	// Opening the new video closes the last, after its remaining frames
+	m_closePending = false;
+	m_videoFilename = filename;
+	m_framesPerSecond = std::max(1, framesPerSecond);
+	m_recording = true;
+	m_frame = 0;
+	m_numDropped = 0;
+}
+
+void CFrameCapture::StopRecording()
+{
+	if (!m_recording)
+		return;
+	m_recording = false;
+	m_videoFilename.clear();
+	m_closePending = true;
+}
+
+bool CFrameCapture::IsRecording()
+{
+	return m_recording;
+}
+
+int CFrameCapture::GetNumDroppedFrames()
+{
+	return m_numDropped;
+}
+
+void CFrameCapture::Capture(int width, int height)
+{
+	if (!m_encoder.joinable())
+		return;
+	PROFILE_ZONE("Capture frame");
+
+	// A video cannot change size, and buffers in flight are the old size, so a resize waits for them
+	if (width != m_width || height != m_height) {
+		if (m_recording) {
+			LogMessage("Recording stopped:  the window was resized");
+			StopRecording();
+		}
+		Flush();
+		DeleteBuffers();
+		m_width = width;
+		m_height = height;
+		CreateBuffers();
+	}
+
+	Collect(false);
+	bool screenshot = !m_screenshotFilename.empty();
+	if (!screenshot && !m_recording)
+		return;
+
+	int free = -1;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (int i = 0; i < FRAME_CAPTURE_BUFFERS && free < 0; i++) {
+			if (m_slots[i].state == SLOT_FREE)
+				free = i;
+		}
+	}
+	if (free < 0) {
+		// The screenshot waits for the next frame; a video frame is dropped
+		if (m_recording) {
+			m_numDropped++;
+			m_frame++;
+		}
+		return;
+	}
+
+	Slot &slot = m_slots[free];
+	slot.width = m_width;
+	slot.height = m_height;
+	slot.frame = m_recording ? m_frame++ : -1;
+	slot.screenshotFilename.swap(m_screenshotFilename);
+	m_screenshotFilename.clear();
+	slot.videoFilename.clear();
+	if (m_recording)
+		slot.videoFilename.swap(m_videoFilename);
+	slot.framesPerSecond = m_framesPerSecond;
+
+	// Rows of four bytes need no padding, and BGRA is the layout the driver reads the back buffer in fastest
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glReadPixels(0, 0, m_width, m_height, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	slot.state = SLOT_READING;
+	m_reading.push_back(free);
+}
+
+// Unmap the buffers the encoder is done with, and map and hand it those whose fences have passed.  Frames are handed on
+// in order, so the first still in flight holds back the rest.
+void CFrameCapture::Collect(bool wait)
+{
+	for (int i = 0; i < FRAME_CAPTURE_BUFFERS; i++) {
+		bool encoded;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			encoded = m_slots[i].state == SLOT_ENCODED;
+		}
+		if (encoded) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, m_slots[i].buffer);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_slots[i].pPixels = NULL;
+			m_slots[i].state = SLOT_FREE;
+		}
+	}
+
+	while (!m_reading.empty()) {
+		Slot &slot = m_slots[m_reading[0]];
+		GLenum result = wait ? glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) :
+			glClientWaitSync(slot.fence, 0, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(slot.fence);
+		slot.fence = NULL;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		slot.pPixels = (const BYTE*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)slot.width * slot.height * 4,
+			GL_MAP_READ_BIT);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			slot.state = slot.pPixels ? SLOT_ENCODING : SLOT_FREE;
+			if (slot.pPixels)
+				m_queue.push_back(m_reading[0]);
+		}
+		m_wake.notify_one();
+		m_reading.erase(m_reading.begin());
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (m_closePending && m_reading.empty()) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_queue.push_back(-1);
+			m_videoLength = m_frame;
+		}
+		m_wake.notify_one();
+		m_closePending = false;
+	}
+}
+
+// Wait until every frame captured has been written out, and every buffer is free
+void CFrameCapture::Flush()
+{
+	while (true) {
+		Collect(true);
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this] { return m_queue.empty(); });
+		bool idle = m_reading.empty();
+		for (int i = 0; i < FRAME_CAPTURE_BUFFERS; i++)
+			idle = idle && (m_slots[i].state == SLOT_FREE || m_slots[i].state == SLOT_ENCODED);
+		lock.unlock();
+		if (idle) {
+			Collect(false);
+			return;
+		}
+	}
+}
+
+void CFrameCapture::EncoderLoop()
+{
+	CProfiler::SetThreadName("Frame encoder");
+	while (true) {
+		int index;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+			if (m_queue.empty())
+				break; // Stopping, and nothing left to write
+			index = m_queue[0];
+		}
+
+		if (index < 0) {
+			int length;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				length = m_videoLength;
+			}
+			RepeatVideoFrame(length);
+			CloseVideo();
+		}
+		else
+			Encode(m_slots[index]);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (index >= 0)
+				m_slots[index].state = SLOT_ENCODED;
+			m_queue.erase(m_queue.begin());
+		}
+		m_done.notify_all();
+	}
+	CloseVideo();
+}
+
+void CFrameCapture::Encode(Slot &slot)
+{
+	PROFILE_ZONE("Encode frame");
+	if (!slot.screenshotFilename.empty())
+		WritePng(slot);
+	if (!slot.videoFilename.empty())
+		OpenVideo(slot);
+	if (slot.frame >= 0 && m_pVideo)
+		WriteVideoFrame(slot);
+}
+
+void CFrameCapture::WritePng(const Slot &slot)
+{
+	// FreeImage's 32 bit layout is BGRA on little endian machines, and its rows run bottom up, as OpenGL's do.  The back
+	// buffer's alpha is not meaningful, so it is dropped.
+	FIBITMAP *pBitmap = FreeImage_ConvertFromRawBits((BYTE*)slot.pPixels, slot.width, slot.height, slot.width * 4, 32,
+		FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, FALSE);
+	FIBITMAP *pOpaque = pBitmap ? FreeImage_ConvertTo24Bits(pBitmap) : NULL;
+	if (pOpaque && FreeImage_Save(FIF_PNG, pOpaque, slot.screenshotFilename.c_str()))
+		LogMessage("Saved %s", slot.screenshotFilename.c_str());
+	else
+		LogMessage("Could not save %s", slot.screenshotFilename.c_str());
+	if (pOpaque) FreeImage_Unload(pOpaque);
+	if (pBitmap) FreeImage_Unload(pBitmap);
+}
+
+// Y4M is a text header then raw frames.  C420jpeg is full range 4:2:0, which ffmpeg and most players read directly.
+void CFrameCapture::OpenVideo(const Slot &slot)
+{
+	CloseVideo();
+	m_pVideo = fopen(slot.videoFilename.c_str(), "wb");
+	if (m_pVideo == NULL) {
+		LogMessage("Could not open %s for recording", slot.videoFilename.c_str());
+		return;
+	}
+	fprintf(m_pVideo, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", slot.width, slot.height, slot.framesPerSecond);
+	m_videoWidth = slot.width;
+	m_videoHeight = slot.height;
+	m_lastVideoFrame = slot.frame - 1;
+	int chromaSize = ((slot.width + 1) / 2) * ((slot.height + 1) / 2);
+	m_yuv.resize(slot.width * slot.height + 2 * chromaSize);
+	LogMessage("Recording to %s", slot.videoFilename.c_str());
+}
+
+void CFrameCapture::WriteVideoFrame(const Slot &slot)
+{
+	if (slot.width != m_videoWidth || slot.height != m_videoHeight)
+		return;
+
+	RepeatVideoFrame(slot.frame);
+
+	// BT.601 full range in 8.8 fixed point, the picture turned top row first.  Chroma is taken from the mean of each 2x2
+	// block of pixels.
+	int width = slot.width, height = slot.height;
+	int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+	BYTE *pY = &m_yuv[0];
+	BYTE *pCb = pY + width * height;
+	BYTE *pCr = pCb + chromaWidth * chromaHeight;
+	for (int y = 0; y < height; y++) {
+		const BYTE *pRow = slot.pPixels + (size_t)(height - 1 - y) * width * 4;
+		for (int x = 0; x < width; x++) {
+			const BYTE *p = pRow + 4 * x;
+			pY[y * width + x] = (BYTE)((77 * p[2] + 150 * p[1] + 29 * p[0] + 128) >> 8);
+		}
+	}
+	for (int cy = 0; cy < chromaHeight; cy++) {
+		const BYTE *pRow0 = slot.pPixels + (size_t)(height - 1 - 2 * cy) * width * 4;
+		const BYTE *pRow1 = 2 * cy + 1 < height ? pRow0 - width * 4 : pRow0;
+		for (int cx = 0; cx < chromaWidth; cx++) {
+			int x0 = 2 * cx, x1 = std::min(2 * cx + 1, width - 1);
+			int b = pRow0[4 * x0] + pRow0[4 * x1] + pRow1[4 * x0] + pRow1[4 * x1];
+			int g = pRow0[4 * x0 + 1] + pRow0[4 * x1 + 1] + pRow1[4 * x0 + 1] + pRow1[4 * x1 + 1];
+			int r = pRow0[4 * x0 + 2] + pRow0[4 * x1 + 2] + pRow1[4 * x0 + 2] + pRow1[4 * x1 + 2];
+			// Sums of four, so the offset of 128 and the rounding are four times as large
+			pCb[cy * chromaWidth + cx] = (BYTE)std::min(255, (-43 * r - 85 * g + 128 * b + 131584) >> 10);
+			pCr[cy * chromaWidth + cx] = (BYTE)std::min(255, (128 * r - 107 * g - 21 * b + 131584) >> 10);
+		}
+	}
+
+	fputs("FRAME\n", m_pVideo);
+	fwrite(&m_yuv[0], 1, m_yuv.size(), m_pVideo);
+	m_lastVideoFrame = slot.frame;
+}
+
+// Repeat the last frame written in place of those dropped up to the given one
+void CFrameCapture::RepeatVideoFrame(int frame)
+{
+	if (m_pVideo == NULL || m_lastVideoFrame < 0)
+		return;
+	for (; m_lastVideoFrame + 1 < frame; m_lastVideoFrame++) {
+		fputs("FRAME\n", m_pVideo);
+		fwrite(&m_yuv[0], 1, m_yuv.size(), m_pVideo);
+	}
+}
+
+void CFrameCapture::CloseVideo()
+{
+	if (m_pVideo == NULL)
+		return;
+	fclose(m_pVideo);
+	m_pVideo = NULL;
+	LogMessage("Recorded %d frames", m_lastVideoFrame + 1);
+}
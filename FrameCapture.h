@@ -0,0 +1,100 @@
+#pragma once
+#include "Common.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Pixel buffers in the readback ring.  A frame read into one is normally mapped two frames later, once its fence has
+// passed, and the buffer stays mapped until the encoder has written it out.
+#define FRAME_CAPTURE_BUFFERS 4
+
+// Screenshots and video recording without stalling the pipeline.  Each captured frame is read from the back buffer into
+// a pixel buffer object with a fence behind it.  Only once the fence has passed, a couple of frames later, is the buffer
+// mapped and handed to an encoder thread, which writes a PNG or appends the frame to a raw Y4M video and then returns the
+// buffer to be unmapped.  The main thread never waits on the GPU or the encoder:  if every buffer is busy, the frame is
+// not captured.  A video repeats the previous frame in place of each dropped one, so it keeps time.
+class CFrameCapture
+{
+public:
+	CFrameCapture();
+	~CFrameCapture();
+
+	void Create(int width, int height);
+	// Write out every frame already captured, then stop the encoder.  Needs the GL context.
+	void Release();
+
+	// Save the next frame captured as a PNG
+	void Screenshot(const string &filename);
+	// Append every frame to a Y4M video, played back at the given rate
+	void StartRecording(const string &filename, int framesPerSecond);
+	void StopRecording();
+	bool IsRecording();
+	int GetNumDroppedFrames();				// Of the current or last recording
+
+	// Call each frame once it is rendered to the default framebuffer, before presenting it
+	void Capture(int width, int height);
+
+private:
+	enum SlotState
+	{
+		SLOT_FREE,
+		SLOT_READING,						// Waiting for the fence
+		SLOT_ENCODING,						// Mapped, and owned by the encoder
+		SLOT_ENCODED						// To be unmapped
+	};
+
+	struct Slot
+	{
+		GLuint buffer;
+		GLsync fence;
+		SlotState state;
+		const BYTE *pPixels;				// BGRA, bottom row first
+		int width;
+		int height;
+		int frame;							// In the video, or -1 if the frame is only a screenshot
+		string screenshotFilename;
+		string videoFilename;				// Starts a new video with this frame
+		int framesPerSecond;
+	};
+
+	void CreateBuffers();
+	void DeleteBuffers();
+	void Collect(bool wait);
+	void Flush();
+	void EncoderLoop();
+	void Encode(Slot &slot);
+	void WritePng(const Slot &slot);
+	void OpenVideo(const Slot &slot);
+	void WriteVideoFrame(const Slot &slot);
+	void RepeatVideoFrame(int frame);
+	void CloseVideo();
+
+	Slot m_slots[FRAME_CAPTURE_BUFFERS];
+	vector<int> m_reading;					// Slots waiting for their fences, oldest first
+	int m_width;
+	int m_height;
+
+	string m_screenshotFilename;			// Pending, until a buffer is free
+	string m_videoFilename;					// Pending, until the first frame of the video is captured
+	int m_framesPerSecond;
+	bool m_recording;
+	bool m_closePending;					// Close the video once its last frames are handed on
+	int m_frame;
+	int m_numDropped;
+
+	// Shared with the encoder
+	std::thread m_encoder;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	vector<int> m_queue;					// Slots to encode, in order; -1 closes the video
+	int m_videoLength;						// Frames in the video to close, counting those dropped at its end
+	bool m_stopping;
+
+	// The encoder's own
+	FILE *m_pVideo;
+	int m_videoWidth;
+	int m_videoHeight;
+	int m_lastVideoFrame;
+	vector<BYTE> m_yuv;						// The last frame written, to repeat in place of dropped ones
+};
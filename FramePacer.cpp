@@ -0,0 +1,219 @@
+#include "FramePacer.h"
+#include "Platform.h"
+#include "Profiler.h"
+#include <algorithm>
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Wake this long before the frame has to start, as the scheduler may run the thread late
+#define FRAME_PACER_MARGIN 1.0
+// Spin rather than sleep for the last part of the wait
+#define FRAME_PACER_SPIN_HIGH_RESOLUTION 0.5
+#define FRAME_PACER_SPIN 2.0
+
+CFramePacer::CFramePacer()
+{
+	m_created = false;
+#ifdef _WIN32
+	m_timer = NULL;
+#endif
+	m_highResolution = false;
+	m_frequency = 1.0;
+	m_period = 1000.0 / 60.0;
+	m_deadline = 0.0;
+	m_frameStart = 0.0;
+	m_work = 0.0;
+	m_latency = 0.0;
+	m_frameLatency = 0.0;
+	m_sleep = 0.0;
+	m_slept = 0.0;
+	m_numMissed = 0;
+}
+
+CFramePacer::~CFramePacer()
+{
+	Release();
+}
+
+void CFramePacer::Create(int refreshRate)
+{
+	Release();
+
+#ifdef _WIN32
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_frequency = frequency.QuadPart / 1000.0;
+
+	// Rates of 0 and 1 mean the display's default
+	if (refreshRate <= 0) {
+		DEVMODE mode;
+		memset(&mode, 0, sizeof(mode));
+		mode.dmSize = sizeof(mode);
+		if (EnumDisplaySettings(NULL, ENUM_CURRENT_SETTINGS, &mode) && mode.dmDisplayFrequency > 1)
+			refreshRate = mode.dmDisplayFrequency;
+		else
+			refreshRate = 60;
+	}
+
+	// High resolution timers need Windows 10 1803; before that, fall back to a one millisecond system tick
+	m_timer = CreateWaitableTimerEx(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	m_highResolution = m_timer != NULL;
+	if (m_timer == NULL) {
+		m_timer = CreateWaitableTimerEx(NULL, NULL, 0, TIMER_ALL_ACCESS);
+		if (m_timer == NULL)
+			return;
+		timeBeginPeriod(1);
+	}
+#else
+	// Now() reads nanoseconds.  Without a display, pace to a nominal 60 Hz unless told otherwise.
+	m_frequency = 1.0e6;
+	if (refreshRate <= 1)
+		refreshRate = 60;
+	m_highResolution = true;
+#endif
+	m_period = 1000.0 / refreshRate;
+	m_created = true;
+
+	m_deadline = Now() + m_period;
+	m_work = 0.5 * m_period;
+	m_numMissed = 0;
+}
+
+void CFramePacer::Release()
+{
+	if (!m_created)
+		return;
+#ifdef _WIN32
+	if (!m_highResolution)
+		timeEndPeriod(1);
+	CloseHandle(m_timer);
+	m_timer = NULL;
+#endif
+	m_created = false;
+}
+
+double CFramePacer::Now()
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart / m_frequency;
+#else
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1.0e9 + now.tv_nsec) / m_frequency;
+#endif
+}
+
+void CFramePacer::Spin(double until)
+{
+	while (Now() < until) {
+#ifdef _WIN32
+		YieldProcessor();
+#endif
+	}
+}
+
+bool CFramePacer::Wait()
+{
+	if (!m_created)
+		return true;
+
+	// Start as late as the frame can take and still present in time
+	double wake = m_deadline - m_work - FRAME_PACER_MARGIN;
+	double spin = m_highResolution ? FRAME_PACER_SPIN_HIGH_RESOLUTION : FRAME_PACER_SPIN;
+	double start = Now();
+	double remaining = wake - start;
+	if (remaining > spin) {
+#ifdef _WIN32
+		// Relative due times are negative, in units of 100 ns
+		LARGE_INTEGER due;
+		due.QuadPart = -(LONGLONG)((remaining - spin) * 10000.0);
+		SetWaitableTimer(m_timer, &due, 0, NULL, NULL, FALSE);
+		DWORD result = MsgWaitForMultipleObjects(1, &m_timer, FALSE, INFINITE, QS_ALLINPUT);
+		m_slept += Now() - start;
+		if (result == WAIT_OBJECT_0 + 1) {
+			CancelWaitableTimer(m_timer);
+			return false;
+		}
+#else
+		double milliseconds = remaining - spin;
+		timespec due;
+		due.tv_sec = (time_t)(milliseconds / 1000.0);
+		due.tv_nsec = (long)((milliseconds - due.tv_sec * 1000.0) * 1.0e6);
+		nanosleep(&due, NULL);
+		m_slept += Now() - start;
+#endif
+	}
+	Spin(wake);
+	return true;
+}
+
+void CFramePacer::BeginFrame()
+{
+	m_frameStart = Now();
+	m_sleep = 0.9 * m_sleep + 0.1 * m_slept;
+	m_slept = 0.0;
+}
+
+void CFramePacer::Present(CPlatform *pPlatform)
+{
+	{
+		PROFILE_ZONE("Swap buffers");
+		pPlatform->SwapBuffers();
+	}
+	double end = Now();
+
+	// Track the slowest recent frames, so that a single slow one moves the wake up at once and the estimate then relaxes
+	double work = end - m_frameStart;
+	m_work = work > m_work ? work : 0.95 * m_work + 0.05 * work;
+	m_work = std::min(m_work, m_period);
+
+	// The frame is shown at the first refresh after it was presented.  With vsync, SwapBuffers may block until the
+	// refresh itself, and returning just after the deadline then means the refresh came a little later than predicted,
+	// so the prediction follows it.
+	if (end > m_deadline + 0.25 * m_period) {
+		m_numMissed++;
+		m_deadline += ceil((end - m_deadline) / m_period) * m_period;
+	}
+	else if (end > m_deadline)
+		m_deadline = end;
+	m_frameLatency = m_deadline - m_frameStart;
+	m_latency = 0.9 * m_latency + 0.1 * m_frameLatency;
+	m_deadline += m_period;
+}
+
+double CFramePacer::GetRefreshMilliseconds()
+{
+	return m_period;
+}
+
+double CFramePacer::GetWorkMilliseconds()
+{
+	return m_work;
+}
+
+double CFramePacer::GetLatencyMilliseconds()
+{
+	return m_latency;
+}
+
+double CFramePacer::GetFrameLatencyMilliseconds()
+{
+	return m_frameLatency;
+}
+
+double CFramePacer::GetSleepMilliseconds()
+{
+	return m_sleep;
+}
+
+int CFramePacer::GetNumMissedFrames()
+{
+	return m_numMissed;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "Common.h"
+
+class CPlatform;
+
+// Paces the game loop to the display's refresh instead of spinning.  The pacer predicts when the next frame must be
+// presented (the next refresh after the last one), and sleeps until just before that, less the time a frame has been
+// taking, on a high resolution waitable timer, then spins for the last fraction of a millisecond.  The frame then starts
+// as late as it can and still make the refresh, so input is sampled as close to the display as possible.  Off Windows
+// there is no input to wake for, and the wait is a plain sleep on the monotonic clock.
+class CFramePacer
+{
+public:
+	CFramePacer();
+	~CFramePacer();
+
+	// refreshRate 0 reads the current display mode's rate
+	void Create(int refreshRate = 0);
+	void Release();
+
+	// Sleep until the frame should start.  Returns false early if a window message arrives first, so that it can be
+	// handled; call again to carry on waiting for the same frame.
+	bool Wait();
+	// Call as the frame starts, before input is read and the game updated
+	void BeginFrame();
+	// Present the frame, and learn from its timing
+	void Present(CPlatform *pPlatform);
+
+	double GetRefreshMilliseconds();
+	double GetWorkMilliseconds();			// Estimated time from BeginFrame to the end of Present
+	double GetLatencyMilliseconds();		// Smoothed time from BeginFrame to the refresh the frame is shown at
+	double GetFrameLatencyMilliseconds();	// The same for the last frame presented, unsmoothed
+	double GetSleepMilliseconds();			// Smoothed time slept in Wait per frame
+	int GetNumMissedFrames();				// Frames presented after their refresh
+
+private:
+	double Now();
+	void Spin(double until);
+
+	bool m_created;
+#ifdef _WIN32
+	HANDLE m_timer;
+#endif
+	bool m_highResolution;					// Otherwise the timer is only as fine as the system tick
+	double m_frequency;						// Of the performance counter, in counts per millisecond
+	double m_period;						// Milliseconds between refreshes
+
+	double m_deadline;						// When the next frame is due on screen
+	double m_frameStart;
+	double m_work;
+	double m_latency;
+	double m_frameLatency;
+	double m_sleep;
+	double m_slept;							// So far, for the frame being waited for
+	int m_numMissed;
+};
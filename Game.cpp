@@ -20,26 +20,48 @@ Source code drawn from a number of sources and examples, including contributions
 */
 
 
-#include "game.h"
+#include "Game.h"
 
 
 // Setup includes
 #include "HighResolutionTimer.h"
-#include "GameWindow.h"
+#include "FramePacer.h"
+#include "Benchmark.h"
+#include "Profiler.h"
+#include "ProfilerOverlay.h"
+#include "FrameCapture.h"
+#include "ViewLayout.h"
+#include "FrameArena.h"
+#include "Platform.h"
 #include "CatmullRom.h"
 
 // Game includes
 #include "Camera.h"
 #include "Skybox.h"
-#include "Plane.h"
-#include "Shaders.h"
-#include "FreeTypeFont.h"
+#include "Terrain.h"
+#include "Trackside.h"
+#include "DynamicResolution.h"
+#include "ShaderCache.h"
+#include "ShaderPermutations.h"
+#include "ClusteredLights.h"
+#include "GeometryPool.h"
+#include "TrackGenerator.h"
+#include "HudText.h"
 #include "Sphere.h"
 #include "MatrixStack.h"
 #include "OpenAssetImportMesh.h"
 #include "Audio.h"
 #include "Cube.h"
+#include "Primitives.h"
 #include "Triangle.h"
+#include "LodMesh.h"
+#include "MeshCache.h"
+#include "Log.h"
+#include "JobSystem.h"
+#include "AssetLoader.h"
+#include "ResourceManager.h"
+#include "ReflectionProbes.h"
+#include <time.h>
 
 // Constructor
 Game::Game()
@@ -47,23 +69,50 @@ Game::Game()
 	m_pSkybox = NULL;
 	m_pCamera = NULL;
 	m_pShaderPrograms = NULL;
-	m_pPlanarTerrain = NULL;
-	m_pFtFont = NULL;
+	m_pShaderCache = NULL;
+	m_pMainShader = NULL;
+	m_pTrackLights = NULL;
+	m_pGeometryPool = NULL;
+	m_pTrackGenerator = NULL;
+	m_pTerrain = NULL;
+	m_pTrackside = NULL;
+	m_pDynamicResolution = NULL;
+	m_pHudText = NULL;
+	m_pModelViewMatrixStack = NULL;
+	m_pProfilerOverlay = NULL;
+	m_pFrameCapture = NULL;
+	m_pViewLayout = NULL;
+	m_pReflectionProbes = NULL;
 	m_pBarrelMesh = NULL;
 	m_pHorseMesh = NULL;
 	m_pSphere = NULL;
 	m_pHighResolutionTimer = NULL;
+	m_pFramePacer = NULL;
+	m_pPlatform = NULL;
+	m_pBenchmark = NULL;
+	m_appActive = false;
 	m_pAudio = NULL;
 	m_pCatmullRom = NULL;
 	m_pFighterMesh = NULL;
 	m_pCube = NULL;
+	m_pPrimitives = NULL;
 	m_pCarMesh = NULL;
 	m_pStandMesh = NULL;
-	m_pFenceMesh = NULL;
 	m_pTreeMesh = NULL;
 	m_pRepair = NULL;
 	m_pConeMesh = NULL;
 	m_pLap = NULL;
+	m_pJobSystem = NULL;
+	m_pAssetLoader = NULL;
+	m_pLoadingTimer = NULL;
+	m_loadingReported = false;
+	m_mainShaderChecked = false;
+	m_clusteredLighting = false;
+	m_probeReflections = false;
+	m_indirectDraws = false;
+	m_packedNormals = false;
+	m_hudFrameRate = m_hudSpeed = m_hudDamage = m_hudLap = m_hudTime = 0;
+	m_hudLoading = m_hudGameOver = m_hudFinished = 0;
 	m_dt = 0.0;
 	m_framesPerSecond = 0;
 	m_frameCount = 0;
@@ -73,14 +122,39 @@ Game::Game()
 	
 }
 
-// Destructor
+// Destructor.  The game objects are already gone, freed by Release while the context was current.
 Game::~Game()
 {
+	//setup objects
+	delete m_pHighResolutionTimer;
+	delete m_pFramePacer;
+	delete m_pBenchmark;
+	delete m_pPlatform;
+}
+
+// Delete the game objects, which free their OpenGL objects, so this must run before the platform's context is destroyed
+void Game::Release()
+{
+	// Stop the workers before deleting the objects they may still be loading
+	delete m_pJobSystem;
+	delete m_pShaderCache;
+	delete m_pMainShader;
+	delete m_pTrackLights;
+	delete m_pAssetLoader;
+	delete m_pLoadingTimer;
+
 	//game objects
 	delete m_pCamera;
 	delete m_pSkybox;
-	delete m_pPlanarTerrain;
-	delete m_pFtFont;
+	delete m_pTerrain;
+	delete m_pTrackside;
+	delete m_pDynamicResolution;
+	delete m_pProfilerOverlay;
+	delete m_pFrameCapture;
+	delete m_pViewLayout;
+	delete m_pReflectionProbes;
+	delete m_pHudText;
+	delete m_pModelViewMatrixStack;
 	delete m_pBarrelMesh;
 	delete m_pHorseMesh;
 	delete m_pSphere;
@@ -88,15 +162,17 @@ Game::~Game()
 	delete m_pCatmullRom;
 	delete m_pFighterMesh;
 	delete m_pCube;
+	delete m_pPrimitives;
 	delete m_pCarMesh;
 	delete m_pStandMesh;
-	delete m_pFenceMesh;
 	delete m_pTreeMesh;
 	delete m_pRepair;
 	delete m_pConeMesh;
 	delete m_pLap;
 	delete m_pBuildingMesh;
 	delete m_pStartMesh;
+	delete m_pGeometryPool;
+	delete m_pTrackGenerator;
 
 	if (m_pShaderPrograms != NULL) {
 		for (unsigned int i = 0; i < m_pShaderPrograms->size(); i++)
@@ -104,14 +180,21 @@ Game::~Game()
 	}
 	delete m_pShaderPrograms;
 
-	//setup objects
-	delete m_pHighResolutionTimer;
+	// After the objects, which release what they hold, so that only leaks are left
+	CResourceManager::Release();
 }
 
 // Initialisation:  This method only runs once at startup
 void Game::Initialise()
 {
+	m_pLoadingTimer = new CHighResolutionTimer;
+	m_pLoadingTimer->Start();
 
+	// File I/O, decoding and mesh processing run on the workers; uploads are drained in GameLoop
+	m_pJobSystem = new CJobSystem;
+	m_pJobSystem->Start();
+	m_pAssetLoader = new CAssetLoader(m_pJobSystem);
+	CResourceManager::Create(m_pJobSystem);
 
 	float m_t = 0.0f;
 	glm::vec3 m_spaceShipPosition = { 0.f, 0.f, 0.f };
@@ -123,9 +206,16 @@ void Game::Initialise()
 	/// Create objects
 	m_pCamera = new CCamera;
 	m_pSkybox = new CSkybox;
-	m_pShaderPrograms = new vector <CShaderProgram *>;
-	m_pPlanarTerrain = new CPlane;
-	m_pFtFont = new CFreeTypeFont;
+	m_pShaderPrograms = new vector <CCachedProgram *>;
+	m_pTerrain = new CTerrain;
+	m_pTrackside = new CTrackside;
+	m_pDynamicResolution = new CDynamicResolution;
+	m_pHudText = new CHudText;
+	m_pModelViewMatrixStack = new glutil::MatrixStack;
+	m_pProfilerOverlay = new CProfilerOverlay;
+	m_pFrameCapture = new CFrameCapture;
+	m_pViewLayout = new CViewLayout;
+	m_pReflectionProbes = new CReflectionProbes;
 	m_pBarrelMesh = new COpenAssetImportMesh;
 	m_pHorseMesh = new COpenAssetImportMesh;
 	m_pSphere = new CSphere;
@@ -133,19 +223,20 @@ void Game::Initialise()
 	m_pCatmullRom = new CCatmullRom;
 	m_pFighterMesh = new COpenAssetImportMesh;
 	m_pCube = new CCube;
-	m_pCarMesh = new COpenAssetImportMesh;
-	m_pStandMesh = new COpenAssetImportMesh;
-	m_pFenceMesh = new COpenAssetImportMesh;
-	m_pTreeMesh = new COpenAssetImportMesh;
+	m_pPrimitives = new CPrimitiveLibrary;
+	m_pCarMesh = new CLodMesh;
+	m_pStandMesh = new CLodMesh;
+	m_pTreeMesh = new CLodMesh;
 	m_pRepair = new CTriangle;
-	m_pConeMesh = new COpenAssetImportMesh;
-	m_pBuildingMesh = new COpenAssetImportMesh;
-	m_pStartMesh = new COpenAssetImportMesh;
-
-	RECT dimensions = m_gameWindow.GetDimensions();
+	m_pConeMesh = new CLodMesh;
+	m_pBuildingMesh = new CLodMesh;
+	m_pStartMesh = new CLodMesh;
+	m_pTrackLights = new CClusteredLights;
+	m_pGeometryPool = new CGeometryPool;
+	m_pTrackGenerator = new CTrackGenerator;
 
-	int width = dimensions.right - dimensions.left;
-	int height = dimensions.bottom - dimensions.top;
+	int width = m_pPlatform->GetWidth();
+	int height = m_pPlatform->GetHeight();
 
 	//=====Animation for creating line CreatePath()
 	//glm::vec3 p0 = glm::vec3(-500, 10, -200);
@@ -154,68 +245,74 @@ void Game::Initialise()
 	//glm::vec3 p3 = glm::vec3(-500, 10, 200);
 
 	m_pCatmullRom->CreateCentreline();
-	m_pCatmullRom->CreateOffsetCurves();
-	m_pCatmullRom->CreateTrack("resources\\textures\\", "r2.jpg");
+
+	// The scene is drawn at whatever resolution keeps it within its share of a 60 FPS frame.  A benchmark measures it at
+	// full resolution, as a scale that follows the GPU time would hide a regression.
+	m_pDynamicResolution->Create(width, height, 14.0f, m_pBenchmark ? 1.0f : 0.5f);
+
+	// Floodlights on both sides of the track, and the flashing start lights, shaded by cluster in the main shader
+	m_pTrackLights->Create();
+	float trackLength = m_pCatmullRom->GetLength();
+	for (float d = 0.0f; d < trackLength; d += 40.0f) {
+		glm::vec3 p, pNext, up;
+		m_pCatmullRom->Sample(d, p, up);
+		m_pCatmullRom->Sample(d + 1.0f, pNext, up);
+		glm::vec3 side = glm::normalize(glm::cross(pNext - p, up));
+		m_pTrackLights->AddLight(p - side * 40.0f + up * 25.0f, glm::vec3(1.0f, 0.95f, 0.8f), 60.0f);
+		m_pTrackLights->AddLight(p + side * 40.0f + up * 25.0f, glm::vec3(1.0f, 0.95f, 0.8f), 60.0f);
+	}
+	m_startLights[0] = m_pTrackLights->AddLight(glm::vec3(-400.f, 200.f, 355.f), glm::vec3(1.0f, 0.6f, 0.0f), 250.0f);
+	m_startLights[1] = m_pTrackLights->AddLight(glm::vec3(-47.f, 200.f, -250.f), glm::vec3(1.0f, 0.6f, 0.0f), 250.0f);
+	m_startLights[2] = m_pTrackLights->AddLight(glm::vec3(915.f, 200.f, 335.f), glm::vec3(1.0f, 0.6f, 0.0f), 250.0f);
 	//m_pCatmullRom->CreatePath(p0, p1, p2, p3);
 
 	// Set the orthographic and perspective projection matrices based on the image size
 	m_pCamera->SetOrthographicProjectionMatrix(width, height);
 	m_pCamera->SetPerspectiveProjectionMatrix(45.5f, (float)width / (float)height, 0.5f, 5000.0f);
 
-	// Load shaders
-	vector<CShader> shShaders;
-	vector<string> sShaderFileNames;
-	sShaderFileNames.push_back("mainShader.vert");
-	sShaderFileNames.push_back("mainShader.frag");
-	sShaderFileNames.push_back("textShader.vert");
-	sShaderFileNames.push_back("textShader.frag");
-	sShaderFileNames.push_back("sphereShader.vert");
-	sShaderFileNames.push_back("sphereShader.frag");
-
-	for (int i = 0; i < (int)sShaderFileNames.size(); i++) {
-		string sExt = sShaderFileNames[i].substr((int)sShaderFileNames[i].size() - 4, 4);
-		int iShaderType;
-		if (sExt == "vert") iShaderType = GL_VERTEX_SHADER;
-		else if (sExt == "frag") iShaderType = GL_FRAGMENT_SHADER;
-		else if (sExt == "geom") iShaderType = GL_GEOMETRY_SHADER;
-		else if (sExt == "tcnl") iShaderType = GL_TESS_CONTROL_SHADER;
-		else iShaderType = GL_TESS_EVALUATION_SHADER;
-		CShader shader;
-		shader.LoadShader("resources\\shaders\\" + sShaderFileNames[i], iShaderType);
-		shShaders.push_back(shader);
-	}
-
-	// Create the main shader program
-	CShaderProgram *pMainProgram = new CShaderProgram;
-	pMainProgram->CreateProgram();
-	pMainProgram->AddShaderToProgram(&shShaders[0]);
-	pMainProgram->AddShaderToProgram(&shShaders[1]);
-	pMainProgram->LinkProgram();
-	m_pShaderPrograms->push_back(pMainProgram);
+	// Load shaders.  Programs come from the binary cache when it is up to date; otherwise they compile on a background
+	// context, and Render shows a blank frame until they are ready.
+	m_pShaderCache = new CShaderCache;
+	m_pShaderCache->Start(m_pPlatform);
+
+	// Create the main shader program.  Each combination of features used in Render is compiled as a separate permutation
+	// with its bools fixed, so the shader has no branches on them.
+	vector<string> mainShaderFeatures;
+	mainShaderFeatures.push_back("bUseTexture");
+	mainShaderFeatures.push_back("renderSkybox");
+	mainShaderFeatures.push_back("wallShift");
+	mainShaderFeatures.push_back("indirectDraw");
+	mainShaderFeatures.push_back("packedNormal");
+	mainShaderFeatures.push_back("reflective");
+	m_pMainShader = new CShaderPermutations;
+	m_pMainShader->Create(m_pShaderCache, "mainShader.vert", "mainShader.frag", mainShaderFeatures,
+		MAIN_SHADER_INDIRECT | MAIN_SHADER_PACKED_NORMAL);
+	m_pMainShader->Precompile(MAIN_SHADER_TEXTURE);
+	m_pMainShader->Precompile(MAIN_SHADER_TEXTURE | MAIN_SHADER_SKYBOX);
+	m_pMainShader->Precompile(MAIN_SHADER_TEXTURE | MAIN_SHADER_WALL_SHIFT);
+	m_pMainShader->Precompile(MAIN_SHADER_TEXTURE | MAIN_SHADER_INDIRECT);
+	m_pMainShader->Precompile(MAIN_SHADER_TEXTURE | MAIN_SHADER_WALL_SHIFT | MAIN_SHADER_PACKED_NORMAL);
+	m_pMainShader->Precompile(MAIN_SHADER_TEXTURE | MAIN_SHADER_REFLECT);
+	m_pMainShader->Precompile(0);
 
 	// Create a shader program for fonts
-	CShaderProgram *pFontProgram = new CShaderProgram;
-	pFontProgram->CreateProgram();
-	pFontProgram->AddShaderToProgram(&shShaders[2]);
-	pFontProgram->AddShaderToProgram(&shShaders[3]);
-	pFontProgram->LinkProgram();
+	CCachedProgram *pFontProgram = m_pShaderCache->CreateProgram("textShader.vert", "textShader.frag");
 	m_pShaderPrograms->push_back(pFontProgram);
 
 	// Create the sphere shader program
-	CShaderProgram *pSphereProgram = new CShaderProgram;
-	pSphereProgram->CreateProgram();
-	pSphereProgram->AddShaderToProgram(&shShaders[4]);
-	pSphereProgram->AddShaderToProgram(&shShaders[5]);
-	pSphereProgram->LinkProgram();
+	CCachedProgram *pSphereProgram = m_pShaderCache->CreateProgram("sphereShader.vert", "sphereShader.frag");
 	m_pShaderPrograms->push_back(pSphereProgram);
 
-	//CShaderProgram *pTerrainProgram = new CShaderProgram;
-	//pTerrainProgram->CreateProgram();
-	//pTerrainProgram->AddShaderToProgram(&shShaders[6]);
-	//pTerrainProgram->AddShaderToProgram(&shShaders[7]);
-	//pTerrainProgram->LinkProgram();
+	//CCachedProgram *pTerrainProgram = m_pShaderCache->CreateProgram("terrainShader.vert", "terrainShader.frag");
 	//m_pShaderPrograms->push_back(pTerrainProgram);
 
+	// The track is generated by a compute shader from the centreline's control points, in the first frame.  It is 50
+	// units wide, sampled as often as the centreline.
+	m_pTrackGenerator->Create(m_pShaderCache);
+	m_pCatmullRom->SetTrackGenerator(m_pTrackGenerator);
+	m_pCatmullRom->CreateTrack("resources/textures/", "r2.jpg");
+	m_pCatmullRom->RebuildTrack(50.0f, 500);
+
 	// You can follow this pattern to load additional shaders
 
 	// Create the skybox
@@ -223,72 +320,125 @@ void Game::Initialise()
 	m_pSkybox->Create(2500.0f);
 
 	// Create the planar terrain
-	m_pPlanarTerrain->Create("resources\\textures\\", "grass.jpg", 2000.0f, 2000.0f, 50.0f); // Texture downloaded from http://www.psionicgames.com/?page_id=26 on 24 Jan 2013
 
-	m_pFtFont->LoadFont("resources\\fonts\\orangekid.ttf", 32);
-	m_pFtFont->SetShaderProgram(pFontProgram);
+	m_pHudText->LoadFont("resources/fonts/orangekid.ttf", 32);
+	m_pHudText->SetShaderProgram(pFontProgram);
+	m_hudFrameRate = m_pHudText->AddString("FPS: %d", 32);
+	m_hudSpeed = m_pHudText->AddString("SPEED: %d mph", 32);
+	m_hudDamage = m_pHudText->AddString("DAMAGE: x %d", 32);
+	m_hudLap = m_pHudText->AddString("LAP: %d / 2", 32);
+	m_hudTime = m_pHudText->AddString("TIME: %d:%d:%d", 32);
+	m_hudLoading = m_pHudText->AddString("LOADING %d%%", 32);
+	m_hudGameOver = m_pHudText->AddString("GAME OVER", 64);
+	m_hudFinished = m_pHudText->AddString("FINISHED", 64);
+	// Hidden until F4 turns the profiler on
+	m_pProfilerOverlay->Create(m_pShaderCache, m_pHudText);
+	m_pFrameCapture->Create(m_pPlatform->GetWidth(), m_pPlatform->GetHeight());
+
+	// Static meshes share the vertex and index buffers of the geometry pool
+	m_pGeometryPool->Create();
+	m_pGeometryPool->SetJobSystem(m_pJobSystem);
+	CLodMesh *pPooledMeshes[] = { m_pCarMesh, m_pStandMesh, m_pTreeMesh, m_pConeMesh, m_pBuildingMesh, m_pStartMesh };
+	for (unsigned int i = 0; i < sizeof(pPooledMeshes) / sizeof(pPooledMeshes[0]); i++)
+		pPooledMeshes[i]->SetGeometryPool(m_pGeometryPool);
+
+	// The ground is a streamed heightfield, flattened around the track, and also drawn from the pool
+	m_pTerrain->Create(m_pJobSystem, m_pGeometryPool, "resources/textures/grass.jpg", m_pCatmullRom->GetCentrelinePoints()); // Texture downloaded from http://www.psionicgames.com/?page_id=26 on 24 Jan 2013
+
+	// Barriers, fences and kerbs along the track's edges, built once the track is, and drawn from the pool
+	m_pTrackside->Create(m_pGeometryPool, "resources/textures/wallg.jpg");
+
+	// Reflection probes every 150 units along the centreline, at about the height of the car, for it to reflect the
+	// scene around it
+	vector<glm::vec3> probePositions;
+	const vector<glm::vec3> &centreline = m_pCatmullRom->GetCentrelinePoints();
+	float sinceProbe = 150.0f;
+	for (unsigned int i = 0; i < centreline.size(); i++) {
+		if (i > 0)
+			sinceProbe += glm::distance(centreline[i - 1], centreline[i]);
+		if (sinceProbe >= 150.0f) {
+			probePositions.push_back(centreline[i] + glm::vec3(0.0f, 6.0f, 0.0f));
+			sinceProbe = 0.0f;
+		}
+	}
+	m_pReflectionProbes->Create(probePositions);
 
 	// Load some meshes in OBJ format
-	//m_pBarrelMesh->Load("resources\\models\\Barrel\\Barrel02.obj");  // Downloaded from http://www.psionicgames.com/?page_id=24 on 24 Jan 2013
-	//m_pHorseMesh->Load("resources\\models\\Horse\\Horse2.obj");  // Downloaded from http://opengameart.org/content/horse-lowpoly on 24 Jan 2013
-	//m_pFighterMesh->Load("resources\\models\\Fighter\\fighter1.3ds");
-	m_pCarMesh->Load("resources\\models\\Car\\ferrari2.obj");
-	m_pStandMesh->Load("resources\\models\\Enviroment\\generic medium.obj"); //downloaded from https://www.cgtrader.com/items/183081/download-page 0n 03 April 2020
-	m_pFenceMesh->Load("resources\\models\\Enviroment\\fence_01_obj.obj"); //downloaded from https://www.turbosquid.com/3d-models/stadium-fence-3ds-free/545545 on 03 April 2020
-	m_pTreeMesh->Load("resources\\models\\Enviroment\\firtree1.3ds"); //downloaded from https://www.turbosquid.com/3d-models/free-firtree-3d-model/480733 on 03 April 2020
-	m_pRepair->Create("resources\\textures\\bolt.jpg");
-	m_pConeMesh->Load("resources\\models\\Enviroment\\1.obj");
-	m_pSphere->Create("resources\\textures\\", "dirtpile01.jpg", 25, 25);  // Texture downloaded from http://www.psionicgames.com/?page_id=26 on 24 Jan 2013
-	m_pBuildingMesh->Load("resources\\models\\Enviroment\\Building.obj");
-	m_pStartMesh->Load("resources\\models\\Enviroment\\LevelCrossing.obj");
+	//m_pBarrelMesh->Load("resources/models/Barrel/Barrel02.obj");  // Downloaded from http://www.psionicgames.com/?page_id=24 on 24 Jan 2013
+	//m_pHorseMesh->Load("resources/models/Horse/Horse2.obj");  // Downloaded from http://opengameart.org/content/horse-lowpoly on 24 Jan 2013
+	//m_pFighterMesh->Load("resources/models/Fighter/fighter1.3ds");
+	m_pCarMesh->LoadAsync(m_pAssetLoader, "resources/models/Car/ferrari2.obj", 1);
+	m_pStandMesh->LoadAsync(m_pAssetLoader, "resources/models/Enviroment/generic medium.obj"); //downloaded from https://www.cgtrader.com/items/183081/download-page 0n 03 April 2020
+	m_pTreeMesh->LoadAsync(m_pAssetLoader, "resources/models/Enviroment/firtree1.3ds"); //downloaded from https://www.turbosquid.com/3d-models/free-firtree-3d-model/480733 on 03 April 2020
+	m_pRepair->Create("resources/textures/bolt.jpg");
+	m_pConeMesh->LoadAsync(m_pAssetLoader, "resources/models/Enviroment/1.obj", 1);
+	m_pSphere->Create("resources/textures/", "dirtpile01.jpg", 25, 25);  // Texture downloaded from http://www.psionicgames.com/?page_id=26 on 24 Jan 2013
+	m_pBuildingMesh->LoadAsync(m_pAssetLoader, "resources/models/Enviroment/Building.obj");
+	m_pTreeMesh->CreateImpostor(m_pMainShader, glm::vec3(0.0f, 0.0f, 1.0f)); // The 3ds tree is modelled z-up
+	m_pStartMesh->LoadAsync(m_pAssetLoader, "resources/models/Enviroment/LevelCrossing.obj", 1);
 	//glEnable(GL_CULL_FACE);
 
 	//Cube
-	m_pCube->Create("resources\\textures\\wallg.jpg");
+	m_pCube->Create("resources/textures/wallg.jpg", m_pPrimitives);
 
 	// Initialise audio and play background music
 	//m_pAudio->Initialise();
-	//m_pAudio->LoadEventSound("resources\\Audio\\Boing.wav");					// Royalty free sound from freesound.org
-	//m_pAudio->LoadMusicStream("resources\\Audio\\DST-Garote.mp3");	// Royalty free music from http://www.nosoapradio.us/
+	//m_pAudio->LoadEventSound("resources/Audio/Boing.wav");					// Royalty free sound from freesound.org
+	//m_pAudio->LoadMusicStream("resources/Audio/DST-Garote.mp3");	// Royalty free music from http://www.nosoapradio.us/
 	//m_pAudio->PlayMusicStream();
+
+	LogMessage("First frame after %.1f ms", m_pLoadingTimer->Elapsed());
 }
 
 // Render method runs repeatedly in a loop
 void Game::Render()
 {
+	PROFILE_GPU_ZONE("Render");
 
 	// Clear the buffers and enable depth testing (z-buffering)
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glEnable(GL_DEPTH_TEST);
 
-	// Set up a matrix stack
-	glutil::MatrixStack modelViewMatrixStack;
-	modelViewMatrixStack.SetIdentity();
-
-	// Use the main shader program 
-	CShaderProgram *pMainProgram = (*m_pShaderPrograms)[0];
-	pMainProgram->UseProgram();
-	pMainProgram->SetUniform("bUseTexture", true);
-	pMainProgram->SetUniform("sampler0", 0);
-	pMainProgram->SetUniform("sampler1", 1);
-	pMainProgram->SetUniform("wallShift", false);
-	// Note: cubemap and non-cubemap textures should not be mixed in the same texture unit.  Setting unit 10 to be a cubemap texture.
-	int cubeMapTextureUnit = 10;
-	pMainProgram->SetUniform("CubeMapTex", cubeMapTextureUnit);
-
+	// Nothing can be drawn until the shaders have compiled
+	if (!m_pShaderCache->IsFinished())
+		return;
+
+	// Only bin the track lights, update the reflection probes, multi-draw the pool and pack the primitives' normals if the
+	// main shader has included clusteredLights.glsl, reflectionProbe.glsl, geometryPool.glsl and vertexFormat.glsl to
+	// read them
+	if (!m_mainShaderChecked) {
+		m_clusteredLighting = m_pMainShader->HasStorageBlock(MAIN_SHADER_TEXTURE, "ClusterGrid");
+		if (!m_clusteredLighting)
+			LogMessage("mainShader.frag does not include clusteredLights.glsl, so the track lights are off");
+		m_probeReflections = m_pMainShader->HasUniform(MAIN_SHADER_TEXTURE | MAIN_SHADER_REFLECT, "probeCubeMap");
+		if (!m_probeReflections)
+			LogMessage("mainShader.frag does not sample reflectionProbe.glsl, so the reflection probes are off");
+		m_indirectDraws = m_pMainShader->HasStorageBlock(MAIN_SHADER_TEXTURE | MAIN_SHADER_INDIRECT, "GeometryDraws");
+		if (!m_indirectDraws) {
+			LogMessage("mainShader.vert does not include geometryPool.glsl, so the pooled meshes are drawn one by one");
+			m_pGeometryPool->SetDirectDraws(true);
+		}
+		m_packedNormals = m_pMainShader->GetAttributeType(MAIN_SHADER_TEXTURE | MAIN_SHADER_WALL_SHIFT |
+			MAIN_SHADER_PACKED_NORMAL, 2) == GL_FLOAT_VEC2;
+		if (!m_packedNormals) {
+			LogMessage("mainShader.vert does not decode octahedral normals, so the primitives store them unpacked");
+			m_pPrimitives->SetNormalFormat(VERTEX_NORMAL_SNORM16);
+		}
+		m_mainShaderChecked = true;
+	}
 
-	// Set the projection matrix
-	pMainProgram->SetUniform("matrices.projMatrix", m_pCamera->GetPerspectiveProjectionMatrix());
+	// A benchmark checks the generated track against the CPU's once, as the readback stalls
+	if (m_pCatmullRom->UpdateTrack() && m_pBenchmark)
+		m_pBenchmark->AddCheck("generated track", m_pCatmullRom->CheckGeneratedTrack());
 
-	// Call LookAt to create the view matrix and put this on the modelViewMatrix stack. 
-	// Store the view matrix and the normal matrix associated with the view matrix for later (they're useful for lighting -- since lighting is done in eye coordinates)
-	modelViewMatrixStack.LookAt(m_pCamera->GetPosition(), m_pCamera->GetView(), m_pCamera->GetUpVector());
-	glm::mat4 viewMatrix = modelViewMatrixStack.Top();
-	glm::mat3 viewNormalMatrix = m_pCamera->ComputeNormalMatrix(viewMatrix);
+	// Draw the scene offscreen, at the resolution chosen from the GPU time of the last frames
+	m_pDynamicResolution->Begin();
+	int sceneWidth = m_pDynamicResolution->GetWidth();
+	int sceneHeight = m_pDynamicResolution->GetHeight();
 
-
-	// Set light and materials in main shader program
-	glm::vec4 lightPosition1 = glm::vec4(-100, 100, -100, 1); // Position of light source *in world coordinates*
+	// Divide the scene between the views of the layout.  The main view is the game's camera; Update places the others.
+	m_pViewLayout->SetCamera(VIEW_CAMERA_MAIN, m_pCamera->GetPosition(), m_pCamera->GetView(), m_pCamera->GetUpVector());
+	m_pViewLayout->Build(sceneWidth, sceneHeight, *m_pCamera->GetPerspectiveProjectionMatrix());
 
 	if (counter % 6 == 0)
 	{
@@ -304,232 +454,280 @@ void Game::Render()
 		lightPosition4 = glm::vec4(0, -30, 0, 1);
 	}
 
-	pMainProgram->SetUniform("light1.position", viewMatrix*lightPosition1); // Position of light source *in eye coordinates*
-	pMainProgram->SetUniform("light1.La", glm::vec3(1.0f));		// Ambient colour of light
-	pMainProgram->SetUniform("light1.Ld", glm::vec3(1.0f));		// Diffuse colour of light
-	pMainProgram->SetUniform("light1.Ls", glm::vec3(0.0f));		// Specular colour of light
-	pMainProgram->SetUniform("material1.Ma", glm::vec3(1.0f));	// Ambient material reflectance
-	pMainProgram->SetUniform("material1.Md", glm::vec3(0.0f));	// Diffuse material reflectance
-	pMainProgram->SetUniform("material1.Ms", glm::vec3(0.0f));	// Specular material reflectance
-	pMainProgram->SetUniform("material1.shininess", 15.0f);		// Shininess material property
-
-
-
+	// The start lights flash on one frame in six
+	for (int i = 0; i < 3; i++)
+		m_pTrackLights->SetEnabled(m_startLights[i], counter % 6 == 0);
+
+	// Walk the scene once for every view, then cull what it queued against all the views together on the workers.
+	// This frame's face of a reflection probe near the car is culled with them, as one more view.
+	QueueScene();
+	GeometryView views[VIEW_LAYOUT_MAX_VIEWS + 1];
+	int numViews = m_pViewLayout->GetNumViews();
+	for (int v = 0; v < numViews; v++)
+		views[v] = m_pViewLayout->GetViews()[v];
+	bool probeFace = m_probeReflections && m_pReflectionProbes->Schedule(m_carPosition, views[numViews]);
+	m_pGeometryPool->Prepare(views, probeFace ? numViews + 1 : numViews);
+
+	// The probe's face is drawn first, so that the car's reflection is at most a frame behind for that face
+	if (probeFace) {
+		PROFILE_GPU_ZONE("Probe face");
+		int resolution = m_pReflectionProbes->GetFaceResolution();
+		m_pReflectionProbes->BeginFace();
+		DrawScene(numViews, views[numViews].viewMatrix, m_pReflectionProbes->GetFaceProjectionMatrix(),
+			glm::ivec4(0, 0, resolution, resolution), m_pReflectionProbes->GetFacePosition(), false);
+		m_pReflectionProbes->EndFace();
+		m_pDynamicResolution->Bind();
+	}
 
+	for (int v = 0; v < numViews; v++)
+		RenderView(v);
 
+	// Upscale the scene to the window, so that the HUD is drawn at full resolution
+	m_pDynamicResolution->End();
 
+	// Draw the 2D graphics after the 3D graphics.  The Display methods only update the HUD strings, which are laid out
+	// again when their values change and drawn together at the end.
+	m_pHudText->SetVisible(m_hudLoading, false);
+	m_pHudText->SetVisible(m_hudGameOver, false);
+	m_pHudText->SetVisible(m_hudFinished, false);
 
-	// Render the skybox and terrain with full ambient reflectance 
-	modelViewMatrixStack.Push();
-	pMainProgram->SetUniform("renderSkybox", true);
-	// Translate the modelview matrix to the camera eye point so skybox stays centred around camera
-	glm::vec3 vEye = m_pCamera->GetPosition();
-	modelViewMatrixStack.Translate(vEye);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pSkybox->Render(cubeMapTextureUnit);
-	pMainProgram->SetUniform("renderSkybox", false);
-	modelViewMatrixStack.Pop();
+	//DisplayFrameRate();
 
-	// Render the planar terrain
-	modelViewMatrixStack.Push();
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pPlanarTerrain->Render();
-	modelViewMatrixStack.Pop();
+	//display speed
+	DisplaySpeed();
 
+	//display damage
+	DisplayDamage();
 
-	// Turn on diffuse + specular materials
-	pMainProgram->SetUniform("material1.Ma", glm::vec3(0.5f));	// Ambient material reflectance
-	pMainProgram->SetUniform("material1.Md", glm::vec3(0.5f));	// Diffuse material reflectance
-	pMainProgram->SetUniform("material1.Ms", glm::vec3(1.0f));	// Specular material reflectance	
+	//displaying lap count
+	if (m_lapCount == 3)
+	{
+		DisplayLap(2);
+		up1 = 0;
 
+	}
+	else
+	{
+		DisplayLap(m_lapCount);
+	}
+	
+	//display time
+	DisplayTime();
 
+	//display loading progress while meshes are still streaming in
+	if (!m_pAssetLoader->IsFinished())
+		DisplayLoading();
 
+	//display gameover
+	if (m_topSpeed == 0)
+	{
+		up1 = 0;
+		
+		m_currentDistance = 0.0f;
+		gameOver = true;
+		
+		DisplayGameOver();
+	}
 
-//	modelViewMatrixStack.Push(); {
-		// Render the F1 CAR
-	//	modelViewMatrixStack.SetIdentity();
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(m_carPosition);
-	modelViewMatrixStack.Rotate(glm::vec3(0, 1, 0), theta);
-	modelViewMatrixStack.Scale(5.0f);
-	
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	// To turn off texture mapping and use the sphere colour only (currently white material), uncomment the next line
-	//pMainProgram->SetUniform("bUseTexture", false);
+	//display finsihed
+	if ((up1 == 0) && (gameOver == false)) 
+	{
+		
+		DisplayFinished();
+		m_currentDistance = 0.0f;
+		DisplayLap(2);
+	}
 
-	m_pCarMesh->Render();
-	modelViewMatrixStack.Pop();
+	m_pProfilerOverlay->Render(m_pPlatform->GetWidth(), m_pPlatform->GetHeight(), *m_pCamera->GetOrthographicProjectionMatrix());
+	m_pHudText->Render(*m_pCamera->GetOrthographicProjectionMatrix());
+}
 
+// Queue the static meshes in the geometry pool with their model matrices, once for all the views.  Levels of detail are
+// chosen from the main view, and the terrain's tiles for whichever view is nearest; the pool then culls every draw
+// against each view.
+void Game::QueueScene()
+{
+	PROFILE_ZONE("Queue scene");
+	const GeometryView *pViews = m_pViewLayout->GetViews();
+	int numViews = m_pViewLayout->GetNumViews();
+	const glm::mat4 &viewMatrix = pViews[0].viewMatrix;
+	const glm::mat4 &projectionMatrix = pViews[0].projectionMatrix;
+	// Levels are picked by projected size in the window's pixels, whatever the scene's resolution
+	int height = m_pPlatform->GetHeight() * m_pViewLayout->GetViewport(0).w / std::max(m_pDynamicResolution->GetHeight(), 1);
+
+	// The stack holds model matrices here; each view applies its own view matrix when it draws
+	glutil::MatrixStack &modelMatrixStack = *m_pModelViewMatrixStack;
+	modelMatrixStack.SetIdentity();
+	m_pStandMesh->ClearImpostors();
+	m_pBuildingMesh->ClearImpostors();
+	m_pTreeMesh->ClearImpostors();
+
+	// The terrain tiles around the cameras.  They are drawn with the pool's other meshes, lit like them so that the
+	// hills show.
+	m_pTerrain->Update(pViews, numViews);
+	m_pTerrain->Render();
+	m_pTrackside->Update(m_pCatmullRom);
+	m_pTrackside->Render(pViews, numViews);
+
+	// The F1 car is drawn by DrawScene, with its reflections, rather than from the pool
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(m_carPosition);
+	modelMatrixStack.Rotate(glm::vec3(0, 1, 0), theta);
+	modelMatrixStack.Scale(5.0f);
+	m_carModelMatrix = modelMatrixStack.Top();
+	modelMatrixStack.Pop();
+
+	// Stands, in two rows of four by the start and three at the far hairpin
+	for (int i = 0; i < 4; i++) {
+		modelMatrixStack.Push();
+		modelMatrixStack.Translate(glm::vec3(400.f - (i * 105), 0.0f, 500.0f));
+		modelMatrixStack.Scale(4.5f);
+		m_pStandMesh->Render(i, modelMatrixStack.Top(), viewMatrix, projectionMatrix, height);
+		modelMatrixStack.Pop();
+	}
+	for (int i = 0; i < 4; i++) {
+		modelMatrixStack.Push();
+		modelMatrixStack.Translate(glm::vec3(400.f - (i * 105), 0.0f, 700.0f));
+		modelMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 3.14f);
+		modelMatrixStack.Scale(4.5f);
+		m_pStandMesh->Render(4 + i, modelMatrixStack.Top(), viewMatrix, projectionMatrix, height);
+		modelMatrixStack.Pop();
+	}
+	glm::vec3 hairpinStands[3] = { glm::vec3(-780.f, 0.0f, -260.0f), glm::vec3(-618.f, 0.0f, -397.0f),
+		glm::vec3(-698.f, 0.0f, -329.0f) };
+	for (int i = 0; i < 3; i++) {
+		modelMatrixStack.Push();
+		modelMatrixStack.Translate(hairpinStands[i]);
+		modelMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 40 * M_PI / 180);
+		modelMatrixStack.Scale(4.5f);
+		m_pStandMesh->Render(8 + i, modelMatrixStack.Top(), viewMatrix, projectionMatrix, height);
+		modelMatrixStack.Pop();
+	}
 
-	
+	//buildings
+	for (int y = 0; y <= 4; y++) {
+		modelMatrixStack.Push();
+		modelMatrixStack.Translate(glm::vec3(550.f - (y * 300), 0.0f, 900.f));
+		modelMatrixStack.Rotate(glm::vec3(1.0f, 0.0f, 0.0f), -90 * M_PI / 180);
+		modelMatrixStack.Scale(0.09f);
+		m_pBuildingMesh->Render(y, modelMatrixStack.Top(), viewMatrix, projectionMatrix, height);
+		modelMatrixStack.Pop();
+	}
+	////Tree 1
+	for (int z = 0; z <= 6; z++) {
+		for (int x = 0; x <= 8 ; x++) {
+			modelMatrixStack.Push();
+			modelMatrixStack.Translate(glm::vec3(-550.f + (x * 65), 0.0f, 250.f - (z * 65)));
+			modelMatrixStack.Rotate(glm::vec3(1.0f, 0.0f, 0.0f), 270 * M_PI / 180);
+			modelMatrixStack.Scale(16.f);
+			m_pTreeMesh->Render(z * 9 + x, modelMatrixStack.Top(), viewMatrix, projectionMatrix, height);
+			modelMatrixStack.Pop();
+		}
+	}
+	modelMatrixStack.Push();
+	modelMatrixStack.Translate(glm::vec3(-550.f, 0.0f, 250.f));
+	modelMatrixStack.Rotate(glm::vec3(1.0f, 0.0f, 0.0f), 270 * M_PI / 180);
+	modelMatrixStack.Scale(16.f);
+	m_pTreeMesh->Render(63, modelMatrixStack.Top(), viewMatrix, projectionMatrix, height);
+	modelMatrixStack.Pop();
+
+	if (counter < 600)
+	{
+		modelMatrixStack.Push();
+		modelMatrixStack.Translate(200.f, 20.f, 610.f);
+		modelMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 180 * M_PI / 180);
+		modelMatrixStack.Scale(0.5f);
+		m_pStartMesh->QueueLevel(0, modelMatrixStack.Top());
+		modelMatrixStack.Pop();
+	}
 
-	//stand 1
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(400.f, 0.0f, 500.0f));
-	//modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 3.14f);
-	modelViewMatrixStack.Scale(4.5f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pStandMesh->Render();
-	modelViewMatrixStack.Pop();
+	//cones
+	glm::vec3 cones[6] = { m_cone1, m_cone2, m_cone3, m_cone4, m_cone5, m_cone6 };
+	for (int i = 0; i < 6; i++) {
+		modelMatrixStack.Push();
+		modelMatrixStack.Translate(cones[i]);
+		modelMatrixStack.Scale(1.2f);
+		m_pConeMesh->QueueLevel(0, modelMatrixStack.Top());
+		modelMatrixStack.Pop();
+	}
+}
 
-	//stand 2
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(295.f, 0.0f, 500.0f));
-	//modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 3.14f);
-	modelViewMatrixStack.Scale(4.5f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pStandMesh->Render();
-	modelViewMatrixStack.Pop();
+// Draw one view into its part of the scene's viewport
+void Game::RenderView(int view)
+{
+	PROFILE_GPU_ZONE("View");
+	const glm::ivec4 &viewport = m_pViewLayout->GetViewport(view);
+	glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
+	if (m_pViewLayout->IsInset(view)) {
+		// Over another view, so clear only the inset
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(viewport.x, viewport.y, viewport.z, viewport.w);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glDisable(GL_SCISSOR_TEST);
+	}
 
-	//stand 3
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(190.f, 0.0f, 500.0f));
-	//modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 3.14f);
-	modelViewMatrixStack.Scale(4.5f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pStandMesh->Render();
-	modelViewMatrixStack.Pop();
+	const GeometryView &geometryView = m_pViewLayout->GetViews()[view];
+	DrawScene(view, geometryView.viewMatrix, geometryView.projectionMatrix, viewport, m_pViewLayout->GetEyePosition(view),
+		true);
+}
 
-	//stand 4
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(85.f, 0.0f, 500.0f));
-	//modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 3.14f);
-	modelViewMatrixStack.Scale(4.5f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pStandMesh->Render();
-	modelViewMatrixStack.Pop();
+// The pool's draws were prepared for every camera in one pass and only their commands are issued here; the few objects
+// drawn directly are drawn again for each camera.  Reflection probes leave out the car, which would only reflect itself.
+void Game::DrawScene(int poolView, const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix,
+	const glm::ivec4 &viewport, const glm::vec3 &eyePosition, bool drawCar)
+{
+	glm::mat3 viewNormalMatrix = m_pCamera->ComputeNormalMatrix(viewMatrix);
 
-	//stand 5
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(400.f, 0.0f, 700.0f));
-	modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 3.14f);
-	modelViewMatrixStack.Scale(4.5f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pStandMesh->Render();
-	modelViewMatrixStack.Pop();
+	// Set up a matrix stack, starting from this view's camera
+	glutil::MatrixStack &modelViewMatrixStack = *m_pModelViewMatrixStack;
+	modelViewMatrixStack.SetIdentity();
+	modelViewMatrixStack.ApplyMatrix(viewMatrix);
 
-	//stand 6
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(295.f, 0.0f, 700.0f));
-	modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 3.14f);
-	modelViewMatrixStack.Scale(4.5f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pStandMesh->Render();
-	modelViewMatrixStack.Pop();
+	// Use the main shader program 
+	CShaderPermutations *pMainProgram = m_pMainShader;
+	pMainProgram->UseProgram(MAIN_SHADER_TEXTURE);
+	pMainProgram->SetUniform("sampler0", 0);
+	pMainProgram->SetUniform("sampler1", 1);
+	// Note: cubemap and non-cubemap textures should not be mixed in the same texture unit.  Setting unit 10 to be a cubemap texture.
+	int cubeMapTextureUnit = 10;
+	pMainProgram->SetUniform("CubeMapTex", cubeMapTextureUnit);
 
-	//stand 7
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(190.f, 0.0f, 700.0f));
-	modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 3.14f);
-	modelViewMatrixStack.Scale(4.5f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pStandMesh->Render();
-	modelViewMatrixStack.Pop();
+	// Set the projection matrix
+	pMainProgram->SetUniform("matrices.projMatrix", projectionMatrix);
 
-	//stand 8
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(85.f, 0.0f, 700.0f));
-	modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 3.14f);
-	modelViewMatrixStack.Scale(4.5f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pStandMesh->Render();
-	modelViewMatrixStack.Pop();
+	// Set light and materials in main shader program
+	glm::vec4 lightPosition1 = glm::vec4(-100, 100, -100, 1); // Position of light source *in world coordinates*
 
-	//stand 9
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(-780.f, 0.0f, -260.0f));
-	modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 40 * M_PI / 180);
-	modelViewMatrixStack.Scale(4.5f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pStandMesh->Render();
-	modelViewMatrixStack.Pop();
+	// The clusters are built in this view's own space and tiles
+	if (m_clusteredLighting) {
+		m_pTrackLights->Build(viewMatrix, projectionMatrix, viewport.z, viewport.w, viewport.x, viewport.y);
+		m_pTrackLights->Bind();
+	}
 
-	//stand 10
-	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(-618.f, 0.0f, -397.0f));
-	modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 40 * M_PI / 180);
-	modelViewMatrixStack.Scale(4.5f);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pStandMesh->Render();
-	modelViewMatrixStack.Pop();
+	pMainProgram->SetUniform("light1.position", viewMatrix*lightPosition1); // Position of light source *in eye coordinates*
+	pMainProgram->SetUniform("light1.La", glm::vec3(1.0f));		// Ambient colour of light
+	pMainProgram->SetUniform("light1.Ld", glm::vec3(1.0f));		// Diffuse colour of light
+	pMainProgram->SetUniform("light1.Ls", glm::vec3(0.0f));		// Specular colour of light
+	pMainProgram->SetUniform("material1.Ma", glm::vec3(1.0f));	// Ambient material reflectance
+	pMainProgram->SetUniform("material1.Md", glm::vec3(0.0f));	// Diffuse material reflectance
+	pMainProgram->SetUniform("material1.Ms", glm::vec3(0.0f));	// Specular material reflectance
+	pMainProgram->SetUniform("material1.shininess", 15.0f);		// Shininess material property
 
-	//stand 11
+	// Render the skybox with full ambient reflectance 
 	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(-698.f, 0.0f, -329.0f));
-	modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 40 * M_PI / 180);
-	modelViewMatrixStack.Scale(4.5f);
+	pMainProgram->UseProgram(MAIN_SHADER_TEXTURE | MAIN_SHADER_SKYBOX);
+	// Translate the modelview matrix to the camera eye point so skybox stays centred around camera
+	modelViewMatrixStack.Translate(eyePosition);
 	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
 	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pStandMesh->Render();
+	m_pSkybox->Render(cubeMapTextureUnit);
+	pMainProgram->UseProgram(MAIN_SHADER_TEXTURE);
 	modelViewMatrixStack.Pop();
 
-	////fence 1
-	for (int h = 0; h <= 50; h++) {
-		modelViewMatrixStack.Push();
-		modelViewMatrixStack.Translate(glm::vec3(250.f - (h * 20), 0.0f, 560.f));
-		//modelViewMatrixStack.Translate(glm::vec3(0.f, 5.0f, 1.f));
-		//modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 40 * M_PI / 180);
-		modelViewMatrixStack.Scale(0.05f);
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		m_pFenceMesh->Render();
-		modelViewMatrixStack.Pop();
-	}
-
-	// Render the wall 4
-	for (int h = 0; h <= 50; h++) {
-		modelViewMatrixStack.Push();
-		modelViewMatrixStack.Translate(glm::vec3(225.f - (h * 20), 0.0f, 560.f));
-		modelViewMatrixStack.Scale(5.0f);
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		// To turn off texture mapping and use the sphere colour only (currently white material), uncomment the next line
-		//pMainProgram->SetUniform("bUseTexture", false);
-		m_pCube->Render();
-		modelViewMatrixStack.Pop();
-	}
-
-	//fence 1 
-	for (int h = 0; h <= 50; h++) {
-		modelViewMatrixStack.Push();
-		modelViewMatrixStack.Translate(glm::vec3(500.f - (h * 20), 0.0f, 650.f));
-		//modelViewMatrixStack.Translate(glm::vec3(0.f, 5.0f, 1.f));
-		modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 180 * M_PI / 180);
-		modelViewMatrixStack.Scale(0.05f);
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		m_pFenceMesh->Render();
-		modelViewMatrixStack.Pop();
-	}
-
-	// Render the wall 4
-	//for (int h = 0; h <= 0; h++) {
-	//	modelViewMatrixStack.Push();
-	//	modelViewMatrixStack.Translate(glm::vec3(250.f - (h * 20), 0.0f, 650.f));
-	//	modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 180 * M_PI / 180);
-	//	modelViewMatrixStack.Scale(5.0f);
-	//	
-	//	pMainProgram->SetUniform("wallShift", true);
-	//	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	//	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	//	// To turn off texture mapping and use the sphere colour only (currently white material), uncomment the next line
-	//	//pMainProgram->SetUniform("bUseTexture", false);
-	//	m_pCube->Render();
-	//	modelViewMatrixStack.Pop();
-	//}
+	// Turn on diffuse + specular materials
+	pMainProgram->SetUniform("material1.Ma", glm::vec3(0.5f));	// Ambient material reflectance
+	pMainProgram->SetUniform("material1.Md", glm::vec3(0.5f));	// Diffuse material reflectance
+	pMainProgram->SetUniform("material1.Ms", glm::vec3(1.0f));	// Specular material reflectance	
 
 	//Render Wall
 	modelViewMatrixStack.Push();
@@ -537,47 +735,15 @@ void Game::Render()
 	modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 180 * M_PI / 180);
 	modelViewMatrixStack.Scale(5.0f);
 
-	pMainProgram->SetUniform("wallShift", true);
+	unsigned int normalFeature = m_packedNormals ? MAIN_SHADER_PACKED_NORMAL : 0;
+	pMainProgram->UseProgram(MAIN_SHADER_TEXTURE | MAIN_SHADER_WALL_SHIFT | normalFeature);
 	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
 	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
 	// To turn off texture mapping and use the sphere colour only (currently white material), uncomment the next line
-	//pMainProgram->SetUniform("bUseTexture", false);
-	m_pCube->Render();
-	pMainProgram->SetUniform("wallShift", false);
+	//pMainProgram->UseProgram(0);
+	m_pCube->Render(40);
+	pMainProgram->UseProgram(MAIN_SHADER_TEXTURE);
 	modelViewMatrixStack.Pop();
-		//buildings
-		for (int y = 0; y <= 4; y++) {
-			modelViewMatrixStack.Push();
-			modelViewMatrixStack.Translate(glm::vec3(550.f - (y * 300), 0.0f, 900.f));
-			//modelViewMatrixStack.Translate(glm::vec3(0.f, 5.0f, 1.f));
-			modelViewMatrixStack.Rotate(glm::vec3(1.0f, 0.0f, 0.0f), -90 * M_PI / 180);
-			modelViewMatrixStack.Scale(0.09f);
-			pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-			pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-			m_pBuildingMesh->Render();
-			modelViewMatrixStack.Pop();
-		}
-		////Tree 1
-		for (int z = 0; z <= 6; z++) {
-			for (int x = 0; x <= 8 ; x++) {
-				modelViewMatrixStack.Push();
-				modelViewMatrixStack.Translate(glm::vec3(-550.f + (x * 65), 0.0f, 250.f - (z * 65)));
-				modelViewMatrixStack.Rotate(glm::vec3(1.0f, 0.0f, 0.0f), 270 * M_PI / 180);
-				modelViewMatrixStack.Scale(16.f);
-				pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-				pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-				m_pTreeMesh->Render();
-				modelViewMatrixStack.Pop();
-			}
-		}
-			modelViewMatrixStack.Push();
-			modelViewMatrixStack.Translate(glm::vec3(-550.f, 0.0f, 250.f));
-			modelViewMatrixStack.Rotate(glm::vec3(1.0f, 0.0f, 0.0f), 270 * M_PI / 180);
-			modelViewMatrixStack.Scale(16.f);
-			pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-			pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-			m_pTreeMesh->Render();
-			modelViewMatrixStack.Pop();
 
 		//Repair 1
 		modelViewMatrixStack.Push();
@@ -588,19 +754,6 @@ void Game::Render()
 		m_pRepair->Render();
 		modelViewMatrixStack.Pop();
 
-		if (counter < 600)
-		{
-			modelViewMatrixStack.Push();
-			modelViewMatrixStack.Translate(200.f, 20.f, 610.f);
-			modelViewMatrixStack.Rotate(glm::vec3(0.0f, 1.0f, 0.0f), 180 * M_PI / 180);
-			modelViewMatrixStack.Scale(0.5f);
-			pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-			pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-			m_pStartMesh->Render();
-			modelViewMatrixStack.Pop();
-		}
-		
-
 		//trafficelight 2
 		modelViewMatrixStack.Push();
 		modelViewMatrixStack.Translate(m_repair2);
@@ -610,61 +763,49 @@ void Game::Render()
 		pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
 		m_pRepair->Render();
 		modelViewMatrixStack.Pop();
-		
-		//cone1
-		modelViewMatrixStack.Push();
-		modelViewMatrixStack.Translate(m_cone1);
-		modelViewMatrixStack.Scale(1.2f);
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		m_pConeMesh->Render();
-		modelViewMatrixStack.Pop();
-		//cone2
-		modelViewMatrixStack.Push();
-		modelViewMatrixStack.Translate(m_cone2);
-		modelViewMatrixStack.Scale(1.2f);
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		m_pConeMesh->Render();
-		modelViewMatrixStack.Pop();
-		//cone3
-		modelViewMatrixStack.Push();
-		modelViewMatrixStack.Translate(m_cone3);
-		modelViewMatrixStack.Scale(1.2f);
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		m_pConeMesh->Render();
-		modelViewMatrixStack.Pop();
-		//cone4
-		modelViewMatrixStack.Push();
-		modelViewMatrixStack.Translate(m_cone4);
-		modelViewMatrixStack.Scale(1.2f);
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		m_pConeMesh->Render();
-		modelViewMatrixStack.Pop();
-		//cone5
-		modelViewMatrixStack.Push();
-		modelViewMatrixStack.Translate(m_cone5);
-		modelViewMatrixStack.Scale(1.2f);
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		m_pConeMesh->Render();
-		modelViewMatrixStack.Pop();
-		//cone6
-		modelViewMatrixStack.Push();
-		modelViewMatrixStack.Translate(m_cone6);
-		modelViewMatrixStack.Scale(1.2f);
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-		pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-		m_pConeMesh->Render();
-		modelViewMatrixStack.Pop();
+
+		// This view's share of the meshes queued in the geometry pool, with one multi-draw per texture, or a draw per
+		// mesh with its own matrices if the shader cannot read the pool's
+		if (m_indirectDraws) {
+			pMainProgram->UseProgram(MAIN_SHADER_TEXTURE | MAIN_SHADER_INDIRECT);
+			m_pGeometryPool->Draw(poolView);
+		}
+		else {
+			pMainProgram->UseProgram(MAIN_SHADER_TEXTURE);
+			m_pGeometryPool->DrawDirect(poolView, pMainProgram);
+		}
+
+		// The car, reflecting the probe nearest it.  Its vertices are in the pool, but it is drawn on its own.
+		if (drawCar) {
+			if (m_probeReflections) {
+				int probeTextureUnit = 11;
+				pMainProgram->UseProgram(MAIN_SHADER_TEXTURE | MAIN_SHADER_REFLECT);
+				m_pReflectionProbes->Bind(m_carPosition, probeTextureUnit);
+				pMainProgram->SetUniform("probeCubeMap", probeTextureUnit);
+				pMainProgram->SetUniform("probeInverseViewMatrix", glm::transpose(glm::mat3(viewMatrix)));
+				pMainProgram->SetUniform("probeMipLevels", (float)m_pReflectionProbes->GetNumMipLevels());
+			}
+			modelViewMatrixStack.Push();
+			modelViewMatrixStack.ApplyMatrix(m_carModelMatrix);
+			pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
+			pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
+			m_pCarMesh->RenderLevel(0);
+			modelViewMatrixStack.Pop();
+		}
+
+		// Instances far enough away to be impostors, turned to face this view's camera
+		pMainProgram->UseProgram(MAIN_SHADER_TEXTURE);
+		m_pStandMesh->RenderImpostors(pMainProgram, viewMatrix);
+		m_pBuildingMesh->RenderImpostors(pMainProgram, viewMatrix);
+		m_pTreeMesh->RenderImpostors(pMainProgram, viewMatrix);
 
 		//Track
 		modelViewMatrixStack.Push();
-		pMainProgram->SetUniform("bUseTexture", true); // turn off texturing
-		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
+		pMainProgram->UseProgram(MAIN_SHADER_TEXTURE);
 		pMainProgram->SetUniform("matrices.normalMatrix",m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
+		// The track's positions are stored relative to its bounds
+		modelViewMatrixStack.ApplyMatrix(m_pCatmullRom->GetTrackDecodeMatrix());
+		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
 		// Render your object here
 		//m_pCatmullRom->RenderPath();
 		//m_pCatmullRom->RenderCentreline();
@@ -673,10 +814,11 @@ void Game::Render()
 		modelViewMatrixStack.Pop();
 
 		// Switch to the sphere program
-		/*CShaderProgram *pTerrainProgram = (*m_pShaderPrograms)[3];
+		/*CCachedProgram *pTerrainProgram = (*m_pShaderPrograms)[2];
 		pTerrainProgram->UseProgram();
 		pTerrainProgram->SetUniform("sampler0", 0);
-		pTerrainProgram->SetUniform("sampler1", 1);*/
+		pTerrainProgram->SetUniform("sampler1", 1);
+*/
 	//	// Render the planar terrain
 	//	modelViewMatrixStack.Push();
 	////	pMainProgram->SetUniform("bUseTerrain", true);
@@ -686,7 +828,7 @@ void Game::Render()
 	//	modelViewMatrixStack.Pop();
 
 		// Switch to the sphere program
-		CShaderProgram *pSphereProgram = (*m_pShaderPrograms)[2];
+		CCachedProgram *pSphereProgram = (*m_pShaderPrograms)[1];
 		pSphereProgram->UseProgram();
 
 		// sphere spotlights
@@ -723,7 +865,7 @@ void Game::Render()
 		
 		modelViewMatrixStack.Push();
 		modelViewMatrixStack.Translate(m_ball1);
-		pSphereProgram->SetUniform("matrices.projMatrix", m_pCamera->GetPerspectiveProjectionMatrix());
+		pSphereProgram->SetUniform("matrices.projMatrix", projectionMatrix);
 		pSphereProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
 		pSphereProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
 		m_pSphere->Render();
@@ -731,7 +873,7 @@ void Game::Render()
 
 		modelViewMatrixStack.Push();
 		modelViewMatrixStack.Translate(m_ball2);
-		pSphereProgram->SetUniform("matrices.projMatrix", m_pCamera->GetPerspectiveProjectionMatrix());
+		pSphereProgram->SetUniform("matrices.projMatrix", projectionMatrix);
 		pSphereProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
 		pSphereProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
 		m_pSphere->Render();
@@ -739,7 +881,7 @@ void Game::Render()
 
 		modelViewMatrixStack.Push();
 		modelViewMatrixStack.Translate(m_ball3);
-		pSphereProgram->SetUniform("matrices.projMatrix", m_pCamera->GetPerspectiveProjectionMatrix());
+		pSphereProgram->SetUniform("matrices.projMatrix", projectionMatrix);
 		pSphereProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
 		pSphereProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
 		m_pSphere->Render();
@@ -747,7 +889,7 @@ void Game::Render()
 
 		modelViewMatrixStack.Push();
 		modelViewMatrixStack.Translate(m_ball4);
-		pSphereProgram->SetUniform("matrices.projMatrix", m_pCamera->GetPerspectiveProjectionMatrix());
+		pSphereProgram->SetUniform("matrices.projMatrix", projectionMatrix);
 		pSphereProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
 		pSphereProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
 		m_pSphere->Render();
@@ -755,7 +897,7 @@ void Game::Render()
 
 		modelViewMatrixStack.Push();
 		modelViewMatrixStack.Translate(m_ball5);
-		pSphereProgram->SetUniform("matrices.projMatrix", m_pCamera->GetPerspectiveProjectionMatrix());
+		pSphereProgram->SetUniform("matrices.projMatrix", projectionMatrix);
 		pSphereProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
 		pSphereProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
 		m_pSphere->Render();
@@ -763,59 +905,13 @@ void Game::Render()
 
 		modelViewMatrixStack.Push();
 		modelViewMatrixStack.Translate(m_ball6);
-		pSphereProgram->SetUniform("matrices.projMatrix", m_pCamera->GetPerspectiveProjectionMatrix());
+		pSphereProgram->SetUniform("matrices.projMatrix", projectionMatrix);
 		pSphereProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
 		pSphereProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
 		m_pSphere->Render();
 		modelViewMatrixStack.Pop();
-	// Draw the 2D graphics after the 3D graphics
-	//DisplayFrameRate();
-
-	//display speed
-	DisplaySpeed();
-
-	//display damage
-	DisplayDamage();
-
-	//displaying lap count
-	if (m_lapCount == 3)
-	{
-		DisplayLap(2);
-		up1 = 0;
-
-	}
-	else
-	{
-		DisplayLap(m_lapCount);
-	}
-	
-	//display time
-	DisplayTime();
-
-	//display gameover
-	if (m_topSpeed == 0)
-	{
-		up1 = 0;
-		
-		m_currentDistance = 0.0f;
-		gameOver = true;
-		
-		DisplayGameOver();
-	}
-
-	//display finsihed
-	if ((up1 == 0) && (gameOver == false)) 
-	{
-		
-		DisplayFinished();
-		m_currentDistance = 0.0f;
-		DisplayLap(2);
-	}
-
-	// Swap buffers to show the rendered image
-	SwapBuffers(m_gameWindow.Hdc());
-
 }
+
 void Game::SideMovement()
 {
 	if (m_TrackPos == 0)
@@ -854,6 +950,7 @@ void Game::SideMovement()
 // Update method runs repeatedly with the Render method
 void Game::Update()
 {
+	PROFILE_ZONE("Update");
 	// Update the camera using the amount of time that has elapsed to avoid framerate dependent motion
 	m_pCamera->Update(m_dt);
 
@@ -948,12 +1045,27 @@ void Game::Update()
 		}
 		
 	}
-	else if (CameraView == 2)
+	// High above and behind the car, looking down the track past it
+	glm::vec3 overheadPos = p1 + (60.0f * B) - (40.0f * T) + (N * m_sideMovement);
+	glm::vec3 overheadViewPoint = p1 + (10.0f * T) + (N * m_sideMovement);
+	if (CameraView == 2)
 	{
-	/*	glm::vec3 cameraPos = thirdP + (8.0f * (B)) + (N * m_sideMovement);
-		glm::vec3 viewPoint = p1 + (100.0f * T);*/
-		
+		m_pCamera->Set(overheadPos, overheadViewPoint, glm::vec3(0, 1, 0));
 	}
+
+	// The other cameras of a split screen layout, without the shake:  the view the player has not chosen, the overhead
+	// view, and a rear view from just above the car for the mirror
+	glm::vec3 chasePos = firstP + (4.6f * (B)) + (N * m_sideMovement);
+	glm::vec3 chaseViewPoint = p1 + (20.0f * T) + (N * m_sideMovement);
+	glm::vec3 farPos = thirdP + (8.0f * (B)) + (N * m_sideMovement);
+	glm::vec3 farViewPoint = p1 + (100.0f * T) + (N * m_sideMovement);
+	if (CameraView == 0)
+		m_pViewLayout->SetCamera(VIEW_CAMERA_SECOND, farPos, farViewPoint, glm::vec3(0, 1, 0));
+	else
+		m_pViewLayout->SetCamera(VIEW_CAMERA_SECOND, chasePos, chaseViewPoint, glm::vec3(0, 1, 0));
+	m_pViewLayout->SetCamera(VIEW_CAMERA_OVERHEAD, overheadPos, overheadViewPoint, glm::vec3(0, 1, 0));
+	m_pViewLayout->SetCamera(VIEW_CAMERA_REAR, firstP + (3.5f * B) + (N * m_sideMovement),
+		p1 - (50.0f * T) + (N * m_sideMovement), glm::vec3(0, 1, 0));
 	//Car Orientation and Position
 	d = p2 - p1;
 	theta = atan2(d.x,d.z);
@@ -1078,10 +1190,7 @@ void Game::Update()
 void Game::DisplayFrameRate()
 {
 
-	CShaderProgram *fontProgram = (*m_pShaderPrograms)[1];
-
-	RECT dimensions = m_gameWindow.GetDimensions();
-	int height = dimensions.bottom - dimensions.top;
+	int height = m_pPlatform->GetHeight();
 
 	// Increase the elapsed time and frame counter
 	m_elapsedTime += m_dt;
@@ -1098,71 +1207,42 @@ void Game::DisplayFrameRate()
 		m_frameCount = 0;
 	}
 
-	//if (m_framesPerSecond > 0) {
-		// Use the font shader program and render the text
-		fontProgram->UseProgram();
-		glDisable(GL_DEPTH_TEST);
-		fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-		fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
-		fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-		m_pFtFont->Render(20, height - 30, 32, "FPS: %d", m_framesPerSecond);
-	//}
+	m_pHudText->SetPosition(m_hudFrameRate, 20, height - 30);
+	m_pHudText->SetValues(m_hudFrameRate, m_framesPerSecond);
+	m_pHudText->SetVisible(m_hudFrameRate, true);
 }
 
 void Game::DisplaySpeed()
 {
 
-	
-	CShaderProgram *fontProgram = (*m_pShaderPrograms)[1];
-
-	RECT dimensions = m_gameWindow.GetDimensions();
-	int height = dimensions.bottom - dimensions.top;
+	int height = m_pPlatform->GetHeight();
 
-	fontProgram->UseProgram();
-	glDisable(GL_DEPTH_TEST);
-	fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-	fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
-	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-	m_pFtFont->Render(20, height - (height - 30), 32, "SPEED: %d mph", m_speedometer);
+	m_pHudText->SetPosition(m_hudSpeed, 20, height - (height - 30));
+	m_pHudText->SetValues(m_hudSpeed, m_speedometer);
+	m_pHudText->SetVisible(m_hudSpeed, true);
 
 }
 
 void Game::DisplayDamage()
 {
 
-		CShaderProgram *fontProgram = (*m_pShaderPrograms)[1];
+	int height = m_pPlatform->GetHeight();
+	int width = m_pPlatform->GetWidth();
 
-	RECT dimensions = m_gameWindow.GetDimensions();
-	int height = dimensions.bottom - dimensions.top;
-	int width = dimensions.right;
+	m_pHudText->SetPosition(m_hudDamage, width - 150, height - (height - 30));
+	m_pHudText->SetValues(m_hudDamage, m_damage);
+	m_pHudText->SetVisible(m_hudDamage, true);
 
-
-	fontProgram->UseProgram();
-	glDisable(GL_DEPTH_TEST);
-	fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-	fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
-	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-	m_pFtFont->Render(width - 150, height - (height - 30), 32, "DAMAGE: x %d", m_damage);
-	
 }
 
 void Game::DisplayLap(int lap)
 {
 
+	int height = m_pPlatform->GetHeight();
 
-	CShaderProgram *fontProgram = (*m_pShaderPrograms)[1];
-
-	RECT dimensions = m_gameWindow.GetDimensions();
-	int height = dimensions.bottom - dimensions.top;
-	int width = dimensions.right;
-
-	
-	fontProgram->UseProgram();
-	glDisable(GL_DEPTH_TEST);
-	fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-	fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
-	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-	m_pFtFont->Render(20, height - 30, 32, "LAP: %d / 2", lap);
+	m_pHudText->SetPosition(m_hudLap, 20, height - 30);
+	m_pHudText->SetValues(m_hudLap, lap);
+	m_pHudText->SetVisible(m_hudLap, true);
 
 }
 
@@ -1171,55 +1251,62 @@ void Game::DisplayLap(int lap)
 void Game::DisplayTime()
 {
 
+	int height = m_pPlatform->GetHeight();
 
-	CShaderProgram *fontProgram = (*m_pShaderPrograms)[1];
-
-	RECT dimensions = m_gameWindow.GetDimensions();
-	int height = dimensions.bottom - dimensions.top;
-
-	fontProgram->UseProgram();
-	glDisable(GL_DEPTH_TEST);
-	fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-	fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
-	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-	m_pFtFont->Render(20, height - (height - 80), 32, "TIME: %d:%d:%d", hr,min,sec);
+	m_pHudText->SetPosition(m_hudTime, 20, height - (height - 80));
+	m_pHudText->SetValues(m_hudTime, hr, min, sec);
+	m_pHudText->SetVisible(m_hudTime, true);
 
 }
 
 void Game::DisplayGameOver()
 {
 
+	int height = m_pPlatform->GetHeight();
 
-	CShaderProgram *fontProgram = (*m_pShaderPrograms)[1];
-
-	RECT dimensions = m_gameWindow.GetDimensions();
-	int height = dimensions.bottom - dimensions.top;
-
-	fontProgram->UseProgram();
-	glDisable(GL_DEPTH_TEST);
-	fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-	fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
-	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-	m_pFtFont->Render(290, height - (height - 300), 64, "GAME OVER");
+	m_pHudText->SetPosition(m_hudGameOver, 290, height - (height - 300));
+	m_pHudText->SetVisible(m_hudGameOver, true);
 
 }
 
 void Game::DisplayFinished()
 {
 
+	int height = m_pPlatform->GetHeight();
 
-	CShaderProgram *fontProgram = (*m_pShaderPrograms)[1];
+	m_pHudText->SetPosition(m_hudFinished, 290, height - (height - 300));
+	m_pHudText->SetVisible(m_hudFinished, true);
 
-	RECT dimensions = m_gameWindow.GetDimensions();
-	int height = dimensions.bottom - dimensions.top;
+}
+
+// Upload assets that finished loading on the workers, a few milliseconds' worth per frame
+void Game::UpdateLoading()
+{
+	// Uploads may render (mesh impostors), so they wait for the shaders
+	if (m_loadingReported || !m_pShaderCache->IsFinished())
+		return;
+
+	PROFILE_ZONE("Upload assets");
+	m_pAssetLoader->ProcessUploads(4.0);
+
+	if (m_pAssetLoader->IsFinished()) {
+		// Startup time depends mostly on whether the meshes came from the cache, so report the two cases separately
+		CMeshCache::Report();
+		CResourceManager::Report();
+		LogMessage("Fully loaded (%s) after %.1f ms", CMeshCache::IsWarmStart() ? "warm" : "cold", m_pLoadingTimer->Elapsed());
+		m_loadingReported = true;
+	}
+}
+
+void Game::DisplayLoading()
+{
+	int height = m_pPlatform->GetHeight();
 
-	fontProgram->UseProgram();
-	glDisable(GL_DEPTH_TEST);
-	fontProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
-	fontProgram->SetUniform("matrices.projMatrix", m_pCamera->GetOrthographicProjectionMatrix());
-	fontProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-	m_pFtFont->Render(290, height - (height - 300), 64, "FINISHED");
+	int percent = 100 * m_pAssetLoader->GetNumFinished() / std::max(1, m_pAssetLoader->GetNumQueued());
 
+	m_pHudText->SetPosition(m_hudLoading, 20, height - (height - 130));
+	m_pHudText->SetValues(m_hudLoading, percent);
+	m_pHudText->SetVisible(m_hudLoading, true);
 }
 
 // The game loop runs repeatedly until game over
@@ -1236,147 +1323,201 @@ void Game::GameLoop()
 	*/
 
 
-	// Variable timer
+	// Variable timer, from the start of one frame to the start of the next, so that it includes the frame pacer's wait
+	m_dt = m_pHighResolutionTimer->Elapsed();
 	m_pHighResolutionTimer->Start();
+	m_pFramePacer->BeginFrame();
+	CFrameArena::Reset();
+	CProfiler::BeginFrame();
+	UpdateLoading();
+
+	// Once loaded, a benchmark puts the car where its script says at a fixed time step, so every run draws the same frames
+	bool benchmarking = m_pBenchmark && m_loadingReported;
+	if (benchmarking) {
+		m_dt = 1000.0 / FPS;
+		m_speedometer = 0;
+		CameraView = m_pBenchmark->GetCameraView();
+		m_currentDistance = m_pBenchmark->GetDistance();
+		m_pBenchmark->BeginFrame();
+	}
+
 	Update();
 	Render();
-	m_dt = m_pHighResolutionTimer->Elapsed();
+	m_pFrameCapture->Capture(m_pPlatform->GetWidth(), m_pPlatform->GetHeight());
+
+	// Swap buffers to show the rendered image
+	m_pFramePacer->Present(m_pPlatform);
+	CResourceManager::Update();
+	CProfiler::EndFrame();
+
+	if (benchmarking) {
+		m_pBenchmark->EndFrame(m_pTerrain->GetNumPagedTiles() > 0, m_pFramePacer->GetFrameLatencyMilliseconds());
+		if (m_pBenchmark->IsFinished()) {
+			int exitCode = m_pBenchmark->Finish();
+			m_pBenchmark->Release();
+			m_pPlatform->Quit(exitCode);
+		}
+	}
 
 
 }
 
 
-WPARAM Game::Execute()
+int Game::Execute(int argc, char **argv)
 {
-	m_pHighResolutionTimer = new CHighResolutionTimer;
-	m_gameWindow.Init(m_hInstance);
+	BenchmarkOptions benchmarkOptions;
+	if (CBenchmark::ParseCommandLine(argc, argv, benchmarkOptions))
+		m_pBenchmark = new CBenchmark;
 
-	if (!m_gameWindow.Hdc()) {
+	m_pHighResolutionTimer = new CHighResolutionTimer;
+	m_pPlatform = CreatePlatform();
+	int width = m_pBenchmark ? benchmarkOptions.width : DEFAULT_WIDTH;
+	int height = m_pBenchmark ? benchmarkOptions.height : DEFAULT_HEIGHT;
+	if (!m_pPlatform->Create(this, width, height)) {
 		return 1;
 	}
+	CProfiler::SetThreadName("Main");
+	CProfiler::Create();
+	CFrameArena::Create();
 
 	Initialise();
+	if (m_pBenchmark) {
+		ViewLayoutMode layout;
+		if (CViewLayout::ParseMode(benchmarkOptions.layout, layout))
+			m_pViewLayout->SetMode(layout);
+		else
+			LogMessage("Unknown view layout %s", benchmarkOptions.layout.c_str());
+		m_pBenchmark->Create(benchmarkOptions, m_pCatmullRom->GetLength());
+	}
 
+	m_pFramePacer = new CFramePacer;
+	m_pFramePacer->Create();
 	m_pHighResolutionTimer->Start();
 
 
-	MSG msg;
-
-	while (1) {
-		if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
-			if (msg.message == WM_QUIT) {
-				break;
-			}
-
-			TranslateMessage(&msg);
-			DispatchMessage(&msg);
+	while (m_pPlatform->PumpEvents()) {
+		if (m_pBenchmark) {
+			// Flat out, whether or not the window has focus
+			GameLoop();
 		}
 		else if (m_appActive) {
-			GameLoop();
+			// Sleep until the frame has to start, waking early for messages so that input is handled promptly
+			if (m_pFramePacer->Wait())
+				GameLoop();
 		}
-		else Sleep(200); // Do not consume processor power if application isn't active
+		else m_pPlatform->WaitEvents(); // Do not consume processor power if application isn't active
 	}
 
-	m_gameWindow.Deinit();
+	// Finish writing any recording, and free every GL object, while the context is still there
+	m_pFrameCapture->Release();
+	Release();
+	CProfiler::Release();
+	CFrameArena::Release();
+	m_pPlatform->Destroy();
 
-	return(msg.wParam);
+	return m_pPlatform->GetExitCode();
 }
 
-LRESULT Game::ProcessEvents(HWND window, UINT message, WPARAM w_param, LPARAM l_param)
+void Game::OnActivate(bool active)
 {
-	LRESULT result = 0;
+	m_appActive = active;
+	if (active)
+		m_pHighResolutionTimer->Start();
+}
 
-	switch (message) {
+void Game::OnResize(int width, int height)
+{
+	if (m_pDynamicResolution)
+		m_pDynamicResolution->Resize(width, height);
+}
 
+// Named for the time, so that captures from different runs do not overwrite each other
+static string GetCaptureFilename(const char *pPrefix, const char *pExtension)
+{
+	time_t now = time(NULL);
+	char timestamp[32], filename[64];
+	strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", localtime(&now));
+	snprintf(filename, sizeof(filename), "%s_%s.%s", pPrefix, timestamp, pExtension);
+	return filename;
+}
 
-	case WM_ACTIVATE:
-	{
-		switch (LOWORD(w_param))
+void Game::OnKeyDown(int key)
+{
+	switch (key) {
+	case PLATFORM_KEY_ESCAPE:
+		m_pPlatform->Quit(0);
+		break;
+	case 'W':
+		//moving forward
+		if (m_speedometer < m_topSpeed)
 		{
-		case WA_ACTIVE:
-		case WA_CLICKACTIVE:
-			m_appActive = true;
-			m_pHighResolutionTimer->Start();
-			break;
-		case WA_INACTIVE:
-			m_appActive = false;
-			break;
+			m_speedometer += 50;
 		}
-		break;
-	}
 
-	case WM_SIZE:
-		RECT dimensions;
-		GetClientRect(window, &dimensions);
-		m_gameWindow.SetDimensions(dimensions);
+
 		break;
+	case 'S':
+		//moving backwards
+		if (m_speedometer > 0)
+		{
+			m_speedometer -= 50;
+		}
 
-	case WM_PAINT:
-		PAINTSTRUCT ps;
-		BeginPaint(window, &ps);
-		EndPaint(window, &ps);
 		break;
+	case 'A':
+		if (m_TrackPos != 0)
+		{
+			m_TrackPos--;
+		}
 
-	case WM_KEYDOWN:
-		switch (w_param) {
-		case VK_ESCAPE:
-			PostQuitMessage(0);
-			break;
-		case 'W':
-			//moving forward
-			if (m_speedometer < m_topSpeed)
-			{
-				m_speedometer += 50;
-			}
-			
-	
-			break;
-		case 'S':
-			//moving backwards
-			if (m_speedometer > 0)
-			{
-				m_speedometer -= 50;
-			}
-		
-			break;
-		case 'A':
-			if (m_TrackPos != 0)
-			{
-				m_TrackPos--;
-			}
-			
-			break;
-		case 'D':
-			if (m_TrackPos != 2)
-			{
-				m_TrackPos++;
-			}
-			break;
-		case VK_F1:
-		
-			CameraView = 0;
-			break;
-		case VK_F2:
-	
-			CameraView = 1;
-			break;
-		case VK_F3:
-		
-			CameraView = 2;
-			break;
+		break;
+	case 'D':
+		if (m_TrackPos != 2)
+		{
+			m_TrackPos++;
 		}
 		break;
+	case PLATFORM_KEY_F1:
 
-	case WM_DESTROY:
-		PostQuitMessage(0);
+		CameraView = 0;
 		break;
+	case PLATFORM_KEY_F2:
 
-	default:
-		result = DefWindowProc(window, message, w_param, l_param);
+		CameraView = 1;
 		break;
-	}
+	case PLATFORM_KEY_F3:
 
-	return result;
+		CameraView = 2;
+		break;
+	case PLATFORM_KEY_F4:
+		// The profiler only records while its overlay is up, or a trace would cost every frame for nothing
+		CProfiler::SetEnabled(!CProfiler::IsEnabled());
+		m_pProfilerOverlay->SetVisible(CProfiler::IsEnabled());
+		break;
+	case PLATFORM_KEY_F5:
+		CProfiler::WriteChromeTrace("profile.json");
+		break;
+	case PLATFORM_KEY_F6:
+		CResourceManager::Report();
+		break;
+	case PLATFORM_KEY_F7:
+		m_pFrameCapture->Screenshot(GetCaptureFilename("screenshot", "png"));
+		break;
+	case PLATFORM_KEY_F9:
+		// Single view, two or four way split screen, or the main view with a rear view mirror
+		m_pViewLayout->NextMode();
+		LogMessage("View layout: %s", m_pViewLayout->GetModeName());
+		break;
+	case PLATFORM_KEY_F8:
+		if (m_pFrameCapture->IsRecording()) {
+			m_pFrameCapture->StopRecording();
+			LogMessage("Recording stopped, %d frames dropped", m_pFrameCapture->GetNumDroppedFrames());
+		}
+		else
+			m_pFrameCapture->StartRecording(GetCaptureFilename("recording", "y4m"),
+				(int)(1000.0 / m_pFramePacer->GetRefreshMilliseconds() + 0.5));
+		break;
+	}
 }
 
 Game& Game::GetInstance()
@@ -1386,19 +1527,18 @@ Game& Game::GetInstance()
 	return instance;
 }
 
-void Game::SetHinstance(HINSTANCE hinstance)
-{
-	m_hInstance = hinstance;
-}
+#ifdef _WIN32
+int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE, PSTR, int){
+	Game &game = Game::GetInstance();
 
-LRESULT CALLBACK WinProc(HWND window, UINT message, WPARAM w_param, LPARAM l_param)
-{
-	return Game::GetInstance().ProcessEvents(window, message, w_param, l_param);
+	return game.Execute(__argc, __argv);
 }
-
-int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE, PSTR, int){
+#else
+// Headless, rendering offscreen until killed, or until a benchmark finishes
+int main(int argc, char **argv)
+{
 	Game &game = Game::GetInstance();
-	game.SetHinstance(hinstance);
 
-	return game.Execute();
+	return game.Execute(argc, argv);
 }
+#endif
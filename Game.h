@@ -1,55 +1,113 @@
 #pragma once
 
 #include "Common.h"
-#include "GameWindow.h"
+#include "Platform.h"
 
 // Classes used in game.  For a new class, declare it here and provide a pointer to an object of this class below.  Then, in Game.cpp, 
 // include the header.  In the Game constructor, set the pointer to NULL and in Game::Initialise, create a new object.  Don't forget to 
 // delete the object in the destructor.   
 class CCamera;
 class CSkybox;
-class CShader;
-class CShaderProgram;
-class CPlane;
-class CFreeTypeFont;
+class CCachedProgram;
+class CShaderCache;
+class CShaderPermutations;
+class CClusteredLights;
+class CGeometryPool;
+class CTrackGenerator;
+class CTerrain;
+class CTrackside;
+class CDynamicResolution;
+class CHudText;
+class CProfilerOverlay;
+class CFrameCapture;
+class CViewLayout;
+class CReflectionProbes;
 class CHighResolutionTimer;
+class CFramePacer;
+class CBenchmark;
 class CSphere;
 class COpenAssetImportMesh;
 class CAudio;
 class CCatmullRom;
 class CCube;
+class CPrimitiveLibrary;
 class CTriangle;
+class CLodMesh;
+class CJobSystem;
+class CAssetLoader;
+namespace glutil { class MatrixStack; }
 
-class Game {
+class Game : public CPlatformListener {
 private:
 	// Three main methods used in the game.  Initialise runs once, while Update and Render run repeatedly in the game loop.
 	void Initialise();
 	void Update();
 	void Render();
+	void Release();
+	// Render draws the scene once for each view of the layout, from what QueueScene queues once for all of them
+	void QueueScene();
+	void RenderView(int view);
+	// Draw the scene from one camera into the bound framebuffer.  poolView is the camera's view in the geometry pool.
+	void DrawScene(int poolView, const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix, const glm::ivec4 &viewport,
+		const glm::vec3 &eyePosition, bool drawCar);
 
 	// Pointers to game objects.  They will get allocated in Game::Initialise()
 	CSkybox *m_pSkybox;
 	CCamera *m_pCamera;
 	CCatmullRom *m_pLap;
-	vector <CShaderProgram *> *m_pShaderPrograms;
-	CPlane *m_pPlanarTerrain;
-	CFreeTypeFont *m_pFtFont;
+	vector <CCachedProgram *> *m_pShaderPrograms;
+	CShaderCache *m_pShaderCache;
+	CShaderPermutations *m_pMainShader;
+	CClusteredLights *m_pTrackLights;
+	CGeometryPool *m_pGeometryPool;
+	CTrackGenerator *m_pTrackGenerator;
+	int m_startLights[3];
+	CTerrain *m_pTerrain;
+	CTrackside *m_pTrackside;
+	CDynamicResolution *m_pDynamicResolution;
+	CHudText *m_pHudText;
+	glutil::MatrixStack *m_pModelViewMatrixStack;	// Kept between frames, so that pushing reuses its storage
+	CProfilerOverlay *m_pProfilerOverlay;
+	CFrameCapture *m_pFrameCapture;
+	CViewLayout *m_pViewLayout;
+	CReflectionProbes *m_pReflectionProbes;
 	COpenAssetImportMesh *m_pBarrelMesh;
 	COpenAssetImportMesh *m_pHorseMesh;
 	CSphere *m_pSphere;
 	CHighResolutionTimer *m_pHighResolutionTimer;
+	CFramePacer *m_pFramePacer;
+	CBenchmark *m_pBenchmark;
 	CAudio *m_pAudio;
 	CCatmullRom *m_pCatmullRom;
 	COpenAssetImportMesh *m_pFighterMesh;
 	CCube *m_pCube;
+	CPrimitiveLibrary *m_pPrimitives;
 	CTriangle *m_pRepair;
-	COpenAssetImportMesh *m_pCarMesh;
-	COpenAssetImportMesh *m_pStandMesh;
-	COpenAssetImportMesh *m_pFenceMesh;
-	COpenAssetImportMesh *m_pTreeMesh;
-	COpenAssetImportMesh *m_pConeMesh;
-	COpenAssetImportMesh *m_pBuildingMesh;
-	COpenAssetImportMesh *m_pStartMesh;
+	CLodMesh *m_pCarMesh;
+	CLodMesh *m_pStandMesh;
+	CLodMesh *m_pTreeMesh;
+	CLodMesh *m_pConeMesh;
+	CLodMesh *m_pBuildingMesh;
+	CLodMesh *m_pStartMesh;
+	CJobSystem *m_pJobSystem;
+	CAssetLoader *m_pAssetLoader;
+	CHighResolutionTimer *m_pLoadingTimer;
+	bool m_loadingReported;
+	bool m_mainShaderChecked;			// Once its permutations are ready, for the optional parts it includes
+	bool m_clusteredLighting;
+	bool m_probeReflections;
+	bool m_indirectDraws;				// Otherwise the pooled meshes are drawn one by one
+	bool m_packedNormals;				// Otherwise the primitive library stores its normals unpacked
+
+	// HUD strings, all drawn in one batch by m_pHudText
+	int m_hudFrameRate;
+	int m_hudSpeed;
+	int m_hudDamage;
+	int m_hudLap;
+	int m_hudTime;
+	int m_hudLoading;
+	int m_hudGameOver;
+	int m_hudFinished;
 	
 	// Some other member variables
 	double m_dt;
@@ -75,6 +133,7 @@ private:
 	glm::vec3 m_cone5 = glm::vec3(915.f, 1.f, 335.f);
 	glm::vec3 m_cone6 = glm::vec3(945.f, 1.f, 335.f);
 	glm::mat4 m_carOrientation;
+	glm::mat4 m_carModelMatrix;			// Set by QueueScene
 	float m_currentDistance;
 	float theta;
 	void SideMovement();
@@ -112,12 +171,18 @@ public:
 	Game();
 	~Game();
 	static Game& GetInstance();
-	LRESULT ProcessEvents(HWND window,UINT message, WPARAM w_param, LPARAM l_param);
-	void SetHinstance(HINSTANCE hinstance);
-	WPARAM Execute();
+	// The command line may ask for a benchmark run (see CBenchmark)
+	int Execute(int argc, char **argv);
+
+	// Window events, from CPlatform::PumpEvents
+	void OnActivate(bool active);
+	void OnResize(int width, int height);
+	void OnKeyDown(int key);
 
 private:
 	static const int FPS = 60;
+	static const int DEFAULT_WIDTH = 1280;		// For the headless backend; a window sizes itself
+	static const int DEFAULT_HEIGHT = 720;
 	void DisplayFrameRate();
 	void DisplaySpeed();
 	void DisplayDamage();
@@ -125,9 +190,10 @@ private:
 	void DisplayFinished();
 	void DisplayTime();
 	void DisplayGameOver();
+	void DisplayLoading();
+	void UpdateLoading();
 	void GameLoop();
-	GameWindow m_gameWindow;
-	HINSTANCE m_hInstance;
+	CPlatform *m_pPlatform;
 	int m_frameCount;
 	double m_elapsedTime;
 
@@ -0,0 +1,514 @@
+#include "GeometryPool.h"
+#include "CompiledTexture.h"
+#include "JobSystem.h"
+#include "RenderStats.h"
+#include "ShaderPermutations.h"
+#include "Profiler.h"
+#include <algorithm>
+
+void ExtractFrustumPlanes(const GeometryView &view, glm::vec4 planes[6])
+{
+	glm::mat4 viewProjectionMatrix = view.projectionMatrix * view.viewMatrix;
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(viewProjectionMatrix[0][i], viewProjectionMatrix[1][i], viewProjectionMatrix[2][i],
+			viewProjectionMatrix[3][i]);
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[3] + rows[2];
+	planes[5] = rows[3] - rows[2];
+	for (int i = 0; i < 6; i++)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+// The box is outside if its corner furthest along a plane's normal is behind the plane
+bool IsBoxVisible(const glm::vec4 planes[6], const glm::vec3 &minimum, const glm::vec3 &maximum)
+{
+	for (int i = 0; i < 6; i++) {
+		glm::vec3 p(planes[i].x >= 0.0f ? maximum.x : minimum.x, planes[i].y >= 0.0f ? maximum.y : minimum.y,
+			planes[i].z >= 0.0f ? maximum.z : minimum.z);
+		if (glm::dot(glm::vec3(planes[i]), p) + planes[i].w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+bool IsSphereVisible(const glm::vec4 planes[6], const glm::vec3 &centre, float radius)
+{
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(planes[i]), centre) + planes[i].w < -radius)
+			return false;
+	}
+	return true;
+}
+
+CGeometryPool::CGeometryPool()
+{
+	m_vao = 0;
+	m_vbo = 0;
+	m_ibo = 0;
+	m_drawIndexBuffer = 0;
+	m_indirectBuffer = 0;
+	m_drawDataBuffer = 0;
+	m_viewBuffer = 0;
+	m_viewStride = 0;
+	m_vertexCapacity = 0;
+	m_indexCapacity = 0;
+	m_maxDraws = 0;
+	m_pJobSystem = NULL;
+	m_direct = false;
+	m_numDraws = 0;
+	m_numBatches = 0;
+	m_numCulled = 0;
+	m_numViews = 0;
+}
+
+CGeometryPool::~CGeometryPool()
+{
+	Release();
+}
+
+void CGeometryPool::Create(unsigned int numVertices, unsigned int numIndices, unsigned int maxDraws)
+{
+	Release();
+	m_vertexCapacity = numVertices;
+	m_indexCapacity = numIndices;
+	m_maxDraws = maxDraws;
+
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(MeshVertex), NULL, GL_STATIC_DRAW);
+	glGenBuffers(1, &m_ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+
+	vector<unsigned int> drawIndices(maxDraws);
+	for (unsigned int i = 0; i < maxDraws; i++)
+		drawIndices[i] = i;
+	glGenBuffers(1, &m_drawIndexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_drawIndexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, maxDraws * sizeof(unsigned int), &drawIndices[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_indirectBuffer);
+	glGenBuffers(1, &m_drawDataBuffer);
+
+	// Each view's data is bound as a range, which must start on the alignment
+	GLint alignment = 1;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	m_viewStride = ((GLint)sizeof(ViewData) + alignment - 1) / alignment * alignment;
+	glGenBuffers(1, &m_viewBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_viewBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, GEOMETRY_MAX_VIEWS * m_viewStride, NULL, GL_STREAM_DRAW);
+	glGenVertexArrays(1, &m_vao);
+	SetupVertexArray();
+
+	Block vertices = { 0, numVertices };
+	Block indices = { 0, numIndices };
+	m_freeVertices.push_back(vertices);
+	m_freeIndices.push_back(indices);
+}
+
+void CGeometryPool::SetupVertexArray()
+{
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+
+	GLsizei stride = sizeof(MeshVertex);
+	// Vertex positions
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+	// Texture coordinates
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
+	// Normal vectors
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3) + sizeof(glm::vec2)));
+	// Draw index, one per instance
+	glBindBuffer(GL_ARRAY_BUFFER, m_drawIndexBuffer);
+	glEnableVertexAttribArray(GEOMETRY_DRAW_INDEX_ATTRIBUTE);
+	glVertexAttribIPointer(GEOMETRY_DRAW_INDEX_ATTRIBUTE, 1, GL_UNSIGNED_INT, 0, 0);
+	glVertexAttribDivisor(GEOMETRY_DRAW_INDEX_ATTRIBUTE, 1);
+
+	glBindVertexArray(0);
+}
+
+void CGeometryPool::SetJobSystem(CJobSystem *pJobSystem)
+{
+	m_pJobSystem = pJobSystem;
+}
+
+void CGeometryPool::SetDirectDraws(bool direct)
+{
+	m_direct = direct;
+}
+
+// Reallocate the draw index buffer with room for more draws.  The VAO refers to the buffer by name, so it needs no change.
+void CGeometryPool::GrowDrawIndices(unsigned int minDraws)
+{
+	m_maxDraws = std::max(2 * m_maxDraws, minDraws);
+	vector<unsigned int> drawIndices(m_maxDraws);
+	for (unsigned int i = 0; i < m_maxDraws; i++)
+		drawIndices[i] = i;
+	glBindBuffer(GL_ARRAY_BUFFER, m_drawIndexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, m_maxDraws * sizeof(unsigned int), &drawIndices[0], GL_STATIC_DRAW);
+}
+
+void CGeometryPool::Release()
+{
+	if (m_vao) glDeleteVertexArrays(1, &m_vao);
+	if (m_vbo) glDeleteBuffers(1, &m_vbo);
+	if (m_ibo) glDeleteBuffers(1, &m_ibo);
+	if (m_drawIndexBuffer) glDeleteBuffers(1, &m_drawIndexBuffer);
+	if (m_indirectBuffer) glDeleteBuffers(1, &m_indirectBuffer);
+	if (m_drawDataBuffer) glDeleteBuffers(1, &m_drawDataBuffer);
+	if (m_viewBuffer) glDeleteBuffers(1, &m_viewBuffer);
+	m_vao = m_vbo = m_ibo = m_drawIndexBuffer = m_indirectBuffer = m_drawDataBuffer = m_viewBuffer = 0;
+	m_freeVertices.clear();
+	m_freeIndices.clear();
+	m_queue.clear();
+	m_numViews = 0;
+}
+
+// First fit from a list of free blocks sorted by start
+bool CGeometryPool::AllocateBlock(vector<Block> &freeBlocks, unsigned int size, unsigned int &start)
+{
+	for (unsigned int i = 0; i < freeBlocks.size(); i++) {
+		if (freeBlocks[i].size < size)
+			continue;
+		start = freeBlocks[i].start;
+		freeBlocks[i].start += size;
+		freeBlocks[i].size -= size;
+		if (freeBlocks[i].size == 0)
+			freeBlocks.erase(freeBlocks.begin() + i);
+		return true;
+	}
+	return false;
+}
+
+// Return a block to the list, merging it with its neighbours
+void CGeometryPool::FreeBlock(vector<Block> &freeBlocks, unsigned int start, unsigned int size)
+{
+	if (size == 0)
+		return;
+
+	unsigned int i = 0;
+	while (i < freeBlocks.size() && freeBlocks[i].start < start)
+		i++;
+	Block block = { start, size };
+	freeBlocks.insert(freeBlocks.begin() + i, block);
+
+	if (i + 1 < freeBlocks.size() && freeBlocks[i].start + freeBlocks[i].size == freeBlocks[i + 1].start) {
+		freeBlocks[i].size += freeBlocks[i + 1].size;
+		freeBlocks.erase(freeBlocks.begin() + i + 1);
+	}
+	if (i > 0 && freeBlocks[i - 1].start + freeBlocks[i - 1].size == freeBlocks[i].start) {
+		freeBlocks[i - 1].size += freeBlocks[i].size;
+		freeBlocks.erase(freeBlocks.begin() + i);
+	}
+}
+
+// Copy a buffer into a larger one, and free the new space
+void CGeometryPool::Grow(GLuint &buffer, unsigned int elementSize, unsigned int &capacity,
+	unsigned int minCapacity, vector<Block> &freeBlocks)
+{
+	unsigned int newCapacity = std::max(2 * capacity, minCapacity);
+	GLuint newBuffer;
+	glGenBuffers(1, &newBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)newCapacity * elementSize, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)capacity * elementSize);
+	glDeleteBuffers(1, &buffer);
+
+	FreeBlock(freeBlocks, capacity, newCapacity - capacity);
+	buffer = newBuffer;
+	capacity = newCapacity;
+	SetupVertexArray();
+}
+
+GeometryRange CGeometryPool::Allocate(const MeshVertex *pVertices, unsigned int numVertices, const unsigned int *pIndices,
+	unsigned int numIndices)
+{
+	GeometryRange range;
+	range.numVertices = numVertices;
+	range.numIndices = numIndices;
+
+	// The free space at the end may be too small on its own, so grow to fit the whole mesh
+	while (!AllocateBlock(m_freeVertices, numVertices, range.firstVertex))
+		Grow(m_vbo, sizeof(MeshVertex), m_vertexCapacity, m_vertexCapacity + numVertices, m_freeVertices);
+	range.firstIndex = 0;
+	while (numIndices > 0 && !AllocateBlock(m_freeIndices, numIndices, range.firstIndex))
+		Grow(m_ibo, sizeof(unsigned int), m_indexCapacity, m_indexCapacity + numIndices, m_freeIndices);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, range.firstVertex * sizeof(MeshVertex), numVertices * sizeof(MeshVertex), pVertices);
+	if (numIndices > 0) {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, range.firstIndex * sizeof(unsigned int), numIndices * sizeof(unsigned int), pIndices);
+	}
+	return range;
+}
+
+void CGeometryPool::Free(const GeometryRange &range)
+{
+	FreeBlock(m_freeVertices, range.firstVertex, range.numVertices);
+	FreeBlock(m_freeIndices, range.firstIndex, range.numIndices);
+}
+
+void CGeometryPool::Bind()
+{
+	glBindVertexArray(m_vao);
+	CRenderStats::AddStateChanges();
+}
+
+void CGeometryPool::AddDraw(const GeometryRange &range, unsigned int firstIndex, unsigned int numIndices,
+	CCompiledTexture *pTexture, const glm::mat4 &modelMatrix, const glm::vec4 &boundingSphere)
+{
+	QueuedDraw draw;
+	draw.command.count = numIndices;
+	draw.command.instanceCount = 1;
+	draw.command.firstIndex = range.firstIndex + firstIndex;
+	draw.command.baseVertex = range.firstVertex;
+	draw.command.baseInstance = 0;
+	draw.pTexture = pTexture;
+	draw.modelMatrix = modelMatrix;
+	draw.boundingSphere = boundingSphere;
+	m_queue.push_back(draw);
+}
+
+// Runs on a worker.  Each draw's data goes in the slot of its place in the queue, so the jobs write to the mapped buffer
+// without coordinating.  The data is written once whichever views see the draw, and a draw no view sees leaves its
+// slot unused.
+void CGeometryPool::PrepareDraws(unsigned int first, unsigned int last, const glm::vec4 (*pPlanes)[6], int numViews,
+	DrawData *pDrawData, CommandList &list)
+{
+	PROFILE_ZONE("Prepare draws");
+	for (int v = 0; v < numViews; v++) {
+		ViewCommands &view = list.views[v];
+		view.textures.clear();
+		for (unsigned int i = 0; i < view.commands.size(); i++)
+			view.commands[i].clear();
+		view.numCulled = 0;
+	}
+
+	unsigned int allViews = (1u << numViews) - 1;
+	for (unsigned int i = first; i < last; i++) {
+		const QueuedDraw &draw = m_queue[i];
+
+		// The bounding sphere in world space, tested against the world space planes of every view
+		unsigned int visible = allViews;
+		if (draw.boundingSphere.w > 0.0f) {
+			glm::vec3 centre = glm::vec3(draw.modelMatrix * glm::vec4(glm::vec3(draw.boundingSphere), 1.0f));
+			float scale = std::max(glm::length(glm::vec3(draw.modelMatrix[0])),
+				std::max(glm::length(glm::vec3(draw.modelMatrix[1])), glm::length(glm::vec3(draw.modelMatrix[2]))));
+			float radius = draw.boundingSphere.w * scale;
+			for (int v = 0; v < numViews; v++) {
+				if (!IsSphereVisible(pPlanes[v], centre, radius)) {
+					visible &= ~(1u << v);
+					list.views[v].numCulled++;
+				}
+			}
+		}
+		if (visible == 0)
+			continue;
+
+		pDrawData[i].modelMatrix = draw.modelMatrix;
+		pDrawData[i].normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(draw.modelMatrix))));
+		if (m_direct)
+			m_modelMatrices[i] = draw.modelMatrix;
+
+		DrawCommand command = draw.command;
+		command.baseInstance = i;
+		for (int v = 0; v < numViews; v++) {
+			if ((visible & (1u << v)) == 0)
+				continue;
+			ViewCommands &view = list.views[v];
+			unsigned int slot = 0;
+			while (slot < view.textures.size() && view.textures[slot] != draw.pTexture)
+				slot++;
+			if (slot == view.textures.size()) {
+				view.textures.push_back(draw.pTexture);
+				if (view.commands.size() < view.textures.size())
+					view.commands.resize(view.textures.size());
+			}
+			view.commands[slot].push_back(command);
+		}
+	}
+}
+
+// Merge the jobs' lists for one view into one batch per texture, keeping the queue's order within a batch
+void CGeometryPool::MergeCommands(int view, int numLists)
+{
+	m_views[view].firstBatch = (unsigned int)m_batches.size();
+	for (int i = 0; i < numLists; i++) {
+		ViewCommands &list = m_commandLists[i].views[view];
+		m_numCulled += list.numCulled;
+		for (unsigned int slot = 0; slot < list.textures.size(); slot++) {
+			bool merged = false;
+			for (unsigned int b = m_views[view].firstBatch; b < m_batches.size(); b++)
+				merged = merged || m_batches[b].pTexture == list.textures[slot];
+			if (merged)
+				continue;
+
+			Batch batch;
+			batch.pTexture = list.textures[slot];
+			batch.firstCommand = (unsigned int)m_commands.size();
+			for (int j = i; j < numLists; j++) {
+				ViewCommands &other = m_commandLists[j].views[view];
+				for (unsigned int s = 0; s < other.textures.size(); s++) {
+					if (other.textures[s] == batch.pTexture)
+						m_commands.insert(m_commands.end(), other.commands[s].begin(), other.commands[s].end());
+				}
+			}
+			batch.numCommands = (unsigned int)m_commands.size() - batch.firstCommand;
+			m_batches.push_back(batch);
+		}
+	}
+	m_views[view].numBatches = (unsigned int)m_batches.size() - m_views[view].firstBatch;
+}
+
+void CGeometryPool::Prepare(const GeometryView *pViews, int numViews)
+{
+	PROFILE_ZONE("Geometry pool");
+	m_numDraws = 0;
+	m_numBatches = 0;
+	m_numCulled = 0;
+	m_numViews = std::min(numViews, GEOMETRY_MAX_VIEWS);
+	m_commands.clear();
+	m_batches.clear();
+	for (int v = 0; v < GEOMETRY_MAX_VIEWS; v++)
+		m_views[v].firstBatch = m_views[v].numBatches = 0;
+	if (m_queue.empty() || m_numViews <= 0)
+		return;
+
+	// A draw's base instance is its place in the queue, which the draw index buffer must cover
+	unsigned int numQueued = (unsigned int)m_queue.size();
+	if (numQueued > m_maxDraws)
+		GrowDrawIndices(numQueued);
+
+	glm::vec4 planes[GEOMETRY_MAX_VIEWS][6];
+	for (int v = 0; v < m_numViews; v++)
+		ExtractFrustumPlanes(pViews[v], planes[v]);
+
+	// Orphan the draw data, so that writing it does not wait for the previous frame's draws
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawDataBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, numQueued * sizeof(DrawData), NULL, GL_STREAM_DRAW);
+	DrawData *pDrawData = (DrawData*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, numQueued * sizeof(DrawData),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (pDrawData == NULL) {
+		m_queue.clear();
+		m_numViews = 0;
+		return;
+	}
+
+	if (m_direct && m_modelMatrices.size() < numQueued)
+		m_modelMatrices.resize(numQueued);
+
+	int numLists = (numQueued + GEOMETRY_JOB_DRAWS - 1) / GEOMETRY_JOB_DRAWS;
+	if ((int)m_commandLists.size() < numLists)
+		m_commandLists.resize(numLists);
+	int activeViews = m_numViews;
+	// A lambda rather than a std::function, which would allocate for the captures
+	auto prepare = [this, &planes, activeViews, pDrawData](int first, int last) {
+		PrepareDraws(first, last, planes, activeViews, pDrawData, m_commandLists[first / GEOMETRY_JOB_DRAWS]);
+	};
+	if (m_pJobSystem)
+		m_pJobSystem->ParallelFor(numQueued, GEOMETRY_JOB_DRAWS, prepare);
+	else {
+		for (unsigned int first = 0; first < numQueued; first += GEOMETRY_JOB_DRAWS)
+			prepare(first, std::min(first + GEOMETRY_JOB_DRAWS, numQueued));
+	}
+	glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+
+	// Every view's commands go in one indirect buffer, and every view's matrices in one view buffer
+	for (int v = 0; v < m_numViews; v++)
+		MergeCommands(v, numLists);
+	m_numDraws = (int)m_commands.size();
+	m_queue.clear();
+	if (!m_commands.empty()) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commands.size() * sizeof(DrawCommand), &m_commands[0], GL_STREAM_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_viewBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, GEOMETRY_MAX_VIEWS * m_viewStride, NULL, GL_STREAM_DRAW);
+	for (int v = 0; v < m_numViews; v++) {
+		m_viewMatrices[v] = pViews[v].viewMatrix;
+		ViewData data;
+		data.viewMatrix = pViews[v].viewMatrix;
+		data.normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(pViews[v].viewMatrix))));
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, v * m_viewStride, sizeof(ViewData), &data);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void CGeometryPool::Draw(int view)
+{
+	PROFILE_GPU_ZONE("Geometry pool");
+	if (view < 0 || view >= m_numViews || m_views[view].numBatches == 0)
+		return;
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GEOMETRY_DRAW_DATA_BINDING, m_drawDataBuffer);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, GEOMETRY_VIEW_BINDING, m_viewBuffer, view * m_viewStride, sizeof(ViewData));
+	glBindVertexArray(m_vao);
+	CRenderStats::AddStateChanges();
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+	unsigned int last = m_views[view].firstBatch + m_views[view].numBatches;
+	for (unsigned int b = m_views[view].firstBatch; b < last; b++) {
+		if (m_batches[b].pTexture)
+			m_batches[b].pTexture->Bind();
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(m_batches[b].firstCommand * sizeof(DrawCommand)),
+			m_batches[b].numCommands, 0);
+		CRenderStats::AddDrawCalls();
+		m_numBatches++;
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+// Without the per draw matrices in the shader, each command becomes a direct draw with its own uniforms
+void CGeometryPool::DrawDirect(int view, CShaderPermutations *pProgram)
+{
+	PROFILE_GPU_ZONE("Geometry pool");
+	if (view < 0 || view >= m_numViews || m_views[view].numBatches == 0 || !m_direct)
+		return;
+
+	glBindVertexArray(m_vao);
+	CRenderStats::AddStateChanges();
+	unsigned int last = m_views[view].firstBatch + m_views[view].numBatches;
+	for (unsigned int b = m_views[view].firstBatch; b < last; b++) {
+		if (m_batches[b].pTexture)
+			m_batches[b].pTexture->Bind();
+		for (unsigned int c = 0; c < m_batches[b].numCommands; c++) {
+			const DrawCommand &command = m_commands[m_batches[b].firstCommand + c];
+			glm::mat4 modelViewMatrix = m_viewMatrices[view] * m_modelMatrices[command.baseInstance];
+			pProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrix);
+			pProgram->SetUniform("matrices.normalMatrix", glm::transpose(glm::inverse(glm::mat3(modelViewMatrix))));
+			glDrawElementsBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+				(void*)(command.firstIndex * sizeof(GLuint)), command.baseVertex);
+			CRenderStats::AddDrawCalls();
+		}
+		m_numBatches++;
+	}
+	glBindVertexArray(0);
+}
+
+int CGeometryPool::GetNumDraws()
+{
+	return m_numDraws;
+}
+
+int CGeometryPool::GetNumBatches()
+{
+	return m_numBatches;
+}
+
+int CGeometryPool::GetNumCulled()
+{
+	return m_numCulled;
+}
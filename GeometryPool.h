@@ -0,0 +1,195 @@
+#pragma once
+#include "Common.h"
+#include "MeshSimplifier.h"
+
+class CCompiledTexture;
+class CJobSystem;
+class CShaderPermutations;
+
+// Binding points used by resources\shaders\geometryPool.glsl
+#define GEOMETRY_DRAW_DATA_BINDING 3
+#define GEOMETRY_VIEW_BINDING 4
+#define GEOMETRY_DRAW_INDEX_ATTRIBUTE 3
+
+// Queued draws prepared by each job in Prepare
+#define GEOMETRY_JOB_DRAWS 256
+
+// Views culled at once by Prepare; a draw's visibility is a bitmask with a bit per view
+#define GEOMETRY_MAX_VIEWS 8
+
+// The part of the pool holding one mesh.  Indices are relative to firstVertex.
+struct GeometryRange
+{
+	unsigned int firstVertex;
+	unsigned int numVertices;
+	unsigned int firstIndex;
+	unsigned int numIndices;
+};
+
+// A camera the queued draws are culled for and drawn from
+struct GeometryView
+{
+	glm::mat4 viewMatrix;
+	glm::mat4 projectionMatrix;
+};
+
+// A view's frustum planes in world space, from the rows of its view-projection matrix.  They point inwards and are
+// normalised, so a point's distance from a plane is in world units.
+void ExtractFrustumPlanes(const GeometryView &view, glm::vec4 planes[6]);
+// Culling tests against the planes of ExtractFrustumPlanes.  They are conservative: near a corner of the frustum a box
+// or sphere outside it may still be found visible.
+bool IsBoxVisible(const glm::vec4 planes[6], const glm::vec3 &minimum, const glm::vec3 &maximum);
+bool IsSphereVisible(const glm::vec4 planes[6], const glm::vec3 &centre, float radius);
+
+// One vertex buffer and one index buffer shared by the static meshes, all in the MeshVertex format, so that they share
+// one VAO.  Meshes can draw from the pool directly, or queue draws with their model matrix.  The queue is traversed once
+// a frame by Prepare, for every view at once, and Draw then draws one view's visible draws with one
+// glMultiDrawElementsIndirect per texture.  A shader drawing queued draws reads its matrices with
+// resources\shaders\geometryPool.glsl, which finds the draw's model matrix by its base instance and the view's matrices
+// in a buffer range bound by Draw.
+// Prepare works through the queue in ranges on the job system's workers: each job writes its draws' model and normal
+// matrices into the mapped buffer once, shared by all the views, tests each draw against every view's frustum for a
+// bitmask of the views that see it, and records its commands by view and texture.  The GL thread only merges the
+// command lists, so a second view costs a frustum test and a command per draw rather than another pass over the scene.
+class CGeometryPool
+{
+public:
+	CGeometryPool();
+	~CGeometryPool();
+
+	void Create(unsigned int numVertices = 1 << 20, unsigned int numIndices = 1 << 22, unsigned int maxDraws = 4096);
+	void Release();
+	// Prepare the queued draws on the workers; without a job system Prepare does them on the calling thread
+	void SetJobSystem(CJobSystem *pJobSystem);
+	// Keep the queued draws' model matrices from each Prepare, for DrawDirect
+	void SetDirectDraws(bool direct);
+
+	// The pool grows if there is no room for the mesh
+	GeometryRange Allocate(const MeshVertex *pVertices, unsigned int numVertices, const unsigned int *pIndices,
+		unsigned int numIndices);
+	void Free(const GeometryRange &range);
+
+	// Bind the shared VAO for direct draws (glDrawElementsBaseVertex with the range's first vertex and index)
+	void Bind();
+
+	// Queue numIndices indices, starting firstIndex into the range.  A draw with a bounding sphere (its model space centre
+	// and radius) is culled against each view's frustum in Prepare; one with a radius of 0 is drawn in every view.
+	void AddDraw(const GeometryRange &range, unsigned int firstIndex, unsigned int numIndices, CCompiledTexture *pTexture,
+		const glm::mat4 &modelMatrix, const glm::vec4 &boundingSphere = glm::vec4(0.0f));
+	// Cull the queue against up to GEOMETRY_MAX_VIEWS views and build each view's commands, then empty the queue
+	void Prepare(const GeometryView *pViews, int numViews);
+	// Draw one view's commands from the last Prepare, into the current viewport
+	void Draw(int view);
+	// The same commands with a draw call each, setting pProgram's matrices.modelViewMatrix and matrices.normalMatrix,
+	// for a shader that does not read geometryPool.glsl.  Needs SetDirectDraws(true) before the Prepare.
+	void DrawDirect(int view, CShaderPermutations *pProgram);
+
+	int GetNumDraws();						// Over all the views of the last Prepare
+	int GetNumBatches();
+	int GetNumCulled();
+
+private:
+	struct Block
+	{
+		unsigned int start;
+		unsigned int size;
+	};
+
+	// Layout of DrawElementsIndirectCommand
+	struct DrawCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// Shared by every view
+	struct DrawData
+	{
+		glm::mat4 modelMatrix;
+		glm::mat4 normalMatrix;				// A mat3 padded to columns of vec4, as std430 lays it out
+	};
+
+	struct ViewData
+	{
+		glm::mat4 viewMatrix;
+		glm::mat4 normalMatrix;
+	};
+
+	struct QueuedDraw
+	{
+		DrawCommand command;
+		CCompiledTexture *pTexture;
+		glm::mat4 modelMatrix;
+		glm::vec4 boundingSphere;
+	};
+
+	// The commands of the draws one view sees in one job's range of the queue, by texture in order of first use
+	struct ViewCommands
+	{
+		vector<CCompiledTexture*> textures;
+		vector<vector<DrawCommand> > commands;	// One list per texture; may have more lists than textures
+		int numCulled;
+	};
+
+	// One job's commands for every view.  The lists are kept between frames so that their storage is reused.
+	struct CommandList
+	{
+		ViewCommands views[GEOMETRY_MAX_VIEWS];
+	};
+
+	struct Batch
+	{
+		CCompiledTexture *pTexture;
+		unsigned int firstCommand;
+		unsigned int numCommands;
+	};
+
+	// A view's batches, from firstBatch in m_batches
+	struct ViewBatches
+	{
+		unsigned int firstBatch;
+		unsigned int numBatches;
+	};
+
+	static bool AllocateBlock(vector<Block> &freeBlocks, unsigned int size, unsigned int &start);
+	static void FreeBlock(vector<Block> &freeBlocks, unsigned int start, unsigned int size);
+	void Grow(GLuint &buffer, unsigned int elementSize, unsigned int &capacity, unsigned int minCapacity,
+		vector<Block> &freeBlocks);
+	void SetupVertexArray();
+	void GrowDrawIndices(unsigned int minDraws);
+	void PrepareDraws(unsigned int first, unsigned int last, const glm::vec4 (*pPlanes)[6], int numViews,
+		DrawData *pDrawData, CommandList &list);
+	void MergeCommands(int view, int numLists);
+
+	GLuint m_vao;
+	GLuint m_vbo;
+	GLuint m_ibo;
+	GLuint m_drawIndexBuffer;				// 0, 1, 2, ... read per instance, so a draw's base instance is its index
+	GLuint m_indirectBuffer;
+	GLuint m_drawDataBuffer;
+	GLuint m_viewBuffer;					// A ViewData per view, each at an aligned offset
+	GLint m_viewStride;
+
+	unsigned int m_vertexCapacity;
+	unsigned int m_indexCapacity;
+	unsigned int m_maxDraws;
+	vector<Block> m_freeVertices;
+	vector<Block> m_freeIndices;
+
+	CJobSystem *m_pJobSystem;
+	bool m_direct;
+	vector<glm::mat4> m_modelMatrices;		// By base instance, if m_direct
+	glm::mat4 m_viewMatrices[GEOMETRY_MAX_VIEWS];
+	vector<QueuedDraw> m_queue;
+	vector<CommandList> m_commandLists;
+	vector<DrawCommand> m_commands;
+	vector<Batch> m_batches;
+	ViewBatches m_views[GEOMETRY_MAX_VIEWS];
+	int m_numViews;
+	int m_numDraws;
+	int m_numBatches;
+	int m_numCulled;
+};
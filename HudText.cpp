@@ -0,0 +1,290 @@
+#include "HudText.h"
+#include "ShaderCache.h"
+#include "RenderStats.h"
+#include "FrameArena.h"
+#include "Profiler.h"
+#include "Log.h"
+#include <stdio.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+static const int ATLAS_WIDTH = 512;
+static const int ATLAS_PADDING = 2;		// Empty texels between glyphs, so that linear filtering never reads a neighbour
+
+CHudText::CHudText()
+{
+	for (int i = 0; i < NUM_CHARACTERS; i++)
+		m_glyphs[i] = Glyph();
+	m_pixelSize = 0;
+	m_lineHeight = 0;
+	m_atlasTexture = 0;
+	m_vao = 0;
+	m_vbo = 0;
+	m_vboCapacity = 0;
+	m_numVertices = 0;
+	m_dirty = true;
+	m_pProgram = NULL;
+}
+
+CHudText::~CHudText()
+{
+	Release();
+}
+
+// Render the printable ASCII characters at one pixel size and pack them into rows of a single-channel atlas
+bool CHudText::LoadFont(const string &filename, int pixelSize)
+{
+	FT_Library library;
+	FT_Face face;
+	if (FT_Init_FreeType(&library) != 0)
+		return false;
+	if (FT_New_Face(library, filename.c_str(), 0, &face) != 0) {
+		FT_Done_FreeType(library);
+		ReportError("Error loading font", filename.c_str());
+		return false;
+	}
+	FT_Set_Pixel_Sizes(face, pixelSize, pixelSize);
+
+	m_pixelSize = pixelSize;
+	m_lineHeight = (int)(face->size->metrics.height >> 6);
+
+	// Lay the glyphs out first, so that the atlas is only as tall as it needs to be.  Each slot is the size of the
+	// rendered bitmap, which can be larger than the glyph's metrics, as that is what is copied in.
+	int positionX[NUM_CHARACTERS], positionY[NUM_CHARACTERS];
+	int slotWidth[NUM_CHARACTERS], slotHeight[NUM_CHARACTERS];
+	int x = 0, y = 0, rowHeight = 0;
+	for (int i = 0; i < NUM_CHARACTERS; i++) {
+		FT_Load_Char(face, FIRST_CHARACTER + i, FT_LOAD_RENDER);
+		int width = std::min((int)face->glyph->bitmap.width, ATLAS_WIDTH);
+		int height = (int)face->glyph->bitmap.rows;
+		slotWidth[i] = width;
+		slotHeight[i] = height;
+		if (x + width + ATLAS_PADDING > ATLAS_WIDTH) {
+			x = 0;
+			y += rowHeight + ATLAS_PADDING;
+			rowHeight = 0;
+		}
+		positionX[i] = x;
+		positionY[i] = y;
+		x += width + ATLAS_PADDING;
+		rowHeight = std::max(rowHeight, height);
+	}
+	int atlasHeight = 1;
+	while (atlasHeight < y + rowHeight)
+		atlasHeight *= 2;
+
+	vector<BYTE> atlas(ATLAS_WIDTH * atlasHeight, 0);
+	for (int i = 0; i < NUM_CHARACTERS; i++) {
+		FT_Load_Char(face, FIRST_CHARACTER + i, FT_LOAD_RENDER);
+		FT_GlyphSlot pSlot = face->glyph;
+		Glyph &glyph = m_glyphs[i];
+		glyph.width = std::min((int)pSlot->bitmap.width, slotWidth[i]);
+		glyph.height = std::min((int)pSlot->bitmap.rows, slotHeight[i]);
+		glyph.left = pSlot->bitmap_left;
+		glyph.top = pSlot->bitmap_top;
+		glyph.advance = (int)(pSlot->advance.x >> 6);
+		glyph.texCoordMin = glm::vec2((float)positionX[i] / ATLAS_WIDTH, (float)positionY[i] / atlasHeight);
+		glyph.texCoordMax = glm::vec2((float)(positionX[i] + glyph.width) / ATLAS_WIDTH, (float)(positionY[i] + glyph.height) / atlasHeight);
+
+		for (int row = 0; row < glyph.height; row++)
+			memcpy(&atlas[(positionY[i] + row) * ATLAS_WIDTH + positionX[i]], pSlot->bitmap.buffer + row * pSlot->bitmap.pitch, glyph.width);
+	}
+
+	FT_Done_Face(face);
+	FT_Done_FreeType(library);
+
+	// The text shader may read coverage from any channel, so all four return the red channel
+	GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_RED };
+	glGenTextures(1, &m_atlasTexture);
+	glBindTexture(GL_TEXTURE_2D, m_atlasTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, atlasHeight, 0, GL_RED, GL_UNSIGNED_BYTE, &atlas[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+
+	// Vertices are a 2D position and a texture coordinate, as the text shader expects
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), 0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)sizeof(glm::vec2));
+	glBindVertexArray(0);
+
+	m_dirty = true;
+	return true;
+}
+
+void CHudText::SetShaderProgram(CCachedProgram *pProgram)
+{
+	m_pProgram = pProgram;
+}
+
+int CHudText::AddString(const char *format, int size)
+{
+	HudString hudString;
+	hudString.format = format;
+	hudString.size = size;
+	hudString.x = 0;
+	hudString.y = 0;
+	hudString.values[0] = hudString.values[1] = hudString.values[2] = 0;
+	hudString.visible = false;
+	hudString.drawn = false;
+	Layout(hudString);
+	m_strings.push_back(hudString);
+	return (int)m_strings.size() - 1;
+}
+
+void CHudText::SetPosition(int id, int x, int y)
+{
+	HudString &hudString = m_strings[id];
+	if (hudString.x == x && hudString.y == y)
+		return;
+	hudString.x = x;
+	hudString.y = y;
+	Layout(hudString);
+}
+
+void CHudText::SetValues(int id, int a, int b, int c)
+{
+	HudString &hudString = m_strings[id];
+	if (hudString.values[0] == a && hudString.values[1] == b && hudString.values[2] == c)
+		return;
+	hudString.values[0] = a;
+	hudString.values[1] = b;
+	hudString.values[2] = c;
+	Layout(hudString);
+}
+
+// Only the visibility at Render time matters, so a string may be hidden and shown again within a frame for free
+void CHudText::SetVisible(int id, bool visible)
+{
+	m_strings[id].visible = visible;
+}
+
+// Format the string and build its glyph quads, with (x, y) on the baseline measured from the bottom left of the screen
+void CHudText::Layout(HudString &hudString)
+{
+	char text[256];
+	snprintf(text, sizeof(text), hudString.format.c_str(), hudString.values[0], hudString.values[1], hudString.values[2]);
+
+	hudString.vertices.clear();
+	if (m_pixelSize == 0)
+		return;
+
+	float scale = (float)hudString.size / m_pixelSize;
+	float x = (float)hudString.x, y = (float)hudString.y;
+	for (const char *pCharacter = text; *pCharacter; pCharacter++) {
+		if (*pCharacter == '\n') {
+			x = (float)hudString.x;
+			y -= m_lineHeight * scale;
+			continue;
+		}
+		int index = *pCharacter - FIRST_CHARACTER;
+		if (index < 0 || index >= NUM_CHARACTERS)
+			continue;
+
+		const Glyph &glyph = m_glyphs[index];
+		if (glyph.width > 0 && glyph.height > 0) {
+			float left = x + glyph.left * scale, right = left + glyph.width * scale;
+			float top = y + glyph.top * scale, bottom = top - glyph.height * scale;
+			glm::vec4 topLeft(left, top, glyph.texCoordMin.x, glyph.texCoordMin.y);
+			glm::vec4 topRight(right, top, glyph.texCoordMax.x, glyph.texCoordMin.y);
+			glm::vec4 bottomLeft(left, bottom, glyph.texCoordMin.x, glyph.texCoordMax.y);
+			glm::vec4 bottomRight(right, bottom, glyph.texCoordMax.x, glyph.texCoordMax.y);
+			hudString.vertices.push_back(bottomLeft);
+			hudString.vertices.push_back(bottomRight);
+			hudString.vertices.push_back(topRight);
+			hudString.vertices.push_back(bottomLeft);
+			hudString.vertices.push_back(topRight);
+			hudString.vertices.push_back(topLeft);
+		}
+		x += glyph.advance * scale;
+	}
+
+	if (hudString.visible || hudString.drawn)
+		m_dirty = true;
+}
+
+// Gather the visible strings into the vertex buffer, growing it only when it is too small
+void CHudText::UploadVertices()
+{
+	m_numVertices = 0;
+	for (unsigned int i = 0; i < m_strings.size(); i++) {
+		if (m_strings[i].visible)
+			m_numVertices += (unsigned int)m_strings[i].vertices.size();
+	}
+	glm::vec4 *pVertices = CFrameArena::Allocate<glm::vec4>(m_numVertices);
+	unsigned int numCopied = 0;
+	for (unsigned int i = 0; i < m_strings.size(); i++) {
+		if (m_strings[i].visible && !m_strings[i].vertices.empty()) {
+			memcpy(pVertices + numCopied, &m_strings[i].vertices[0], m_strings[i].vertices.size() * sizeof(glm::vec4));
+			numCopied += (unsigned int)m_strings[i].vertices.size();
+		}
+		m_strings[i].drawn = m_strings[i].visible;
+	}
+	m_dirty = false;
+	if (m_numVertices == 0)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	if (m_numVertices > m_vboCapacity) {
+		m_vboCapacity = std::max(m_numVertices, 2 * m_vboCapacity);
+		glBufferData(GL_ARRAY_BUFFER, m_vboCapacity * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, m_numVertices * sizeof(glm::vec4), pVertices);
+}
+
+void CHudText::Render(const glm::mat4 &projectionMatrix)
+{
+	PROFILE_GPU_ZONE("HUD");
+	for (unsigned int i = 0; i < m_strings.size() && !m_dirty; i++) {
+		if (m_strings[i].visible != m_strings[i].drawn)
+			m_dirty = true;
+	}
+	if (m_dirty)
+		UploadVertices();
+	if (m_numVertices == 0 || m_pProgram == NULL)
+		return;
+
+	m_pProgram->UseProgram();
+	m_pProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1));
+	m_pProgram->SetUniform("matrices.projMatrix", projectionMatrix);
+	m_pProgram->SetUniform("vColour", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+	m_pProgram->SetUniform("sampler0", 0);
+
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, m_atlasTexture);
+	glBindSampler(0, 0);
+
+	glBindVertexArray(m_vao);
+	glDrawArrays(GL_TRIANGLES, 0, m_numVertices);
+	glBindVertexArray(0);
+	CRenderStats::AddStateChanges(2);
+	CRenderStats::AddDrawCalls();
+
+	glDisable(GL_BLEND);
+}
+
+void CHudText::Release()
+{
+	if (m_vbo) glDeleteBuffers(1, &m_vbo);
+	if (m_vao) glDeleteVertexArrays(1, &m_vao);
+	if (m_atlasTexture) glDeleteTextures(1, &m_atlasTexture);
+	m_vbo = m_vao = m_atlasTexture = 0;
+	m_vboCapacity = 0;
+	m_numVertices = 0;
+	m_pixelSize = 0;
+	m_strings.clear();
+	m_dirty = true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "Common.h"
+
+class CCachedProgram;
+
+// Screen text for the HUD, drawn from a single glyph atlas.  Each string has a printf format with up to three integer
+// arguments and is laid out into quads only when its arguments, position or size change.  All visible strings share one
+// vertex buffer and are drawn with one call to Render.
+class CHudText
+{
+public:
+	CHudText();
+	~CHudText();
+
+	bool LoadFont(const string &filename, int pixelSize);
+	void SetShaderProgram(CCachedProgram *pProgram);
+
+	// Returns the id used by the other methods.  Strings start hidden.
+	int AddString(const char *format, int size);
+	void SetPosition(int id, int x, int y);
+	void SetValues(int id, int a = 0, int b = 0, int c = 0);
+	void SetVisible(int id, bool visible);
+
+	void Render(const glm::mat4 &projectionMatrix);
+	void Release();
+
+private:
+	struct Glyph
+	{
+		glm::vec2 texCoordMin;
+		glm::vec2 texCoordMax;
+		int width;
+		int height;
+		int left;
+		int top;
+		int advance;
+	};
+
+	struct HudString
+	{
+		string format;
+		int size;
+		int x;
+		int y;
+		int values[3];
+		bool visible;
+		bool drawn;					// Whether the string is in the vertex buffer
+		vector<glm::vec4> vertices;	// Position and texture coordinate, two triangles per glyph
+	};
+
+	void Layout(HudString &hudString);
+	void UploadVertices();
+
+	static const int FIRST_CHARACTER = 32;
+	static const int NUM_CHARACTERS = 95;
+
+	Glyph m_glyphs[NUM_CHARACTERS];
+	int m_pixelSize;
+	int m_lineHeight;
+	GLuint m_atlasTexture;
+	GLuint m_vao;
+	GLuint m_vbo;
+	unsigned int m_vboCapacity;
+	unsigned int m_numVertices;
+	bool m_dirty;
+
+	vector<HudString> m_strings;
+	CCachedProgram *m_pProgram;
+};
@@ -0,0 +1,69 @@
+#include "ImageData.h"
+#include <FreeImage.h>
+
+CImageData::CImageData()
+{
+	m_pBitmap = NULL;
+}
+
+CImageData::~CImageData()
+{
+	Release();
+}
+
+bool CImageData::Load(const string &path)
+{
+	Release();
+
+	FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(path.c_str(), 0);
+	if (fif == FIF_UNKNOWN)
+		fif = FreeImage_GetFIFFromFilename(path.c_str());
+	if (fif == FIF_UNKNOWN || !FreeImage_FIFSupportsReading(fif))
+		return false;
+
+	m_pBitmap = FreeImage_Load(fif, path.c_str());
+	if (m_pBitmap == NULL)
+		return false;
+
+	// Textures are uploaded as 24 or 32 bit BGR(A), like CTexture::Load does
+	int bpp = FreeImage_GetBPP(m_pBitmap);
+	if (bpp != 24 && bpp != 32) {
+		FIBITMAP *pConverted = FreeImage_ConvertTo24Bits(m_pBitmap);
+		FreeImage_Unload(m_pBitmap);
+		m_pBitmap = pConverted;
+	}
+
+	return m_pBitmap != NULL && FreeImage_GetBits(m_pBitmap) != NULL;
+}
+
+void CImageData::Release()
+{
+	if (m_pBitmap)
+		FreeImage_Unload(m_pBitmap);
+	m_pBitmap = NULL;
+}
+
+BYTE *CImageData::GetBits()
+{
+	return m_pBitmap ? FreeImage_GetBits(m_pBitmap) : NULL;
+}
+
+int CImageData::GetWidth()
+{
+	return m_pBitmap ? FreeImage_GetWidth(m_pBitmap) : 0;
+}
+
+int CImageData::GetHeight()
+{
+	return m_pBitmap ? FreeImage_GetHeight(m_pBitmap) : 0;
+}
+
+int CImageData::GetBPP()
+{
+	return m_pBitmap ? FreeImage_GetBPP(m_pBitmap) : 0;
+}
+
+GLenum CImageData::GetFormat()
+{
+	return GetBPP() == 32 ? GL_BGRA : GL_BGR;
+}
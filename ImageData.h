@@ -0,0 +1,28 @@
+#pragma once
+#include "Common.h"
+
+struct FIBITMAP;
+
+// Decoded image pixels, loaded with FreeImage without touching OpenGL so that decoding can run on a worker thread.
+// Upload the result on the GL thread with CTexture::CreateFromData.
+class CImageData
+{
+public:
+	CImageData();
+	~CImageData();
+
+	bool Load(const string &path);
+	void Release();
+
+	BYTE *GetBits();
+	int GetWidth();
+	int GetHeight();
+	int GetBPP();
+	GLenum GetFormat();
+
+private:
+	CImageData(const CImageData &);
+	CImageData &operator=(const CImageData &);
+
+	FIBITMAP *m_pBitmap;
+};
@@ -0,0 +1,165 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+
+CJobSystem::CJobSystem()
+{
+	m_numActive = 0;
+	m_stopping = false;
+	m_firstJob = 0;
+	m_numJobs = 0;
+}
+
+CJobSystem::~CJobSystem()
+{
+	Stop();
+	for (unsigned int i = 0; i < m_freeRanges.size(); i++)
+		delete m_freeRanges[i];
+}
+
+void CJobSystem::Start(int numThreads)
+{
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+	m_stopping = false;
+	for (int i = 0; i < numThreads; i++)
+		m_threads.push_back(std::thread(&CJobSystem::WorkerLoop, this));
+}
+
+// Finish the jobs already queued, then join the workers
+void CJobSystem::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+
+	for (unsigned int i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+	m_threads.clear();
+}
+
+void CJobSystem::Submit(const std::function<void()> &job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		// Grow the ring, unrolled so that the queued jobs start at the front
+		if (m_numJobs == m_jobs.size()) {
+			vector<std::function<void()> > jobs(std::max(16u, 2 * m_numJobs));
+			for (unsigned int i = 0; i < m_numJobs; i++)
+				jobs[i].swap(m_jobs[(m_firstJob + i) % m_jobs.size()]);
+			m_jobs.swap(jobs);
+			m_firstJob = 0;
+		}
+		m_jobs[(m_firstJob + m_numJobs) % m_jobs.size()] = job;
+		m_numJobs++;
+	}
+	m_wake.notify_one();
+}
+
+// Block until the queue is empty and no job is running
+void CJobSystem::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this] { return m_numJobs == 0 && m_numActive == 0; });
+}
+
+void CJobSystem::ParallelFor(int count, int grain, RangeFunction function, const void *pJob)
+{
+	int numRanges = (count + grain - 1) / grain;
+	if (numRanges <= 1 || m_threads.empty()) {
+		if (count > 0)
+			function(pJob, 0, count);
+		return;
+	}
+
+	int numHelpers = std::min((int)m_threads.size(), numRanges - 1);
+	Ranges *pRanges = NULL;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_freeRanges.empty()) {
+			pRanges = m_freeRanges.back();
+			m_freeRanges.pop_back();
+		}
+	}
+	if (pRanges == NULL)
+		pRanges = new Ranges;
+	pRanges->function = function;
+	pRanges->pJob = pJob;
+	pRanges->count = count;
+	pRanges->grain = grain;
+	pRanges->numRanges = numRanges;
+	pRanges->next = 0;
+	pRanges->done = 0;
+	pRanges->references = numHelpers + 1;
+
+	// Two pointers, which std::function holds without allocating
+	for (int i = 0; i < numHelpers; i++)
+		Submit([this, pRanges] {
+			RunRanges(pRanges);
+			ReleaseRanges(pRanges);
+		});
+	RunRanges(pRanges);
+
+	// The job is only called for ranges taken before the last is done, so it need not outlive this
+	{
+		std::unique_lock<std::mutex> lock(pRanges->mutex);
+		pRanges->finished.wait(lock, [pRanges] { return pRanges->done == pRanges->numRanges; });
+	}
+	ReleaseRanges(pRanges);
+}
+
+// Take ranges until none are left
+void CJobSystem::RunRanges(Ranges *pRanges)
+{
+	int range;
+	while ((range = pRanges->next++) < pRanges->numRanges) {
+		int first = range * pRanges->grain;
+		pRanges->function(pRanges->pJob, first, std::min(first + pRanges->grain, pRanges->count));
+		if (++pRanges->done == pRanges->numRanges) {
+			std::lock_guard<std::mutex> lock(pRanges->mutex);
+			pRanges->finished.notify_all();
+		}
+	}
+}
+
+void CJobSystem::ReleaseRanges(Ranges *pRanges)
+{
+	if (--pRanges->references == 0) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_freeRanges.push_back(pRanges);
+	}
+}
+
+int CJobSystem::GetNumThreads()
+{
+	return (int)m_threads.size();
+}
+
+void CJobSystem::WorkerLoop()
+{
+	CProfiler::SetThreadName("Worker");
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_stopping || m_numJobs > 0; });
+			if (m_numJobs == 0)
+				return; // Stopping, and nothing left to do
+			job.swap(m_jobs[m_firstJob]);
+			m_firstJob = (m_firstJob + 1) % m_jobs.size();
+			m_numJobs--;
+			m_numActive++;
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_numActive--;
+			if (m_numJobs == 0 && m_numActive == 0)
+				m_idle.notify_all();
+		}
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "Common.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+
+// A pool of worker threads that run queued jobs in submission order.  Jobs must not touch OpenGL; work that needs the
+// GL context is handed back to the main thread (see CAssetLoader).
+class CJobSystem
+{
+public:
+	CJobSystem();
+	~CJobSystem();
+
+	// Start numThreads workers, or one per core less the main thread if numThreads is 0
+	void Start(int numThreads = 0);
+	void Stop();
+
+	void Submit(const std::function<void()> &job);
+	void WaitIdle();
+
+	// Run job(first, last) over [0, count) in ranges of up to grain, on the workers and the calling thread, and return
+	// when every range is done.  The caller takes ranges too, so this finishes even while the workers are busy with other
+	// jobs.  The job is called in place rather than copied, so this allocates nothing once the queue has grown.
+	template <typename Job> void ParallelFor(int count, int grain, const Job &job)
+	{
+		ParallelFor(count, grain, &CallRange<Job>, &job);
+	}
+
+	int GetNumThreads();
+
+private:
+	typedef void (*RangeFunction)(const void *pJob, int first, int last);
+
+	// One ParallelFor's progress, shared with the helpers it queued.  The last to finish with it returns it to the free
+	// list, as a helper may only start after the ParallelFor has returned.
+	struct Ranges
+	{
+		RangeFunction function;
+		const void *pJob;
+		int count;
+		int grain;
+		int numRanges;
+		std::atomic<int> next;
+		std::atomic<int> done;
+		std::atomic<int> references;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+
+	template <typename Job> static void CallRange(const void *pJob, int first, int last)
+	{
+		(*(const Job*)pJob)(first, last);
+	}
+
+	void ParallelFor(int count, int grain, RangeFunction function, const void *pJob);
+	void RunRanges(Ranges *pRanges);
+	void ReleaseRanges(Ranges *pRanges);
+	void WorkerLoop();
+
+	vector<std::thread> m_threads;
+	vector<std::function<void()> > m_jobs;	// A ring, of which m_numJobs from m_firstJob are queued
+	unsigned int m_firstJob;
+	unsigned int m_numJobs;
+	vector<Ranges*> m_freeRanges;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_idle;
+	int m_numActive;
+	bool m_stopping;
+};
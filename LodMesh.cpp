@@ -0,0 +1,657 @@
+#include "LodMesh.h"
+#include "ShaderPermutations.h"
+#include "HighResolutionTimer.h"
+#include "AssetLoader.h"
+#include "RenderStats.h"
+#include "ResourceManager.h"
+#include "FileSystem.h"
+#include "Log.h"
+#include <memory>
+#include <algorithm>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <assimp/DefaultIOSystem.h>
+
+// Projected diameter (pixels) below which the first simplified level is used; each further level halves the triangle count
+// and is used below a further reduction of the screen size.
+static const float LOD_FIRST_SWITCH_SIZE = 300.0f;
+static const float LOD_SWITCH_RATIO = 2.5f;
+static const float LOD_TRIANGLE_RATIO = 0.5f;
+static const float LOD_HYSTERESIS = 0.15f;
+
+CLodMesh::CLodMesh()
+{
+	m_vao = 0;
+	m_vbo = 0;
+	m_ibo = 0;
+	m_pPool = NULL;
+	m_pooled = false;
+	m_resource = -1;
+	m_bufferBytes = 0;
+	m_centre = glm::vec3(0.0f);
+	m_radius = 0.0f;
+	m_ready = false;
+	m_pImpostorProgram = NULL;
+	m_impostorResolution = 0;
+	m_hasImpostor = false;
+	m_impostorVao = 0;
+	m_impostorVbo = 0;
+	m_impostorFbo = 0;
+	m_impostorTexture = 0;
+	m_impostorDepth = 0;
+}
+
+CLodMesh::~CLodMesh()
+{
+	Release();
+}
+
+bool CLodMesh::Load(const string &filename, int numLevels)
+{
+	Release();
+
+	PendingLoad load;
+	LoadData(filename, numLevels, load);
+	Finish(load);
+	return load.succeeded;
+}
+
+void CLodMesh::LoadAsync(CAssetLoader *pLoader, const string &filename, int numLevels)
+{
+	Release();
+
+	// The upload runs on the GL thread, as Release does, so a load that was not cancelled has a live mesh to finish
+	std::shared_ptr<PendingLoad> pLoad(new PendingLoad);
+	m_pPendingLoad = pLoad;
+	pLoader->Queue(
+		[pLoad, filename, numLevels] {
+			if (!pLoad->cancelled)
+				LoadData(filename, numLevels, *pLoad);
+		},
+		[this, pLoad] {
+			if (!pLoad->cancelled)
+				Finish(*pLoad);
+		});
+}
+
+bool CLodMesh::IsReady()
+{
+	return m_ready;
+}
+
+CLodMesh::PendingLoad::PendingLoad()
+{
+	warm = false;
+	succeeded = false;
+	milliseconds = 0.0;
+	cancelled = false;
+}
+
+CLodMesh::PendingLoad::~PendingLoad()
+{
+	for (unsigned int i = 0; i < textures.size(); i++)
+		delete textures[i];
+}
+
+// Read the mesh from the cache (or import and cache it) and map or decode its textures.  This does not use OpenGL, so it can
+// run on a worker thread.
+void CLodMesh::LoadData(const string &filename, int numLevels, PendingLoad &load)
+{
+	CHighResolutionTimer timer;
+	timer.Start();
+
+	// The cache key covers the source contents and the import settings
+	unsigned long long key = CMeshCache::HashFile(filename);
+	key = CMeshCache::HashData(&numLevels, sizeof(numLevels), key);
+
+	string cacheFilename = CMeshCache::GetCacheFilename(filename);
+	load.warm = CMeshCache::Read(cacheFilename, key, load.cacheFile, load.data);
+	if (!load.warm) {
+		load.cacheFile.Close();
+		load.data = LodMeshData();
+		if (!Import(filename, numLevels, load.data, load.error))
+			return;
+		CMeshCache::Write(cacheFilename, key, load.data);
+	}
+
+	// A texture another mesh has loaded, or whose file has the same contents as one loaded, is shared
+	load.filename = filename;
+	load.textures.resize(load.data.materials.size(), NULL);
+	load.textureHashes.resize(load.data.materials.size(), 0);
+	for (unsigned int i = 0; i < load.data.materials.size(); i++) {
+		if (load.data.materials[i].texturePath.empty() || CResourceManager::IsTextureLoaded(load.data.materials[i].texturePath))
+			continue;
+		load.textureHashes[i] = CMeshCache::HashFile(load.data.materials[i].texturePath);
+		load.textures[i] = new CTextureData;
+		if (!load.textures[i]->Load(load.data.materials[i].texturePath)) {
+			delete load.textures[i];
+			load.textures[i] = NULL;
+		}
+	}
+
+	load.milliseconds = timer.Elapsed();
+	load.succeeded = true;
+}
+
+// Upload the loaded data; runs on the GL thread
+void CLodMesh::Finish(PendingLoad &load)
+{
+	m_pPendingLoad.reset();
+	if (!load.succeeded) {
+		ReportError("Error loading mesh model", load.error.c_str());
+		return;
+	}
+
+	CHighResolutionTimer timer;
+	timer.Start();
+
+	Upload(load.data);
+	load.succeeded = InitMaterials(load.data.materials, load.textures, load.textureHashes);
+	m_resource = CResourceManager::Register(RESOURCE_MESH, load.filename, 0, m_bufferBytes);
+	load.cacheFile.Close();
+	m_ready = true;
+
+	CMeshCache::RecordLoad(load.warm, load.milliseconds + timer.Elapsed());
+
+	if (m_pImpostorProgram)
+		CreateImpostor(m_pImpostorProgram, m_impostorUp, m_impostorResolution);
+}
+
+// Records each file Assimp opens, such as an OBJ's material library, so that the mesh cache can check them too
+class CRecordingIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+	Assimp::IOStream *Open(const char *pFile, const char *pMode = "rb")
+	{
+		Assimp::IOStream *pStream = Assimp::DefaultIOSystem::Open(pFile, pMode);
+		if (pStream)
+			m_files.push_back(pFile);
+		return pStream;
+	}
+
+	vector<string> m_files;
+};
+
+// Run Assimp and the simplifier over a source file
+bool CLodMesh::Import(const string &filename, int numLevels, LodMeshData &data, string &error)
+{
+	Assimp::Importer importer;
+	CRecordingIOSystem *pIOSystem = new CRecordingIOSystem;
+	importer.SetIOHandler(pIOSystem);		// Deleted by the importer
+	const aiScene *pScene = importer.ReadFile(filename.c_str(),
+		aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
+	if (!pScene) {
+		error = filename + ": " + importer.GetErrorString();
+		return false;
+	}
+
+	// Gather the vertices of all sub-meshes into one buffer
+	vector<MeshVertex> &vertices = data.vertices;
+	vector<vector<unsigned int> > subMeshIndices(pScene->mNumMeshes);
+	vector<unsigned int> subMeshMaterials(pScene->mNumMeshes);
+	glm::vec3 minimum(1e30f), maximum(-1e30f);
+
+	for (unsigned int m = 0; m < pScene->mNumMeshes; m++) {
+		const aiMesh *pMesh = pScene->mMeshes[m];
+		unsigned int baseVertex = (unsigned int)vertices.size();
+		const aiVector3D zero(0.0f, 0.0f, 0.0f);
+
+		for (unsigned int i = 0; i < pMesh->mNumVertices; i++) {
+			const aiVector3D *pPos = &(pMesh->mVertices[i]);
+			const aiVector3D *pNormal = &(pMesh->mNormals[i]);
+			const aiVector3D *pTexCoord = pMesh->HasTextureCoords(0) ? &(pMesh->mTextureCoords[0][i]) : &zero;
+
+			MeshVertex v;
+			v.position = glm::vec3(pPos->x, pPos->y, pPos->z);
+			v.texCoord = glm::vec2(pTexCoord->x, pTexCoord->y);
+			v.normal = glm::vec3(pNormal->x, pNormal->y, pNormal->z);
+			vertices.push_back(v);
+
+			minimum = glm::min(minimum, v.position);
+			maximum = glm::max(maximum, v.position);
+		}
+
+		for (unsigned int i = 0; i < pMesh->mNumFaces; i++) {
+			const aiFace &face = pMesh->mFaces[i];
+			if (face.mNumIndices != 3)
+				continue;
+			subMeshIndices[m].push_back(baseVertex + face.mIndices[0]);
+			subMeshIndices[m].push_back(baseVertex + face.mIndices[1]);
+			subMeshIndices[m].push_back(baseVertex + face.mIndices[2]);
+		}
+		subMeshMaterials[m] = pMesh->mMaterialIndex;
+	}
+
+	if (vertices.empty()) {
+		error = filename + ": no vertices";
+		return false;
+	}
+
+	data.centre = 0.5f * (minimum + maximum);
+	data.radius = 0.0f;
+	for (unsigned int i = 0; i < vertices.size(); i++)
+		data.radius = std::max(data.radius, glm::distance(data.centre, vertices[i].position));
+
+	// Simplify each sub-mesh separately so that material boundaries are kept.  All levels share the vertex buffer.
+	vector<unsigned int> &indices = data.indices;
+	CMeshSimplifier simplifier;
+	float screenSize = LOD_FIRST_SWITCH_SIZE;
+	for (int l = 0; l < numLevels; l++) {
+		LodLevel level;
+		level.minScreenSize = (l == numLevels - 1) ? 0.0f : screenSize;
+		screenSize /= LOD_SWITCH_RATIO;
+
+		for (unsigned int m = 0; m < subMeshIndices.size(); m++) {
+			if (l > 0) {
+				unsigned int target = (unsigned int)(subMeshIndices[m].size() / 3 * LOD_TRIANGLE_RATIO);
+				subMeshIndices[m] = simplifier.Simplify(vertices, subMeshIndices[m], target);
+			}
+			if (subMeshIndices[m].empty())
+				continue;
+
+			LodIndexRange range;
+			range.firstIndex = (unsigned int)indices.size();
+			range.numIndices = (unsigned int)subMeshIndices[m].size();
+			range.materialIndex = subMeshMaterials[m];
+			level.ranges.push_back(range);
+			indices.insert(indices.end(), subMeshIndices[m].begin(), subMeshIndices[m].end());
+		}
+		data.levels.push_back(level);
+	}
+
+	if (indices.empty()) {
+		error = filename + ": no triangles";
+		return false;
+	}
+
+	data.pVertices = &vertices[0];
+	data.numVertices = (unsigned int)vertices.size();
+	data.pIndices = &indices[0];
+	data.numIndices = (unsigned int)indices.size();
+
+	// Resolve the diffuse texture of each material relative to the mesh file
+	string::size_type slashIndex = filename.find_last_of("\\/");
+	string dir;
+	if (slashIndex == string::npos)
+		dir = ".";
+	else if (slashIndex == 0)
+		dir = "/";
+	else
+		dir = filename.substr(0, slashIndex);
+
+	data.materials.resize(pScene->mNumMaterials);
+	for (unsigned int i = 0; i < pScene->mNumMaterials; i++) {
+		const aiMaterial *pMaterial = pScene->mMaterials[i];
+
+		aiString path;
+		if (pMaterial->GetTextureCount(aiTextureType_DIFFUSE) > 0 &&
+			pMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS)
+			data.materials[i].texturePath = JoinPath(dir, path.data);
+
+		aiColor3D colour(0.0f, 0.0f, 0.0f);
+		pMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, colour);
+		data.materials[i].diffuse = glm::vec3(colour.r, colour.g, colour.b);
+	}
+
+	// Editing any file the mesh was built from invalidates its cache file
+	for (unsigned int i = 0; i < pIOSystem->m_files.size(); i++) {
+		if (pIOSystem->m_files[i] != filename)
+			data.dependencies.push_back(pIOSystem->m_files[i]);
+	}
+	for (unsigned int i = 0; i < data.materials.size(); i++) {
+		if (!data.materials[i].texturePath.empty())
+			data.dependencies.push_back(data.materials[i].texturePath);
+	}
+	std::sort(data.dependencies.begin(), data.dependencies.end());
+	data.dependencies.erase(std::unique(data.dependencies.begin(), data.dependencies.end()), data.dependencies.end());
+
+	return true;
+}
+
+void CLodMesh::Upload(const LodMeshData &data)
+{
+	m_levels = data.levels;
+	m_centre = data.centre;
+	m_radius = data.radius;
+	m_bufferBytes = data.numVertices * sizeof(MeshVertex) + data.numIndices * sizeof(unsigned int);
+
+	if (m_pPool) {
+		m_poolRange = m_pPool->Allocate(data.pVertices, data.numVertices, data.pIndices, data.numIndices);
+		m_pooled = true;
+		return;
+	}
+
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, data.numVertices * sizeof(MeshVertex), data.pVertices, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.numIndices * sizeof(unsigned int), data.pIndices, GL_STATIC_DRAW);
+
+	GLsizei stride = sizeof(MeshVertex);
+	// Vertex positions
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+	// Texture coordinates
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
+	// Normal vectors
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3) + sizeof(glm::vec2)));
+
+	glBindVertexArray(0);
+}
+
+// Create the diffuse texture of each material from its loaded data, or a single texel of the diffuse colour if there is none
+bool CLodMesh::InitMaterials(const vector<LodMaterial> &materials, const vector<CTextureData*> &textures,
+	const vector<unsigned long long> &textureHashes)
+{
+	bool result = true;
+	m_textures.resize(materials.size(), NULL);
+
+	for (unsigned int i = 0; i < materials.size(); i++) {
+		if (!materials[i].texturePath.empty()) {
+			CTextureData *pData = i < textures.size() ? textures[i] : NULL;
+			unsigned long long hash = i < textureHashes.size() ? textureHashes[i] : 0;
+			m_textures[i] = CResourceManager::AcquireLoadedTexture(materials[i].texturePath, hash, pData, true);
+			if (!m_textures[i]) {
+				ReportError("Error loading mesh texture", materials[i].texturePath.c_str());
+				result = false;
+			}
+		}
+
+		if (!m_textures[i]) {
+			const glm::vec3 &colour = materials[i].diffuse;
+			BYTE data[3];
+			data[0] = (BYTE)(colour.b * 255);
+			data[1] = (BYTE)(colour.g * 255);
+			data[2] = (BYTE)(colour.r * 255);
+			m_textures[i] = CResourceManager::AcquireTextureFromData("Material colour", data, 1, 1, 24, GL_BGR);
+		}
+	}
+
+	return result;
+}
+
+// Render the mesh once from the side into a texture, to be drawn as a camera-facing billboard for the farthest level.
+// The impostor uses the shader's own lighting with full ambient reflectance, like the skybox and terrain.
+void CLodMesh::CreateImpostor(CShaderPermutations *pProgram, const glm::vec3 &upAxis, int resolution)
+{
+	m_impostorUp = glm::normalize(upAxis);
+	if (!m_ready) {
+		m_pImpostorProgram = pProgram;
+		m_impostorResolution = resolution;
+		return;
+	}
+	m_pImpostorProgram = NULL;
+	if (m_levels.empty())
+		return;
+
+	glGenTextures(1, &m_impostorTexture);
+	glBindTexture(GL_TEXTURE_2D, m_impostorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, resolution, resolution, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenRenderbuffers(1, &m_impostorDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_impostorDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, resolution, resolution);
+
+	glGenFramebuffers(1, &m_impostorFbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_impostorFbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_impostorTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_impostorDepth);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return;
+	}
+
+	GLint viewport[4];
+	GLfloat clearColour[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColour);
+
+	glViewport(0, 0, resolution, resolution);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+
+	// Look at the mesh along a direction perpendicular to its up axis
+	glm::vec3 side = fabs(m_impostorUp.y) < 0.9f ? glm::vec3(0, 1, 0) : glm::vec3(0, 0, 1);
+	glm::vec3 viewDirection = glm::normalize(glm::cross(m_impostorUp, side));
+	glm::mat4 view = glm::lookAt(m_centre - viewDirection * (2.0f * m_radius), m_centre, m_impostorUp);
+	glm::mat4 projection = glm::ortho(-m_radius, m_radius, -m_radius, m_radius, 0.0f, 4.0f * m_radius);
+
+	pProgram->UseProgram(MAIN_SHADER_TEXTURE);
+	pProgram->SetUniform("matrices.projMatrix", projection);
+	pProgram->SetUniform("matrices.modelViewMatrix", view);
+	pProgram->SetUniform("matrices.normalMatrix", glm::transpose(glm::inverse(glm::mat3(view))));
+	pProgram->SetUniform("light1.position", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	pProgram->SetUniform("light1.La", glm::vec3(1.0f));
+	pProgram->SetUniform("light1.Ld", glm::vec3(0.0f));
+	pProgram->SetUniform("light1.Ls", glm::vec3(0.0f));
+	pProgram->SetUniform("material1.Ma", glm::vec3(1.0f));
+	pProgram->SetUniform("material1.Md", glm::vec3(0.0f));
+	pProgram->SetUniform("material1.Ms", glm::vec3(0.0f));
+	RenderLevel(0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glClearColor(clearColour[0], clearColour[1], clearColour[2], clearColour[3]);
+
+	// A dynamic quad, rebuilt to face the camera for every instance drawn as an impostor
+	glGenVertexArrays(1, &m_impostorVao);
+	glBindVertexArray(m_impostorVao);
+	glGenBuffers(1, &m_impostorVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_impostorVbo);
+	glBufferData(GL_ARRAY_BUFFER, 4 * sizeof(MeshVertex), NULL, GL_DYNAMIC_DRAW);
+
+	GLsizei stride = sizeof(MeshVertex);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3) + sizeof(glm::vec2)));
+	glBindVertexArray(0);
+
+	// The impostor replaces the last mesh level, which now switches in at the previous threshold
+	LodLevel impostor;
+	impostor.minScreenSize = 0.0f;
+	m_levels.back().minScreenSize = m_levels.size() > 1 ?
+		m_levels[m_levels.size() - 2].minScreenSize / LOD_SWITCH_RATIO : LOD_FIRST_SWITCH_SIZE;
+	m_levels.push_back(impostor);
+	m_hasImpostor = true;
+	// Four bytes of colour and four of depth a texel
+	CResourceManager::SetBytes(m_resource, 0, m_bufferBytes + (size_t)resolution * resolution * 8);
+}
+
+// Diameter of the bounding sphere on screen, in pixels
+float CLodMesh::ProjectedSize(const glm::mat4 &modelViewMatrix, const glm::mat4 &projectionMatrix, int viewportHeight)
+{
+	glm::vec4 centre = modelViewMatrix * glm::vec4(m_centre, 1.0f);
+	float scale = glm::length(glm::vec3(modelViewMatrix[0]));
+	float radius = m_radius * scale;
+	float distance = -centre.z;
+	if (distance <= radius)
+		return 1e30f;
+
+	return radius * projectionMatrix[1][1] * viewportHeight / distance;
+}
+
+void CLodMesh::Render(int instance, const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix,
+	const glm::mat4 &projectionMatrix, int viewportHeight)
+{
+	if (m_levels.empty())
+		return;
+
+	if (instance >= (int)m_instanceLevels.size())
+		m_instanceLevels.resize(instance + 1, 0);
+
+	float size = ProjectedSize(viewMatrix * modelMatrix, projectionMatrix, viewportHeight);
+
+	// Only move to a finer level when clearly above its threshold, and to a coarser one when clearly below, so that
+	// an instance sitting on a threshold does not flicker between levels
+	int level = m_instanceLevels[instance];
+	int lastLevel = (int)m_levels.size() - 1;
+	while (level > 0 && size > m_levels[level - 1].minScreenSize * (1.0f + LOD_HYSTERESIS))
+		level--;
+	while (level < lastLevel && size < m_levels[level].minScreenSize * (1.0f - LOD_HYSTERESIS))
+		level++;
+	m_instanceLevels[instance] = level;
+
+	if (m_hasImpostor && level == lastLevel)
+		m_impostors.push_back(modelMatrix);
+	else
+		QueueLevel(level, modelMatrix);
+}
+
+void CLodMesh::RenderLevel(int level)
+{
+	if (level < 0 || level >= (int)m_levels.size() || m_levels[level].ranges.empty())
+		return;
+
+	// In a pool, the level's indices are offset by the mesh's range
+	unsigned int firstIndex = 0, baseVertex = 0;
+	if (m_pooled) {
+		m_pPool->Bind();
+		firstIndex = m_poolRange.firstIndex;
+		baseVertex = m_poolRange.firstVertex;
+	}
+	else {
+		glBindVertexArray(m_vao);
+		CRenderStats::AddStateChanges();
+	}
+
+	const vector<LodIndexRange> &ranges = m_levels[level].ranges;
+	for (unsigned int i = 0; i < ranges.size(); i++) {
+		unsigned int materialIndex = ranges[i].materialIndex;
+		if (materialIndex < m_textures.size() && m_textures[materialIndex])
+			m_textures[materialIndex]->Bind();
+		glDrawElementsBaseVertex(GL_TRIANGLES, ranges[i].numIndices, GL_UNSIGNED_INT,
+			(void*)((firstIndex + ranges[i].firstIndex) * sizeof(unsigned int)), baseVertex);
+		CRenderStats::AddDrawCalls();
+	}
+}
+
+void CLodMesh::QueueLevel(int level, const glm::mat4 &modelMatrix)
+{
+	if (!m_pooled) {
+		RenderLevel(level);
+		return;
+	}
+	if (level < 0 || level >= (int)m_levels.size())
+		return;
+
+	const vector<LodIndexRange> &ranges = m_levels[level].ranges;
+	for (unsigned int i = 0; i < ranges.size(); i++) {
+		unsigned int materialIndex = ranges[i].materialIndex;
+		CCompiledTexture *pTexture = materialIndex < m_textures.size() ? m_textures[materialIndex] : NULL;
+		m_pPool->AddDraw(m_poolRange, ranges[i].firstIndex, ranges[i].numIndices, pTexture, modelMatrix,
+			glm::vec4(m_centre, m_radius));
+	}
+}
+
+void CLodMesh::RenderImpostors(CShaderPermutations *pProgram, const glm::mat4 &viewMatrix)
+{
+	for (unsigned int i = 0; i < m_impostors.size(); i++) {
+		glm::mat4 modelViewMatrix = viewMatrix * m_impostors[i];
+		pProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrix);
+		pProgram->SetUniform("matrices.normalMatrix", glm::transpose(glm::inverse(glm::mat3(modelViewMatrix))));
+		RenderImpostor(modelViewMatrix);
+	}
+}
+
+void CLodMesh::ClearImpostors()
+{
+	m_impostors.clear();
+}
+
+void CLodMesh::SetGeometryPool(CGeometryPool *pPool)
+{
+	m_pPool = pPool;
+}
+
+// Draw the captured image on a quad that turns about the up axis to face the camera
+void CLodMesh::RenderImpostor(const glm::mat4 &modelViewMatrix)
+{
+	glm::vec3 eye = glm::vec3(glm::inverse(modelViewMatrix) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	glm::vec3 toEye = eye - m_centre;
+	toEye -= glm::dot(toEye, m_impostorUp) * m_impostorUp;
+	if (glm::length(toEye) < 1e-6f)
+		return;
+	glm::vec3 normal = glm::normalize(toEye);
+	glm::vec3 right = glm::cross(m_impostorUp, normal);
+	glm::vec3 up = m_impostorUp * m_radius;
+	right *= m_radius;
+
+	MeshVertex quad[4];
+	quad[0].position = m_centre - right - up; quad[0].texCoord = glm::vec2(0, 0);
+	quad[1].position = m_centre + right - up; quad[1].texCoord = glm::vec2(1, 0);
+	quad[2].position = m_centre - right + up; quad[2].texCoord = glm::vec2(0, 1);
+	quad[3].position = m_centre + right + up; quad[3].texCoord = glm::vec2(1, 1);
+	for (int i = 0; i < 4; i++)
+		quad[i].normal = normal;
+
+	glBindVertexArray(m_impostorVao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_impostorVbo);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(quad), quad);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, m_impostorTexture);
+	glBindSampler(0, 0);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glDisable(GL_BLEND);
+	CRenderStats::AddStateChanges(2);
+	CRenderStats::AddDrawCalls();
+}
+
+int CLodMesh::GetNumLevels()
+{
+	return (int)m_levels.size();
+}
+
+void CLodMesh::Release()
+{
+	if (m_pPendingLoad) {
+		m_pPendingLoad->cancelled = true;
+		m_pPendingLoad.reset();
+	}
+	for (unsigned int i = 0; i < m_textures.size(); i++)
+		CResourceManager::ReleaseTexture(m_textures[i]);
+	m_textures.clear();
+	CResourceManager::Unregister(m_resource);
+	m_resource = -1;
+	m_levels.clear();
+	m_instanceLevels.clear();
+	m_impostors.clear();
+	m_ready = false;
+
+	if (m_vao) glDeleteVertexArrays(1, &m_vao);
+	if (m_vbo) glDeleteBuffers(1, &m_vbo);
+	if (m_ibo) glDeleteBuffers(1, &m_ibo);
+	m_vao = m_vbo = m_ibo = 0;
+	if (m_pooled)
+		m_pPool->Free(m_poolRange);
+	m_pooled = false;
+
+	if (m_impostorVao) glDeleteVertexArrays(1, &m_impostorVao);
+	if (m_impostorVbo) glDeleteBuffers(1, &m_impostorVbo);
+	if (m_impostorFbo) glDeleteFramebuffers(1, &m_impostorFbo);
+	if (m_impostorTexture) glDeleteTextures(1, &m_impostorTexture);
+	if (m_impostorDepth) glDeleteRenderbuffers(1, &m_impostorDepth);
+	m_impostorVao = m_impostorVbo = m_impostorFbo = m_impostorTexture = m_impostorDepth = 0;
+	m_hasImpostor = false;
+}
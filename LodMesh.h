@@ -0,0 +1,109 @@
+#pragma once
+#include "Common.h"
+#include "CompiledTexture.h"
+#include "MeshCache.h"
+#include "GeometryPool.h"
+#include <atomic>
+#include <memory>
+
+class CShaderPermutations;
+class CAssetLoader;
+
+// A static mesh imported with Assimp, together with a chain of simplified levels of detail that are generated at load time by
+// quadric edge collapse.  Render picks a level from the projected screen size of the mesh's bounding sphere, with hysteresis
+// so that instances do not pop between levels at a threshold.  Optionally, the farthest level is a camera-facing impostor.
+class CLodMesh
+{
+public:
+	CLodMesh();
+	~CLodMesh();
+
+	// Load a mesh with numLevels levels of detail (level 0 is the original mesh).  The result is cached, so Assimp and the
+	// simplifier only run when the source file or the number of levels changes.
+	bool Load(const string &filename, int numLevels = 4);
+
+	// Load on the asset loader's workers and upload when the loader next processes uploads.  Until then the mesh is not
+	// ready and renders nothing.  Releasing or reloading the mesh, or deleting it, cancels a load still in flight.
+	void LoadAsync(CAssetLoader *pLoader, const string &filename, int numLevels = 4);
+	bool IsReady();
+
+	// Upload into a shared pool rather than buffers of the mesh's own.  Call before loading.
+	void SetGeometryPool(CGeometryPool *pPool);
+
+	// If the mesh is still loading, the impostor is created as soon as it has been uploaded
+	void CreateImpostor(CShaderPermutations *pProgram, const glm::vec3 &upAxis, int resolution = 256);
+
+	// Render one instance of the mesh, choosing its level from the given view.  Each instance keeps its own level so that
+	// hysteresis works per instance.  In a geometry pool, the level is queued with the model matrix; otherwise the
+	// modelview matrix must already be set in the shader.  An instance at the impostor level is kept for RenderImpostors.
+	void Render(int instance, const glm::mat4 &modelMatrix, const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix,
+		int viewportHeight);
+	void RenderLevel(int level);
+	// Queue a level in the geometry pool with its model matrix, or render it now if the mesh is not in a pool
+	void QueueLevel(int level, const glm::mat4 &modelMatrix);
+	// Draw the instances kept at the impostor level since ClearImpostors, facing the camera of the given view.  The
+	// program's other uniforms must already be set.
+	void RenderImpostors(CShaderPermutations *pProgram, const glm::mat4 &viewMatrix);
+	void ClearImpostors();
+	int GetNumLevels();
+	void Release();
+
+private:
+	// Everything produced off the GL thread, kept until the upload.  It is shared with the loader's jobs, which only touch
+	// the mesh itself while the load has not been cancelled.
+	struct PendingLoad
+	{
+		LodMeshData data;
+		CMappedFile cacheFile;
+		string filename;
+		vector<CTextureData*> textures;	// Diffuse texture of each material, or NULL if none or already loaded
+		vector<unsigned long long> textureHashes;
+		bool warm;
+		bool succeeded;
+		string error;					// Reported on the GL thread if the load failed
+		double milliseconds;
+		std::atomic<bool> cancelled;
+
+		PendingLoad();
+		~PendingLoad();
+	};
+
+	// These two run on a worker, so they do not use the mesh
+	static void LoadData(const string &filename, int numLevels, PendingLoad &load);
+	static bool Import(const string &filename, int numLevels, LodMeshData &data, string &error);
+	void Finish(PendingLoad &load);
+	void Upload(const LodMeshData &data);
+	bool InitMaterials(const vector<LodMaterial> &materials, const vector<CTextureData*> &textures,
+		const vector<unsigned long long> &textureHashes);
+	float ProjectedSize(const glm::mat4 &modelViewMatrix, const glm::mat4 &projectionMatrix, int viewportHeight);
+	void RenderImpostor(const glm::mat4 &modelViewMatrix);
+
+	GLuint m_vao;
+	GLuint m_vbo;
+	GLuint m_ibo;
+	CGeometryPool *m_pPool;
+	GeometryRange m_poolRange;
+	bool m_pooled;
+	vector<LodLevel> m_levels;
+	vector<CCompiledTexture*> m_textures;	// Held from the resource manager
+	int m_resource;							// The resource manager's handle for the buffers and impostor
+	size_t m_bufferBytes;					// Of the vertices and indices, in the pool or not
+	vector<int> m_instanceLevels;
+	vector<glm::mat4> m_impostors;			// Model matrices of the instances at the impostor level
+	std::shared_ptr<PendingLoad> m_pPendingLoad;	// Of LoadAsync, until it is uploaded
+
+	glm::vec3 m_centre;						// Bounding sphere in model space
+	float m_radius;
+
+	bool m_ready;
+	CShaderPermutations *m_pImpostorProgram;	// Set while an impostor is waiting for the mesh to load
+	int m_impostorResolution;
+
+	bool m_hasImpostor;
+	glm::vec3 m_impostorUp;
+	GLuint m_impostorVao;
+	GLuint m_impostorVbo;
+	GLuint m_impostorFbo;
+	GLuint m_impostorTexture;
+	GLuint m_impostorDepth;
+};
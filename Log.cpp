@@ -0,0 +1,28 @@
+#include "Log.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+void LogMessage(const char *format, ...)
+{
+	char buffer[1024];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, sizeof(buffer) - 2, format, args);
+	va_end(args);
+	strcat(buffer, "\n");
+
+#ifdef _WIN32
+	OutputDebugStringA(buffer);
+#else
+	// Headless runs have no debugger attached
+	fputs(buffer, stderr);
+#endif
+}
+
+void ReportError(const char *title, const char *message)
+{
+	LogMessage("%s: %s", title, message);
+#ifdef _WIN32
+	MessageBox(NULL, message, title, MB_ICONHAND);
+#endif
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include "Common.h"
+
+// Write a printf-style line to the debugger output, or to stderr off Windows
+void LogMessage(const char *format, ...);
+// Log an error, and on Windows also show it in a message box, which blocks the calling thread until it is dismissed
+void ReportError(const char *title, const char *message);
@@ -0,0 +1,26 @@
+#pragma once
+#include "Common.h"
+
+// A read-only view of a whole file mapped into memory
+class CMappedFile
+{
+public:
+	CMappedFile();
+	~CMappedFile();
+
+	bool Open(const string &filename);
+	void Close();
+
+	const BYTE *GetData();
+	size_t GetSize();
+
+private:
+#ifdef _WIN32
+	HANDLE m_file;
+	HANDLE m_mapping;
+#else
+	int m_file;
+#endif
+	const BYTE *m_pData;
+	size_t m_size;
+};
@@ -0,0 +1,243 @@
+#include "MeshCache.h"
+#include "Log.h"
+#include "FileSystem.h"
+#include <stdio.h>
+
+// Bump when the layout below or the way meshes are processed on import changes
+static const unsigned int MESH_CACHE_MAGIC = 0x4D444F4C; // "LODM"
+static const unsigned int MESH_CACHE_VERSION = 2;
+
+struct MeshCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long key;
+	unsigned int numVertices;
+	unsigned int numIndices;
+	unsigned int numLevels;
+	unsigned int numRanges;
+	unsigned int numMaterials;
+	unsigned int numDependencies;
+	float centre[3];
+	float radius;
+};
+
+struct MeshCacheLevel
+{
+	float minScreenSize;
+	unsigned int firstRange;
+	unsigned int numRanges;
+};
+
+int CMeshCache::m_warmLoads = 0;
+int CMeshCache::m_coldLoads = 0;
+double CMeshCache::m_warmTime = 0.0;
+double CMeshCache::m_coldTime = 0.0;
+
+// 64-bit FNV-1a
+unsigned long long CMeshCache::HashData(const void *pData, size_t size, unsigned long long hash)
+{
+	const BYTE *pBytes = (const BYTE*)pData;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= pBytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Hash of a file's contents, or 0 if it cannot be read
+unsigned long long CMeshCache::HashFile(const string &filename)
+{
+	CMappedFile file;
+	if (!file.Open(filename))
+		return 0;
+	return HashData(file.GetData(), file.GetSize());
+}
+
+string CMeshCache::GetCacheFilename(const string &sourceFilename)
+{
+	string name = sourceFilename;
+	for (unsigned int i = 0; i < name.size(); i++) {
+		if (name[i] == '\\' || name[i] == '/' || name[i] == ' ' || name[i] == '.' || name[i] == ':')
+			name[i] = '_';
+	}
+	return JoinPath("resources/cache", name + ".lodmesh");
+}
+
+// Map a cache file and point data at its contents.  The file must stay open while the data is in use.  Fails if the key
+// or the contents of any dependency have changed.
+bool CMeshCache::Read(const string &cacheFilename, unsigned long long key, CMappedFile &file, LodMeshData &data)
+{
+	if (!file.Open(cacheFilename))
+		return false;
+
+	const BYTE *pData = file.GetData();
+	size_t size = file.GetSize();
+	if (size < sizeof(MeshCacheHeader))
+		return false;
+
+	const MeshCacheHeader *pHeader = (const MeshCacheHeader*)pData;
+	if (pHeader->magic != MESH_CACHE_MAGIC || pHeader->version != MESH_CACHE_VERSION || pHeader->key != key)
+		return false;
+
+	size_t offset = sizeof(MeshCacheHeader);
+	size_t fixedSize = offset + pHeader->numVertices * sizeof(MeshVertex) + pHeader->numIndices * sizeof(unsigned int)
+		+ pHeader->numLevels * sizeof(MeshCacheLevel) + pHeader->numRanges * sizeof(LodIndexRange);
+	if (fixedSize > size)
+		return false;
+
+	data.pVertices = (const MeshVertex*)(pData + offset);
+	data.numVertices = pHeader->numVertices;
+	offset += pHeader->numVertices * sizeof(MeshVertex);
+
+	data.pIndices = (const unsigned int*)(pData + offset);
+	data.numIndices = pHeader->numIndices;
+	offset += pHeader->numIndices * sizeof(unsigned int);
+
+	const MeshCacheLevel *pLevels = (const MeshCacheLevel*)(pData + offset);
+	offset += pHeader->numLevels * sizeof(MeshCacheLevel);
+	const LodIndexRange *pRanges = (const LodIndexRange*)(pData + offset);
+	offset += pHeader->numRanges * sizeof(LodIndexRange);
+
+	data.levels.resize(pHeader->numLevels);
+	for (unsigned int i = 0; i < pHeader->numLevels; i++) {
+		if (pLevels[i].firstRange + pLevels[i].numRanges > pHeader->numRanges)
+			return false;
+		data.levels[i].minScreenSize = pLevels[i].minScreenSize;
+		data.levels[i].ranges.assign(pRanges + pLevels[i].firstRange, pRanges + pLevels[i].firstRange + pLevels[i].numRanges);
+	}
+
+	data.materials.resize(pHeader->numMaterials);
+	for (unsigned int i = 0; i < pHeader->numMaterials; i++) {
+		if (offset + 4 * sizeof(float) > size)
+			return false;
+		const float *pDiffuse = (const float*)(pData + offset);
+		unsigned int pathLength = *(const unsigned int*)(pData + offset + 3 * sizeof(float));
+		offset += 4 * sizeof(float);
+		if (offset + pathLength > size)
+			return false;
+		data.materials[i].diffuse = glm::vec3(pDiffuse[0], pDiffuse[1], pDiffuse[2]);
+		data.materials[i].texturePath.assign((const char*)(pData + offset), pathLength);
+		offset += (pathLength + 3) & ~3u;
+	}
+
+	data.dependencies.resize(pHeader->numDependencies);
+	for (unsigned int i = 0; i < pHeader->numDependencies; i++) {
+		if (offset + sizeof(unsigned long long) + sizeof(unsigned int) > size)
+			return false;
+		unsigned long long hash = *(const unsigned long long*)(pData + offset);
+		unsigned int pathLength = *(const unsigned int*)(pData + offset + sizeof(unsigned long long));
+		offset += sizeof(unsigned long long) + sizeof(unsigned int);
+		if (offset + pathLength > size)
+			return false;
+		data.dependencies[i].assign((const char*)(pData + offset), pathLength);
+		offset += (pathLength + 3) & ~3u;
+		if (HashFile(data.dependencies[i]) != hash)
+			return false;
+	}
+
+	data.centre = glm::vec3(pHeader->centre[0], pHeader->centre[1], pHeader->centre[2]);
+	data.radius = pHeader->radius;
+	return true;
+}
+
+bool CMeshCache::Write(const string &cacheFilename, unsigned long long key, const LodMeshData &data)
+{
+	MakeDirectory("resources/cache");
+
+	string temporaryFilename = cacheFilename + ".tmp";
+	FILE *pFile = fopen(temporaryFilename.c_str(), "wb");
+	if (pFile == NULL)
+		return false;
+
+	unsigned int numRanges = 0;
+	for (unsigned int i = 0; i < data.levels.size(); i++)
+		numRanges += (unsigned int)data.levels[i].ranges.size();
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.key = key;
+	header.numVertices = data.numVertices;
+	header.numIndices = data.numIndices;
+	header.numLevels = (unsigned int)data.levels.size();
+	header.numRanges = numRanges;
+	header.numMaterials = (unsigned int)data.materials.size();
+	header.numDependencies = (unsigned int)data.dependencies.size();
+	header.centre[0] = data.centre.x;
+	header.centre[1] = data.centre.y;
+	header.centre[2] = data.centre.z;
+	header.radius = data.radius;
+
+	fwrite(&header, sizeof(header), 1, pFile);
+	fwrite(data.pVertices, sizeof(MeshVertex), data.numVertices, pFile);
+	fwrite(data.pIndices, sizeof(unsigned int), data.numIndices, pFile);
+
+	unsigned int firstRange = 0;
+	for (unsigned int i = 0; i < data.levels.size(); i++) {
+		MeshCacheLevel level;
+		level.minScreenSize = data.levels[i].minScreenSize;
+		level.firstRange = firstRange;
+		level.numRanges = (unsigned int)data.levels[i].ranges.size();
+		fwrite(&level, sizeof(level), 1, pFile);
+		firstRange += level.numRanges;
+	}
+	for (unsigned int i = 0; i < data.levels.size(); i++) {
+		if (!data.levels[i].ranges.empty())
+			fwrite(&data.levels[i].ranges[0], sizeof(LodIndexRange), data.levels[i].ranges.size(), pFile);
+	}
+
+	for (unsigned int i = 0; i < data.materials.size(); i++) {
+		float diffuse[3] = { data.materials[i].diffuse.x, data.materials[i].diffuse.y, data.materials[i].diffuse.z };
+		unsigned int pathLength = (unsigned int)data.materials[i].texturePath.size();
+		unsigned int padding = 0;
+		fwrite(diffuse, sizeof(float), 3, pFile);
+		fwrite(&pathLength, sizeof(pathLength), 1, pFile);
+		fwrite(data.materials[i].texturePath.c_str(), 1, pathLength, pFile);
+		fwrite(&padding, 1, ((pathLength + 3) & ~3u) - pathLength, pFile);
+	}
+
+	// Followed by the path, padded to four bytes
+	for (unsigned int i = 0; i < data.dependencies.size(); i++) {
+		unsigned long long hash = HashFile(data.dependencies[i]);
+		unsigned int pathLength = (unsigned int)data.dependencies[i].size();
+		unsigned int padding = 0;
+		fwrite(&hash, sizeof(hash), 1, pFile);
+		fwrite(&pathLength, sizeof(pathLength), 1, pFile);
+		fwrite(data.dependencies[i].c_str(), 1, pathLength, pFile);
+		fwrite(&padding, 1, ((pathLength + 3) & ~3u) - pathLength, pFile);
+	}
+
+	bool result = ferror(pFile) == 0;
+	result = fclose(pFile) == 0 && result;
+	if (result)
+		result = ReplaceFile(temporaryFilename, cacheFilename);
+	if (!result)
+		remove(temporaryFilename.c_str());
+	return result;
+}
+
+void CMeshCache::RecordLoad(bool warm, double milliseconds)
+{
+	if (warm) {
+		m_warmLoads++;
+		m_warmTime += milliseconds;
+	}
+	else {
+		m_coldLoads++;
+		m_coldTime += milliseconds;
+	}
+}
+
+void CMeshCache::Report()
+{
+	LogMessage("Mesh loading: %d warm (cached) in %.1f ms, %d cold (Assimp) in %.1f ms",
+		m_warmLoads, m_warmTime, m_coldLoads, m_coldTime);
+}
+
+// True if every mesh so far was served from the cache
+bool CMeshCache::IsWarmStart()
+{
+	return m_coldLoads == 0;
+}
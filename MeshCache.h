@@ -0,0 +1,70 @@
+#pragma once
+#include "Common.h"
+#include "MeshSimplifier.h"
+#include "MappedFile.h"
+
+// A run of indices drawn with one material
+struct LodIndexRange
+{
+	unsigned int firstIndex;
+	unsigned int numIndices;
+	unsigned int materialIndex;
+};
+
+struct LodLevel
+{
+	vector<LodIndexRange> ranges;
+	float minScreenSize;					// Smallest projected diameter (pixels) at which this level is used
+};
+
+struct LodMaterial
+{
+	string texturePath;						// Empty if the material has no diffuse texture
+	glm::vec3 diffuse;
+};
+
+// Post-processed mesh data, ready for upload.  The vertex and index pointers either refer to the vectors below (after an
+// import) or directly into a memory-mapped cache file.
+struct LodMeshData
+{
+	const MeshVertex *pVertices;
+	unsigned int numVertices;
+	const unsigned int *pIndices;
+	unsigned int numIndices;
+	vector<LodLevel> levels;
+	vector<LodMaterial> materials;
+	glm::vec3 centre;
+	float radius;
+
+	vector<MeshVertex> vertices;
+	vector<unsigned int> indices;
+
+	// Other files the mesh was built from, such as an OBJ's material library and the materials' textures
+	vector<string> dependencies;
+};
+
+// Binary cache of imported meshes, so that Assimp only runs when a source file has changed.  Each source file has one cache
+// file under resources/cache, tagged with a hash of the source contents and the import settings, and listing the hash of
+// each of the mesh's dependencies, which Read checks too.  A cache file is written under a temporary name and renamed
+// into place, so a crash part way through never leaves a truncated one behind.
+class CMeshCache
+{
+public:
+	static unsigned long long HashFile(const string &filename);
+	static unsigned long long HashData(const void *pData, size_t size, unsigned long long hash = 14695981039346656037ULL);
+	static string GetCacheFilename(const string &sourceFilename);
+
+	static bool Read(const string &cacheFilename, unsigned long long key, CMappedFile &file, LodMeshData &data);
+	static bool Write(const string &cacheFilename, unsigned long long key, const LodMeshData &data);
+
+	// Startup statistics, kept separately for loads served from the cache (warm) and loads that ran Assimp (cold)
+	static void RecordLoad(bool warm, double milliseconds);
+	static void Report();
+	static bool IsWarmStart();
+
+private:
+	static int m_warmLoads;
+	static int m_coldLoads;
+	static double m_warmTime;
+	static double m_coldTime;
+};
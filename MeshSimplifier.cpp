@@ -0,0 +1,321 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <map>
+
+namespace
+{
+	// Strict ordering on positions so that bit-identical positions can be welded together
+	struct PositionLess
+	{
+		bool operator()(const glm::vec3 &a, const glm::vec3 &b) const
+		{
+			if (a.x != b.x) return a.x < b.x;
+			if (a.y != b.y) return a.y < b.y;
+			return a.z < b.z;
+		}
+	};
+}
+
+CMeshSimplifier::CMeshSimplifier()
+{}
+
+CMeshSimplifier::~CMeshSimplifier()
+{}
+
+// Accumulate the fundamental error quadric of a plane (a, b, c, d) into q.  Only the upper triangle of the symmetric 4x4 matrix is stored.
+void CMeshSimplifier::AddPlane(Quadric &q, const glm::dvec4 &plane, double weight)
+{
+	double a = plane.x, b = plane.y, c = plane.z, d = plane.w;
+	q.a[0] += weight * a * a; q.a[1] += weight * a * b; q.a[2] += weight * a * c; q.a[3] += weight * a * d;
+	q.a[4] += weight * b * b; q.a[5] += weight * b * c; q.a[6] += weight * b * d;
+	q.a[7] += weight * c * c; q.a[8] += weight * c * d;
+	q.a[9] += weight * d * d;
+}
+
+// Squared distance of p to the planes accumulated in q
+double CMeshSimplifier::Evaluate(const Quadric &q, const glm::vec3 &p)
+{
+	double x = p.x, y = p.y, z = p.z;
+	return q.a[0] * x * x + 2 * q.a[1] * x * y + 2 * q.a[2] * x * z + 2 * q.a[3] * x
+		+ q.a[4] * y * y + 2 * q.a[5] * y * z + 2 * q.a[6] * y
+		+ q.a[7] * z * z + 2 * q.a[8] * z
+		+ q.a[9];
+}
+
+void CMeshSimplifier::WeldPositions(const vector<MeshVertex> &vertices)
+{
+	std::map<glm::vec3, unsigned int, PositionLess> lookup;
+
+	m_positionId.resize(vertices.size());
+	for (unsigned int i = 0; i < vertices.size(); i++) {
+		std::map<glm::vec3, unsigned int, PositionLess>::iterator it = lookup.find(vertices[i].position);
+		if (it == lookup.end()) {
+			unsigned int id = (unsigned int)m_positions.size();
+			lookup[vertices[i].position] = id;
+			m_positions.push_back(vertices[i].position);
+			m_wedges.push_back(vector<unsigned int>());
+			m_positionId[i] = id;
+		}
+		else {
+			m_positionId[i] = it->second;
+		}
+		m_wedges[m_positionId[i]].push_back(i);
+	}
+
+	// A position shared by vertices with different attributes lies on a texture seam or a hard edge; keep it fixed
+	m_locked.assign(m_positions.size(), false);
+	for (unsigned int i = 0; i < m_positions.size(); i++) {
+		const MeshVertex &first = vertices[m_wedges[i][0]];
+		for (unsigned int w = 1; w < m_wedges[i].size() && !m_locked[i]; w++) {
+			const MeshVertex &other = vertices[m_wedges[i][w]];
+			m_locked[i] = other.texCoord != first.texCoord || other.normal != first.normal;
+		}
+	}
+}
+
+void CMeshSimplifier::ComputeQuadrics(const vector<unsigned int> &indices)
+{
+	Quadric zero;
+	for (int i = 0; i < 10; i++)
+		zero.a[i] = 0.0;
+	m_quadrics.assign(m_positions.size(), zero);
+	m_vertexTriangles.assign(m_positions.size(), vector<unsigned int>());
+
+	for (unsigned int i = 0; i + 2 < indices.size(); i += 3) {
+		unsigned int p0 = m_positionId[indices[i]];
+		unsigned int p1 = m_positionId[indices[i + 1]];
+		unsigned int p2 = m_positionId[indices[i + 2]];
+		if (p0 == p1 || p1 == p2 || p2 == p0)
+			continue;
+
+		glm::dvec3 a(m_positions[p0]), b(m_positions[p1]), c(m_positions[p2]);
+		glm::dvec3 n = glm::cross(b - a, c - a);
+		double area = glm::length(n);
+		if (area <= 0.0)
+			continue;
+		n /= area;
+		glm::dvec4 plane(n, -glm::dot(n, a));
+
+		// Weight by area so large faces dominate the error
+		AddPlane(m_quadrics[p0], plane, area);
+		AddPlane(m_quadrics[p1], plane, area);
+		AddPlane(m_quadrics[p2], plane, area);
+
+		unsigned int t = (unsigned int)m_triangles.size() / 3;
+		m_triangles.push_back(p0);
+		m_triangles.push_back(p1);
+		m_triangles.push_back(p2);
+		m_vertexTriangles[p0].push_back(t);
+		m_vertexTriangles[p1].push_back(t);
+		m_vertexTriangles[p2].push_back(t);
+	}
+	m_triangleRemoved.assign(m_triangles.size() / 3, false);
+}
+
+// Lock both ends of every edge that belongs to only one triangle, so open borders do not shrink
+void CMeshSimplifier::LockBoundaries()
+{
+	std::map<std::pair<unsigned int, unsigned int>, int> edgeCount;
+	for (unsigned int t = 0; t < m_triangleRemoved.size(); t++) {
+		for (int e = 0; e < 3; e++) {
+			unsigned int a = m_triangles[t * 3 + e];
+			unsigned int b = m_triangles[t * 3 + (e + 1) % 3];
+			edgeCount[std::make_pair(std::min(a, b), std::max(a, b))]++;
+		}
+	}
+
+	std::map<std::pair<unsigned int, unsigned int>, int>::iterator it;
+	for (it = edgeCount.begin(); it != edgeCount.end(); ++it) {
+		if (it->second == 1) {
+			m_locked[it->first.first] = true;
+			m_locked[it->first.second] = true;
+		}
+	}
+}
+
+float CMeshSimplifier::CollapseCost(unsigned int from, unsigned int to)
+{
+	Quadric q = m_quadrics[from];
+	for (int i = 0; i < 10; i++)
+		q.a[i] += m_quadrics[to].a[i];
+	return (float)std::max(0.0, Evaluate(q, m_positions[to]));
+}
+
+// Moving from onto to must not turn any of the surrounding triangles inside out
+bool CMeshSimplifier::FlipsTriangle(unsigned int from, unsigned int to)
+{
+	const vector<unsigned int> &triangles = m_vertexTriangles[from];
+	for (unsigned int i = 0; i < triangles.size(); i++) {
+		unsigned int t = triangles[i];
+		if (m_triangleRemoved[t])
+			continue;
+
+		unsigned int *tri = &m_triangles[t * 3];
+		if (tri[0] == to || tri[1] == to || tri[2] == to)
+			continue; // This triangle degenerates and is removed
+
+		glm::vec3 p[3], q[3];
+		for (int c = 0; c < 3; c++) {
+			p[c] = m_positions[tri[c]];
+			q[c] = tri[c] == from ? m_positions[to] : p[c];
+		}
+		glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+		glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+		if (glm::dot(before, after) <= 0.0f)
+			return true;
+	}
+	return false;
+}
+
+// Queue the collapse of v onto each of its current neighbours
+void CMeshSimplifier::PushCollapses(unsigned int v)
+{
+	if (m_locked[v] || m_remap[v] != v)
+		return;
+
+	const vector<unsigned int> &triangles = m_vertexTriangles[v];
+	for (unsigned int i = 0; i < triangles.size(); i++) {
+		unsigned int t = triangles[i];
+		if (m_triangleRemoved[t])
+			continue;
+		for (int c = 0; c < 3; c++) {
+			unsigned int n = m_triangles[t * 3 + c];
+			if (n == v)
+				continue;
+			Collapse collapse;
+			collapse.cost = CollapseCost(v, n);
+			collapse.from = v;
+			collapse.to = n;
+			collapse.version = m_version[v];
+			m_heap.push_back(collapse);
+			std::push_heap(m_heap.begin(), m_heap.end());
+		}
+	}
+}
+
+// Pick the vertex at a welded position whose texture coordinate best matches the vertex it replaces
+unsigned int CMeshSimplifier::ClosestWedge(const vector<MeshVertex> &vertices, unsigned int position, unsigned int original)
+{
+	const vector<unsigned int> &wedges = m_wedges[position];
+	unsigned int best = wedges[0];
+	float bestDistance = 1e30f;
+	for (unsigned int i = 0; i < wedges.size(); i++) {
+		glm::vec2 d = vertices[wedges[i]].texCoord - vertices[original].texCoord;
+		float distance = glm::dot(d, d);
+		if (distance < bestDistance) {
+			bestDistance = distance;
+			best = wedges[i];
+		}
+	}
+	return best;
+}
+
+vector<unsigned int> CMeshSimplifier::Simplify(const vector<MeshVertex> &vertices, const vector<unsigned int> &indices,
+	unsigned int targetTriangles, float maxError)
+{
+	m_positionId.clear();
+	m_wedges.clear();
+	m_positions.clear();
+	m_triangles.clear();
+	m_heap.clear();
+
+	WeldPositions(vertices);
+	ComputeQuadrics(indices);
+	LockBoundaries();
+
+	unsigned int numPositions = (unsigned int)m_positions.size();
+	m_remap.resize(numPositions);
+	for (unsigned int i = 0; i < numPositions; i++)
+		m_remap[i] = i;
+	m_version.assign(numPositions, 0);
+
+	for (unsigned int v = 0; v < numPositions; v++)
+		PushCollapses(v);
+
+	unsigned int triangleCount = (unsigned int)m_triangleRemoved.size();
+	while (triangleCount > targetTriangles && !m_heap.empty()) {
+		std::pop_heap(m_heap.begin(), m_heap.end());
+		Collapse collapse = m_heap.back();
+		m_heap.pop_back();
+
+		if (collapse.cost > maxError)
+			break;
+
+		// Skip entries made stale by earlier collapses
+		unsigned int from = collapse.from, to = collapse.to;
+		if (collapse.version != m_version[from] || m_remap[from] != from || m_remap[to] != to)
+			continue;
+		if (FlipsTriangle(from, to))
+			continue;
+
+		m_remap[from] = to;
+		for (int i = 0; i < 10; i++)
+			m_quadrics[to].a[i] += m_quadrics[from].a[i];
+
+		const vector<unsigned int> &triangles = m_vertexTriangles[from];
+		for (unsigned int i = 0; i < triangles.size(); i++) {
+			unsigned int t = triangles[i];
+			if (m_triangleRemoved[t])
+				continue;
+			unsigned int *tri = &m_triangles[t * 3];
+			for (int c = 0; c < 3; c++) {
+				if (tri[c] == from)
+					tri[c] = to;
+			}
+			if (tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0]) {
+				m_triangleRemoved[t] = true;
+				triangleCount--;
+			}
+			else {
+				m_vertexTriangles[to].push_back(t);
+			}
+		}
+
+		// Every collapse touching the neighbourhood of to now has a different cost
+		m_version[to]++;
+		PushCollapses(to);
+		const vector<unsigned int> &neighbourhood = m_vertexTriangles[to];
+		for (unsigned int i = 0; i < neighbourhood.size(); i++) {
+			unsigned int t = neighbourhood[i];
+			if (m_triangleRemoved[t])
+				continue;
+			for (int c = 0; c < 3; c++) {
+				unsigned int n = m_triangles[t * 3 + c];
+				if (n != to) {
+					m_version[n]++;
+					PushCollapses(n);
+				}
+			}
+		}
+	}
+
+	// Map the surviving triangles back onto the original vertices, preserving winding order
+	vector<unsigned int> result;
+	result.reserve(triangleCount * 3);
+	unsigned int t = 0;
+	for (unsigned int i = 0; i + 2 < indices.size(); i += 3) {
+		unsigned int p0 = m_positionId[indices[i]];
+		unsigned int p1 = m_positionId[indices[i + 1]];
+		unsigned int p2 = m_positionId[indices[i + 2]];
+		if (p0 == p1 || p1 == p2 || p2 == p0)
+			continue;
+
+		glm::dvec3 a(m_positions[p0]), b(m_positions[p1]), c(m_positions[p2]);
+		if (glm::length(glm::cross(b - a, c - a)) <= 0.0)
+			continue; // Skipped by ComputeQuadrics as well
+
+		if (!m_triangleRemoved[t]) {
+			for (int corner = 0; corner < 3; corner++) {
+				unsigned int original = indices[i + corner];
+				unsigned int position = m_triangles[t * 3 + corner];
+				if (position == m_positionId[original])
+					result.push_back(original);
+				else
+					result.push_back(ClosestWedge(vertices, position, original));
+			}
+		}
+		t++;
+	}
+
+	return result;
+}
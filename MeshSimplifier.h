@@ -0,0 +1,63 @@
+#pragma once
+#include "Common.h"
+
+// Interleaved vertex layout shared by the imported meshes: position, texture coordinate, normal
+struct MeshVertex
+{
+	glm::vec3 position;
+	glm::vec2 texCoord;
+	glm::vec3 normal;
+};
+
+// Simplifies an indexed triangle list with quadric error metric edge collapse (Garland & Heckbert).  Vertices are only ever
+// collapsed onto existing vertices, so the vertex buffer is left untouched and only a new index list is produced.  Vertices
+// on open boundaries and on texture seams are locked so that the silhouette and UV layout survive simplification.
+class CMeshSimplifier
+{
+public:
+	CMeshSimplifier();
+	~CMeshSimplifier();
+
+	// Reduce indices (a triangle list into vertices) to at most targetTriangles triangles, or until the next collapse would
+	// cost more than maxError.  Returns the simplified triangle list.
+	vector<unsigned int> Simplify(const vector<MeshVertex> &vertices, const vector<unsigned int> &indices,
+		unsigned int targetTriangles, float maxError = 1e30f);
+
+private:
+	struct Quadric
+	{
+		double a[10];
+	};
+
+	struct Collapse
+	{
+		float cost;
+		unsigned int from;
+		unsigned int to;
+		unsigned int version;
+		bool operator<(const Collapse &other) const { return cost > other.cost; } // min-heap on cost
+	};
+
+	void WeldPositions(const vector<MeshVertex> &vertices);
+	void ComputeQuadrics(const vector<unsigned int> &indices);
+	void LockBoundaries();
+	float CollapseCost(unsigned int from, unsigned int to);
+	bool FlipsTriangle(unsigned int from, unsigned int to);
+	void PushCollapses(unsigned int v);
+	unsigned int ClosestWedge(const vector<MeshVertex> &vertices, unsigned int position, unsigned int original);
+
+	static void AddPlane(Quadric &q, const glm::dvec4 &plane, double weight);
+	static double Evaluate(const Quadric &q, const glm::vec3 &p);
+
+	vector<unsigned int> m_positionId;		// Original vertex -> welded position
+	vector<vector<unsigned int> > m_wedges;	// Welded position -> original vertices sharing it
+	vector<glm::vec3> m_positions;			// Welded positions
+	vector<Quadric> m_quadrics;
+	vector<bool> m_locked;
+	vector<unsigned int> m_remap;			// Welded position -> position it was collapsed onto
+	vector<unsigned int> m_version;			// Bumped whenever a position's neighbourhood changes
+	vector<vector<unsigned int> > m_vertexTriangles;	// Welded position -> adjacent triangles
+	vector<unsigned int> m_triangles;		// Triangles over welded positions
+	vector<bool> m_triangleRemoved;
+	vector<Collapse> m_heap;
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include "Common.h"
+
+// Keys passed to OnKeyDown.  Letters are their upper case characters, as on Windows.
+#define PLATFORM_KEY_ESCAPE 0x1B
+#define PLATFORM_KEY_F1 0x70
+#define PLATFORM_KEY_F2 0x71
+#define PLATFORM_KEY_F3 0x72
+#define PLATFORM_KEY_F4 0x73
+#define PLATFORM_KEY_F5 0x74
+#define PLATFORM_KEY_F6 0x75
+#define PLATFORM_KEY_F7 0x76
+#define PLATFORM_KEY_F8 0x77
+#define PLATFORM_KEY_F9 0x78
+
+// Receives the window's events as the platform pumps them
+class CPlatformListener
+{
+public:
+	virtual ~CPlatformListener() {}
+
+	virtual void OnActivate(bool active) = 0;
+	virtual void OnResize(int width, int height) = 0;
+	virtual void OnKeyDown(int key) = 0;
+};
+
+// The window, event pump and OpenGL context the game runs in.  On Windows this is a WGL window; the headless backend
+// renders into an offscreen EGL pbuffer instead, with no window or input, so that the game can run unattended on a
+// machine with no display (e.g. Mesa's llvmpipe on a Linux build server) for automated performance runs.
+class CPlatform
+{
+public:
+	virtual ~CPlatform() {}
+
+	// Open the window, and make a 4.3 core context current on the calling thread.  A window may choose its own size.
+	virtual bool Create(CPlatformListener *pListener, int width, int height) = 0;
+	virtual void Destroy() = 0;
+
+	// Pass pending events to the listener without blocking.  Returns false once the game should quit.
+	virtual bool PumpEvents() = 0;
+	// Block until an event arrives, for when the game is inactive
+	virtual void WaitEvents() = 0;
+	virtual void Quit(int exitCode) = 0;
+	virtual int GetExitCode() = 0;
+
+	virtual void SwapBuffers() = 0;
+	virtual int GetWidth() = 0;
+	virtual int GetHeight() = 0;
+	virtual bool IsHeadless() = 0;
+
+	// Contexts sharing objects with the main one, for background threads.  MakeCurrent(NULL) releases the calling
+	// thread's context.
+	virtual void *CreateSharedContext() = 0;
+	virtual bool MakeCurrent(void *pContext) = 0;
+	virtual void DeleteContext(void *pContext) = 0;
+};
+
+// A window on Windows, and the headless backend elsewhere
+CPlatform *CreatePlatform();
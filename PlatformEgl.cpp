@@ -0,0 +1,215 @@
+#include "PlatformEgl.h"
+#ifndef _WIN32
+#include "Log.h"
+#include <EGL/eglext.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+CPlatform *CreatePlatform()
+{
+	return new CPlatformEgl;
+}
+
+CPlatformEgl::CPlatformEgl()
+{
+	m_display = EGL_NO_DISPLAY;
+	m_config = NULL;
+	m_surface = EGL_NO_SURFACE;
+	m_context = EGL_NO_CONTEXT;
+	m_pListener = NULL;
+	m_width = 0;
+	m_height = 0;
+	m_quit = false;
+	m_exitCode = 0;
+}
+
+CPlatformEgl::~CPlatformEgl()
+{
+	Destroy();
+}
+
+EGLDisplay CPlatformEgl::OpenDisplay()
+{
+	const char *pExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (pExtensions && strstr(pExtensions, "EGL_MESA_platform_surfaceless")) {
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay) {
+			EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+			if (display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL))
+				return display;
+		}
+	}
+
+	EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL))
+		return display;
+	return EGL_NO_DISPLAY;
+}
+
+EGLContext CPlatformEgl::CreateContext(EGLContext shareContext)
+{
+	EGLint attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	return eglCreateContext(m_display, m_config, shareContext, attributes);
+}
+
+bool CPlatformEgl::Create(CPlatformListener *pListener, int width, int height)
+{
+	Destroy();
+	m_pListener = pListener;
+	m_width = width;
+	m_height = height;
+
+	m_display = OpenDisplay();
+	if (m_display == EGL_NO_DISPLAY) {
+		LogMessage("Could not open an EGL display");
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		LogMessage("EGL has no desktop OpenGL");
+		Destroy();
+		return false;
+	}
+
+	EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_STENCIL_SIZE, 8,
+		EGL_NONE
+	};
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(m_display, configAttributes, &m_config, 1, &numConfigs) || numConfigs == 0) {
+		LogMessage("No EGL config with a pbuffer and depth buffer");
+		Destroy();
+		return false;
+	}
+
+	EGLint surfaceAttributes[] = {
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_NONE
+	};
+	m_surface = eglCreatePbufferSurface(m_display, m_config, surfaceAttributes);
+	m_context = CreateContext(EGL_NO_CONTEXT);
+	if (m_surface == EGL_NO_SURFACE || m_context == EGL_NO_CONTEXT
+		|| !eglMakeCurrent(m_display, m_surface, m_surface, m_context)) {
+		LogMessage("Could not create a 4.3 core context on a %dx%d pbuffer (EGL error 0x%x)", width, height, eglGetError());
+		Destroy();
+		return false;
+	}
+
+	// GLEW has to be built with GLEW_EGL to find its entry points through EGL rather than GLX
+	glewExperimental = GL_TRUE;
+	GLenum result = glewInit();
+	if (result != GLEW_OK) {
+		LogMessage("Could not load OpenGL entry points: %s", (const char*)glewGetErrorString(result));
+		Destroy();
+		return false;
+	}
+	// GLEW can leave an error behind from probing the core profile
+	glGetError();
+
+	LogMessage("Headless %dx%d on %s", width, height, (const char*)glGetString(GL_RENDERER));
+	if (m_pListener) {
+		m_pListener->OnResize(m_width, m_height);
+		m_pListener->OnActivate(true);
+	}
+	return true;
+}
+
+void CPlatformEgl::Destroy()
+{
+	if (m_display == EGL_NO_DISPLAY)
+		return;
+
+	eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (m_context != EGL_NO_CONTEXT)
+		eglDestroyContext(m_display, m_context);
+	if (m_surface != EGL_NO_SURFACE)
+		eglDestroySurface(m_display, m_surface);
+	eglTerminate(m_display);
+
+	m_display = EGL_NO_DISPLAY;
+	m_config = NULL;
+	m_surface = EGL_NO_SURFACE;
+	m_context = EGL_NO_CONTEXT;
+	m_pListener = NULL;
+}
+
+bool CPlatformEgl::PumpEvents()
+{
+	return !m_quit;
+}
+
+// Nothing ever arrives, so this only yields
+void CPlatformEgl::WaitEvents()
+{
+	usleep(1000);
+}
+
+void CPlatformEgl::Quit(int exitCode)
+{
+	m_quit = true;
+	m_exitCode = exitCode;
+}
+
+int CPlatformEgl::GetExitCode()
+{
+	return m_exitCode;
+}
+
+// A pbuffer has no back buffer to show, but swapping still ends the frame, so that the driver flushes its work
+void CPlatformEgl::SwapBuffers()
+{
+	eglSwapBuffers(m_display, m_surface);
+}
+
+int CPlatformEgl::GetWidth()
+{
+	return m_width;
+}
+
+int CPlatformEgl::GetHeight()
+{
+	return m_height;
+}
+
+bool CPlatformEgl::IsHeadless()
+{
+	return true;
+}
+
+void *CPlatformEgl::CreateSharedContext()
+{
+	EGLContext context = CreateContext(m_context);
+	return context == EGL_NO_CONTEXT ? NULL : context;
+}
+
+// Background contexts need no surface (EGL_KHR_surfaceless_context), as they only compile and upload
+bool CPlatformEgl::MakeCurrent(void *pContext)
+{
+	if (pContext == NULL)
+		return eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT) == EGL_TRUE;
+	return eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, (EGLContext)pContext) == EGL_TRUE;
+}
+
+void CPlatformEgl::DeleteContext(void *pContext)
+{
+	if (pContext)
+		eglDestroyContext(m_display, (EGLContext)pContext);
+}
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+#ifndef _WIN32
+#include "Platform.h"
+#include <EGL/egl.h>
+
+// Renders offscreen into an EGL pbuffer, with no window, input or vsync, so that the game runs on a machine with no
+// display.  Mesa's surfaceless platform is preferred, as it needs neither X nor a GPU device and so works with llvmpipe
+// (LIBGL_ALWAYS_SOFTWARE=1) in a container; the default display is the fallback.  Only quitting is ever reported.
+class CPlatformEgl : public CPlatform
+{
+public:
+	CPlatformEgl();
+	~CPlatformEgl();
+
+	bool Create(CPlatformListener *pListener, int width, int height);
+	void Destroy();
+
+	bool PumpEvents();
+	void WaitEvents();
+	void Quit(int exitCode);
+	int GetExitCode();
+
+	void SwapBuffers();
+	int GetWidth();
+	int GetHeight();
+	bool IsHeadless();
+
+	void *CreateSharedContext();
+	bool MakeCurrent(void *pContext);
+	void DeleteContext(void *pContext);
+
+private:
+	EGLDisplay OpenDisplay();
+	EGLContext CreateContext(EGLContext shareContext);
+
+	EGLDisplay m_display;
+	EGLConfig m_config;
+	EGLSurface m_surface;
+	EGLContext m_context;
+	CPlatformListener *m_pListener;
+	int m_width;
+	int m_height;
+	bool m_quit;
+	int m_exitCode;
+};
+#endif
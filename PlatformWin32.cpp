@@ -0,0 +1,205 @@
+#include "PlatformWin32.h"
+#ifdef _WIN32
+
+#ifndef WGL_CONTEXT_MAJOR_VERSION_ARB
+#define WGL_CONTEXT_MAJOR_VERSION_ARB 0x2091
+#define WGL_CONTEXT_MINOR_VERSION_ARB 0x2092
+#define WGL_CONTEXT_PROFILE_MASK_ARB 0x9126
+#endif
+typedef HGLRC (WINAPI *CreateContextAttribsFunction)(HDC hdc, HGLRC shareContext, const int *pAttributes);
+
+CPlatformWin32 *CPlatformWin32::s_pInstance = NULL;
+
+CPlatform *CreatePlatform()
+{
+	return new CPlatformWin32(GetModuleHandle(NULL));
+}
+
+CPlatformWin32::CPlatformWin32(HINSTANCE hInstance)
+{
+	m_hInstance = hInstance;
+	m_pListener = NULL;
+	m_created = false;
+	m_quit = false;
+	m_exitCode = 0;
+	s_pInstance = this;
+}
+
+CPlatformWin32::~CPlatformWin32()
+{
+	Destroy();
+	if (s_pInstance == this)
+		s_pInstance = NULL;
+}
+
+CPlatformWin32 *CPlatformWin32::GetInstance()
+{
+	return s_pInstance;
+}
+
+// The window sizes itself to the desktop, so the size asked for is ignored
+bool CPlatformWin32::Create(CPlatformListener *pListener, int width, int height)
+{
+	m_pListener = pListener;
+	m_gameWindow.Init(m_hInstance);
+	m_created = m_gameWindow.Hdc() != NULL;
+	return m_created;
+}
+
+void CPlatformWin32::Destroy()
+{
+	if (!m_created)
+		return;
+	m_gameWindow.Deinit();
+	m_pListener = NULL;
+	m_created = false;
+}
+
+bool CPlatformWin32::PumpEvents()
+{
+	MSG msg;
+	while (!m_quit && PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+		if (msg.message == WM_QUIT) {
+			m_quit = true;
+			m_exitCode = (int)msg.wParam;
+			break;
+		}
+
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
+	}
+	return !m_quit;
+}
+
+void CPlatformWin32::WaitEvents()
+{
+	WaitMessage();
+}
+
+void CPlatformWin32::Quit(int exitCode)
+{
+	PostQuitMessage(exitCode);
+}
+
+int CPlatformWin32::GetExitCode()
+{
+	return m_exitCode;
+}
+
+void CPlatformWin32::SwapBuffers()
+{
+	::SwapBuffers(m_gameWindow.Hdc());
+}
+
+int CPlatformWin32::GetWidth()
+{
+	RECT dimensions = m_gameWindow.GetDimensions();
+	return dimensions.right - dimensions.left;
+}
+
+int CPlatformWin32::GetHeight()
+{
+	RECT dimensions = m_gameWindow.GetDimensions();
+	return dimensions.bottom - dimensions.top;
+}
+
+bool CPlatformWin32::IsHeadless()
+{
+	return false;
+}
+
+// Create a context with the same version and profile as the current one, sharing its objects
+void *CPlatformWin32::CreateSharedContext()
+{
+	CreateContextAttribsFunction createContextAttribs =
+		(CreateContextAttribsFunction)wglGetProcAddress("wglCreateContextAttribsARB");
+	if (createContextAttribs == NULL)
+		return NULL;
+
+	GLint majorVersion = 0, minorVersion = 0, profileMask = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+	glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+	glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profileMask);
+	int attributes[] = {
+		WGL_CONTEXT_MAJOR_VERSION_ARB, majorVersion,
+		WGL_CONTEXT_MINOR_VERSION_ARB, minorVersion,
+		WGL_CONTEXT_PROFILE_MASK_ARB, profileMask,
+		0
+	};
+
+	return createContextAttribs(m_gameWindow.Hdc(), wglGetCurrentContext(), attributes);
+}
+
+bool CPlatformWin32::MakeCurrent(void *pContext)
+{
+	if (pContext == NULL)
+		return wglMakeCurrent(NULL, NULL) != FALSE;
+	return wglMakeCurrent(m_gameWindow.Hdc(), (HGLRC)pContext) != FALSE;
+}
+
+void CPlatformWin32::DeleteContext(void *pContext)
+{
+	if (pContext)
+		wglDeleteContext((HGLRC)pContext);
+}
+
+LRESULT CPlatformWin32::ProcessEvents(HWND window, UINT message, WPARAM w_param, LPARAM l_param)
+{
+	LRESULT result = 0;
+
+	switch (message) {
+
+	case WM_ACTIVATE:
+		switch (LOWORD(w_param)) {
+		case WA_ACTIVE:
+		case WA_CLICKACTIVE:
+			if (m_pListener)
+				m_pListener->OnActivate(true);
+			break;
+		case WA_INACTIVE:
+			if (m_pListener)
+				m_pListener->OnActivate(false);
+			break;
+		}
+		break;
+
+	case WM_SIZE:
+		RECT dimensions;
+		GetClientRect(window, &dimensions);
+		m_gameWindow.SetDimensions(dimensions);
+		if (m_pListener)
+			m_pListener->OnResize(dimensions.right - dimensions.left, dimensions.bottom - dimensions.top);
+		break;
+
+	case WM_PAINT:
+		PAINTSTRUCT ps;
+		BeginPaint(window, &ps);
+		EndPaint(window, &ps);
+		break;
+
+	// Virtual key codes are the platform's key codes
+	case WM_KEYDOWN:
+		if (m_pListener)
+			m_pListener->OnKeyDown((int)w_param);
+		break;
+
+	case WM_DESTROY:
+		PostQuitMessage(0);
+		break;
+
+	default:
+		result = DefWindowProc(window, message, w_param, l_param);
+		break;
+	}
+
+	return result;
+}
+
+LRESULT CALLBACK WinProc(HWND window, UINT message, WPARAM w_param, LPARAM l_param)
+{
+	CPlatformWin32 *pPlatform = CPlatformWin32::GetInstance();
+	if (pPlatform == NULL)
+		return DefWindowProc(window, message, w_param, l_param);
+	return pPlatform->ProcessEvents(window, message, w_param, l_param);
+}
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+#ifdef _WIN32
+#include "Platform.h"
+#include "GameWindow.h"
+
+// A window with a WGL context, fed by the Win32 message queue
+class CPlatformWin32 : public CPlatform
+{
+public:
+	CPlatformWin32(HINSTANCE hInstance);
+	~CPlatformWin32();
+
+	bool Create(CPlatformListener *pListener, int width, int height);
+	void Destroy();
+
+	bool PumpEvents();
+	void WaitEvents();
+	void Quit(int exitCode);
+	int GetExitCode();
+
+	void SwapBuffers();
+	int GetWidth();
+	int GetHeight();
+	bool IsHeadless();
+
+	void *CreateSharedContext();
+	bool MakeCurrent(void *pContext);
+	void DeleteContext(void *pContext);
+
+	LRESULT ProcessEvents(HWND window, UINT message, WPARAM w_param, LPARAM l_param);
+	static CPlatformWin32 *GetInstance();
+
+private:
+	static CPlatformWin32 *s_pInstance;		// For WinProc
+
+	GameWindow m_gameWindow;
+	HINSTANCE m_hInstance;
+	CPlatformListener *m_pListener;
+	bool m_created;
+	bool m_quit;
+	int m_exitCode;
+};
+#endif
@@ -0,0 +1,296 @@
+#include "Primitives.h"
+#include "RenderStats.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+// The faces of a unit box: four corners each, counter-clockwise seen from outside and in texture coordinate order
+// (0, 0), (1, 0), (1, 1), (0, 1).  Bit 0 of a corner is x, bit 1 y and bit 2 z.
+static constexpr unsigned char BOX_FACE_CORNERS[6][4] = {
+	{ 5, 1, 3, 7 },		// +x
+	{ 0, 4, 6, 2 },		// -x
+	{ 6, 7, 3, 2 },		// +y
+	{ 0, 1, 5, 4 },		// -y
+	{ 4, 5, 7, 6 },		// +z
+	{ 1, 0, 2, 3 },		// -z
+};
+static constexpr float BOX_FACE_NORMALS[6][3] = {
+	{ 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+};
+static constexpr float QUAD_TEXCOORDS[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+static constexpr unsigned int QUAD_INDICES[6] = { 0, 1, 2, 0, 2, 3 };
+
+static MeshVertex MakeVertex(const glm::vec3 &position, const glm::vec2 &texCoord, const glm::vec3 &normal)
+{
+	MeshVertex vertex;
+	vertex.position = position;
+	vertex.texCoord = texCoord;
+	vertex.normal = normal;
+	return vertex;
+}
+
+// Two triangles for each quad of a grid of rows x columns vertices, starting at first
+static void AddGridIndices(unsigned int first, int rows, int columns, vector<unsigned int> &indices)
+{
+	for (int j = 0; j + 1 < rows; j++) {
+		for (int i = 0; i + 1 < columns; i++) {
+			unsigned int a = first + j * columns + i;
+			unsigned int b = a + columns;
+			indices.push_back(a); indices.push_back(b); indices.push_back(a + 1);
+			indices.push_back(a + 1); indices.push_back(b); indices.push_back(b + 1);
+		}
+	}
+}
+
+// A disc of sides triangles around centre, facing along normal
+static void AddCap(const glm::vec3 &centre, float radius, int sides, const glm::vec3 &normal, vector<MeshVertex> &vertices,
+	vector<unsigned int> &indices)
+{
+	unsigned int first = (unsigned int)vertices.size();
+	vertices.push_back(MakeVertex(centre, glm::vec2(0.5f), normal));
+	for (int i = 0; i < sides; i++) {
+		float angle = 2.0f * (float)M_PI * i / sides;
+		glm::vec2 direction(cos(angle), sin(angle));
+		vertices.push_back(MakeVertex(centre + radius * glm::vec3(direction.x, 0.0f, -direction.y),
+			glm::vec2(0.5f) + 0.5f * direction, normal));
+	}
+	for (int i = 0; i < sides; i++) {
+		unsigned int a = first + 1 + i;
+		unsigned int b = first + 1 + (i + 1) % sides;
+		indices.push_back(first);
+		if (normal.y > 0.0f) {
+			indices.push_back(a); indices.push_back(b);
+		}
+		else {
+			indices.push_back(b); indices.push_back(a);
+		}
+	}
+}
+
+CPrimitiveLibrary::CPrimitiveLibrary()
+{
+	m_vao = 0;
+	m_vbo = 0;
+	m_ibo = 0;
+	m_normalFormat = VERTEX_NORMAL_OCTAHEDRAL;
+	m_dirty = false;
+}
+
+CPrimitiveLibrary::~CPrimitiveLibrary()
+{
+	Release();
+}
+
+void CPrimitiveLibrary::GenerateBox(const glm::vec3 &minimum, const glm::vec3 &maximum, vector<MeshVertex> &vertices,
+	vector<unsigned int> &indices)
+{
+	for (int face = 0; face < 6; face++) {
+		unsigned int first = (unsigned int)vertices.size();
+		glm::vec3 normal(BOX_FACE_NORMALS[face][0], BOX_FACE_NORMALS[face][1], BOX_FACE_NORMALS[face][2]);
+		for (int i = 0; i < 4; i++) {
+			unsigned char corner = BOX_FACE_CORNERS[face][i];
+			glm::vec3 position((corner & 1) ? maximum.x : minimum.x, (corner & 2) ? maximum.y : minimum.y,
+				(corner & 4) ? maximum.z : minimum.z);
+			vertices.push_back(MakeVertex(position, glm::vec2(QUAD_TEXCOORDS[i][0], QUAD_TEXCOORDS[i][1]), normal));
+		}
+		for (int i = 0; i < 6; i++)
+			indices.push_back(first + QUAD_INDICES[i]);
+	}
+}
+
+// A column of vertices down each seam, so that the texture wraps once around
+void CPrimitiveLibrary::GenerateSphere(float radius, int slices, int stacks, vector<MeshVertex> &vertices,
+	vector<unsigned int> &indices)
+{
+	unsigned int first = (unsigned int)vertices.size();
+	for (int j = 0; j <= stacks; j++) {
+		float theta = (float)M_PI * j / stacks;
+		for (int i = 0; i <= slices; i++) {
+			float phi = 2.0f * (float)M_PI * i / slices;
+			glm::vec3 normal(sin(theta) * cos(phi), cos(theta), -sin(theta) * sin(phi));
+			vertices.push_back(MakeVertex(radius * normal, glm::vec2((float)i / slices, 1.0f - (float)j / stacks), normal));
+		}
+	}
+	AddGridIndices(first, stacks + 1, slices + 1, indices);
+}
+
+void CPrimitiveLibrary::GenerateCone(float radius, float height, int slices, vector<MeshVertex> &vertices,
+	vector<unsigned int> &indices)
+{
+	// The side is a triangle per slice, from an apex vertex of its own, with the normal half way across the slice, to the
+	// rim
+	unsigned int first = (unsigned int)vertices.size();
+	float slope = radius / height;
+	for (int i = 0; i < slices; i++) {
+		float phi = 2.0f * (float)M_PI * (i + 0.5f) / slices;
+		glm::vec3 normal = glm::normalize(glm::vec3(cos(phi), slope, -sin(phi)));
+		vertices.push_back(MakeVertex(glm::vec3(0.0f, height, 0.0f), glm::vec2((i + 0.5f) / slices, 1.0f), normal));
+	}
+	unsigned int rim = (unsigned int)vertices.size();
+	for (int i = 0; i <= slices; i++) {
+		float phi = 2.0f * (float)M_PI * i / slices;
+		glm::vec3 direction(cos(phi), 0.0f, -sin(phi));
+		glm::vec3 normal = glm::normalize(direction + glm::vec3(0.0f, slope, 0.0f));
+		vertices.push_back(MakeVertex(radius * direction, glm::vec2((float)i / slices, 0.0f), normal));
+	}
+	for (int i = 0; i < slices; i++) {
+		indices.push_back(first + i); indices.push_back(rim + i); indices.push_back(rim + i + 1);
+	}
+	AddCap(glm::vec3(0.0f), radius, slices, glm::vec3(0.0f, -1.0f, 0.0f), vertices, indices);
+}
+
+void CPrimitiveLibrary::GeneratePlane(float width, float depth, int divisions, float textureRepeat,
+	vector<MeshVertex> &vertices, vector<unsigned int> &indices)
+{
+	unsigned int first = (unsigned int)vertices.size();
+	for (int j = 0; j <= divisions; j++) {
+		for (int i = 0; i <= divisions; i++) {
+			glm::vec2 t((float)i / divisions, (float)j / divisions);
+			vertices.push_back(MakeVertex(glm::vec3((t.x - 0.5f) * width, 0.0f, (t.y - 0.5f) * depth), t * textureRepeat,
+				glm::vec3(0.0f, 1.0f, 0.0f)));
+		}
+	}
+	AddGridIndices(first, divisions + 1, divisions + 1, indices);
+}
+
+// Flat sides, each a quad of its own, and a cap at each end
+void CPrimitiveLibrary::GeneratePrism(float radius, float height, int sides, vector<MeshVertex> &vertices,
+	vector<unsigned int> &indices)
+{
+	for (int i = 0; i < sides; i++) {
+		float angle0 = 2.0f * (float)M_PI * i / sides;
+		float angle1 = 2.0f * (float)M_PI * (i + 1) / sides;
+		glm::vec3 p0 = radius * glm::vec3(cos(angle0), 0.0f, -sin(angle0));
+		glm::vec3 p1 = radius * glm::vec3(cos(angle1), 0.0f, -sin(angle1));
+		glm::vec3 normal = glm::normalize(0.5f * (p0 + p1));
+		glm::vec3 up(0.0f, height, 0.0f);
+
+		unsigned int first = (unsigned int)vertices.size();
+		vertices.push_back(MakeVertex(p0, glm::vec2(0.0f, 0.0f), normal));
+		vertices.push_back(MakeVertex(p1, glm::vec2(1.0f, 0.0f), normal));
+		vertices.push_back(MakeVertex(p1 + up, glm::vec2(1.0f, 1.0f), normal));
+		vertices.push_back(MakeVertex(p0 + up, glm::vec2(0.0f, 1.0f), normal));
+		for (int k = 0; k < 6; k++)
+			indices.push_back(first + QUAD_INDICES[k]);
+	}
+	AddCap(glm::vec3(0.0f), radius, sides, glm::vec3(0.0f, -1.0f, 0.0f), vertices, indices);
+	AddCap(glm::vec3(0.0f, height, 0.0f), radius, sides, glm::vec3(0.0f, 1.0f, 0.0f), vertices, indices);
+}
+
+int CPrimitiveLibrary::AddBox(const glm::vec3 &minimum, const glm::vec3 &maximum)
+{
+	vector<MeshVertex> vertices;
+	vector<unsigned int> indices;
+	GenerateBox(minimum, maximum, vertices, indices);
+	return Add(vertices, indices);
+}
+
+int CPrimitiveLibrary::AddSphere(float radius, int slices, int stacks)
+{
+	vector<MeshVertex> vertices;
+	vector<unsigned int> indices;
+	GenerateSphere(radius, slices, stacks, vertices, indices);
+	return Add(vertices, indices);
+}
+
+int CPrimitiveLibrary::AddCone(float radius, float height, int slices)
+{
+	vector<MeshVertex> vertices;
+	vector<unsigned int> indices;
+	GenerateCone(radius, height, slices, vertices, indices);
+	return Add(vertices, indices);
+}
+
+int CPrimitiveLibrary::AddPlane(float width, float depth, int divisions, float textureRepeat)
+{
+	vector<MeshVertex> vertices;
+	vector<unsigned int> indices;
+	GeneratePlane(width, depth, divisions, textureRepeat, vertices, indices);
+	return Add(vertices, indices);
+}
+
+int CPrimitiveLibrary::AddPrism(float radius, float height, int sides)
+{
+	vector<MeshVertex> vertices;
+	vector<unsigned int> indices;
+	GeneratePrism(radius, height, sides, vertices, indices);
+	return Add(vertices, indices);
+}
+
+// Indices are drawn with the primitive's base vertex, so 16 bits are enough for any primitive up to 65536 vertices
+int CPrimitiveLibrary::Add(const vector<MeshVertex> &vertices, const vector<unsigned int> &indices)
+{
+	if (vertices.size() > 65536)
+		return -1;
+
+	PrimitiveRange range;
+	range.firstVertex = (unsigned int)m_vertices.size();
+	range.firstIndex = (unsigned int)m_indices.size();
+	range.numIndices = (unsigned int)indices.size();
+	m_ranges.push_back(range);
+
+	m_vertices.insert(m_vertices.end(), vertices.begin(), vertices.end());
+	for (unsigned int i = 0; i < indices.size(); i++)
+		m_indices.push_back((unsigned short)indices[i]);
+	m_dirty = true;
+	return (int)m_ranges.size() - 1;
+}
+
+// Primitives are added at load, so the buffers are simply rebuilt with everything in them
+void CPrimitiveLibrary::Upload()
+{
+	if (m_vao == 0) {
+		glGenVertexArrays(1, &m_vao);
+		glGenBuffers(1, &m_vbo);
+		glGenBuffers(1, &m_ibo);
+	}
+
+	vector<BYTE> packedVertices;
+	m_format.Create(&m_vertices[0], (unsigned int)m_vertices.size(), VERTEX_POSITION_HALF, m_normalFormat);
+	m_format.Pack(&m_vertices[0], (unsigned int)m_vertices.size(), packedVertices);
+
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, packedVertices.size(), &packedVertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(unsigned short), &m_indices[0], GL_STATIC_DRAW);
+	m_format.SetAttributes();
+	m_dirty = false;
+}
+
+void CPrimitiveLibrary::SetNormalFormat(VertexNormalFormat normalFormat)
+{
+	if (normalFormat == m_normalFormat)
+		return;
+	m_normalFormat = normalFormat;
+	m_dirty = !m_vertices.empty();
+}
+
+void CPrimitiveLibrary::Bind()
+{
+	if (m_dirty)
+		Upload();
+	glBindVertexArray(m_vao);
+	CRenderStats::AddStateChanges();
+}
+
+void CPrimitiveLibrary::Draw(int id, int numInstances)
+{
+	const PrimitiveRange &range = m_ranges[id];
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.numIndices, GL_UNSIGNED_SHORT,
+		(void*)(range.firstIndex * sizeof(unsigned short)), numInstances, range.firstVertex);
+	CRenderStats::AddDrawCalls();
+}
+
+void CPrimitiveLibrary::Release()
+{
+	if (m_vao) {
+		glDeleteVertexArrays(1, &m_vao);
+		glDeleteBuffers(1, &m_vbo);
+		glDeleteBuffers(1, &m_ibo);
+		m_vao = m_vbo = m_ibo = 0;
+	}
+	m_vertices.clear();
+	m_indices.clear();
+	m_ranges.clear();
+	m_dirty = false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "Common.h"
+#include "MeshSimplifier.h"
+#include "VertexFormat.h"
+
+// The part of the library's buffers holding one primitive.  Indices are relative to firstVertex.
+struct PrimitiveRange
+{
+	unsigned int firstVertex;
+	unsigned int firstIndex;
+	unsigned int numIndices;
+};
+
+// Indexed triangle meshes of simple shapes, parameterised by their dimensions and tessellation.  Vertices are shared
+// wherever their attributes match (only faces with different normals have their own).  Every primitive added to a library
+// goes into the same vertex buffer, packed by CPackedVertexFormat, and the same 16 bit index buffer, so drawing any number
+// of primitives takes one bind.
+// The library is kept apart from CGeometryPool on purpose.  The pool holds full 32 byte MeshVertex data for its culled
+// multi-draws, while the library packs to 16 bytes, and its one user, the wall, is drawn instanced with the main
+// shader's wallShift feature spacing the sections by gl_InstanceID, which the pool's indirect draws cannot do.  Shapes
+// that should batch with the pooled meshes go into the pool through the Generate functions instead, as CTrackside does
+// with its fence posts.
+class CPrimitiveLibrary
+{
+public:
+	CPrimitiveLibrary();
+	~CPrimitiveLibrary();
+
+	// Each returns the id to draw the primitive with.  Texture coordinates span [0, 1] over each flat face, and around
+	// and along curved ones.
+	int AddBox(const glm::vec3 &minimum, const glm::vec3 &maximum);
+	int AddSphere(float radius, int slices, int stacks);
+	int AddCone(float radius, float height, int slices);		// Base centred on the origin, apex up the y axis
+	int AddPlane(float width, float depth, int divisions, float textureRepeat);	// In the xz plane, facing up
+	int AddPrism(float radius, float height, int sides);		// A regular prism, standing on the xz plane
+
+	// Octahedral by default; VERTEX_NORMAL_SNORM16 for a shader that cannot decode them.  The buffers are packed again on
+	// the next Bind.
+	void SetNormalFormat(VertexNormalFormat normalFormat);
+	// Bind the shared buffers, uploading any primitives added since the last call
+	void Bind();
+	void Draw(int id, int numInstances = 1);
+	void Release();
+
+	static void GenerateBox(const glm::vec3 &minimum, const glm::vec3 &maximum, vector<MeshVertex> &vertices,
+		vector<unsigned int> &indices);
+	static void GenerateSphere(float radius, int slices, int stacks, vector<MeshVertex> &vertices, vector<unsigned int> &indices);
+	static void GenerateCone(float radius, float height, int slices, vector<MeshVertex> &vertices, vector<unsigned int> &indices);
+	static void GeneratePlane(float width, float depth, int divisions, float textureRepeat, vector<MeshVertex> &vertices,
+		vector<unsigned int> &indices);
+	static void GeneratePrism(float radius, float height, int sides, vector<MeshVertex> &vertices, vector<unsigned int> &indices);
+
+private:
+	int Add(const vector<MeshVertex> &vertices, const vector<unsigned int> &indices);
+	void Upload();
+
+	vector<MeshVertex> m_vertices;
+	vector<unsigned short> m_indices;
+	vector<PrimitiveRange> m_ranges;
+	CPackedVertexFormat m_format;
+	VertexNormalFormat m_normalFormat;
+	GLuint m_vao;
+	GLuint m_vbo;
+	GLuint m_ibo;
+	bool m_dirty;
+};
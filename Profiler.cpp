@@ -0,0 +1,360 @@
+#include "Profiler.h"
+#include "Log.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+// Each zone's average moves this far towards its latest frame's time, so it follows roughly the last 20 frames
+#define PROFILER_SMOOTHING 0.05
+// Queries are generated in blocks of this many
+#define PROFILER_QUERY_BLOCK 64
+
+std::atomic<bool> CProfiler::m_enabled(false);
+bool CProfiler::m_created = false;
+std::mutex CProfiler::m_mutex;
+vector<CProfiler::Thread*> CProfiler::m_threads;
+std::atomic<int> CProfiler::m_generation(0);
+CProfiler::Thread CProfiler::m_gpuThread;
+CProfiler::GpuFrame CProfiler::m_gpuFrames[PROFILER_GPU_FRAMES];
+int CProfiler::m_frame = 0;
+int CProfiler::m_gpuDepth = 0;
+bool CProfiler::m_inFrame = false;
+long long CProfiler::m_frameStart = 0;
+AllocationCount CProfiler::m_frameAllocations;
+int CProfiler::m_frameGpuZone = -1;
+vector<ProfileZoneStats> CProfiler::m_zones;
+float CProfiler::m_cpuHistory[PROFILER_HISTORY];
+float CProfiler::m_gpuHistory[PROFILER_HISTORY];
+
+static thread_local void *g_pProfilerThread = NULL;
+static thread_local int g_profilerThreadGeneration = 0;
+
+void CProfiler::Create()
+{
+	m_gpuThread.id = PROFILER_GPU_THREAD;
+	m_gpuThread.name = "GPU";
+	m_gpuThread.events.resize(PROFILER_EVENTS_PER_THREAD);
+	m_gpuThread.head = 0;
+	m_gpuThread.read = 0;
+	m_gpuThread.depth = 0;
+	for (int i = 0; i < PROFILER_GPU_FRAMES; i++)
+		m_gpuFrames[i].pending = false;
+	for (int i = 0; i < PROFILER_HISTORY; i++)
+		m_cpuHistory[i] = m_gpuHistory[i] = 0.0f;
+	m_created = true;
+}
+
+void CProfiler::Release()
+{
+	m_enabled = false;
+	m_inFrame = false;
+	for (int i = 0; i < PROFILER_GPU_FRAMES; i++) {
+		GpuFrame &frame = m_gpuFrames[i];
+		if (!frame.queries.empty())
+			glDeleteQueries((GLsizei)frame.queries.size(), &frame.queries[0]);
+		frame.queries.clear();
+		frame.zones.clear();
+		frame.pending = false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (unsigned int i = 0; i < m_threads.size(); i++)
+			delete m_threads[i];
+		m_threads.clear();
+		m_generation++;
+	}
+	vector<ProfileEvent>().swap(m_gpuThread.events);
+	m_gpuThread.head = 0;
+	m_gpuThread.read = 0;
+	m_zones.clear();
+	m_created = false;
+}
+
+// GPU zones still in flight from before are dropped, as their frames were only partly recorded
+void CProfiler::SetEnabled(bool enabled)
+{
+	if (enabled && !m_enabled) {
+		for (int i = 0; i < PROFILER_GPU_FRAMES; i++)
+			m_gpuFrames[i].pending = false;
+	}
+	m_enabled = enabled;
+}
+
+long long CProfiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CProfiler::Thread *CProfiler::GetThread()
+{
+	Thread *pThread = (Thread*)g_pProfilerThread;
+	if (pThread && g_profilerThreadGeneration == m_generation.load(std::memory_order_relaxed))
+		return pThread;
+
+	pThread = new Thread;
+	pThread->events.resize(PROFILER_EVENTS_PER_THREAD);
+	pThread->head = 0;
+	pThread->read = 0;
+	pThread->depth = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		pThread->id = (int)m_threads.size();
+		char name[32];
+		snprintf(name, sizeof(name), "Thread %d", pThread->id);
+		pThread->name = name;
+		m_threads.push_back(pThread);
+		g_profilerThreadGeneration = m_generation.load(std::memory_order_relaxed);
+	}
+	g_pProfilerThread = pThread;
+	return pThread;
+}
+
+void CProfiler::SetThreadName(const char *pName)
+{
+	Thread *pThread = GetThread();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	pThread->name = pName;
+}
+
+long long CProfiler::BeginCpuZone()
+{
+	GetThread()->depth++;
+	return Now();
+}
+
+// Only the owning thread writes its ring, and publishes each event by moving the head on after it
+void CProfiler::EndCpuZone(const char *pName, long long start, const AllocationCount &allocationsAtStart)
+{
+	long long end = Now();
+	AllocationCount allocations = CAllocations::GetThreadTotal();
+	Thread *pThread = GetThread();
+	pThread->depth--;
+	unsigned int head = pThread->head.load(std::memory_order_relaxed);
+	ProfileEvent &event = pThread->events[head % PROFILER_EVENTS_PER_THREAD];
+	event.pName = pName;
+	event.start = start;
+	event.end = end;
+	event.depth = pThread->depth;
+	event.allocations = (unsigned int)(allocations.allocations - allocationsAtStart.allocations);
+	event.bytes = allocations.bytes - allocationsAtStart.bytes;
+	pThread->head.store(head + 1, std::memory_order_release);
+}
+
+int CProfiler::BeginGpuZone(const char *pName)
+{
+	if (!m_inFrame)
+		return -1;
+
+	GpuFrame &frame = m_gpuFrames[m_frame % PROFILER_GPU_FRAMES];
+	int index = (int)frame.zones.size();
+	if (frame.queries.size() < 2 * (unsigned int)(index + 1)) {
+		size_t first = frame.queries.size();
+		frame.queries.resize(first + PROFILER_QUERY_BLOCK);
+		glGenQueries(PROFILER_QUERY_BLOCK, &frame.queries[first]);
+	}
+
+	GpuZone zone;
+	zone.pName = pName;
+	zone.depth = m_gpuDepth++;
+	frame.zones.push_back(zone);
+	glQueryCounter(frame.queries[2 * index], GL_TIMESTAMP);
+	return index;
+}
+
+void CProfiler::EndGpuZone(int index)
+{
+	if (!m_inFrame)
+		return;
+	GpuFrame &frame = m_gpuFrames[m_frame % PROFILER_GPU_FRAMES];
+	glQueryCounter(frame.queries[2 * index + 1], GL_TIMESTAMP);
+	m_gpuDepth--;
+}
+
+void CProfiler::BeginFrame()
+{
+	if (!m_created || !IsEnabled())
+		return;
+
+	// This slot's queries were issued PROFILER_GPU_FRAMES ago
+	GpuFrame &frame = m_gpuFrames[m_frame % PROFILER_GPU_FRAMES];
+	if (frame.pending)
+		ResolveGpuFrame(frame);
+	frame.zones.clear();
+
+	GLint64 gpuNow = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	frame.cpuAtGpuZero = Now() - gpuNow;
+	frame.pending = true;
+
+	m_inFrame = true;
+	m_gpuDepth = 0;
+	m_frameAllocations = CAllocations::GetThreadTotal();
+	m_frameStart = BeginCpuZone();
+	m_frameGpuZone = BeginGpuZone("Frame");
+}
+
+void CProfiler::EndFrame()
+{
+	if (!m_inFrame)
+		return;
+
+	EndGpuZone(m_frameGpuZone);
+	EndCpuZone("Frame", m_frameStart, m_frameAllocations);
+	m_inFrame = false;
+	m_cpuHistory[m_frame % PROFILER_HISTORY] = (float)((Now() - m_frameStart) / 1.0e6);
+
+	// The GPU's times were added when its frame was resolved in BeginFrame
+	ConsumeCpuEvents();
+	for (unsigned int i = 0; i < m_zones.size(); i++) {
+		ProfileZoneStats &zone = m_zones[i];
+		zone.cpuMilliseconds += PROFILER_SMOOTHING * (zone.cpuThisFrame - zone.cpuMilliseconds);
+		zone.gpuMilliseconds += PROFILER_SMOOTHING * (zone.gpuThisFrame - zone.gpuMilliseconds);
+		zone.allocations += PROFILER_SMOOTHING * (zone.allocationsThisFrame - zone.allocations);
+		zone.cpuThisFrame = 0.0;
+		zone.gpuThisFrame = 0.0;
+		zone.allocationsThisFrame = 0.0;
+	}
+	m_frame++;
+}
+
+// Zone names are mostly the same literal, so the pointer is compared before the string
+ProfileZoneStats &CProfiler::FindZone(const char *pName, int depth)
+{
+	for (unsigned int i = 0; i < m_zones.size(); i++) {
+		if (m_zones[i].pName == pName || strcmp(m_zones[i].pName, pName) == 0) {
+			m_zones[i].depth = depth;
+			return m_zones[i];
+		}
+	}
+
+	ProfileZoneStats zone;
+	zone.pName = pName;
+	zone.depth = depth;
+	zone.cpuMilliseconds = zone.gpuMilliseconds = zone.allocations = 0.0;
+	zone.cpuThisFrame = zone.gpuThisFrame = zone.allocationsThisFrame = 0.0;
+	m_zones.push_back(zone);
+	return m_zones.back();
+}
+
+// Add the time of every zone closed since the last frame, on any thread, to its zone's total for this frame.  A thread
+// that wrote more than a ring's worth since has its oldest zones skipped.
+void CProfiler::ConsumeCpuEvents()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (unsigned int t = 0; t < m_threads.size(); t++) {
+		Thread *pThread = m_threads[t];
+		unsigned int head = pThread->head.load(std::memory_order_acquire);
+		if (head - pThread->read > PROFILER_EVENTS_PER_THREAD)
+			pThread->read = head - PROFILER_EVENTS_PER_THREAD;
+		for (; pThread->read != head; pThread->read++) {
+			const ProfileEvent &event = pThread->events[pThread->read % PROFILER_EVENTS_PER_THREAD];
+			ProfileZoneStats &zone = FindZone(event.pName, event.depth);
+			zone.cpuThisFrame += (event.end - event.start) / 1.0e6;
+			zone.allocationsThisFrame += event.allocations;
+		}
+	}
+}
+
+// The results are normally ready by now; if they are not, the frame is dropped rather than waited for.  The Frame zone
+// comes first and its end is the frame's last timestamp, and timestamps complete in order, so once it is available
+// every other zone's are too.
+void CProfiler::ResolveGpuFrame(GpuFrame &frame)
+{
+	frame.pending = false;
+	if (frame.zones.empty())
+		return;
+	GLint available = 0;
+	glGetQueryObjectiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;
+
+	for (unsigned int i = 0; i < frame.zones.size(); i++) {
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(frame.queries[2 * i], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(frame.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+		double milliseconds = end > start ? (end - start) / 1.0e6 : 0.0;
+		FindZone(frame.zones[i].pName, frame.zones[i].depth).gpuThisFrame += milliseconds;
+		// The frame's own zone comes first
+		if (i == 0)
+			m_gpuHistory[m_frame % PROFILER_HISTORY] = (float)milliseconds;
+
+		unsigned int head = m_gpuThread.head.load(std::memory_order_relaxed);
+		ProfileEvent &event = m_gpuThread.events[head % PROFILER_EVENTS_PER_THREAD];
+		event.pName = frame.zones[i].pName;
+		event.start = frame.cpuAtGpuZero + (long long)start;
+		event.end = frame.cpuAtGpuZero + (long long)end;
+		event.depth = frame.zones[i].depth;
+		event.allocations = 0;
+		event.bytes = 0;
+		m_gpuThread.head.store(head + 1, std::memory_order_release);
+	}
+}
+
+int CProfiler::GetNumZones()
+{
+	return (int)m_zones.size();
+}
+
+const ProfileZoneStats &CProfiler::GetZone(int index)
+{
+	return m_zones[index];
+}
+
+void CProfiler::GetHistory(float *pCpuMilliseconds, float *pGpuMilliseconds)
+{
+	for (int i = 0; i < PROFILER_HISTORY; i++) {
+		int frame = (m_frame + i) % PROFILER_HISTORY;
+		pCpuMilliseconds[i] = m_cpuHistory[frame];
+		pGpuMilliseconds[i] = m_gpuHistory[frame];
+	}
+}
+
+// Complete ("X") events in microseconds, one track per thread.  Workers may still be writing; the zones they are
+// writing are past the heads read here, so only a ring that wraps during the write can tear an event.
+bool CProfiler::WriteChromeTrace(const string &filename)
+{
+	FILE *pFile = fopen(filename.c_str(), "wb");
+	if (pFile == NULL) {
+		LogMessage("Could not write the profile to %s", filename.c_str());
+		return false;
+	}
+
+	vector<Thread*> threads;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		threads = m_threads;
+	}
+	threads.push_back(&m_gpuThread);
+
+	fprintf(pFile, "{\"traceEvents\":[\n");
+	bool first = true;
+	int numEvents = 0;
+	for (unsigned int t = 0; t < threads.size(); t++) {
+		Thread *pThread = threads[t];
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			fprintf(pFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				first ? "" : ",\n", pThread->id, pThread->name.c_str());
+		}
+		first = false;
+
+		unsigned int head = pThread->head.load(std::memory_order_acquire);
+		unsigned int begin = head > PROFILER_EVENTS_PER_THREAD ? head - PROFILER_EVENTS_PER_THREAD : 0;
+		for (unsigned int i = begin; i != head; i++) {
+			const ProfileEvent &event = pThread->events[i % PROFILER_EVENTS_PER_THREAD];
+			fprintf(pFile, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+				event.pName, pThread->id, event.start / 1000.0, (event.end - event.start) / 1000.0);
+			if (event.allocations > 0)
+				fprintf(pFile, ",\"args\":{\"allocations\":%u,\"bytes\":%llu}", event.allocations, event.bytes);
+			fprintf(pFile, "}");
+			numEvents++;
+		}
+	}
+	fprintf(pFile, "\n]}\n");
+	fclose(pFile);
+
+	LogMessage("Wrote %d profile zones to %s", numEvents, filename.c_str());
+	return true;
+}
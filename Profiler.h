@@ -0,0 +1,177 @@
+#pragma once
+#include "Common.h"
+#include "Allocations.h"
+#include <atomic>
+#include <mutex>
+
+// Define as 0 to compile every zone out
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// Zones kept per thread for the trace; older ones are overwritten
+#define PROFILER_EVENTS_PER_THREAD 16384
+// Frames the GPU zones are read back after, so that reading them never waits for the GPU
+#define PROFILER_GPU_FRAMES 4
+// Frames of history in the overlay's graphs
+#define PROFILER_HISTORY 240
+// The GPU's zones appear in the trace as a thread of this id
+#define PROFILER_GPU_THREAD 1000
+
+#define PROFILER_CONCATENATE2(a, b) a##b
+#define PROFILER_CONCATENATE(a, b) PROFILER_CONCATENATE2(a, b)
+
+#if PROFILER_ENABLED
+// Time the rest of the enclosing scope on the CPU.  The name must be a string literal, or live as long as the profiler.
+#define PROFILE_ZONE(name) CProfileZone PROFILER_CONCATENATE(profileZone, __LINE__)(name)
+// Time the rest of the scope on the CPU, and the GL commands it issues on the GPU.  Main thread only.
+#define PROFILE_GPU_ZONE(name) CProfileZone PROFILER_CONCATENATE(profileZone, __LINE__)(name, true)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+#endif
+
+struct ProfileEvent
+{
+	const char *pName;
+	long long start;						// Nanoseconds on the profiler's clock
+	long long end;
+	int depth;
+	unsigned int allocations;				// Made on the zone's thread while it was open, including its children's
+	unsigned long long bytes;
+};
+
+// Rolling averages for one zone name, over every thread
+struct ProfileZoneStats
+{
+	const char *pName;
+	int depth;								// Of the zone's last instance, for indenting
+	double cpuMilliseconds;
+	double gpuMilliseconds;
+	double allocations;						// Per frame
+	double cpuThisFrame;
+	double gpuThisFrame;
+	double allocationsThisFrame;
+};
+
+// Records nested CPU and GPU zones.  Each thread writes the zones it closes to its own ring buffer, with no locks, so
+// zones on the workers cost a clock read and a store each.  GPU zones put timestamp queries around the commands in
+// them, which are read back PROFILER_GPU_FRAMES later and placed on the CPU's timeline.  A zone also takes the heap
+// allocations its thread made while it was open (see CAllocations).  Once a frame, the main thread
+// sums each zone's time into rolling averages for the overlay (see CProfilerOverlay); the rings can be written out as
+// a Chrome trace (chrome://tracing, or ui.perfetto.dev) at any time.  While disabled, a zone costs one load and branch.
+class CProfiler
+{
+public:
+	// Create the GPU queries; call on the main thread with the context current
+	static void Create();
+	// Free the queries and every thread's ring.  Call once the other threads that record zones have stopped.
+	static void Release();
+
+	static void SetEnabled(bool enabled);
+	static inline bool IsEnabled() { return m_enabled.load(std::memory_order_relaxed); }
+	// Names the calling thread in the trace
+	static void SetThreadName(const char *pName);
+
+	// Bracket each frame on the main thread
+	static void BeginFrame();
+	static void EndFrame();
+
+	static bool WriteChromeTrace(const string &filename);
+
+	// For the overlay
+	static int GetNumZones();
+	static const ProfileZoneStats &GetZone(int index);
+	// Milliseconds, oldest first
+	static void GetHistory(float *pCpuMilliseconds, float *pGpuMilliseconds);
+
+	// Used by CProfileZone
+	static long long Now();
+	static long long BeginCpuZone();
+	static void EndCpuZone(const char *pName, long long start, const AllocationCount &allocationsAtStart);
+	static int BeginGpuZone(const char *pName);
+	static void EndGpuZone(int index);
+
+private:
+	struct Thread
+	{
+		int id;
+		string name;
+		vector<ProfileEvent> events;
+		std::atomic<unsigned int> head;		// Total written; the consumer reads up to it
+		unsigned int read;					// Consumed into the statistics so far
+		int depth;
+	};
+
+	struct GpuZone
+	{
+		const char *pName;
+		int depth;
+	};
+
+	// The zones of one frame, and the queries at their ends
+	struct GpuFrame
+	{
+		vector<GpuZone> zones;
+		vector<GLuint> queries;				// Two per zone, allocated as needed
+		long long cpuAtGpuZero;				// The CPU clock when the GPU clock read zero, to line the two up
+		bool pending;
+	};
+
+	static Thread *GetThread();
+	static ProfileZoneStats &FindZone(const char *pName, int depth);
+	static void ResolveGpuFrame(GpuFrame &frame);
+	static void ConsumeCpuEvents();
+
+	static std::atomic<bool> m_enabled;
+	static bool m_created;
+	static std::mutex m_mutex;				// Guards the list of threads
+	static vector<Thread*> m_threads;
+	static std::atomic<int> m_generation;	// Moved on by Release, so that threads register again with a new ring
+	static Thread m_gpuThread;				// The GPU's resolved zones, written by the main thread
+
+	static GpuFrame m_gpuFrames[PROFILER_GPU_FRAMES];
+	static int m_frame;
+	static int m_gpuDepth;
+	static bool m_inFrame;
+	static long long m_frameStart;
+	static AllocationCount m_frameAllocations;
+	static int m_frameGpuZone;
+
+	static vector<ProfileZoneStats> m_zones;
+	static float m_cpuHistory[PROFILER_HISTORY];
+	static float m_gpuHistory[PROFILER_HISTORY];
+};
+
+// Times its scope; see PROFILE_ZONE
+class CProfileZone
+{
+public:
+	inline CProfileZone(const char *pName, bool gpu = false)
+	{
+		m_pName = NULL;
+		m_gpuZone = -1;
+		if (!CProfiler::IsEnabled())
+			return;
+		m_pName = pName;
+		m_allocations = CAllocations::GetThreadTotal();
+		m_start = CProfiler::BeginCpuZone();
+		if (gpu)
+			m_gpuZone = CProfiler::BeginGpuZone(pName);
+	}
+
+	inline ~CProfileZone()
+	{
+		if (m_pName == NULL)
+			return;
+		if (m_gpuZone >= 0)
+			CProfiler::EndGpuZone(m_gpuZone);
+		CProfiler::EndCpuZone(m_pName, m_start, m_allocations);
+	}
+
+private:
+	const char *m_pName;
+	long long m_start;
+	AllocationCount m_allocations;
+	int m_gpuZone;
+};
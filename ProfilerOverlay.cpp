@@ -0,0 +1,143 @@
+#include "ProfilerOverlay.h"
+#include "ShaderCache.h"
+#include "HudText.h"
+#include "RenderStats.h"
+#include "FrameArena.h"
+
+// The graph is a pixel per frame wide, and its top is two frames' budget
+#define PROFILER_OVERLAY_HEIGHT 100
+#define PROFILER_OVERLAY_MARGIN 20
+#define PROFILER_OVERLAY_BUDGET (1000.0f / 60.0f)
+#define PROFILER_OVERLAY_RANGE (2.0f * PROFILER_OVERLAY_BUDGET)
+#define PROFILER_OVERLAY_TEXT_SIZE 16
+#define PROFILER_OVERLAY_ROW_HEIGHT 18
+#define PROFILER_OVERLAY_ROW_WIDTH 360
+// Numbers that change every frame cannot be read, so the rows only change this often
+#define PROFILER_OVERLAY_UPDATE_FRAMES 10
+
+CProfilerOverlay::CProfilerOverlay()
+{
+	m_pProgram = NULL;
+	m_pHudText = NULL;
+	m_vao = 0;
+	m_vbo = 0;
+	m_frame = 0;
+	m_visible = false;
+}
+
+CProfilerOverlay::~CProfilerOverlay()
+{
+	Release();
+}
+
+void CProfilerOverlay::Create(CShaderCache *pShaderCache, CHudText *pHudText)
+{
+	Release();
+	m_pProgram = pShaderCache->CreateProgram("profilerGraph.vert", "profilerGraph.frag");
+	m_pHudText = pHudText;
+	m_rows.push_back(m_pHudText->AddString("Zone  cpu / gpu us  allocations", PROFILER_OVERLAY_TEXT_SIZE));
+
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), 0);
+	glBindVertexArray(0);
+}
+
+void CProfilerOverlay::Release()
+{
+	if (m_vao) glDeleteVertexArrays(1, &m_vao);
+	if (m_vbo) glDeleteBuffers(1, &m_vbo);
+	m_vao = m_vbo = 0;
+	delete m_pProgram;
+	m_pProgram = NULL;
+	m_rows.clear();
+}
+
+void CProfilerOverlay::SetVisible(bool visible)
+{
+	m_visible = visible;
+	for (unsigned int i = 0; i < m_rows.size(); i++)
+		m_pHudText->SetVisible(m_rows[i], visible);
+}
+
+bool CProfilerOverlay::IsVisible()
+{
+	return m_visible;
+}
+
+// A row per zone, added as zones are first seen, under the graph.  The first row is the header.
+void CProfilerOverlay::UpdateRows(int width, int height)
+{
+	while ((int)m_rows.size() < CProfiler::GetNumZones() + 1) {
+		const ProfileZoneStats &zone = CProfiler::GetZone((int)m_rows.size() - 1);
+		string format = string(2 * zone.depth, ' ') + zone.pName + "  %d / %d  %d";
+		m_rows.push_back(m_pHudText->AddString(format.c_str(), PROFILER_OVERLAY_TEXT_SIZE));
+	}
+
+	bool update = m_frame++ % PROFILER_OVERLAY_UPDATE_FRAMES == 0;
+	int x = width - PROFILER_OVERLAY_MARGIN - PROFILER_OVERLAY_ROW_WIDTH;
+	int y = height - 2 * PROFILER_OVERLAY_MARGIN - PROFILER_OVERLAY_HEIGHT - PROFILER_OVERLAY_ROW_HEIGHT;
+	for (unsigned int i = 0; i < m_rows.size(); i++) {
+		m_pHudText->SetPosition(m_rows[i], x, y - i * PROFILER_OVERLAY_ROW_HEIGHT);
+		m_pHudText->SetVisible(m_rows[i], true);
+		if (update && i > 0) {
+			const ProfileZoneStats &zone = CProfiler::GetZone(i - 1);
+			m_pHudText->SetValues(m_rows[i], (int)(1000.0 * zone.cpuMilliseconds), (int)(1000.0 * zone.gpuMilliseconds),
+				(int)(zone.allocations + 0.5));
+		}
+	}
+}
+
+void CProfilerOverlay::Render(int width, int height, const glm::mat4 &projectionMatrix)
+{
+	if (!m_visible)
+		return;
+	UpdateRows(width, height);
+	if (m_pProgram == NULL || !m_pProgram->IsReady())
+		return;
+
+	float cpuMilliseconds[PROFILER_HISTORY], gpuMilliseconds[PROFILER_HISTORY];
+	CProfiler::GetHistory(cpuMilliseconds, gpuMilliseconds);
+
+	// The frame, the budget, then the CPU and GPU times
+	float left = (float)(width - PROFILER_OVERLAY_MARGIN - PROFILER_HISTORY);
+	float right = left + PROFILER_HISTORY;
+	float bottom = (float)(height - PROFILER_OVERLAY_MARGIN - PROFILER_OVERLAY_HEIGHT);
+	float top = bottom + PROFILER_OVERLAY_HEIGHT;
+	float scale = PROFILER_OVERLAY_HEIGHT / PROFILER_OVERLAY_RANGE;
+	int numVertices = 7 + 2 * PROFILER_HISTORY;
+	glm::vec2 *pVertices = CFrameArena::Allocate<glm::vec2>(numVertices);
+	pVertices[0] = glm::vec2(left, bottom);
+	pVertices[1] = glm::vec2(right, bottom);
+	pVertices[2] = glm::vec2(right, top);
+	pVertices[3] = glm::vec2(left, top);
+	pVertices[4] = glm::vec2(left, bottom);
+	pVertices[5] = glm::vec2(left, bottom + PROFILER_OVERLAY_BUDGET * scale);
+	pVertices[6] = glm::vec2(right, bottom + PROFILER_OVERLAY_BUDGET * scale);
+	for (int i = 0; i < PROFILER_HISTORY; i++) {
+		pVertices[7 + i] = glm::vec2(left + i, bottom + std::min(cpuMilliseconds[i], PROFILER_OVERLAY_RANGE) * scale);
+		pVertices[7 + PROFILER_HISTORY + i] = glm::vec2(left + i, bottom + std::min(gpuMilliseconds[i], PROFILER_OVERLAY_RANGE) * scale);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(glm::vec2), pVertices, GL_STREAM_DRAW);
+
+	m_pProgram->UseProgram();
+	m_pProgram->SetUniform("projMatrix", projectionMatrix);
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(m_vao);
+	m_pProgram->SetUniform("colour", glm::vec4(1.0f, 1.0f, 1.0f, 0.5f));
+	glDrawArrays(GL_LINE_STRIP, 0, 5);
+	m_pProgram->SetUniform("colour", glm::vec4(1.0f, 0.2f, 0.2f, 1.0f));
+	glDrawArrays(GL_LINES, 5, 2);
+	m_pProgram->SetUniform("colour", glm::vec4(1.0f, 0.7f, 0.1f, 1.0f));
+	glDrawArrays(GL_LINE_STRIP, 7, PROFILER_HISTORY);
+	m_pProgram->SetUniform("colour", glm::vec4(0.2f, 1.0f, 0.3f, 1.0f));
+	glDrawArrays(GL_LINE_STRIP, 7 + PROFILER_HISTORY, PROFILER_HISTORY);
+	glBindVertexArray(0);
+	CRenderStats::AddStateChanges();
+	CRenderStats::AddDrawCalls(4);
+}
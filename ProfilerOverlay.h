@@ -0,0 +1,37 @@
+#pragma once
+#include "Common.h"
+#include "Profiler.h"
+
+class CCachedProgram;
+class CShaderCache;
+class CHudText;
+
+// Draws the profiler's statistics over the game:  graphs of the last PROFILER_HISTORY frames' CPU and GPU times against
+// the 60 FPS budget in the top right corner, and below them each zone's average CPU and GPU time and allocations, indented by nesting.
+// The rows are HUD strings, so they are drawn by CHudText::Render with the rest of the HUD.
+class CProfilerOverlay
+{
+public:
+	CProfilerOverlay();
+	~CProfilerOverlay();
+
+	void Create(CShaderCache *pShaderCache, CHudText *pHudText);
+	void Release();
+
+	void SetVisible(bool visible);
+	bool IsVisible();
+
+	// Draw the graphs and update the rows; call before CHudText::Render
+	void Render(int width, int height, const glm::mat4 &projectionMatrix);
+
+private:
+	void UpdateRows(int width, int height);
+
+	CCachedProgram *m_pProgram;
+	CHudText *m_pHudText;
+	GLuint m_vao;
+	GLuint m_vbo;
+	vector<int> m_rows;						// HUD string ids, in the profiler's zone order
+	int m_frame;
+	bool m_visible;
+};
@@ -0,0 +1,242 @@
+#include "ReflectionProbes.h"
+#include "ResourceManager.h"
+#include "RenderStats.h"
+#include "Profiler.h"
+#include <algorithm>
+
+// Near plane of the faces, and the far plane they are drawn with
+#define REFLECTION_PROBE_NEAR 0.5f
+#define REFLECTION_PROBE_FAR 5000.0f
+
+CReflectionProbes::CReflectionProbes()
+{
+	m_resolution = 0;
+	m_numMipLevels = 0;
+	m_fbo = 0;
+	m_readFbo = 0;
+	m_depth = 0;
+	m_resource = -1;
+	m_nextProbe = 0;
+	m_probe = -1;
+	m_face = 0;
+	m_faceProjection = glm::mat4(1.0f);
+	m_numUpdated = 0;
+}
+
+CReflectionProbes::~CReflectionProbes()
+{
+	Release();
+}
+
+void CReflectionProbes::Create(const vector<glm::vec3> &positions, int resolution)
+{
+	Release();
+	m_resolution = resolution;
+	m_numMipLevels = 1;
+	while ((resolution >> m_numMipLevels) > 0)
+		m_numMipLevels++;
+
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	m_probes.resize(positions.size());
+	for (unsigned int i = 0; i < m_probes.size(); i++) {
+		Probe &probe = m_probes[i];
+		probe.position = positions[i];
+		probe.front = 0;
+		probe.nextFace = 0;
+		glGenTextures(2, probe.textures);
+		for (int t = 0; t < 2; t++) {
+			glBindTexture(GL_TEXTURE_CUBE_MAP, probe.textures[t]);
+			glTexStorage2D(GL_TEXTURE_CUBE_MAP, m_numMipLevels, GL_RGBA8, resolution, resolution);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		}
+	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	glGenRenderbuffers(1, &m_depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, resolution, resolution);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glGenFramebuffers(1, &m_fbo);
+	glGenFramebuffers(1, &m_readFbo);
+
+	// Storage starts undefined, and a probe is sampled before its first update is done, so every level of every face
+	// starts as the scene's clear colour
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	for (unsigned int i = 0; i < m_probes.size(); i++) {
+		for (int t = 0; t < 2; t++) {
+			for (int face = 0; face < 6; face++) {
+				for (int level = 0; level < m_numMipLevels; level++) {
+					glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+						m_probes[i].textures[t], level);
+					glClear(GL_COLOR_BUFFER_BIT);
+				}
+			}
+		}
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// 90 degrees, so the six faces meet
+	m_faceProjection = glm::perspective(1.5707963f, 1.0f, REFLECTION_PROBE_NEAR, REFLECTION_PROBE_FAR);
+
+	// Four bytes a texel, a third more for the mips, two cube maps a probe, and the shared depth
+	size_t faceBytes = (size_t)resolution * resolution * 4;
+	size_t gpuBytes = m_probes.size() * 2 * 6 * (faceBytes + faceBytes / 3) + faceBytes;
+	m_resource = CResourceManager::Register(RESOURCE_TEXTURE, "Reflection probes", 0, gpuBytes);
+}
+
+void CReflectionProbes::Release()
+{
+	for (unsigned int i = 0; i < m_probes.size(); i++)
+		glDeleteTextures(2, m_probes[i].textures);
+	m_probes.clear();
+	if (m_fbo) glDeleteFramebuffers(1, &m_fbo);
+	if (m_readFbo) glDeleteFramebuffers(1, &m_readFbo);
+	if (m_depth) glDeleteRenderbuffers(1, &m_depth);
+	m_fbo = m_readFbo = m_depth = 0;
+	CResourceManager::Unregister(m_resource);
+	m_resource = -1;
+	m_probe = -1;
+	m_nextProbe = 0;
+	m_numUpdated = 0;
+}
+
+// The GL cube map convention, with each face's image upside down from a camera's view of it
+void CReflectionProbes::GetFaceAxes(int face, glm::vec3 &direction, glm::vec3 &upVector)
+{
+	static const glm::vec3 directions[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+		glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+	static const glm::vec3 upVectors[6] = { glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1),
+		glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0) };
+	direction = directions[face];
+	upVector = upVectors[face];
+}
+
+bool CReflectionProbes::Schedule(const glm::vec3 &focusPosition, GeometryView &cullView)
+{
+	m_probe = -1;
+	int numProbes = (int)m_probes.size();
+	if (numProbes == 0)
+		return false;
+
+	// A probe part way through an update carries on with its next face; otherwise find the next probe in range
+	int candidate = m_nextProbe % numProbes;
+	for (int i = 0; i < numProbes; i++, candidate = (candidate + 1) % numProbes) {
+		if (glm::distance(m_probes[candidate].position, focusPosition) <= REFLECTION_PROBE_RANGE) {
+			m_probe = candidate;
+			break;
+		}
+	}
+	if (m_probe < 0)
+		return false;
+	m_nextProbe = m_probe;
+	m_face = m_probes[m_probe].nextFace;
+
+	glm::vec3 direction, upVector;
+	GetFaceAxes(m_face, direction, upVector);
+	const glm::vec3 &position = m_probes[m_probe].position;
+	cullView.viewMatrix = glm::lookAt(position, position + direction, upVector);
+	cullView.projectionMatrix = glm::perspective(1.5707963f, 1.0f, REFLECTION_PROBE_NEAR, REFLECTION_PROBE_CULL_DISTANCE);
+	return true;
+}
+
+void CReflectionProbes::BeginFace()
+{
+	if (m_probe < 0)
+		return;
+	const Probe &probe = m_probes[m_probe];
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + m_face,
+		probe.textures[1 - probe.front], 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+	glViewport(0, 0, m_resolution, m_resolution);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	CRenderStats::AddStateChanges(2);
+}
+
+void CReflectionProbes::EndFace()
+{
+	if (m_probe < 0)
+		return;
+	PROFILE_GPU_ZONE("Probe mips");
+	Probe &probe = m_probes[m_probe];
+	GLuint texture = probe.textures[1 - probe.front];
+	GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + m_face;
+
+	// Each level is filtered down from the one above, so rough reflections read a blurred scene
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_readFbo);
+	for (int level = 1; level < m_numMipLevels; level++) {
+		int source = std::max(m_resolution >> (level - 1), 1);
+		int destination = std::max(m_resolution >> level, 1);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, texture, level - 1);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, texture, level);
+		glBlitFramebuffer(0, 0, source, source, 0, 0, destination, destination, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	CRenderStats::AddStateChanges(m_numMipLevels);
+
+	probe.nextFace++;
+	if (probe.nextFace == 6) {
+		probe.nextFace = 0;
+		probe.front = 1 - probe.front;
+		m_nextProbe = m_probe + 1;
+		m_numUpdated++;
+	}
+	m_probe = -1;
+}
+
+const glm::mat4 &CReflectionProbes::GetFaceProjectionMatrix()
+{
+	return m_faceProjection;
+}
+
+const glm::vec3 &CReflectionProbes::GetFacePosition()
+{
+	return m_probes[std::max(m_probe, 0)].position;
+}
+
+int CReflectionProbes::GetFaceResolution()
+{
+	return m_resolution;
+}
+
+void CReflectionProbes::Bind(const glm::vec3 &position, int textureUnit)
+{
+	if (m_probes.empty())
+		return;
+	int nearest = 0;
+	float nearestDistance = glm::distance(m_probes[0].position, position);
+	for (unsigned int i = 1; i < m_probes.size(); i++) {
+		float distance = glm::distance(m_probes[i].position, position);
+		if (distance < nearestDistance) {
+			nearest = i;
+			nearestDistance = distance;
+		}
+	}
+
+	const Probe &probe = m_probes[nearest];
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, probe.textures[probe.front]);
+	glBindSampler(textureUnit, 0);
+	glActiveTexture(GL_TEXTURE0);
+	CRenderStats::AddStateChanges();
+}
+
+int CReflectionProbes::GetNumMipLevels()
+{
+	return m_numMipLevels;
+}
+
+int CReflectionProbes::GetNumProbes()
+{
+	return (int)m_probes.size();
+}
+
+int CReflectionProbes::GetNumUpdatedProbes()
+{
+	return m_numUpdated;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "Common.h"
+#include "GeometryPool.h"
+
+// Size of a probe's cube faces, in pixels
+#define REFLECTION_PROBE_RESOLUTION 128
+// Probes further than this from the focus are not updated, as nothing near enough samples them
+#define REFLECTION_PROBE_RANGE 400.0f
+// Pooled draws beyond this distance from a probe are culled from its faces
+#define REFLECTION_PROBE_CULL_DISTANCE 1500.0f
+
+// Dynamic environment cube maps at fixed points along the track, for reflections of the scene around them.  Updating a
+// probe in one go would cost six scene renders, so the cost is spread out:  each frame Schedule picks one face of one
+// probe, in round robin order among the probes near the focus, and the game renders the scene into it at low
+// resolution, culled to a short distance.  EndFace then downsamples that face's mip chain, so the prefiltered levels are
+// built a face at a time too.  Each probe has two cube maps; faces are drawn into the back one, which is swapped to the
+// front once all six faces and their mips are done, so a probe never shows a half updated cube.
+class CReflectionProbes
+{
+public:
+	CReflectionProbes();
+	~CReflectionProbes();
+
+	void Create(const vector<glm::vec3> &positions, int resolution = REFLECTION_PROBE_RESOLUTION);
+	void Release();
+
+	// Choose this frame's face.  Returns false if no probe is near the focus; otherwise cullView is the face's camera,
+	// with a projection that culls at REFLECTION_PROBE_CULL_DISTANCE, to be prepared in the geometry pool with the
+	// frame's views.
+	bool Schedule(const glm::vec3 &focusPosition, GeometryView &cullView);
+	// Bind the scheduled face as the framebuffer with its viewport, and clear it
+	void BeginFace();
+	// Build the face's mips and, after the probe's last face, swap its cube maps.  Leaves framebuffer 0 bound.
+	void EndFace();
+
+	// The scheduled face's projection for drawing, which keeps the skybox in range
+	const glm::mat4 &GetFaceProjectionMatrix();
+	const glm::vec3 &GetFacePosition();
+	int GetFaceResolution();
+
+	// Bind the front cube map of the probe nearest a position for sampling
+	void Bind(const glm::vec3 &position, int textureUnit);
+	int GetNumMipLevels();
+	int GetNumProbes();
+	int GetNumUpdatedProbes();				// Full updates since Create
+
+private:
+	struct Probe
+	{
+		glm::vec3 position;
+		GLuint textures[2];					// Front and back
+		int front;
+		int nextFace;
+	};
+
+	static void GetFaceAxes(int face, glm::vec3 &direction, glm::vec3 &upVector);
+
+	vector<Probe> m_probes;
+	int m_resolution;
+	int m_numMipLevels;
+	GLuint m_fbo;
+	GLuint m_readFbo;						// For downsampling one mip level into the next
+	GLuint m_depth;							// Shared by every face
+	int m_resource;
+
+	int m_nextProbe;						// Where the round robin search starts
+	int m_probe;							// Scheduled this frame, or -1
+	int m_face;
+	glm::mat4 m_faceProjection;
+	int m_numUpdated;
+};
@@ -0,0 +1,30 @@
+#include "RenderStats.h"
+
+int CRenderStats::m_drawCalls = 0;
+int CRenderStats::m_stateChanges = 0;
+
+void CRenderStats::AddDrawCalls(int count)
+{
+	m_drawCalls += count;
+}
+
+void CRenderStats::AddStateChanges(int count)
+{
+	m_stateChanges += count;
+}
+
+void CRenderStats::Reset()
+{
+	m_drawCalls = 0;
+	m_stateChanges = 0;
+}
+
+int CRenderStats::GetDrawCalls()
+{
+	return m_drawCalls;
+}
+
+int CRenderStats::GetStateChanges()
+{
+	return m_stateChanges;
+}
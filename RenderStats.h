@@ -0,0 +1,20 @@
+#pragma once
+#include "Common.h"
+
+// Counts of the draw calls and state changes (program, texture and vertex array binds) made since the last Reset, for
+// the benchmark.  They are counted where this tree's classes make them; the skybox, sphere and Assimp meshes are not
+// counted.  Draws are only made on the main thread, so the counters are plain ints.
+class CRenderStats
+{
+public:
+	static void AddDrawCalls(int count = 1);
+	static void AddStateChanges(int count = 1);
+	static void Reset();
+
+	static int GetDrawCalls();
+	static int GetStateChanges();
+
+private:
+	static int m_drawCalls;
+	static int m_stateChanges;
+};
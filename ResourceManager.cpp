@@ -0,0 +1,380 @@
+#include "ResourceManager.h"
+#include "AssetLoader.h"
+#include "MeshCache.h"
+#include "Log.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <memory>
+
+static const char *RESOURCE_TYPE_NAMES[NUM_RESOURCE_TYPES] = { "Textures", "Meshes" };
+
+std::mutex CResourceManager::m_mutex;
+vector<CResourceManager::Resource*> CResourceManager::m_resources;
+std::map<string, int> CResourceManager::m_paths;
+std::map<unsigned long long, int> CResourceManager::m_hashes;
+std::map<CCompiledTexture*, int> CResourceManager::m_textures;
+vector<CResourceManager::Resource*> CResourceManager::m_orphans;
+CAssetLoader *CResourceManager::m_pLoader = NULL;
+size_t CResourceManager::m_vramBudget = RESOURCE_VRAM_BUDGET;
+unsigned int CResourceManager::m_frame = 0;
+bool CResourceManager::m_overBudget = false;
+
+void CResourceManager::Create(CJobSystem *pJobSystem, size_t vramBudget)
+{
+	m_pLoader = new CAssetLoader(pJobSystem);
+	m_vramBudget = vramBudget;
+	m_frame = 0;
+	m_overBudget = false;
+}
+
+void CResourceManager::Release()
+{
+	for (unsigned int i = 0; i < m_resources.size(); i++) {
+		if (m_resources[i] == NULL)
+			continue;
+		LogMessage("Resource still held at exit: %s (%d references)", m_resources[i]->name.c_str(),
+			m_resources[i]->references);
+		delete m_resources[i]->pTexture;
+		delete m_resources[i];
+	}
+	for (unsigned int i = 0; i < m_orphans.size(); i++) {
+		delete m_orphans[i]->pTexture;
+		delete m_orphans[i];
+	}
+	m_resources.clear();
+	m_paths.clear();
+	m_hashes.clear();
+	m_textures.clear();
+	m_orphans.clear();
+	delete m_pLoader;
+	m_pLoader = NULL;
+}
+
+// Paths differing in the direction of their slashes name the same file, and on Windows so do those differing in case
+string CResourceManager::GetKey(const string &path)
+{
+	string key = path;
+	for (unsigned int i = 0; i < key.size(); i++) {
+		if (key[i] == '\\')
+			key[i] = '/';
+#ifdef _WIN32
+		else if (key[i] >= 'A' && key[i] <= 'Z')
+			key[i] = key[i] - 'A' + 'a';
+#endif
+	}
+	return key;
+}
+
+CCompiledTexture *CResourceManager::AcquireTexture(const string &path, bool streamable)
+{
+	if (IsTextureLoaded(path))
+		return AcquireLoadedTexture(path, 0, NULL, streamable);
+
+	CTextureData data;
+	data.Load(path);
+	return AcquireLoadedTexture(path, CMeshCache::HashFile(path), &data, streamable);
+}
+
+CCompiledTexture *CResourceManager::AcquireLoadedTexture(const string &path, unsigned long long hash, CTextureData *pData,
+	bool streamable)
+{
+	string key = GetKey(path);
+	std::map<string, int>::iterator byPath = m_paths.find(key);
+	if (byPath != m_paths.end())
+		return Share(byPath->second, key);
+	std::map<unsigned long long, int>::iterator byHash = hash ? m_hashes.find(hash) : m_hashes.end();
+	if (byHash != m_hashes.end())
+		return Share(byHash->second, key);
+
+	// Released since the worker looked, so it has to be loaded here after all
+	if (pData == NULL)
+		return AcquireTexture(path, streamable);
+
+	CCompiledTexture *pTexture = new CCompiledTexture;
+	if (!pTexture->Create(*pData)) {
+		delete pTexture;
+		return NULL;
+	}
+	pTexture->SetSamplerObjectParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	pTexture->SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	pTexture->SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
+	pTexture->SetSamplerObjectParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
+	AddTexture(path, hash, pTexture, streamable);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_paths[key] = m_textures[pTexture];
+	return pTexture;
+}
+
+// Generated textures are only found by their contents, so the name need not be unique
+CCompiledTexture *CResourceManager::AcquireTextureFromData(const string &name, const BYTE *pData, int width, int height,
+	int bpp, GLenum format)
+{
+	int size[2] = { width, height };
+	unsigned long long hash = CMeshCache::HashData(size, sizeof(size));
+	hash = CMeshCache::HashData(pData, (size_t)width * height * (bpp / 8), hash);
+	std::map<unsigned long long, int>::iterator byHash = m_hashes.find(hash);
+	if (byHash != m_hashes.end())
+		return Share(byHash->second, "");
+
+	CCompiledTexture *pTexture = new CCompiledTexture;
+	pTexture->CreateFromData(pData, width, height, bpp, format, false);
+	pTexture->SetSamplerObjectParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	pTexture->SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	pTexture->SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
+	pTexture->SetSamplerObjectParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
+	return AddTexture(name, hash, pTexture, false);
+}
+
+CCompiledTexture *CResourceManager::AddTexture(const string &name, unsigned long long hash, CCompiledTexture *pTexture,
+	bool streamable)
+{
+	Resource *pResource = new Resource;
+	pResource->type = RESOURCE_TEXTURE;
+	pResource->name = name;
+	pResource->hash = hash;
+	pResource->references = 1;
+	pResource->cpuBytes = 0;
+	pResource->gpuBytes = pTexture->GetGpuBytes();
+	pResource->pTexture = pTexture;
+	pResource->streamable = streamable;
+	pResource->resident = true;
+	pResource->reloading = false;
+	pResource->bindCount = pTexture->GetBindCount();
+	pResource->lastUsed = m_frame;
+
+	int handle = Add(pResource);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_textures[pTexture] = handle;
+	if (hash)
+		m_hashes[hash] = handle;
+	return pTexture;
+}
+
+// Another reference to a texture, also known from now on by the key given, if any
+CCompiledTexture *CResourceManager::Share(int handle, const string &key)
+{
+	Resource *pResource = m_resources[handle];
+	pResource->references++;
+	if (!key.empty()) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_paths[key] = handle;
+	}
+	return pResource->pTexture;
+}
+
+void CResourceManager::ReleaseTexture(CCompiledTexture *pTexture)
+{
+	if (pTexture == NULL)
+		return;
+	std::map<CCompiledTexture*, int>::iterator it = m_textures.find(pTexture);
+	if (it == m_textures.end())
+		return;
+	if (--m_resources[it->second]->references == 0)
+		Remove(it->second);
+}
+
+bool CResourceManager::IsTextureLoaded(const string &path)
+{
+	string key = GetKey(path);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_paths.find(key) != m_paths.end();
+}
+
+int CResourceManager::Add(Resource *pResource)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (unsigned int i = 0; i < m_resources.size(); i++) {
+		if (m_resources[i] == NULL) {
+			m_resources[i] = pResource;
+			return (int)i;
+		}
+	}
+	m_resources.push_back(pResource);
+	return (int)m_resources.size() - 1;
+}
+
+int CResourceManager::Register(ResourceType type, const string &name, size_t cpuBytes, size_t gpuBytes)
+{
+	Resource *pResource = new Resource;
+	pResource->type = type;
+	pResource->name = name;
+	pResource->hash = 0;
+	pResource->references = 1;
+	pResource->cpuBytes = cpuBytes;
+	pResource->gpuBytes = gpuBytes;
+	pResource->pTexture = NULL;
+	pResource->streamable = false;
+	pResource->resident = true;
+	pResource->reloading = false;
+	pResource->bindCount = 0;
+	pResource->lastUsed = m_frame;
+	return Add(pResource);
+}
+
+void CResourceManager::SetBytes(int handle, size_t cpuBytes, size_t gpuBytes)
+{
+	if (handle < 0 || handle >= (int)m_resources.size() || m_resources[handle] == NULL)
+		return;
+	m_resources[handle]->cpuBytes = cpuBytes;
+	m_resources[handle]->gpuBytes = gpuBytes;
+}
+
+void CResourceManager::Unregister(int handle)
+{
+	if (handle >= 0 && handle < (int)m_resources.size() && m_resources[handle] != NULL)
+		Remove(handle);
+}
+
+// Forget a resource and free its texture, unless a reload of it is on the way, which then frees it instead
+void CResourceManager::Remove(int handle)
+{
+	Resource *pResource = m_resources[handle];
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_resources[handle] = NULL;
+		for (std::map<string, int>::iterator it = m_paths.begin(); it != m_paths.end();) {
+			if (it->second == handle)
+				it = m_paths.erase(it);
+			else
+				++it;
+		}
+		if (pResource->hash)
+			m_hashes.erase(pResource->hash);
+		m_textures.erase(pResource->pTexture);
+	}
+
+	if (pResource->reloading) {
+		m_orphans.push_back(pResource);
+		return;
+	}
+	delete pResource->pTexture;
+	delete pResource;
+}
+
+void CResourceManager::Update()
+{
+	if (m_pLoader == NULL)
+		return;
+	PROFILE_ZONE("Resources");
+	m_frame++;
+	m_pLoader->ProcessUploads(1.0);
+
+	// A texture bound since the last frame is in use, and one bound while evicted is wanted back
+	size_t gpuBytes = 0;
+	for (unsigned int i = 0; i < m_resources.size(); i++) {
+		Resource *pResource = m_resources[i];
+		if (pResource == NULL)
+			continue;
+		if (pResource->pTexture && pResource->pTexture->GetBindCount() != pResource->bindCount) {
+			pResource->bindCount = pResource->pTexture->GetBindCount();
+			pResource->lastUsed = m_frame;
+			if (!pResource->resident && !pResource->reloading)
+				Reload(pResource);
+		}
+		gpuBytes += pResource->gpuBytes;
+	}
+
+	if (gpuBytes > m_vramBudget)
+		Evict(gpuBytes);
+	else
+		m_overBudget = false;
+}
+
+// Evict the streamable textures unbound for longest until under budget, if enough have gone unbound for long enough
+void CResourceManager::Evict(size_t &gpuBytes)
+{
+	while (gpuBytes > m_vramBudget) {
+		Resource *pOldest = NULL;
+		for (unsigned int i = 0; i < m_resources.size(); i++) {
+			Resource *pResource = m_resources[i];
+			if (pResource == NULL || !pResource->streamable || !pResource->resident || pResource->reloading)
+				continue;
+			if (m_frame - pResource->lastUsed < RESOURCE_EVICT_FRAMES)
+				continue;
+			if (pOldest == NULL || pResource->lastUsed < pOldest->lastUsed)
+				pOldest = pResource;
+		}
+		if (pOldest == NULL) {
+			if (!m_overBudget)
+				LogMessage("Video memory over budget: %u of %u MB, with nothing unused long enough to evict",
+					(unsigned int)(gpuBytes >> 20), (unsigned int)(m_vramBudget >> 20));
+			m_overBudget = true;
+			return;
+		}
+
+		gpuBytes -= pOldest->gpuBytes;
+		pOldest->pTexture->ReleaseImage();
+		pOldest->gpuBytes = 0;
+		pOldest->resident = false;
+	}
+}
+
+// Decode on a worker and upload in a later Update.  The sampler, and so the texture's parameters, survive the eviction.
+void CResourceManager::Reload(Resource *pResource)
+{
+	pResource->reloading = true;
+	std::shared_ptr<CTextureData> pData(new CTextureData);
+	string path = pResource->name;
+	m_pLoader->Queue(
+		[pData, path] { pData->Load(path); },
+		[pResource, pData] {
+			pResource->reloading = false;
+			vector<Resource*>::iterator orphan = std::find(m_orphans.begin(), m_orphans.end(), pResource);
+			if (orphan != m_orphans.end()) {
+				m_orphans.erase(orphan);
+				delete pResource->pTexture;
+				delete pResource;
+				return;
+			}
+			pResource->pTexture->Create(*pData);
+			pResource->gpuBytes = pResource->pTexture->GetGpuBytes();
+			pResource->resident = true;
+		});
+}
+
+size_t CResourceManager::GetGpuBytes()
+{
+	size_t gpuBytes = 0;
+	for (unsigned int i = 0; i < m_resources.size(); i++) {
+		if (m_resources[i])
+			gpuBytes += m_resources[i]->gpuBytes;
+	}
+	return gpuBytes;
+}
+
+static bool CompareGpuBytes(const std::pair<size_t, string> &a, const std::pair<size_t, string> &b)
+{
+	return a.first > b.first;
+}
+
+// Totals by type, then every resource, largest first
+void CResourceManager::Report()
+{
+	size_t cpuBytes[NUM_RESOURCE_TYPES] = { 0 }, gpuBytes[NUM_RESOURCE_TYPES] = { 0 };
+	int counts[NUM_RESOURCE_TYPES] = { 0 }, evicted = 0;
+	vector<std::pair<size_t, string> > lines;
+	for (unsigned int i = 0; i < m_resources.size(); i++) {
+		Resource *pResource = m_resources[i];
+		if (pResource == NULL)
+			continue;
+		counts[pResource->type]++;
+		cpuBytes[pResource->type] += pResource->cpuBytes;
+		gpuBytes[pResource->type] += pResource->gpuBytes;
+		evicted += pResource->resident ? 0 : 1;
+
+		char line[512];
+		snprintf(line, sizeof(line), "  %-48s %2d refs  cpu %7u KB  gpu %7u KB%s", pResource->name.c_str(),
+			pResource->references, (unsigned int)(pResource->cpuBytes >> 10), (unsigned int)(pResource->gpuBytes >> 10),
+			pResource->resident ? "" : "  (evicted)");
+		lines.push_back(std::make_pair(pResource->gpuBytes, string(line)));
+	}
+
+	LogMessage("Resources: %u of %u MB of video memory, %d textures evicted", (unsigned int)(GetGpuBytes() >> 20),
+		(unsigned int)(m_vramBudget >> 20), evicted);
+	for (int t = 0; t < NUM_RESOURCE_TYPES; t++)
+		LogMessage("%s: %d, cpu %u KB, gpu %u KB", RESOURCE_TYPE_NAMES[t], counts[t], (unsigned int)(cpuBytes[t] >> 10),
+			(unsigned int)(gpuBytes[t] >> 10));
+	std::stable_sort(lines.begin(), lines.end(), CompareGpuBytes);
+	for (unsigned int i = 0; i < lines.size(); i++)
+		LogMessage("%s", lines[i].second.c_str());
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "Common.h"
+#include "CompiledTexture.h"
+#include <map>
+#include <mutex>
+
+class CJobSystem;
+class CAssetLoader;
+
+enum ResourceType
+{
+	RESOURCE_TEXTURE,
+	RESOURCE_MESH,
+	NUM_RESOURCE_TYPES
+};
+
+// Video memory the streamable textures are evicted to keep within, unless Create is given another
+#define RESOURCE_VRAM_BUDGET ((size_t)256 << 20)
+// Frames a streamable texture must have gone unbound before it may be evicted
+#define RESOURCE_EVICT_FRAMES 120
+
+// Owns the game's textures and accounts for the memory of its meshes.  A texture is shared: acquiring one again, by its
+// path or by another file with the same contents, returns the same texture with one more reference, and it is freed
+// when the last is released.  Every resource's CPU and GPU bytes are tracked, and Report logs the breakdown.  While
+// video memory is over budget, the streamable textures unbound for longest are evicted; one bound again is reloaded in
+// the background, and draws black until it is back.  Textures are handed out as the CCompiledTexture the geometry pool
+// and the meshes already draw with.  Main thread only, but for IsTextureLoaded.
+class CResourceManager
+{
+public:
+	static void Create(CJobSystem *pJobSystem, size_t vramBudget = RESOURCE_VRAM_BUDGET);
+	// Logs any resource still held.  The job system must have stopped.
+	static void Release();
+
+	// A texture from a file, with trilinear filtering and repeat wrapping, or NULL if it cannot be loaded.  Its sampler
+	// is shared by every holder.
+	static CCompiledTexture *AcquireTexture(const string &path, bool streamable = false);
+	// The same, from data loaded on a worker with the hash of the file (CMeshCache::HashFile).  If IsTextureLoaded said
+	// the texture was in, pData may be NULL and hash 0.
+	static CCompiledTexture *AcquireLoadedTexture(const string &path, unsigned long long hash, CTextureData *pData,
+		bool streamable);
+	// A texture of the given pixels, shared with any other of the same size and contents.  The name is for the report.
+	static CCompiledTexture *AcquireTextureFromData(const string &name, const BYTE *pData, int width, int height, int bpp,
+		GLenum format);
+	static void ReleaseTexture(CCompiledTexture *pTexture);
+	// Safe on any thread, so that a loader can skip decoding a texture that is already in
+	static bool IsTextureLoaded(const string &path);
+
+	// Memory held elsewhere, for the budget and the report.  Returns the handle for SetBytes and Unregister.
+	static int Register(ResourceType type, const string &name, size_t cpuBytes, size_t gpuBytes);
+	static void SetBytes(int handle, size_t cpuBytes, size_t gpuBytes);
+	static void Unregister(int handle);
+
+	// Once a frame, after rendering:  evict and reload streamable textures
+	static void Update();
+	static void Report();
+	static size_t GetGpuBytes();
+
+private:
+	struct Resource
+	{
+		ResourceType type;
+		string name;
+		unsigned long long hash;			// Of the contents, or 0 if not shared by contents
+		int references;
+		size_t cpuBytes;
+		size_t gpuBytes;
+		CCompiledTexture *pTexture;			// For a texture
+		bool streamable;
+		bool resident;
+		bool reloading;
+		unsigned int bindCount;				// The texture's at the last Update
+		unsigned int lastUsed;				// Frame
+	};
+
+	static string GetKey(const string &path);
+	static int Add(Resource *pResource);
+	static CCompiledTexture *AddTexture(const string &name, unsigned long long hash, CCompiledTexture *pTexture,
+		bool streamable);
+	static CCompiledTexture *Share(int handle, const string &key);
+	static void Remove(int handle);
+	static void Reload(Resource *pResource);
+	static void Evict(size_t &gpuBytes);
+
+	static std::mutex m_mutex;				// Guards the tables against IsTextureLoaded
+	static vector<Resource*> m_resources;	// By handle; NULL once removed
+	static std::map<string, int> m_paths;
+	static std::map<unsigned long long, int> m_hashes;
+	static std::map<CCompiledTexture*, int> m_textures;
+	static vector<Resource*> m_orphans;		// Released while reloading, deleted when the reload lands
+	static CAssetLoader *m_pLoader;
+	static size_t m_vramBudget;
+	static unsigned int m_frame;
+	static bool m_overBudget;
+};
@@ -0,0 +1,457 @@
+#include "ShaderCache.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "Log.h"
+#include "Platform.h"
+#include "FileSystem.h"
+#include "RenderStats.h"
+#include "Profiler.h"
+#include <stdio.h>
+#include <fstream>
+#include <regex>
+
+// Bump when the layout below changes
+static const unsigned int SHADER_CACHE_MAGIC = 0x47525050; // "PPRG"
+static const unsigned int SHADER_CACHE_VERSION = 1;
+
+struct ShaderCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long key;
+	unsigned int binaryFormat;
+	unsigned int binarySize;
+};
+
+CCachedProgram::CCachedProgram()
+{
+	m_program = 0;
+	m_ready = false;
+	m_valid = false;
+	m_key = 0;
+}
+
+CCachedProgram::~CCachedProgram()
+{
+	if (m_program)
+		glDeleteProgram(m_program);
+}
+
+bool CCachedProgram::IsReady()
+{
+	return m_ready;
+}
+
+bool CCachedProgram::IsValid()
+{
+	return m_ready && m_valid;
+}
+
+void CCachedProgram::UseProgram()
+{
+	if (IsValid()) {
+		glUseProgram(m_program);
+		CRenderStats::AddStateChanges();
+	}
+}
+
+UINT CCachedProgram::GetProgramID()
+{
+	return m_program;
+}
+
+bool CCachedProgram::HasStorageBlock(const char *name)
+{
+	return IsValid() && glGetProgramResourceIndex(m_program, GL_SHADER_STORAGE_BLOCK, name) != GL_INVALID_INDEX;
+}
+
+bool CCachedProgram::HasUniform(const char *name)
+{
+	return IsValid() && glGetUniformLocation(m_program, name) >= 0;
+}
+
+GLenum CCachedProgram::GetAttributeType(GLint location)
+{
+	if (!IsValid())
+		return 0;
+	GLint numAttributes = 0;
+	glGetProgramiv(m_program, GL_ACTIVE_ATTRIBUTES, &numAttributes);
+	for (GLint i = 0; i < numAttributes; i++) {
+		char name[256];
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveAttrib(m_program, i, sizeof(name), NULL, &size, &type, name);
+		if (glGetAttribLocation(m_program, name) == location)
+			return type;
+	}
+	return 0;
+}
+
+void CCachedProgram::SetUniform(const char *name, float *pValues, int count)
+{
+	glUniform1fv(glGetUniformLocation(m_program, name), count, pValues);
+}
+
+void CCachedProgram::SetUniform(const char *name, const float value)
+{
+	glUniform1fv(glGetUniformLocation(m_program, name), 1, &value);
+}
+
+void CCachedProgram::SetUniform(const char *name, glm::vec2 *pVectors, int count)
+{
+	glUniform2fv(glGetUniformLocation(m_program, name), count, (GLfloat*)pVectors);
+}
+
+void CCachedProgram::SetUniform(const char *name, const glm::vec2 vector)
+{
+	glUniform2fv(glGetUniformLocation(m_program, name), 1, (GLfloat*)&vector);
+}
+
+void CCachedProgram::SetUniform(const char *name, glm::vec3 *pVectors, int count)
+{
+	glUniform3fv(glGetUniformLocation(m_program, name), count, (GLfloat*)pVectors);
+}
+
+void CCachedProgram::SetUniform(const char *name, const glm::vec3 vector)
+{
+	glUniform3fv(glGetUniformLocation(m_program, name), 1, (GLfloat*)&vector);
+}
+
+void CCachedProgram::SetUniform(const char *name, glm::vec4 *pVectors, int count)
+{
+	glUniform4fv(glGetUniformLocation(m_program, name), count, (GLfloat*)pVectors);
+}
+
+void CCachedProgram::SetUniform(const char *name, const glm::vec4 vector)
+{
+	glUniform4fv(glGetUniformLocation(m_program, name), 1, (GLfloat*)&vector);
+}
+
+void CCachedProgram::SetUniform(const char *name, glm::mat3 *pMatrices, int count)
+{
+	glUniformMatrix3fv(glGetUniformLocation(m_program, name), count, GL_FALSE, (GLfloat*)pMatrices);
+}
+
+void CCachedProgram::SetUniform(const char *name, const glm::mat3 matrix)
+{
+	glUniformMatrix3fv(glGetUniformLocation(m_program, name), 1, GL_FALSE, (GLfloat*)&matrix);
+}
+
+void CCachedProgram::SetUniform(const char *name, glm::mat4 *pMatrices, int count)
+{
+	glUniformMatrix4fv(glGetUniformLocation(m_program, name), count, GL_FALSE, (GLfloat*)pMatrices);
+}
+
+void CCachedProgram::SetUniform(const char *name, const glm::mat4 matrix)
+{
+	glUniformMatrix4fv(glGetUniformLocation(m_program, name), 1, GL_FALSE, (GLfloat*)&matrix);
+}
+
+void CCachedProgram::SetUniform(const char *name, int *pValues, int count)
+{
+	glUniform1iv(glGetUniformLocation(m_program, name), count, pValues);
+}
+
+void CCachedProgram::SetUniform(const char *name, const int value)
+{
+	glUniform1i(glGetUniformLocation(m_program, name), value);
+}
+
+CShaderCache::CShaderCache()
+{
+	m_pPlatform = NULL;
+	m_context = NULL;
+	m_started = false;
+	m_numPending = 0;
+}
+
+CShaderCache::~CShaderCache()
+{
+	Release();
+}
+
+// Create a context sharing the current one's objects, and make it current on the compile thread
+bool CShaderCache::Start(CPlatform *pPlatform)
+{
+	m_context = pPlatform->CreateSharedContext();
+	if (m_context == NULL) {
+		LogMessage("Could not create a shared context; shaders will compile on the main thread");
+		return false;
+	}
+
+	m_pPlatform = pPlatform;
+	m_compiler.Start(1);
+	m_compiler.Submit([this] {
+		CProfiler::SetThreadName("Shader compiler");
+		m_pPlatform->MakeCurrent(m_context);
+	});
+	m_started = true;
+	return true;
+}
+
+void CShaderCache::Release()
+{
+	if (!m_started)
+		return;
+
+	m_compiler.Submit([this] { m_pPlatform->MakeCurrent(NULL); });
+	m_compiler.WaitIdle();
+	m_compiler.Stop();
+	m_pPlatform->DeleteContext(m_context);
+	m_context = NULL;
+	m_started = false;
+}
+
+CCachedProgram *CShaderCache::CreateProgram(const string &vertexFilename, const string &fragmentFilename,
+	const vector<ShaderConstant> &constants)
+{
+	CCachedProgram *pProgram = new CCachedProgram;
+	pProgram->m_name = vertexFilename + "+" + fragmentFilename;
+	pProgram->m_filenames.push_back(vertexFilename);
+	pProgram->m_filenames.push_back(fragmentFilename);
+	return Build(pProgram, constants);
+}
+
+CCachedProgram *CShaderCache::CreateComputeProgram(const string &computeFilename, const vector<ShaderConstant> &constants)
+{
+	CCachedProgram *pProgram = new CCachedProgram;
+	pProgram->m_name = computeFilename;
+	pProgram->m_filenames.push_back(computeFilename);
+	return Build(pProgram, constants);
+}
+
+// Read the sources, then load the program from its binary or compile it
+CCachedProgram *CShaderCache::Build(CCachedProgram *pProgram, const vector<ShaderConstant> &constants)
+{
+	if (m_driver.empty())
+		m_driver = string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" +
+			(const char*)glGetString(GL_VERSION);
+	for (unsigned int i = 0; i < constants.size(); i++) {
+		if (constants[i].value)
+			pProgram->m_name += "+" + constants[i].name;
+	}
+
+	// Read the sources here, so that they are part of the key
+	unsigned long long key = CMeshCache::HashData(m_driver.c_str(), m_driver.size());
+	for (unsigned int i = 0; i < pProgram->m_filenames.size(); i++) {
+		const string &filename = pProgram->m_filenames[i];
+		string extension = filename.substr(filename.size() - 4, 4);
+		GLenum type;
+		if (extension == "vert") type = GL_VERTEX_SHADER;
+		else if (extension == "frag") type = GL_FRAGMENT_SHADER;
+		else if (extension == "geom") type = GL_GEOMETRY_SHADER;
+		else if (extension == "tcnl") type = GL_TESS_CONTROL_SHADER;
+		else if (extension == "comp") type = GL_COMPUTE_SHADER;
+		else type = GL_TESS_EVALUATION_SHADER;
+
+		pProgram->m_types.push_back(type);
+		pProgram->m_sources.push_back(Specialise(ReadSource(filename), constants));
+		key = CMeshCache::HashData(&type, sizeof(type), key);
+		key = CMeshCache::HashData(pProgram->m_sources.back().c_str(), pProgram->m_sources.back().size(), key);
+	}
+	pProgram->m_key = key;
+
+	if (LoadBinary(pProgram)) {
+		pProgram->m_ready = true;
+		return pProgram;
+	}
+
+	LogMessage("Shader program %s is not cached, compiling", pProgram->m_name.c_str());
+	if (!m_started) {
+		Compile(pProgram);
+		pProgram->m_ready = true;
+		return pProgram;
+	}
+
+	// The program object belongs to both contexts.  glFinish makes sure it is fully linked before the main thread sees it.
+	m_numPending++;
+	m_compiler.Submit([this, pProgram] {
+		PROFILE_ZONE("Compile shader");
+		Compile(pProgram);
+		glFinish();
+		pProgram->m_ready = true;
+		m_numPending--;
+	});
+	return pProgram;
+}
+
+// Read a shader from resources/shaders, replacing each line #include "filename" with the contents of that file
+string CShaderCache::ReadSource(const string &filename, int depth)
+{
+	std::ifstream file(JoinPath("resources/shaders", filename).c_str());
+	if (!file) {
+		LogMessage("Could not open shader %s", filename.c_str());
+		return "";
+	}
+
+	string result;
+	string line;
+	while (std::getline(file, line)) {
+		string::size_type start = line.find_first_not_of(" \t");
+		if (start != string::npos && line.compare(start, 8, "#include") == 0 && depth < 8) {
+			string::size_type open = line.find('"', start);
+			string::size_type close = line.find('"', open + 1);
+			if (open != string::npos && close != string::npos) {
+				result += ReadSource(line.substr(open + 1, close - open - 1), depth + 1);
+				continue;
+			}
+		}
+		result += line + "\n";
+	}
+	return result;
+}
+
+string CShaderCache::Specialise(const string &source, const vector<ShaderConstant> &constants)
+{
+	if (constants.empty())
+		return source;
+
+	string result = source;
+	string defines;
+	for (unsigned int i = 0; i < constants.size(); i++) {
+		const char *pValue = constants[i].value ? "true" : "false";
+		std::regex declaration("uniform\\s+bool\\s+" + constants[i].name + "\\s*;");
+		result = std::regex_replace(result, declaration, "const bool " + constants[i].name + " = " + pValue + ";");
+		defines += "#define FEATURE_" + constants[i].name + (constants[i].value ? " 1\n" : " 0\n");
+	}
+
+	// Defines go after the #version line, which must come first
+	string::size_type versionIndex = result.find("#version");
+	string::size_type insertIndex = versionIndex == string::npos ? 0 : result.find('\n', versionIndex);
+	if (insertIndex == string::npos)
+		result += "\n" + defines;
+	else
+		result.insert(versionIndex == string::npos ? 0 : insertIndex + 1, defines);
+	return result;
+}
+
+bool CShaderCache::IsFinished()
+{
+	return m_numPending == 0;
+}
+
+void CShaderCache::WaitIdle()
+{
+	if (m_started)
+		m_compiler.WaitIdle();
+}
+
+string CShaderCache::GetCacheFilename(CCachedProgram *pProgram)
+{
+	string name = pProgram->m_name;
+	for (unsigned int i = 0; i < name.size(); i++) {
+		if (name[i] == '.' || name[i] == '+' || name[i] == ' ')
+			name[i] = '_';
+	}
+	return JoinPath("resources/cache", name + ".glprog");
+}
+
+bool CShaderCache::LoadBinary(CCachedProgram *pProgram)
+{
+	CMappedFile file;
+	if (!file.Open(GetCacheFilename(pProgram)) || file.GetSize() < sizeof(ShaderCacheHeader))
+		return false;
+
+	const ShaderCacheHeader *pHeader = (const ShaderCacheHeader*)file.GetData();
+	if (pHeader->magic != SHADER_CACHE_MAGIC || pHeader->version != SHADER_CACHE_VERSION || pHeader->key != pProgram->m_key ||
+		sizeof(ShaderCacheHeader) + pHeader->binarySize > file.GetSize())
+		return false;
+
+	// The driver may still reject a binary (for example after an update that kept the version string)
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, pHeader->binaryFormat, file.GetData() + sizeof(ShaderCacheHeader), pHeader->binarySize);
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		glDeleteProgram(program);
+		return false;
+	}
+
+	pProgram->m_program = program;
+	pProgram->m_valid = true;
+	return true;
+}
+
+// Compile and link from source, and save the binary on success
+void CShaderCache::Compile(CCachedProgram *pProgram)
+{
+	GLuint program = glCreateProgram();
+	vector<GLuint> shaders;
+	bool valid = true;
+
+	for (unsigned int i = 0; i < pProgram->m_sources.size(); i++) {
+		GLuint shader = glCreateShader(pProgram->m_types[i]);
+		const char *pSource = pProgram->m_sources[i].c_str();
+		glShaderSource(shader, 1, &pSource, NULL);
+		glCompileShader(shader);
+
+		GLint status = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+		if (status != GL_TRUE) {
+			char log[1024];
+			glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+			ReportError(pProgram->m_filenames[i].c_str(), log);
+			valid = false;
+		}
+		glAttachShader(program, shader);
+		shaders.push_back(shader);
+	}
+
+	if (valid) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(program);
+
+		GLint status = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status != GL_TRUE) {
+			char log[1024];
+			glGetProgramInfoLog(program, sizeof(log), NULL, log);
+			ReportError(pProgram->m_name.c_str(), log);
+			valid = false;
+		}
+	}
+
+	for (unsigned int i = 0; i < shaders.size(); i++) {
+		glDetachShader(program, shaders[i]);
+		glDeleteShader(shaders[i]);
+	}
+
+	pProgram->m_program = program;
+	pProgram->m_valid = valid;
+	if (valid)
+		SaveBinary(pProgram);
+}
+
+void CShaderCache::SaveBinary(CCachedProgram *pProgram)
+{
+	GLint length = 0;
+	glGetProgramiv(pProgram->m_program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	vector<BYTE> binary(length);
+	GLenum binaryFormat = 0;
+	glGetProgramBinary(pProgram->m_program, length, NULL, &binaryFormat, &binary[0]);
+
+	ShaderCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = SHADER_CACHE_MAGIC;
+	header.version = SHADER_CACHE_VERSION;
+	header.key = pProgram->m_key;
+	header.binaryFormat = binaryFormat;
+	header.binarySize = (unsigned int)length;
+
+	MakeDirectory("resources/cache");
+	// Written aside and renamed into place, so that a crash never leaves a truncated binary behind
+	string filename = GetCacheFilename(pProgram);
+	string temporaryFilename = filename + ".tmp";
+	FILE *pFile = fopen(temporaryFilename.c_str(), "wb");
+	if (pFile == NULL)
+		return;
+	fwrite(&header, sizeof(header), 1, pFile);
+	fwrite(&binary[0], 1, length, pFile);
+	bool result = ferror(pFile) == 0;
+	result = fclose(pFile) == 0 && result;
+	if (!result || !ReplaceFile(temporaryFilename, filename))
+		remove(temporaryFilename.c_str());
+}
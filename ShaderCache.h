@@ -0,0 +1,103 @@
+#pragma once
+#include "Common.h"
+#include "JobSystem.h"
+#include <atomic>
+
+class CPlatform;
+
+// A uniform bool of a shader fixed at compile time, for one permutation of a program (see CShaderPermutations)
+struct ShaderConstant
+{
+	string name;
+	bool value;
+};
+
+// A linked GLSL program with the same interface as CShaderProgram.  Programs come from CShaderCache, either loaded from a
+// cached binary or compiled in the background, and cannot be used until IsReady returns true.
+class CCachedProgram
+{
+public:
+	CCachedProgram();
+	~CCachedProgram();
+
+	bool IsReady();
+	bool IsValid();
+	void UseProgram();
+	UINT GetProgramID();
+	// Whether the linked program declares a shader storage block, e.g. one from an #include the shader may not have
+	bool HasStorageBlock(const char *name);
+	bool HasUniform(const char *name);
+	// The type of the active vertex attribute at a location, such as GL_FLOAT_VEC3, or 0 if there is none
+	GLenum GetAttributeType(GLint location);
+
+	void SetUniform(const char *name, float *pValues, int count = 1);
+	void SetUniform(const char *name, const float value);
+	void SetUniform(const char *name, glm::vec2 *pVectors, int count = 1);
+	void SetUniform(const char *name, const glm::vec2 vector);
+	void SetUniform(const char *name, glm::vec3 *pVectors, int count = 1);
+	void SetUniform(const char *name, const glm::vec3 vector);
+	void SetUniform(const char *name, glm::vec4 *pVectors, int count = 1);
+	void SetUniform(const char *name, const glm::vec4 vector);
+	void SetUniform(const char *name, glm::mat3 *pMatrices, int count = 1);
+	void SetUniform(const char *name, const glm::mat3 matrix);
+	void SetUniform(const char *name, glm::mat4 *pMatrices, int count = 1);
+	void SetUniform(const char *name, const glm::mat4 matrix);
+	void SetUniform(const char *name, int *pValues, int count = 1);
+	void SetUniform(const char *name, const int value);
+
+private:
+	friend class CShaderCache;
+
+	GLuint m_program;
+	std::atomic<bool> m_ready;
+	bool m_valid;						// False if the program failed to compile or link
+	string m_name;
+	vector<string> m_filenames;
+	vector<GLenum> m_types;
+	vector<string> m_sources;
+	unsigned long long m_key;
+};
+
+// Builds shader programs, keeping a binary of each linked program (glGetProgramBinary) in resources\cache.  The binary is
+// keyed by a hash of the sources and the driver's vendor, renderer and version strings, so a driver update or a shader
+// edit recompiles it.  On a miss, the program is compiled on a background thread with its own GL context, shared with the
+// main one, so that the main thread carries on rendering (or showing a loading screen) in the meantime.
+class CShaderCache
+{
+public:
+	CShaderCache();
+	~CShaderCache();
+
+	// Create the shared context for background compiles.  Call on the main thread with its context current.  Without
+	// it, misses are compiled on the main thread.
+	bool Start(CPlatform *pPlatform);
+	void Release();
+
+	// Shader files are read from resources\shaders; the stage is taken from the extension as in Game::Initialise.  Lines
+	// #include "filename" are replaced with that file, and are part of the cache key.  Each
+	// constant replaces the declaration "uniform bool name;" with a constant, so that the compiler removes the branches
+	// on it, and is also defined as FEATURE_name (0 or 1) for use with #if.
+	CCachedProgram *CreateProgram(const string &vertexFilename, const string &fragmentFilename,
+		const vector<ShaderConstant> &constants = vector<ShaderConstant>());
+	CCachedProgram *CreateComputeProgram(const string &computeFilename,
+		const vector<ShaderConstant> &constants = vector<ShaderConstant>());
+
+	bool IsFinished();
+	void WaitIdle();
+
+private:
+	CCachedProgram *Build(CCachedProgram *pProgram, const vector<ShaderConstant> &constants);
+	static string ReadSource(const string &filename, int depth = 0);
+	static string Specialise(const string &source, const vector<ShaderConstant> &constants);
+	bool LoadBinary(CCachedProgram *pProgram);
+	void Compile(CCachedProgram *pProgram);
+	void SaveBinary(CCachedProgram *pProgram);
+	string GetCacheFilename(CCachedProgram *pProgram);
+
+	CJobSystem m_compiler;				// A single thread, with the shared context current
+	CPlatform *m_pPlatform;
+	void *m_context;
+	bool m_started;
+	std::atomic<int> m_numPending;
+	string m_driver;
+};
@@ -0,0 +1,254 @@
+#include "ShaderPermutations.h"
+#include "Log.h"
+
+CShaderPermutations::CShaderPermutations()
+{
+	m_pCache = NULL;
+	m_layoutFeatures = 0;
+	m_version = 0;
+	m_features = 0;
+	m_pCurrent = NULL;
+}
+
+CShaderPermutations::~CShaderPermutations()
+{
+	Release();
+}
+
+void CShaderPermutations::Create(CShaderCache *pCache, const string &vertexFilename, const string &fragmentFilename,
+	const vector<string> &featureNames, unsigned int layoutFeatures)
+{
+	Release();
+	m_pCache = pCache;
+	m_vertexFilename = vertexFilename;
+	m_fragmentFilename = fragmentFilename;
+	m_featureNames = featureNames;
+	m_layoutFeatures = layoutFeatures;
+}
+
+// Start building a permutation now (from the binary cache, or on the shader cache's compile thread)
+void CShaderPermutations::Precompile(unsigned int features)
+{
+	GetPermutation(features);
+}
+
+void CShaderPermutations::Release()
+{
+	for (std::map<unsigned int, Permutation>::iterator it = m_permutations.begin(); it != m_permutations.end(); ++it)
+		delete it->second.pProgram;
+	m_permutations.clear();
+	m_uniforms.clear();
+	m_version = 0;
+	m_pCurrent = NULL;
+}
+
+CShaderPermutations::Permutation &CShaderPermutations::GetPermutation(unsigned int features)
+{
+	std::map<unsigned int, Permutation>::iterator it = m_permutations.find(features);
+	if (it != m_permutations.end())
+		return it->second;
+
+	vector<ShaderConstant> constants(m_featureNames.size());
+	for (unsigned int i = 0; i < m_featureNames.size(); i++) {
+		constants[i].name = m_featureNames[i];
+		constants[i].value = (features & (1u << i)) != 0;
+	}
+
+	Permutation &permutation = m_permutations[features];
+	permutation.pProgram = m_pCache->CreateProgram(m_vertexFilename, m_fragmentFilename, constants);
+	permutation.version = 0;
+	permutation.reported = false;
+	return permutation;
+}
+
+// The valid permutation with the fewest features different from the set, preferring one with fewer features on a tie.
+// One that differs in a layout feature would read the draw's vertices or matrices wrongly, so it is never chosen.
+CShaderPermutations::Permutation *CShaderPermutations::FindNearestReady(unsigned int features, unsigned int &nearestFeatures)
+{
+	Permutation *pNearest = NULL;
+	int nearestDifference = 0, nearestCount = 0;
+	for (std::map<unsigned int, Permutation>::iterator it = m_permutations.begin(); it != m_permutations.end(); ++it) {
+		if (!it->second.pProgram->IsValid() || ((it->first ^ features) & m_layoutFeatures) != 0)
+			continue;
+		int difference = 0, count = 0;
+		for (unsigned int bits = it->first ^ features; bits; bits &= bits - 1)
+			difference++;
+		for (unsigned int bits = it->first; bits; bits &= bits - 1)
+			count++;
+		if (pNearest == NULL || difference < nearestDifference || (difference == nearestDifference && count < nearestCount)) {
+			pNearest = &it->second;
+			nearestFeatures = it->first;
+			nearestDifference = difference;
+			nearestCount = count;
+		}
+	}
+	return pNearest;
+}
+
+bool CShaderPermutations::UseProgram(unsigned int features)
+{
+	// Waiting for a permutation that was not precompiled would stall the frame on the compile thread, so draw with the
+	// nearest one until it is ready.  One that failed to build is never ready, and binding it would silently leave the
+	// previous program bound.
+	Permutation *pPermutation = &GetPermutation(features);
+	bool found = pPermutation->pProgram->IsValid();
+	if (!found) {
+		unsigned int nearestFeatures = 0;
+		Permutation *pNearest = FindNearestReady(features, nearestFeatures);
+		if (!pPermutation->reported) {
+			const char *pState = pPermutation->pProgram->IsReady() ? "failed to build" : "is not ready";
+			if (pNearest)
+				LogMessage("Shader permutation 0x%x of %s %s; using 0x%x in its place", features,
+					m_fragmentFilename.c_str(), pState, nearestFeatures);
+			else
+				LogMessage("Shader permutation 0x%x of %s %s; skipping its draws", features,
+					m_fragmentFilename.c_str(), pState);
+			pPermutation->reported = true;
+		}
+		pPermutation = pNearest;
+	}
+
+	m_features = features;
+	m_pCurrent = pPermutation;
+	if (pPermutation == NULL) {
+		glUseProgram(0);
+		return false;
+	}
+	pPermutation->pProgram->UseProgram();
+	if (pPermutation->version != m_version) {
+		for (std::map<string, UniformValue, std::less<> >::iterator it = m_uniforms.begin(); it != m_uniforms.end(); ++it) {
+			if (it->second.version > pPermutation->version)
+				Apply(pPermutation->pProgram, it->first.c_str(), it->second);
+		}
+		pPermutation->version = m_version;
+	}
+	return found;
+}
+
+unsigned int CShaderPermutations::GetFeatures()
+{
+	return m_features;
+}
+
+bool CShaderPermutations::HasStorageBlock(unsigned int features, const char *name)
+{
+	return GetPermutation(features).pProgram->HasStorageBlock(name);
+}
+
+bool CShaderPermutations::HasUniform(unsigned int features, const char *name)
+{
+	return GetPermutation(features).pProgram->HasUniform(name);
+}
+
+GLenum CShaderPermutations::GetAttributeType(unsigned int features, GLint location)
+{
+	return GetPermutation(features).pProgram->GetAttributeType(location);
+}
+
+// Remember a uniform value, and send it to the bound permutation if it changed.  Other permutations get it when they are
+// next bound.
+void CShaderPermutations::Store(const char *name, UniformType type, const void *pData, int count, size_t size)
+{
+	std::map<string, UniformValue, std::less<> >::iterator it = m_uniforms.find(name);
+	if (it == m_uniforms.end())
+		it = m_uniforms.insert(std::make_pair(string(name), UniformValue())).first;
+	UniformValue &value = it->second;
+	if (value.type == type && value.count == count && value.data.size() == size && memcmp(&value.data[0], pData, size) == 0)
+		return;
+
+	value.type = type;
+	value.count = count;
+	value.data.assign((const BYTE*)pData, (const BYTE*)pData + size);
+	value.version = ++m_version;
+
+	if (m_pCurrent) {
+		bool upToDate = m_pCurrent->version == m_version - 1;
+		Apply(m_pCurrent->pProgram, name, value);
+		if (upToDate)
+			m_pCurrent->version = m_version;
+	}
+}
+
+void CShaderPermutations::Apply(CCachedProgram *pProgram, const char *name, UniformValue &value)
+{
+	void *pData = &value.data[0];
+	switch (value.type) {
+	case UNIFORM_FLOAT: pProgram->SetUniform(name, (float*)pData, value.count); break;
+	case UNIFORM_VEC2: pProgram->SetUniform(name, (glm::vec2*)pData, value.count); break;
+	case UNIFORM_VEC3: pProgram->SetUniform(name, (glm::vec3*)pData, value.count); break;
+	case UNIFORM_VEC4: pProgram->SetUniform(name, (glm::vec4*)pData, value.count); break;
+	case UNIFORM_MAT3: pProgram->SetUniform(name, (glm::mat3*)pData, value.count); break;
+	case UNIFORM_MAT4: pProgram->SetUniform(name, (glm::mat4*)pData, value.count); break;
+	case UNIFORM_INT: pProgram->SetUniform(name, (int*)pData, value.count); break;
+	}
+}
+
+void CShaderPermutations::SetUniform(const char *name, float *pValues, int count)
+{
+	Store(name, UNIFORM_FLOAT, pValues, count, count * sizeof(float));
+}
+
+void CShaderPermutations::SetUniform(const char *name, const float value)
+{
+	Store(name, UNIFORM_FLOAT, &value, 1, sizeof(float));
+}
+
+void CShaderPermutations::SetUniform(const char *name, glm::vec2 *pVectors, int count)
+{
+	Store(name, UNIFORM_VEC2, pVectors, count, count * sizeof(glm::vec2));
+}
+
+void CShaderPermutations::SetUniform(const char *name, const glm::vec2 vector)
+{
+	Store(name, UNIFORM_VEC2, &vector, 1, sizeof(glm::vec2));
+}
+
+void CShaderPermutations::SetUniform(const char *name, glm::vec3 *pVectors, int count)
+{
+	Store(name, UNIFORM_VEC3, pVectors, count, count * sizeof(glm::vec3));
+}
+
+void CShaderPermutations::SetUniform(const char *name, const glm::vec3 vector)
+{
+	Store(name, UNIFORM_VEC3, &vector, 1, sizeof(glm::vec3));
+}
+
+void CShaderPermutations::SetUniform(const char *name, glm::vec4 *pVectors, int count)
+{
+	Store(name, UNIFORM_VEC4, pVectors, count, count * sizeof(glm::vec4));
+}
+
+void CShaderPermutations::SetUniform(const char *name, const glm::vec4 vector)
+{
+	Store(name, UNIFORM_VEC4, &vector, 1, sizeof(glm::vec4));
+}
+
+void CShaderPermutations::SetUniform(const char *name, glm::mat3 *pMatrices, int count)
+{
+	Store(name, UNIFORM_MAT3, pMatrices, count, count * sizeof(glm::mat3));
+}
+
+void CShaderPermutations::SetUniform(const char *name, const glm::mat3 matrix)
+{
+	Store(name, UNIFORM_MAT3, &matrix, 1, sizeof(glm::mat3));
+}
+
+void CShaderPermutations::SetUniform(const char *name, glm::mat4 *pMatrices, int count)
+{
+	Store(name, UNIFORM_MAT4, pMatrices, count, count * sizeof(glm::mat4));
+}
+
+void CShaderPermutations::SetUniform(const char *name, const glm::mat4 matrix)
+{
+	Store(name, UNIFORM_MAT4, &matrix, 1, sizeof(glm::mat4));
+}
+
+void CShaderPermutations::SetUniform(const char *name, int *pValues, int count)
+{
+	Store(name, UNIFORM_INT, pValues, count, count * sizeof(int));
+}
+
+void CShaderPermutations::SetUniform(const char *name, const int value)
+{
+	Store(name, UNIFORM_INT, &value, 1, sizeof(int));
+}
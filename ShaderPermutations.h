@@ -0,0 +1,94 @@
+#pragma once
+#include "Common.h"
+#include "ShaderCache.h"
+#include <map>
+
+// Feature bits of mainShader, one per uniform bool it used to branch on, in the order given to Create in Game::Initialise
+enum MainShaderFeature
+{
+	MAIN_SHADER_TEXTURE = 1 << 0,		// bUseTexture
+	MAIN_SHADER_SKYBOX = 1 << 1,		// renderSkybox
+	MAIN_SHADER_WALL_SHIFT = 1 << 2,	// wallShift
+	MAIN_SHADER_INDIRECT = 1 << 3,		// indirectDraw: matrices per draw from geometryPool.glsl (FEATURE_indirectDraw only)
+	MAIN_SHADER_PACKED_NORMAL = 1 << 4,	// packedNormal: octahedral normals, decoded with vertexFormat.glsl (FEATURE_packedNormal only)
+	MAIN_SHADER_REFLECT = 1 << 5,		// reflective: nearest probe's cube map, from reflectionProbe.glsl (FEATURE_reflective only)
+};
+
+// The permutations of one program, each compiled with its feature bools fixed (see CShaderCache::CreateProgram).  It has
+// the interface of a single program: uniforms are remembered here, and UseProgram(features) binds the permutation and
+// sends it only the uniforms that changed since it was last bound.
+class CShaderPermutations
+{
+public:
+	CShaderPermutations();
+	~CShaderPermutations();
+
+	// Bit i of a feature set controls the uniform bool featureNames[i].  layoutFeatures are those that change what the
+	// draw must supply, such as the vertex layout or where the matrices come from, so a stand-in must match on them.
+	void Create(CShaderCache *pCache, const string &vertexFilename, const string &fragmentFilename,
+		const vector<string> &featureNames, unsigned int layoutFeatures = 0);
+	void Precompile(unsigned int features);
+	void Release();
+
+	// Bind the permutation for a feature set.  One that was not precompiled starts compiling in the background; until
+	// it is ready, or if it failed to build, the nearest valid permutation with the same layout features (the fewest
+	// other features different) is bound in its place, or no program if there is none, so the draws are skipped.
+	// Returns false if the permutation asked for was not bound.
+	bool UseProgram(unsigned int features);
+	unsigned int GetFeatures();
+	// Whether a permutation declares a shader storage block, or uses a uniform, and the type of the vertex attribute it
+	// reads at a location.  False, or 0, until the permutation is ready.
+	bool HasStorageBlock(unsigned int features, const char *name);
+	bool HasUniform(unsigned int features, const char *name);
+	GLenum GetAttributeType(unsigned int features, GLint location);
+
+	void SetUniform(const char *name, float *pValues, int count = 1);
+	void SetUniform(const char *name, const float value);
+	void SetUniform(const char *name, glm::vec2 *pVectors, int count = 1);
+	void SetUniform(const char *name, const glm::vec2 vector);
+	void SetUniform(const char *name, glm::vec3 *pVectors, int count = 1);
+	void SetUniform(const char *name, const glm::vec3 vector);
+	void SetUniform(const char *name, glm::vec4 *pVectors, int count = 1);
+	void SetUniform(const char *name, const glm::vec4 vector);
+	void SetUniform(const char *name, glm::mat3 *pMatrices, int count = 1);
+	void SetUniform(const char *name, const glm::mat3 matrix);
+	void SetUniform(const char *name, glm::mat4 *pMatrices, int count = 1);
+	void SetUniform(const char *name, const glm::mat4 matrix);
+	void SetUniform(const char *name, int *pValues, int count = 1);
+	void SetUniform(const char *name, const int value);
+
+private:
+	enum UniformType { UNIFORM_FLOAT, UNIFORM_VEC2, UNIFORM_VEC3, UNIFORM_VEC4, UNIFORM_MAT3, UNIFORM_MAT4, UNIFORM_INT };
+
+	struct UniformValue
+	{
+		UniformType type;
+		int count;
+		vector<BYTE> data;
+		unsigned int version;
+	};
+
+	struct Permutation
+	{
+		CCachedProgram *pProgram;
+		unsigned int version;			// Uniforms changed after this version have not been sent to the program
+		bool reported;					// It has been logged as not ready or failed
+	};
+
+	Permutation &GetPermutation(unsigned int features);
+	Permutation *FindNearestReady(unsigned int features, unsigned int &nearestFeatures);
+	void Store(const char *name, UniformType type, const void *pData, int count, size_t size);
+	void Apply(CCachedProgram *pProgram, const char *name, UniformValue &value);
+
+	CShaderCache *m_pCache;
+	string m_vertexFilename;
+	string m_fragmentFilename;
+	vector<string> m_featureNames;
+	unsigned int m_layoutFeatures;
+
+	std::map<unsigned int, Permutation> m_permutations;
+	std::map<string, UniformValue, std::less<> > m_uniforms;	// Found by const char *, so setting one allocates nothing
+	unsigned int m_version;
+	unsigned int m_features;
+	Permutation *m_pCurrent;
+};
@@ -0,0 +1,529 @@
+#include "Terrain.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "Profiler.h"
+#include "ResourceManager.h"
+#include "FileSystem.h"
+#include <algorithm>
+#include <float.h>
+#include <stdio.h>
+
+// Bump when the height file layout or the height source changes
+static const unsigned int TERRAIN_FILE_MAGIC = 0x48524554; // "TERH"
+static const unsigned int TERRAIN_FILE_VERSION = 1;
+
+static const int MAX_TERRAIN_LOADS = 8;				// Tiles loading at once
+static const float TERRAIN_TEXTURE_SIZE = 40.0f;		// World units per repeat of the texture, as on the old plane
+static const float TRACK_CLEARANCE = 1.0f;			// The track sits this far above the ground
+
+struct TerrainFileHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long key;
+	int level;
+	int x;
+	int y;
+	unsigned int resolution;				// Heights a side, including a border of one for the normals
+	float minHeight;
+	float maxHeight;
+};
+
+// Grid vertices around the edge of a tile, in order, each edge including both of its corners
+static void GetPerimeter(vector<unsigned int> &perimeter)
+{
+	const int n = TERRAIN_TILE_QUADS + 1;
+	for (int i = 0; i < n; i++) perimeter.push_back(i);
+	for (int j = 0; j < n; j++) perimeter.push_back(j * n + n - 1);
+	for (int i = n - 1; i >= 0; i--) perimeter.push_back((n - 1) * n + i);
+	for (int j = n - 1; j >= 0; j--) perimeter.push_back(j * n);
+}
+
+static float HashLattice(int x, int y)
+{
+	unsigned int h = (unsigned int)x * 374761393u + (unsigned int)y * 668265263u;
+	h = (h ^ (h >> 13)) * 1274126177u;
+	return (float)((h ^ (h >> 16)) & 0xffffff) / (float)0x1000000;
+}
+
+// Smoothly interpolated random values at integer points, in [0, 1)
+static float ValueNoise(float x, float y)
+{
+	float fx = floor(x);
+	float fy = floor(y);
+	int ix = (int)fx;
+	int iy = (int)fy;
+	float tx = x - fx;
+	float ty = y - fy;
+	tx = tx * tx * (3.0f - 2.0f * tx);
+	ty = ty * ty * (3.0f - 2.0f * ty);
+
+	float a = HashLattice(ix, iy);
+	float b = HashLattice(ix + 1, iy);
+	float c = HashLattice(ix, iy + 1);
+	float d = HashLattice(ix + 1, iy + 1);
+	return (a + (b - a) * tx) + ((c + (d - c) * tx) - (a + (b - a) * tx)) * ty;
+}
+
+CTerrain::CTerrain()
+{
+	m_pLoader = NULL;
+	m_pPool = NULL;
+	m_pTexture = NULL;
+	m_worldSize = 0.0f;
+	m_numLevels = 0;
+	m_maxTiles = 0;
+	m_lodDistance = 2.0f;
+	m_hillHeight = 400.0f;
+	m_flatRadius = 350.0f;
+	m_blendDistance = 600.0f;
+	m_sourceKey = 0;
+	m_frame = 0;
+	m_numPaged = 0;
+	m_created = false;
+}
+
+CTerrain::~CTerrain()
+{
+	Release();
+}
+
+void CTerrain::Create(CJobSystem *pJobSystem, CGeometryPool *pPool, const string &textureFilename,
+	const vector<glm::vec3> &trackPoints, float worldSize, int numLevels, size_t memoryBudget)
+{
+	Release();
+	m_pLoader = new CAssetLoader(pJobSystem);
+	m_pPool = pPool;
+	m_worldSize = worldSize;
+	m_numLevels = numLevels;
+	m_trackPoints = trackPoints;
+
+	m_pTexture = CResourceManager::AcquireTexture(textureFilename);
+
+	// The budget covers the tiles' vertices; the indices are shared
+	const int n = TERRAIN_TILE_QUADS + 1;
+	size_t tileSize = (n * n + 4 * n) * sizeof(MeshVertex);
+	m_maxTiles = (unsigned int)std::max(memoryBudget / tileSize, (size_t)(1 + 4 * MAX_TERRAIN_LOADS));
+
+	// Height files baked from a different source are baked again
+	float settings[6] = { worldSize, (float)numLevels, (float)TERRAIN_TILE_QUADS, m_hillHeight, m_flatRadius, m_blendDistance };
+	m_sourceKey = CMeshCache::HashData(settings, sizeof(settings));
+	if (!trackPoints.empty())
+		m_sourceKey = CMeshCache::HashData(&trackPoints[0], trackPoints.size() * sizeof(glm::vec3), m_sourceKey);
+
+	// Two triangles per quad, then two per quad of the skirt hanging from each edge
+	vector<unsigned int> indices;
+	for (int j = 0; j < n - 1; j++) {
+		for (int i = 0; i < n - 1; i++) {
+			unsigned int a = j * n + i;
+			unsigned int c = a + n;
+			indices.push_back(a); indices.push_back(c); indices.push_back(a + 1);
+			indices.push_back(a + 1); indices.push_back(c); indices.push_back(c + 1);
+		}
+	}
+	vector<unsigned int> perimeter;
+	GetPerimeter(perimeter);
+	unsigned int skirtStart = n * n;
+	for (unsigned int k = 0; k + 1 < perimeter.size(); k++) {
+		if (k % n == n - 1)
+			continue;							// The corner ends one edge; the next starts again from it
+		indices.push_back(perimeter[k]); indices.push_back(skirtStart + k); indices.push_back(perimeter[k + 1]);
+		indices.push_back(perimeter[k + 1]); indices.push_back(skirtStart + k); indices.push_back(skirtStart + k + 1);
+	}
+	m_indexRange = m_pPool->Allocate(NULL, 0, &indices[0], (unsigned int)indices.size());
+
+	MakeDirectory("resources/terrain");
+	m_created = true;
+
+	// Nothing is drawn until the root tile is in
+	RequestTile(0, 0, 0, 0.0f);
+	IssueRequests();
+}
+
+// The job system must have stopped if tiles may still be loading
+void CTerrain::Release()
+{
+	if (!m_created)
+		return;
+
+	for (std::map<unsigned long long, Tile>::iterator it = m_tiles.begin(); it != m_tiles.end(); ++it)
+		m_pPool->Free(it->second.range);
+	m_pPool->Free(m_indexRange);
+	m_tiles.clear();
+	m_pending.clear();
+	m_requests.clear();
+	m_drawn.clear();
+	CResourceManager::ReleaseTexture(m_pTexture);
+	m_pTexture = NULL;
+	delete m_pLoader;
+	m_pLoader = NULL;
+	m_created = false;
+}
+
+unsigned long long CTerrain::GetKey(int level, int x, int y)
+{
+	return ((unsigned long long)level << 48) | ((unsigned long long)x << 24) | (unsigned long long)y;
+}
+
+float CTerrain::GetTileSize(int level) const
+{
+	return m_worldSize / (float)(1 << level);
+}
+
+// Tile x runs along the world x axis and tile y along z
+glm::vec2 CTerrain::GetTileOrigin(int level, int x, int y) const
+{
+	float size = GetTileSize(level);
+	return glm::vec2(-0.5f * m_worldSize + x * size, -0.5f * m_worldSize + y * size);
+}
+
+void CTerrain::Update(const GeometryView *pViews, int numViews)
+{
+	PROFILE_ZONE("Terrain update");
+	if (!m_created)
+		return;
+
+	m_frame++;
+	m_numPaged = 0;
+	m_pLoader->ProcessUploads(1.0);
+
+	// Each view's camera position and frustum planes
+	numViews = std::min(numViews, GEOMETRY_MAX_VIEWS);
+	glm::vec3 cameraPositions[GEOMETRY_MAX_VIEWS];
+	glm::vec4 planes[GEOMETRY_MAX_VIEWS][6];
+	for (int v = 0; v < numViews; v++) {
+		cameraPositions[v] = glm::vec3(glm::inverse(pViews[v].viewMatrix)[3]);
+		ExtractFrustumPlanes(pViews[v], planes[v]);
+	}
+
+	m_drawn.clear();
+	m_requests.clear();
+	if (numViews <= 0)
+		return;
+	std::map<unsigned long long, Tile>::iterator root = m_tiles.find(GetKey(0, 0, 0));
+	if (root != m_tiles.end())
+		SelectTile(root->second, cameraPositions, planes, numViews);
+	else
+		RequestTile(0, 0, 0, 0.0f);
+	IssueRequests();
+}
+
+// A tile is drawn if any view sees it, and split for the nearest camera of those that do
+void CTerrain::SelectTile(Tile &tile, const glm::vec3 *pCameraPositions, const glm::vec4 (*pPlanes)[6], int numViews)
+{
+	tile.lastUsed = m_frame;
+
+	float size = GetTileSize(tile.level);
+	glm::vec2 origin = GetTileOrigin(tile.level, tile.x, tile.y);
+	glm::vec3 minimum(origin.x, tile.minHeight, origin.y);
+	glm::vec3 maximum(origin.x + size, tile.maxHeight, origin.y + size);
+	bool visible = false;
+	float distance = FLT_MAX;
+	for (int v = 0; v < numViews; v++) {
+		if (!IsBoxVisible(pPlanes[v], minimum, maximum))
+			continue;
+		const glm::vec3 &cameraPosition = pCameraPositions[v];
+		glm::vec3 closest(std::min(std::max(cameraPosition.x, minimum.x), maximum.x),
+			std::min(std::max(cameraPosition.y, minimum.y), maximum.y), std::min(std::max(cameraPosition.z, minimum.z), maximum.z));
+		distance = std::min(distance, glm::length(cameraPosition - closest));
+		visible = true;
+	}
+	if (!visible)
+		return;
+
+	// Split the tile only when all four children can be drawn in its place.  The children already in are kept in use,
+	// so that they are not paged out while the others load.
+	if (tile.level + 1 < m_numLevels && distance < m_lodDistance * size) {
+		Tile *pChildren[4];
+		bool resident = true;
+		for (int i = 0; i < 4; i++) {
+			int x = 2 * tile.x + (i & 1);
+			int y = 2 * tile.y + (i >> 1);
+			std::map<unsigned long long, Tile>::iterator it = m_tiles.find(GetKey(tile.level + 1, x, y));
+			if (it == m_tiles.end()) {
+				RequestTile(tile.level + 1, x, y, distance);
+				resident = false;
+			}
+			else {
+				pChildren[i] = &it->second;
+				pChildren[i]->lastUsed = m_frame;
+			}
+		}
+		if (resident) {
+			for (int i = 0; i < 4; i++)
+				SelectTile(*pChildren[i], pCameraPositions, pPlanes, numViews);
+			return;
+		}
+	}
+
+	m_drawn.push_back(&tile);
+}
+
+void CTerrain::RequestTile(int level, int x, int y, float distance)
+{
+	unsigned long long key = GetKey(level, x, y);
+	if (m_pending.find(key) == m_pending.end())
+		m_requests.push_back(std::make_pair(distance, key));
+}
+
+// Start loading the nearest requested tiles, making room for them within the budget
+void CTerrain::IssueRequests()
+{
+	std::sort(m_requests.begin(), m_requests.end());
+	for (unsigned int i = 0; i < m_requests.size() && m_pending.size() < MAX_TERRAIN_LOADS; i++) {
+		while (m_tiles.size() + m_pending.size() >= m_maxTiles) {
+			if (!EvictTile())
+				return;
+		}
+
+		unsigned long long key = m_requests[i].second;
+		m_pending.insert(key);
+		m_numPaged++;
+		std::shared_ptr<PendingTile> pPending(new PendingTile);
+		pPending->level = (int)(key >> 48);
+		pPending->x = (int)((key >> 24) & 0xffffff);
+		pPending->y = (int)(key & 0xffffff);
+		m_pLoader->Queue(
+			[this, pPending] { LoadTile(*pPending); },
+			[this, pPending] { UploadTile(*pPending); });
+	}
+}
+
+// Page out the least recently used tile that is not in use this frame.  The root is never paged out.
+bool CTerrain::EvictTile()
+{
+	std::map<unsigned long long, Tile>::iterator oldest = m_tiles.end();
+	for (std::map<unsigned long long, Tile>::iterator it = m_tiles.begin(); it != m_tiles.end(); ++it) {
+		if (it->second.level == 0 || it->second.lastUsed == m_frame)
+			continue;
+		if (oldest == m_tiles.end() || it->second.lastUsed < oldest->second.lastUsed)
+			oldest = it;
+	}
+	if (oldest == m_tiles.end())
+		return false;
+
+	m_pPool->Free(oldest->second.range);
+	m_tiles.erase(oldest);
+	return true;
+}
+
+// Read the tile's heights, or bake and save them if they are missing or out of date.  This does not use OpenGL, so it
+// runs on a worker thread.
+void CTerrain::LoadTile(PendingTile &pending)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "tile_%d_%d_%d.height", pending.level, pending.x, pending.y);
+	string filename = JoinPath("resources/terrain", name);
+
+	vector<float> heights;
+	if (!ReadHeights(filename, pending.level, pending.x, pending.y, heights)) {
+		BakeHeights(pending.level, pending.x, pending.y, heights);
+		WriteHeights(filename, pending.level, pending.x, pending.y, heights);
+	}
+	BuildVertices(pending.level, pending.x, pending.y, heights, pending);
+}
+
+void CTerrain::UploadTile(PendingTile &pending)
+{
+	unsigned long long key = GetKey(pending.level, pending.x, pending.y);
+	m_pending.erase(key);
+	if (!m_created || m_tiles.find(key) != m_tiles.end())
+		return;
+
+	Tile tile;
+	tile.level = pending.level;
+	tile.x = pending.x;
+	tile.y = pending.y;
+	tile.minHeight = pending.minHeight;
+	tile.maxHeight = pending.maxHeight;
+	tile.range = m_pPool->Allocate(&pending.vertices[0], (unsigned int)pending.vertices.size(), NULL, 0);
+	tile.lastUsed = m_frame;
+	m_tiles[key] = tile;
+	m_numPaged++;
+
+	vector<MeshVertex>().swap(pending.vertices);
+}
+
+void CTerrain::Render()
+{
+	PROFILE_ZONE("Terrain");
+	// Tiles are in world coordinates, and draw with the shared indices from their own vertices.  The sphere around each
+	// tile's box lets the pool drop it from the views that do not see it.
+	for (unsigned int i = 0; i < m_drawn.size(); i++) {
+		const Tile &tile = *m_drawn[i];
+		GeometryRange range = tile.range;
+		range.firstIndex = m_indexRange.firstIndex;
+		range.numIndices = m_indexRange.numIndices;
+		float size = GetTileSize(tile.level);
+		glm::vec2 origin = GetTileOrigin(tile.level, tile.x, tile.y);
+		glm::vec3 minimum(origin.x, tile.minHeight, origin.y);
+		glm::vec3 maximum(origin.x + size, tile.maxHeight, origin.y + size);
+		glm::vec4 sphere(0.5f * (minimum + maximum), 0.5f * glm::length(maximum - minimum));
+		m_pPool->AddDraw(range, 0, range.numIndices, m_pTexture, glm::mat4(1.0f), sphere);
+	}
+}
+
+bool CTerrain::ReadHeights(const string &filename, int level, int x, int y, vector<float> &heights) const
+{
+	CMappedFile file;
+	if (!file.Open(filename))
+		return false;
+
+	const unsigned int n = TERRAIN_TILE_QUADS + 3;
+	if (file.GetSize() < sizeof(TerrainFileHeader) + n * n * sizeof(unsigned short))
+		return false;
+	const TerrainFileHeader *pHeader = (const TerrainFileHeader*)file.GetData();
+	if (pHeader->magic != TERRAIN_FILE_MAGIC || pHeader->version != TERRAIN_FILE_VERSION || pHeader->key != m_sourceKey ||
+		pHeader->level != level || pHeader->x != x || pHeader->y != y || pHeader->resolution != n)
+		return false;
+
+	const unsigned short *pHeights = (const unsigned short*)(file.GetData() + sizeof(TerrainFileHeader));
+	float scale = (pHeader->maxHeight - pHeader->minHeight) / 65535.0f;
+	heights.resize(n * n);
+	for (unsigned int i = 0; i < n * n; i++)
+		heights[i] = pHeader->minHeight + pHeights[i] * scale;
+	return true;
+}
+
+// Heights are stored as 16 bits across the tile's range
+// Written aside and renamed into place, so that an interrupted run never leaves a truncated tile for the next to load
+void CTerrain::WriteHeights(const string &filename, int level, int x, int y, const vector<float> &heights) const
+{
+	string temporaryFilename = filename + ".tmp";
+	FILE *pFile = fopen(temporaryFilename.c_str(), "wb");
+	if (pFile == NULL)
+		return;
+
+	TerrainFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = TERRAIN_FILE_MAGIC;
+	header.version = TERRAIN_FILE_VERSION;
+	header.key = m_sourceKey;
+	header.level = level;
+	header.x = x;
+	header.y = y;
+	header.resolution = TERRAIN_TILE_QUADS + 3;
+	header.minHeight = *std::min_element(heights.begin(), heights.end());
+	header.maxHeight = *std::max_element(heights.begin(), heights.end());
+
+	vector<unsigned short> quantized(heights.size());
+	float range = header.maxHeight - header.minHeight;
+	for (unsigned int i = 0; i < heights.size(); i++)
+		quantized[i] = range > 0.0f ? (unsigned short)((heights[i] - header.minHeight) / range * 65535.0f + 0.5f) : 0;
+
+	fwrite(&header, sizeof(header), 1, pFile);
+	fwrite(&quantized[0], sizeof(unsigned short), quantized.size(), pFile);
+	bool result = ferror(pFile) == 0;
+	result = fclose(pFile) == 0 && result;
+	if (!result || !ReplaceFile(temporaryFilename, filename))
+		remove(temporaryFilename.c_str());
+}
+
+// The tile's grid, with a border of one sample on every side so that normals match across tiles
+void CTerrain::BakeHeights(int level, int x, int y, vector<float> &heights) const
+{
+	const int n = TERRAIN_TILE_QUADS + 3;
+	float spacing = GetTileSize(level) / TERRAIN_TILE_QUADS;
+	glm::vec2 origin = GetTileOrigin(level, x, y);
+	heights.resize(n * n);
+	for (int j = 0; j < n; j++) {
+		for (int i = 0; i < n; i++)
+			heights[j * n + i] = GetHeight(origin.x + (i - 1) * spacing, origin.y + (j - 1) * spacing);
+	}
+}
+
+void CTerrain::BuildVertices(int level, int x, int y, const vector<float> &heights, PendingTile &pending) const
+{
+	const int n = TERRAIN_TILE_QUADS + 1;
+	const int border = TERRAIN_TILE_QUADS + 3;
+	float size = GetTileSize(level);
+	float spacing = size / TERRAIN_TILE_QUADS;
+	glm::vec2 origin = GetTileOrigin(level, x, y);
+
+	pending.vertices.resize(n * n + 4 * n);
+	pending.minHeight = heights[border + 1];
+	pending.maxHeight = heights[border + 1];
+	for (int j = 0; j < n; j++) {
+		for (int i = 0; i < n; i++) {
+			const float *pHeight = &heights[(j + 1) * border + i + 1];
+			MeshVertex &vertex = pending.vertices[j * n + i];
+			vertex.position = glm::vec3(origin.x + i * spacing, *pHeight, origin.y + j * spacing);
+			vertex.texCoord = glm::vec2(vertex.position.x, vertex.position.z) / TERRAIN_TEXTURE_SIZE;
+			vertex.normal = glm::normalize(glm::vec3(pHeight[-1] - pHeight[1], 2.0f * spacing, pHeight[-border] - pHeight[border]));
+			pending.minHeight = std::min(pending.minHeight, *pHeight);
+			pending.maxHeight = std::max(pending.maxHeight, *pHeight);
+		}
+	}
+
+	// The skirt drops deep enough to cover the gap to a neighbour a few levels coarser
+	float skirtDepth = 0.05f * size + 2.0f;
+	vector<unsigned int> perimeter;
+	GetPerimeter(perimeter);
+	for (unsigned int k = 0; k < perimeter.size(); k++) {
+		MeshVertex &vertex = pending.vertices[n * n + k];
+		vertex = pending.vertices[perimeter[k]];
+		vertex.position.y -= skirtDepth;
+	}
+	pending.minHeight -= skirtDepth;
+}
+
+float CTerrain::GetHeight(float x, float z) const
+{
+	// Rolling hills from a few octaves of value noise
+	float hills = 0.0f;
+	float amplitude = 0.5f;
+	float frequency = 1.0f / 1500.0f;
+	for (int i = 0; i < 6; i++) {
+		hills += amplitude * ValueNoise(x * frequency, z * frequency);
+		amplitude *= 0.5f;
+		frequency *= 2.0f;
+	}
+	hills *= m_hillHeight;
+
+	// Carve the track in: flat just below it, then blending into the hills
+	float distance, trackHeight;
+	GetTrackDistance(x, z, distance, trackHeight);
+	float ground = trackHeight - TRACK_CLEARANCE;
+	float t = std::min(std::max((distance - m_flatRadius) / m_blendDistance, 0.0f), 1.0f);
+	t = t * t * (3.0f - 2.0f * t);
+	return ground + (hills - ground) * t;
+}
+
+// Horizontal distance to the closest point on the closed centreline, and the height of the track there
+void CTerrain::GetTrackDistance(float x, float z, float &distance, float &trackHeight) const
+{
+	distance = 1e30f;
+	trackHeight = TRACK_CLEARANCE;
+	float closest = 1e30f;
+	for (unsigned int i = 0; i < m_trackPoints.size(); i++) {
+		const glm::vec3 &a = m_trackPoints[i];
+		const glm::vec3 &b = m_trackPoints[(i + 1) % m_trackPoints.size()];
+		glm::vec2 ab(b.x - a.x, b.z - a.z);
+		glm::vec2 ap(x - a.x, z - a.z);
+		float lengthSquared = glm::dot(ab, ab);
+		float t = lengthSquared > 0.0f ? std::min(std::max(glm::dot(ap, ab) / lengthSquared, 0.0f), 1.0f) : 0.0f;
+		glm::vec2 d = ap - ab * t;
+		float distanceSquared = glm::dot(d, d);
+		if (distanceSquared < closest) {
+			closest = distanceSquared;
+			trackHeight = a.y + (b.y - a.y) * t;
+		}
+	}
+	if (closest < 1e30f)
+		distance = sqrt(closest);
+}
+
+int CTerrain::GetNumResidentTiles()
+{
+	return (int)m_tiles.size();
+}
+
+int CTerrain::GetNumDrawnTiles()
+{
+	return (int)m_drawn.size();
+}
+
+int CTerrain::GetNumPagedTiles()
+{
+	return m_numPaged;
+}
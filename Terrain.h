@@ -0,0 +1,110 @@
+#pragma once
+#include "Common.h"
+#include "GeometryPool.h"
+#include "CompiledTexture.h"
+#include "AssetLoader.h"
+#include <map>
+#include <set>
+#include <memory>
+
+// Every tile is a grid of this many quads a side, whatever its size
+#define TERRAIN_TILE_QUADS 32
+
+// A heightfield around the origin, split into a quadtree of tiles (level 0 is one tile over the whole world, and each
+// level halves the tile size).  Each frame the tiles near the camera are refined and the far ones drawn coarse; a tile
+// is only split once its four children are resident, and skirts hide the cracks between tiles of different levels.
+// Tiles are paged in around the camera by a background loader from a pyramid of height files in resources\terrain,
+// baked from the height source the first time they are needed, and paged out least recently used first to stay within
+// a fixed memory budget.  The track is carved into the heights, so the ground meets it at its own height.
+// Resident tiles live in the geometry pool and are queued there for Render, sharing a single index range.  With several
+// views a tile is chosen if any view sees it, at the detail the nearest of their cameras needs, and the pool culls it
+// for each view.
+class CTerrain
+{
+public:
+	CTerrain();
+	~CTerrain();
+
+	// trackPoints is the track's centreline, flattened to within flatRadius of it
+	void Create(CJobSystem *pJobSystem, CGeometryPool *pPool, const string &textureFilename,
+		const vector<glm::vec3> &trackPoints, float worldSize = 8192.0f, int numLevels = 8,
+		size_t memoryBudget = 24 << 20);
+	void Release();
+
+	// Upload loaded tiles, choose the tiles to draw and request or evict tiles.  Call on the GL thread every frame.
+	void Update(const GeometryView *pViews, int numViews);
+	// Queue the chosen tiles in the geometry pool, for its next Prepare
+	void Render();
+
+	// Height of the ground at a point, from the height source (not the tiles).  Safe to call from any thread.
+	float GetHeight(float x, float z) const;
+
+	int GetNumResidentTiles();
+	int GetNumDrawnTiles();
+	// Tiles requested or uploaded by the last Update.  Paging a tile allocates on the GL thread, so a frame that pages
+	// is not a steady one.
+	int GetNumPagedTiles();
+
+private:
+	struct Tile
+	{
+		int level;
+		int x;
+		int y;
+		float minHeight;
+		float maxHeight;
+		GeometryRange range;
+		unsigned int lastUsed;				// Frame the tile was last visited when choosing tiles
+	};
+
+	// Filled on a worker thread
+	struct PendingTile
+	{
+		int level;
+		int x;
+		int y;
+		vector<MeshVertex> vertices;
+		float minHeight;
+		float maxHeight;
+	};
+
+	static unsigned long long GetKey(int level, int x, int y);
+	float GetTileSize(int level) const;
+	glm::vec2 GetTileOrigin(int level, int x, int y) const;
+
+	void SelectTile(Tile &tile, const glm::vec3 *pCameraPositions, const glm::vec4 (*pPlanes)[6], int numViews);
+	void RequestTile(int level, int x, int y, float distance);
+	void IssueRequests();
+	bool EvictTile();
+	void LoadTile(PendingTile &pending);
+	void UploadTile(PendingTile &pending);
+
+	bool ReadHeights(const string &filename, int level, int x, int y, vector<float> &heights) const;
+	void WriteHeights(const string &filename, int level, int x, int y, const vector<float> &heights) const;
+	void BakeHeights(int level, int x, int y, vector<float> &heights) const;
+	void BuildVertices(int level, int x, int y, const vector<float> &heights, PendingTile &pending) const;
+	void GetTrackDistance(float x, float z, float &distance, float &trackHeight) const;
+
+	CAssetLoader *m_pLoader;
+	CGeometryPool *m_pPool;
+	CCompiledTexture *m_pTexture;			// Held from the resource manager
+	GeometryRange m_indexRange;				// The grid and skirt indices, shared by every tile
+
+	float m_worldSize;
+	int m_numLevels;
+	unsigned int m_maxTiles;				// From the memory budget
+	float m_lodDistance;					// A tile splits when the camera is nearer than this many tile sizes
+	float m_hillHeight;
+	float m_flatRadius;						// Flat at the track's height out to here from the centreline
+	float m_blendDistance;					// Then rising to the hills over this distance
+	vector<glm::vec3> m_trackPoints;
+	unsigned long long m_sourceKey;			// Hash of the height source, stored with each height file
+
+	std::map<unsigned long long, Tile> m_tiles;
+	std::set<unsigned long long> m_pending;
+	vector<std::pair<float, unsigned long long> > m_requests;	// Distance and key, nearest first
+	vector<Tile*> m_drawn;
+	unsigned int m_frame;
+	int m_numPaged;
+	bool m_created;
+};
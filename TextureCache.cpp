@@ -0,0 +1,246 @@
+#include "TextureCache.h"
+#include "MeshCache.h"
+#include <stdio.h>
+#include <sys/stat.h>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+// Bump when the layout below or the way the compiler builds mip chains changes
+static const unsigned int TEXTURE_CACHE_MAGIC = 0x58455443; // "CTEX"
+static const unsigned int TEXTURE_CACHE_VERSION = 1;
+static const unsigned int TEXTURE_CACHE_ALIGNMENT = 16;
+
+struct TextureCacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long key;
+	unsigned int format;
+	unsigned int numLevels;
+};
+
+struct TextureCacheLevel
+{
+	unsigned int offset;
+	unsigned int size;
+	int width;
+	int height;
+};
+
+// The compiled file sits next to its source, with the extension replaced
+string CTextureCache::GetCompiledFilename(const string &sourceFilename)
+{
+	string::size_type dotIndex = sourceFilename.find_last_of('.');
+	string::size_type slashIndex = sourceFilename.find_last_of("\\/");
+	if (dotIndex == string::npos || (slashIndex != string::npos && dotIndex < slashIndex))
+		return sourceFilename + ".ctex";
+	return sourceFilename.substr(0, dotIndex) + ".ctex";
+}
+
+// Identify a version of a source file by its size and modification time, which is much cheaper than hashing its contents
+bool CTextureCache::GetSourceKey(const string &sourceFilename, unsigned long long &key)
+{
+	struct stat status;
+	if (stat(sourceFilename.c_str(), &status) != 0)
+		return false;
+
+	unsigned long long size = (unsigned long long)status.st_size;
+	unsigned long long time = (unsigned long long)status.st_mtime;
+	key = CMeshCache::HashData(&size, sizeof(size));
+	key = CMeshCache::HashData(&time, sizeof(time), key);
+	return true;
+}
+
+// Map a compiled file and point the levels at its contents.  The file must stay open while the levels are in use.
+bool CTextureCache::Read(const string &compiledFilename, unsigned long long key, CMappedFile &file, TextureFormat &format,
+	vector<TextureLevel> &levels)
+{
+	if (!file.Open(compiledFilename))
+		return false;
+
+	const BYTE *pData = file.GetData();
+	size_t size = file.GetSize();
+	if (size < sizeof(TextureCacheHeader))
+		return false;
+
+	const TextureCacheHeader *pHeader = (const TextureCacheHeader*)pData;
+	if (pHeader->magic != TEXTURE_CACHE_MAGIC || pHeader->version != TEXTURE_CACHE_VERSION || pHeader->key != key)
+		return false;
+	if (pHeader->format > TEXTURE_FORMAT_BC7 || pHeader->numLevels == 0)
+		return false;
+	if (sizeof(TextureCacheHeader) + pHeader->numLevels * sizeof(TextureCacheLevel) > size)
+		return false;
+
+	format = (TextureFormat)pHeader->format;
+	const TextureCacheLevel *pLevels = (const TextureCacheLevel*)(pData + sizeof(TextureCacheHeader));
+	levels.resize(pHeader->numLevels);
+	for (unsigned int i = 0; i < pHeader->numLevels; i++) {
+		if ((size_t)pLevels[i].offset + pLevels[i].size > size ||
+			pLevels[i].size != GetLevelSize(format, pLevels[i].width, pLevels[i].height))
+			return false;
+		levels[i].pData = pData + pLevels[i].offset;
+		levels[i].size = pLevels[i].size;
+		levels[i].width = pLevels[i].width;
+		levels[i].height = pLevels[i].height;
+	}
+
+	return true;
+}
+
+bool CTextureCache::Write(const string &compiledFilename, unsigned long long key, TextureFormat format,
+	const vector<TextureLevel> &levels)
+{
+	FILE *pFile = fopen(compiledFilename.c_str(), "wb");
+	if (pFile == NULL)
+		return false;
+
+	TextureCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = TEXTURE_CACHE_MAGIC;
+	header.version = TEXTURE_CACHE_VERSION;
+	header.key = key;
+	header.format = format;
+	header.numLevels = (unsigned int)levels.size();
+	fwrite(&header, sizeof(header), 1, pFile);
+
+	// Level data starts on an aligned offset, so that each level can be handed to the driver straight from the mapping
+	unsigned int offset = sizeof(TextureCacheHeader) + (unsigned int)levels.size() * sizeof(TextureCacheLevel);
+	for (unsigned int i = 0; i < levels.size(); i++) {
+		offset = (offset + TEXTURE_CACHE_ALIGNMENT - 1) & ~(TEXTURE_CACHE_ALIGNMENT - 1);
+		TextureCacheLevel level;
+		level.offset = offset;
+		level.size = levels[i].size;
+		level.width = levels[i].width;
+		level.height = levels[i].height;
+		fwrite(&level, sizeof(level), 1, pFile);
+		offset += level.size;
+	}
+
+	BYTE padding[TEXTURE_CACHE_ALIGNMENT] = { 0 };
+	for (unsigned int i = 0; i < levels.size(); i++) {
+		long position = ftell(pFile);
+		fwrite(padding, 1, ((position + TEXTURE_CACHE_ALIGNMENT - 1) & ~(TEXTURE_CACHE_ALIGNMENT - 1)) - position, pFile);
+		fwrite(levels[i].pData, 1, levels[i].size, pFile);
+	}
+
+	bool result = ferror(pFile) == 0;
+	fclose(pFile);
+	if (!result)
+		remove(compiledFilename.c_str());
+	return result;
+}
+
+unsigned int CTextureCache::GetLevelSize(TextureFormat format, int width, int height)
+{
+	unsigned int blocks = ((width + 3) / 4) * ((height + 3) / 4);
+	switch (format) {
+	case TEXTURE_FORMAT_BC1:
+		return blocks * 8;
+	case TEXTURE_FORMAT_BC3:
+	case TEXTURE_FORMAT_BC7:
+		return blocks * 16;
+	default:
+		return width * height * 4;
+	}
+}
+
+GLenum CTextureCache::GetInternalFormat(TextureFormat format)
+{
+	switch (format) {
+	case TEXTURE_FORMAT_BC1:
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case TEXTURE_FORMAT_BC3:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case TEXTURE_FORMAT_BC7:
+		return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	default:
+		return GL_RGBA8;
+	}
+}
+
+// Check the driver's list of compressed formats; it is queried once
+bool CTextureCache::IsFormatSupported(TextureFormat format)
+{
+	static vector<GLint> supportedFormats;
+	static bool queried = false;
+	if (!queried) {
+		GLint numFormats = 0;
+		glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &numFormats);
+		supportedFormats.resize(numFormats);
+		if (numFormats > 0)
+			glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, &supportedFormats[0]);
+		queried = true;
+	}
+
+	if (format == TEXTURE_FORMAT_RGBA8)
+		return true;
+	GLint internalFormat = GetInternalFormat(format);
+	for (unsigned int i = 0; i < supportedFormats.size(); i++) {
+		if (supportedFormats[i] == internalFormat)
+			return true;
+	}
+	return false;
+}
+
+CTextureData::CTextureData()
+{
+	m_compiled = false;
+	m_format = TEXTURE_FORMAT_RGBA8;
+}
+
+// Use the compiled container if it matches the source, and decode the source otherwise
+bool CTextureData::Load(const string &path)
+{
+	m_path = path;
+	m_compiled = false;
+
+	unsigned long long key;
+	if (CTextureCache::GetSourceKey(path, key) &&
+		CTextureCache::Read(CTextureCache::GetCompiledFilename(path), key, m_file, m_format, m_levels)) {
+		m_compiled = true;
+		return true;
+	}
+
+	m_file.Close();
+	m_levels.clear();
+	return LoadSource();
+}
+
+// Decode the source image, for when there is no usable compiled container
+bool CTextureData::LoadSource()
+{
+	return m_image.Load(m_path);
+}
+
+bool CTextureData::IsCompiled()
+{
+	return m_compiled;
+}
+
+const string &CTextureData::GetPath()
+{
+	return m_path;
+}
+
+TextureFormat CTextureData::GetFormat()
+{
+	return m_format;
+}
+
+const vector<TextureLevel> &CTextureData::GetLevels()
+{
+	return m_levels;
+}
+
+CImageData &CTextureData::GetImage()
+{
+	return m_image;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "Common.h"
+#include "MappedFile.h"
+#include "ImageData.h"
+
+// Pixel formats of a compiled texture.  BC1 has no alpha; BC3 and BC7 keep it.  RGBA8 is the uncompressed fallback for
+// drivers without the compressed formats.
+enum TextureFormat
+{
+	TEXTURE_FORMAT_RGBA8,
+	TEXTURE_FORMAT_BC1,
+	TEXTURE_FORMAT_BC3,
+	TEXTURE_FORMAT_BC7,
+};
+
+// One mip level of a compiled texture
+struct TextureLevel
+{
+	const BYTE *pData;
+	unsigned int size;
+	int width;
+	int height;
+};
+
+// Offline-compiled textures.  The texture compiler (tools\TextureCompiler) writes a container next to each source image,
+// holding the full mip chain in a GPU format, so that loading is a memory map and a direct upload of every level.  The
+// container records the size and modification time of its source, and is ignored once the source has changed.
+class CTextureCache
+{
+public:
+	static string GetCompiledFilename(const string &sourceFilename);
+	static bool GetSourceKey(const string &sourceFilename, unsigned long long &key);
+
+	static bool Read(const string &compiledFilename, unsigned long long key, CMappedFile &file, TextureFormat &format,
+		vector<TextureLevel> &levels);
+	static bool Write(const string &compiledFilename, unsigned long long key, TextureFormat format,
+		const vector<TextureLevel> &levels);
+
+	// Block size and OpenGL internal format of each format.  IsFormatSupported needs a current GL context.
+	static unsigned int GetLevelSize(TextureFormat format, int width, int height);
+	static GLenum GetInternalFormat(TextureFormat format);
+	static bool IsFormatSupported(TextureFormat format);
+};
+
+// The pixels of one texture, prepared without OpenGL so that it can run on a worker thread: the mapped mip chain of an up
+// to date compiled container if there is one, and the decoded source image otherwise.
+class CTextureData
+{
+public:
+	CTextureData();
+
+	bool Load(const string &path);
+	bool LoadSource();
+	bool IsCompiled();
+	const string &GetPath();
+
+	TextureFormat GetFormat();
+	const vector<TextureLevel> &GetLevels();
+	CImageData &GetImage();
+
+private:
+	string m_path;
+	bool m_compiled;
+	CMappedFile m_file;
+	TextureFormat m_format;
+	vector<TextureLevel> m_levels;
+	CImageData m_image;
+};
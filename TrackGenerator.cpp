@@ -0,0 +1,98 @@
+#include "TrackGenerator.h"
+
+static const int TRACK_GENERATOR_GROUP_SIZE = 64;		// local_size_x in trackGenerator.comp
+
+CTrackGenerator::CTrackGenerator()
+{
+	m_pProgram = NULL;
+	m_controlPointBuffer = 0;
+	m_distanceBuffer = 0;
+	m_numControlPoints = 0;
+}
+
+CTrackGenerator::~CTrackGenerator()
+{
+	Release();
+}
+
+void CTrackGenerator::Create(CShaderCache *pShaderCache)
+{
+	Release();
+	m_pProgram = pShaderCache->CreateComputeProgram("trackGenerator.comp");
+	glGenBuffers(1, &m_controlPointBuffer);
+	glGenBuffers(1, &m_distanceBuffer);
+}
+
+void CTrackGenerator::Release()
+{
+	delete m_pProgram;
+	m_pProgram = NULL;
+	if (m_controlPointBuffer) glDeleteBuffers(1, &m_controlPointBuffer);
+	if (m_distanceBuffer) glDeleteBuffers(1, &m_distanceBuffer);
+	m_controlPointBuffer = m_distanceBuffer = 0;
+	m_numControlPoints = 0;
+}
+
+bool CTrackGenerator::IsReady()
+{
+	return m_pProgram != NULL && m_pProgram->IsReady();
+}
+
+void CTrackGenerator::SetControlPoints(const vector<glm::vec3> &controlPoints, const vector<float> &distances)
+{
+	m_numControlPoints = (int)controlPoints.size();
+
+	// std430 pads a vec3 array to vec4s
+	vector<glm::vec4> points(controlPoints.size());
+	for (unsigned int i = 0; i < controlPoints.size(); i++)
+		points[i] = glm::vec4(controlPoints[i], 1.0f);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_controlPointBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, points.size() * sizeof(glm::vec4), &points[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_distanceBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, distances.size() * sizeof(float), &distances[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+unsigned int CTrackGenerator::Generate(float width, int numSamples, CPackedVertexFormat &format, GLuint vertexBuffer,
+	GLuint indexBuffer)
+{
+	if (!m_pProgram->IsValid() || m_numControlPoints < 2 || numSamples < 2 || format.GetStride() != 3 * sizeof(GLuint))
+		return 0;
+
+	// Written by the shader and read by vertex fetch, so the CPU never touches the contents
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, vertexBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, GetNumVertices(numSamples) * format.GetStride(), NULL, GL_STATIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, GetNumIndices(numSamples) * sizeof(GLuint), NULL, GL_STATIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TRACK_CONTROL_POINTS_BINDING, m_controlPointBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TRACK_DISTANCES_BINDING, m_distanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TRACK_VERTICES_BINDING, vertexBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TRACK_INDICES_BINDING, indexBuffer);
+
+	m_pProgram->UseProgram();
+	m_pProgram->SetUniform("numControlPoints", m_numControlPoints);
+	m_pProgram->SetUniform("numSamples", numSamples);
+	m_pProgram->SetUniform("width", width);
+	m_pProgram->SetUniform("positionOrigin", format.GetOrigin());
+	m_pProgram->SetUniform("positionScale", 1.0f / format.GetScale());
+	glDispatchCompute((numSamples + TRACK_GENERATOR_GROUP_SIZE - 1) / TRACK_GENERATOR_GROUP_SIZE, 1, 1);
+
+	// The buffers are next read as vertices and indices
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT);
+	glUseProgram(0);
+	return GetNumIndices(numSamples);
+}
+
+// Two vertices per sample, then the first sample again and the left vertex of the second, as CCatmullRom::CreateTrack
+// closes the strip
+unsigned int CTrackGenerator::GetNumVertices(int numSamples)
+{
+	return 2 * numSamples + 3;
+}
+
+unsigned int CTrackGenerator::GetNumIndices(int numSamples)
+{
+	return 2 * numSamples + 2;
+}
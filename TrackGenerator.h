@@ -0,0 +1,43 @@
+#pragma once
+#include "Common.h"
+#include "ShaderCache.h"
+#include "VertexFormat.h"
+
+// Shader storage buffer binding points, matching resources\shaders\trackGenerator.comp.  They follow those of
+// CClusteredLights (0 to 2) and CGeometryPool (3 and 4, GEOMETRY_VIEW_BINDING), which stay bound across frames.
+#define TRACK_CONTROL_POINTS_BINDING 5
+#define TRACK_DISTANCES_BINDING 6
+#define TRACK_VERTICES_BINDING 7
+#define TRACK_INDICES_BINDING 8
+
+// Builds the track of CCatmullRom with a compute shader.  Only the control points of the closed centreline and the
+// lengths along them are uploaded; one invocation per centreline sample interpolates the spline and writes the left
+// and right vertices and their strip indices straight into the track's buffers.  The vertices are packed as
+// CPackedVertexFormat does with snorm16 positions and a constant normal, 12 bytes each.  Changing the width or the
+// number of samples is a single dispatch, and the CPU keeps no copy of the mesh.
+class CTrackGenerator
+{
+public:
+	CTrackGenerator();
+	~CTrackGenerator();
+
+	void Create(CShaderCache *pShaderCache);
+	void Release();
+	bool IsReady();
+
+	// distances holds the length along the control points up to each one, and then the length of the closed curve
+	void SetControlPoints(const vector<glm::vec3> &controlPoints, const vector<float> &distances);
+
+	// Resize the buffers and fill them, with positions encoded for the format's bounds.  Returns the number of indices
+	// to draw as a triangle strip.
+	unsigned int Generate(float width, int numSamples, CPackedVertexFormat &format, GLuint vertexBuffer, GLuint indexBuffer);
+
+	static unsigned int GetNumVertices(int numSamples);
+	static unsigned int GetNumIndices(int numSamples);
+
+private:
+	CCachedProgram *m_pProgram;
+	GLuint m_controlPointBuffer;
+	GLuint m_distanceBuffer;
+	int m_numControlPoints;
+};
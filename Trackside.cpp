@@ -0,0 +1,281 @@
+#include "Trackside.h"
+#include "CatmullRom.h"
+#include "Primitives.h"
+#include "Profiler.h"
+#include "ResourceManager.h"
+#include <algorithm>
+
+// A cross-section, in units away from the track and up from the edge of it.  The points run so that the outside of each
+// face is on its right, seen looking along the track, and the texture repeats every textureLength units along the track
+// and every textureHeight units across the faces.
+struct TracksideProfile
+{
+	const float (*pPoints)[2];
+	int numPoints;
+	float textureLength;
+	float textureHeight;
+};
+
+// A concrete wall a little way off the track, the size of the wall sections it replaces
+static constexpr float BARRIER_POINTS[][2] = { { 7.0f, 0.0f }, { 7.0f, 5.0f }, { 6.0f, 5.0f }, { 6.0f, 0.0f } };
+// Raised just above the track, overlapping its edge
+static constexpr float KERB_POINTS[][2] = { { 4.0f, 0.0f }, { 3.0f, 0.3f }, { -2.0f, 0.3f }, { -3.0f, 0.0f } };
+// A square rail, swept at each of FENCE_RAIL_HEIGHTS
+static constexpr float FENCE_RAIL_POINTS[][2] = {
+	{ 12.2f, -0.2f }, { 12.2f, 0.2f }, { 11.8f, 0.2f }, { 11.8f, -0.2f }, { 12.2f, -0.2f },
+};
+static constexpr float FENCE_RAIL_HEIGHTS[] = { 4.0f, 9.0f };
+
+static constexpr TracksideProfile BARRIER_PROFILE = { BARRIER_POINTS, 4, 50.0f, 5.0f };
+static constexpr TracksideProfile KERB_PROFILE = { KERB_POINTS, 4, 10.0f, 10.0f };
+static constexpr TracksideProfile FENCE_RAIL_PROFILE = { FENCE_RAIL_POINTS, 5, 20.0f, 20.0f };
+
+// The fence posts stand centred under the rails
+static constexpr float FENCE_POST_OFFSET = 12.0f;
+static constexpr float FENCE_POST_WIDTH = 0.6f;
+static constexpr float FENCE_POST_HEIGHT = 10.0f;
+static constexpr float FENCE_POST_SPACING = 20.0f;
+
+static MeshVertex MakeVertex(const glm::vec3 &position, const glm::vec2 &texCoord, const glm::vec3 &normal)
+{
+	MeshVertex vertex;
+	vertex.position = position;
+	vertex.texCoord = texCoord;
+	vertex.normal = normal;
+	return vertex;
+}
+
+// Sweep a profile, raised by height, along samples first to last of the curve.  Each face of the profile has its own
+// vertices, so the edges between faces stay hard.  The left side of the track is a mirror image of the right, so its
+// triangles are wound the other way.
+static void Sweep(const vector<glm::vec3> &curve, const vector<glm::vec3> &outwards, const vector<float> &distances,
+	int first, int last, const TracksideProfile &profile, float height, bool right, vector<MeshVertex> &vertices,
+	vector<unsigned int> &indices)
+{
+	int n = (int)curve.size();
+	glm::vec3 up(0.0f, 1.0f, 0.0f);
+	float across = 0.0f;
+	for (int k = 0; k + 1 < profile.numPoints; k++) {
+		glm::vec2 a(profile.pPoints[k][0], profile.pPoints[k][1] + height);
+		glm::vec2 b(profile.pPoints[k + 1][0], profile.pPoints[k + 1][1] + height);
+		glm::vec2 d = b - a;
+		float length = glm::length(d);
+		float va = across / profile.textureHeight;
+		float vb = (across + length) / profile.textureHeight;
+		across += length;
+
+		unsigned int start = (unsigned int)vertices.size();
+		for (int i = first; i <= last; i++) {
+			const glm::vec3 &p = curve[i % n];
+			const glm::vec3 &outward = outwards[i % n];
+			glm::vec3 normal = glm::normalize(d.y * outward - d.x * up);
+			float u = distances[i] / profile.textureLength;
+			vertices.push_back(MakeVertex(p + a.x * outward + a.y * up, glm::vec2(u, va), normal));
+			vertices.push_back(MakeVertex(p + b.x * outward + b.y * up, glm::vec2(u, vb), normal));
+		}
+		for (int i = 0; i < last - first; i++) {
+			unsigned int a0 = start + 2 * i;
+			unsigned int b0 = a0 + 1;
+			unsigned int a1 = a0 + 2;
+			unsigned int b1 = a0 + 3;
+			if (right) {
+				indices.push_back(a0); indices.push_back(a1); indices.push_back(b0);
+				indices.push_back(b0); indices.push_back(a1); indices.push_back(b1);
+			}
+			else {
+				indices.push_back(a0); indices.push_back(b0); indices.push_back(a1);
+				indices.push_back(b0); indices.push_back(b1); indices.push_back(a1);
+			}
+		}
+	}
+}
+
+// A post at each sample from first up to (not including) last that passes a multiple of FENCE_POST_SPACING.  The posts
+// are boxes from the primitive library, turned to face the track.
+static void AddPosts(const vector<glm::vec3> &curve, const vector<glm::vec3> &outwards, const vector<float> &distances,
+	int first, int last, vector<MeshVertex> &vertices, vector<unsigned int> &indices)
+{
+	int n = (int)curve.size();
+	glm::vec3 up(0.0f, 1.0f, 0.0f);
+	float halfWidth = 0.5f * FENCE_POST_WIDTH;
+	for (int i = first; i < last; i++) {
+		if (i > 0 && (int)(distances[i] / FENCE_POST_SPACING) == (int)(distances[i - 1] / FENCE_POST_SPACING))
+			continue;
+
+		// Outward, up and along, in that order, keep the box's handedness on either side of the track
+		const glm::vec3 &p = curve[i % n];
+		const glm::vec3 &outward = outwards[i % n];
+		glm::vec3 along = glm::cross(outward, up);
+
+		unsigned int firstVertex = (unsigned int)vertices.size();
+		CPrimitiveLibrary::GenerateBox(glm::vec3(FENCE_POST_OFFSET - halfWidth, 0.0f, -halfWidth),
+			glm::vec3(FENCE_POST_OFFSET + halfWidth, FENCE_POST_HEIGHT, halfWidth), vertices, indices);
+		for (unsigned int j = firstVertex; j < vertices.size(); j++) {
+			MeshVertex &vertex = vertices[j];
+			vertex.position = p + vertex.position.x * outward + vertex.position.y * up + vertex.position.z * along;
+			vertex.normal = vertex.normal.x * outward + vertex.normal.y * up + vertex.normal.z * along;
+		}
+	}
+}
+
+CTrackside::CTrackside()
+{
+	m_pPool = NULL;
+	m_revision = 0;
+	m_numDrawn = 0;
+	for (int i = 0; i < NUM_TRACKSIDE_KINDS; i++)
+		m_pTextures[i] = NULL;
+}
+
+CTrackside::~CTrackside()
+{
+	Release();
+}
+
+void CTrackside::Create(CGeometryPool *pPool, const string &barrierTextureFilename)
+{
+	Release();
+	m_pPool = pPool;
+
+	m_pTextures[TRACKSIDE_BARRIER] = CResourceManager::AcquireTexture(barrierTextureFilename);
+
+	// Painted steel for the fence
+	BYTE grey[3] = { 150, 150, 150 };
+	m_pTextures[TRACKSIDE_FENCE] = CResourceManager::AcquireTextureFromData("Fence", grey, 1, 1, 24, GL_BGR);
+
+	// Red and white stripes for the kerbs, half a texture length each
+	BYTE stripes[6] = { 0, 0, 200, 255, 255, 255 };
+	CCompiledTexture *pKerb = CResourceManager::AcquireTextureFromData("Kerb", stripes, 2, 1, 24, GL_BGR);
+	pKerb->SetSamplerObjectParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	pKerb->SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	m_pTextures[TRACKSIDE_KERB] = pKerb;
+}
+
+void CTrackside::Release()
+{
+	FreeChunks();
+	for (int i = 0; i < NUM_TRACKSIDE_KINDS; i++) {
+		CResourceManager::ReleaseTexture(m_pTextures[i]);
+		m_pTextures[i] = NULL;
+	}
+	m_pPool = NULL;
+	m_revision = 0;
+}
+
+void CTrackside::FreeChunks()
+{
+	for (unsigned int i = 0; i < m_chunks.size(); i++)
+		m_pPool->Free(m_chunks[i].range);
+	m_chunks.clear();
+}
+
+void CTrackside::Update(CCatmullRom *pTrack)
+{
+	PROFILE_ZONE("Trackside update");
+	if (m_pPool == NULL || pTrack->GetOffsetRevision() == m_revision)
+		return;
+	m_revision = pTrack->GetOffsetRevision();
+	FreeChunks();
+
+	const vector<glm::vec3> &left = pTrack->GetLeftOffsetPoints();
+	const vector<glm::vec3> &right = pTrack->GetRightOffsetPoints();
+	int n = (int)left.size();
+	if (n < 2 || right.size() != left.size())
+		return;
+
+	// Away from the track is across it, from the other edge.  Each side has its own distances, so the textures keep
+	// their size on the inside of bends.
+	vector<glm::vec3> leftOutwards(n), rightOutwards(n);
+	vector<float> leftDistances(n + 1), rightDistances(n + 1);
+	leftDistances[0] = rightDistances[0] = 0.0f;
+	for (int i = 0; i < n; i++) {
+		glm::vec3 across = right[i] - left[i];
+		across.y = 0.0f;
+		rightOutwards[i] = glm::normalize(across);
+		leftOutwards[i] = -rightOutwards[i];
+		leftDistances[i + 1] = leftDistances[i] + glm::distance(left[i], left[(i + 1) % n]);
+		rightDistances[i + 1] = rightDistances[i] + glm::distance(right[i], right[(i + 1) % n]);
+	}
+
+	Build(left, leftOutwards, leftDistances, false);
+	Build(right, rightOutwards, rightDistances, true);
+}
+
+// The chunks overlap by a sample, which closes the gap between them (and at the end of the lap)
+void CTrackside::Build(const vector<glm::vec3> &curve, const vector<glm::vec3> &outwards,
+	const vector<float> &distances, bool right)
+{
+	int n = (int)curve.size();
+	vector<MeshVertex> vertices;
+	vector<unsigned int> indices;
+	for (int first = 0; first < n; first += TRACKSIDE_CHUNK_SAMPLES) {
+		int last = std::min(first + TRACKSIDE_CHUNK_SAMPLES, n);
+
+		Sweep(curve, outwards, distances, first, last, BARRIER_PROFILE, 0.0f, right, vertices, indices);
+		AddChunk(TRACKSIDE_BARRIER, vertices, indices);
+		vertices.clear();
+		indices.clear();
+
+		for (unsigned int i = 0; i < sizeof(FENCE_RAIL_HEIGHTS) / sizeof(FENCE_RAIL_HEIGHTS[0]); i++)
+			Sweep(curve, outwards, distances, first, last, FENCE_RAIL_PROFILE, FENCE_RAIL_HEIGHTS[i], right, vertices,
+				indices);
+		AddPosts(curve, outwards, distances, first, last, vertices, indices);
+		AddChunk(TRACKSIDE_FENCE, vertices, indices);
+		vertices.clear();
+		indices.clear();
+
+		Sweep(curve, outwards, distances, first, last, KERB_PROFILE, 0.0f, right, vertices, indices);
+		AddChunk(TRACKSIDE_KERB, vertices, indices);
+		vertices.clear();
+		indices.clear();
+	}
+}
+
+void CTrackside::AddChunk(Kind kind, const vector<MeshVertex> &vertices, const vector<unsigned int> &indices)
+{
+	if (vertices.empty())
+		return;
+
+	Chunk chunk;
+	chunk.kind = kind;
+	chunk.minimum = chunk.maximum = vertices[0].position;
+	for (unsigned int i = 1; i < vertices.size(); i++) {
+		chunk.minimum = glm::min(chunk.minimum, vertices[i].position);
+		chunk.maximum = glm::max(chunk.maximum, vertices[i].position);
+	}
+	chunk.range = m_pPool->Allocate(&vertices[0], (unsigned int)vertices.size(), &indices[0],
+		(unsigned int)indices.size());
+	m_chunks.push_back(chunk);
+}
+
+void CTrackside::Render(const GeometryView *pViews, int numViews)
+{
+	PROFILE_ZONE("Trackside");
+	numViews = std::min(numViews, GEOMETRY_MAX_VIEWS);
+	glm::vec4 planes[GEOMETRY_MAX_VIEWS][6];
+	for (int v = 0; v < numViews; v++)
+		ExtractFrustumPlanes(pViews[v], planes[v]);
+
+	m_numDrawn = 0;
+	for (unsigned int i = 0; i < m_chunks.size(); i++) {
+		Chunk &chunk = m_chunks[i];
+		bool visible = false;
+		for (int v = 0; v < numViews && !visible; v++)
+			visible = IsBoxVisible(planes[v], chunk.minimum, chunk.maximum);
+		if (!visible)
+			continue;
+		glm::vec4 sphere(0.5f * (chunk.minimum + chunk.maximum), 0.5f * glm::length(chunk.maximum - chunk.minimum));
+		m_pPool->AddDraw(chunk.range, 0, chunk.range.numIndices, m_pTextures[chunk.kind], glm::mat4(1.0f), sphere);
+		m_numDrawn++;
+	}
+}
+
+int CTrackside::GetNumChunks()
+{
+	return (int)m_chunks.size();
+}
+
+int CTrackside::GetNumDrawnChunks()
+{
+	return m_numDrawn;
+}
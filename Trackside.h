@@ -0,0 +1,61 @@
+#pragma once
+#include "Common.h"
+#include "GeometryPool.h"
+#include "CompiledTexture.h"
+
+class CCatmullRom;
+
+// Samples of an offset curve in each chunk; a lap of 500 samples is 16 chunks a side
+#define TRACKSIDE_CHUNK_SAMPLES 32
+
+// Barriers, fences and kerbs along both sides of the track.  Each is a cross-section swept along the track's offset
+// curves (the fence also has posts at a fixed spacing), merged into chunks of TRACKSIDE_CHUNK_SAMPLES samples.  A chunk
+// is one allocation in the geometry pool with its bounds, so Render drops the chunks no view sees and queues the rest
+// with a bounding sphere for the pool to cull against each view, and a lap of barrier is part of one multi-draw.
+// Update rebuilds the chunks whenever the track's offset curves change.
+class CTrackside
+{
+public:
+	CTrackside();
+	~CTrackside();
+
+	void Create(CGeometryPool *pPool, const string &barrierTextureFilename);
+	void Release();
+
+	// Rebuild if the offset curves have changed since the last call
+	void Update(CCatmullRom *pTrack);
+	// Queue the chunks any of the views see in the geometry pool, for its next Prepare
+	void Render(const GeometryView *pViews, int numViews);
+
+	int GetNumChunks();
+	int GetNumDrawnChunks();
+
+private:
+	enum Kind
+	{
+		TRACKSIDE_BARRIER,
+		TRACKSIDE_FENCE,
+		TRACKSIDE_KERB,
+		NUM_TRACKSIDE_KINDS
+	};
+
+	struct Chunk
+	{
+		GeometryRange range;
+		glm::vec3 minimum;
+		glm::vec3 maximum;
+		Kind kind;
+	};
+
+	// One side of the track, from the curve along its edge and the unit vectors pointing away from the track
+	void Build(const vector<glm::vec3> &curve, const vector<glm::vec3> &outwards, const vector<float> &distances,
+		bool right);
+	void AddChunk(Kind kind, const vector<MeshVertex> &vertices, const vector<unsigned int> &indices);
+	void FreeChunks();
+
+	CGeometryPool *m_pPool;
+	CCompiledTexture *m_pTextures[NUM_TRACKSIDE_KINDS];	// Held from the resource manager
+	vector<Chunk> m_chunks;
+	unsigned int m_revision;				// Of the offset curves the chunks were built from
+	int m_numDrawn;
+};
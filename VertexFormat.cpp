@@ -0,0 +1,229 @@
+#include "VertexFormat.h"
+#include <algorithm>
+
+static const unsigned int PACKED_POSITION_SIZE = 4 * sizeof(short);
+static const unsigned int PACKED_TEXCOORD_SIZE = 2 * sizeof(unsigned short);
+static const unsigned int PACKED_NORMAL_SIZE = 2 * sizeof(short);
+static const unsigned int PACKED_NORMAL_SNORM16_SIZE = 4 * sizeof(short);
+
+static unsigned int GetNormalSize(VertexNormalFormat normalFormat)
+{
+	switch (normalFormat) {
+	case VERTEX_NORMAL_OCTAHEDRAL: return PACKED_NORMAL_SIZE;
+	case VERTEX_NORMAL_SNORM16: return PACKED_NORMAL_SNORM16_SIZE;
+	default: return 0;
+	}
+}
+
+static short FloatToSnorm16(float value)
+{
+	return (short)floor(glm::clamp(value, -1.0f, 1.0f) * 32767.0f + 0.5f);
+}
+
+CPackedVertexFormat::CPackedVertexFormat()
+{
+	m_positionFormat = VERTEX_POSITION_HALF;
+	m_normalFormat = VERTEX_NORMAL_OCTAHEDRAL;
+	m_texCoordUnorm = true;
+	m_origin = glm::vec3(0.0f);
+	m_scale = 1.0f;
+	m_constantNormal = glm::vec3(0.0f, 1.0f, 0.0f);
+	m_stride = PACKED_POSITION_SIZE + PACKED_TEXCOORD_SIZE + PACKED_NORMAL_SIZE;
+}
+
+void CPackedVertexFormat::Create(const MeshVertex *pVertices, unsigned int numVertices, VertexPositionFormat positionFormat,
+	VertexNormalFormat normalFormat)
+{
+	m_positionFormat = positionFormat;
+	m_normalFormat = normalFormat;
+	m_stride = PACKED_POSITION_SIZE + PACKED_TEXCOORD_SIZE + GetNormalSize(normalFormat);
+
+	glm::vec3 minimum(0.0f), maximum(0.0f);
+	m_texCoordUnorm = true;
+	for (unsigned int i = 0; i < numVertices; i++) {
+		const MeshVertex &vertex = pVertices[i];
+		minimum = i == 0 ? vertex.position : glm::min(minimum, vertex.position);
+		maximum = i == 0 ? vertex.position : glm::max(maximum, vertex.position);
+		if (vertex.texCoord.x < 0.0f || vertex.texCoord.x > 1.0f || vertex.texCoord.y < 0.0f || vertex.texCoord.y > 1.0f)
+			m_texCoordUnorm = false;
+	}
+
+	SetBounds(minimum, maximum);
+	if (numVertices > 0)
+		m_constantNormal = pVertices[0].normal;
+}
+
+void CPackedVertexFormat::Create(const glm::vec3 &minimum, const glm::vec3 &maximum, VertexPositionFormat positionFormat,
+	VertexNormalFormat normalFormat, const glm::vec3 &constantNormal)
+{
+	m_positionFormat = positionFormat;
+	m_normalFormat = normalFormat;
+	m_stride = PACKED_POSITION_SIZE + PACKED_TEXCOORD_SIZE + GetNormalSize(normalFormat);
+	m_texCoordUnorm = true;
+	SetBounds(minimum, maximum);
+	m_constantNormal = constantNormal;
+}
+
+// One scale for all axes, so that the decode matrix keeps angles and the normal matrix stays simple
+void CPackedVertexFormat::SetBounds(const glm::vec3 &minimum, const glm::vec3 &maximum)
+{
+	glm::vec3 halfExtent = (maximum - minimum) * 0.5f;
+	m_origin = (minimum + maximum) * 0.5f;
+	m_scale = std::max(std::max(halfExtent.x, halfExtent.y), halfExtent.z);
+	if (m_scale <= 0.0f)
+		m_scale = 1.0f;
+}
+
+void CPackedVertexFormat::Pack(const MeshVertex *pVertices, unsigned int numVertices, vector<BYTE> &data)
+{
+	data.resize(numVertices * m_stride);
+	for (unsigned int i = 0; i < numVertices; i++) {
+		const MeshVertex &vertex = pVertices[i];
+		BYTE *pVertex = &data[i * m_stride];
+
+		short *pPosition = (short*)pVertex;
+		if (m_positionFormat == VERTEX_POSITION_SNORM16) {
+			glm::vec3 p = (vertex.position - m_origin) / m_scale;
+			pPosition[0] = FloatToSnorm16(p.x);
+			pPosition[1] = FloatToSnorm16(p.y);
+			pPosition[2] = FloatToSnorm16(p.z);
+			pPosition[3] = 32767;
+		}
+		else {
+			unsigned short *pHalf = (unsigned short*)pPosition;
+			pHalf[0] = FloatToHalf(vertex.position.x);
+			pHalf[1] = FloatToHalf(vertex.position.y);
+			pHalf[2] = FloatToHalf(vertex.position.z);
+			pHalf[3] = FloatToHalf(1.0f);
+		}
+
+		unsigned short *pTexCoord = (unsigned short*)(pVertex + PACKED_POSITION_SIZE);
+		if (m_texCoordUnorm) {
+			pTexCoord[0] = (unsigned short)floor(vertex.texCoord.x * 65535.0f + 0.5f);
+			pTexCoord[1] = (unsigned short)floor(vertex.texCoord.y * 65535.0f + 0.5f);
+		}
+		else {
+			pTexCoord[0] = FloatToHalf(vertex.texCoord.x);
+			pTexCoord[1] = FloatToHalf(vertex.texCoord.y);
+		}
+
+		short *pNormal = (short*)(pVertex + PACKED_POSITION_SIZE + PACKED_TEXCOORD_SIZE);
+		if (m_normalFormat == VERTEX_NORMAL_OCTAHEDRAL)
+			EncodeOctahedral(vertex.normal, pNormal);
+		else if (m_normalFormat == VERTEX_NORMAL_SNORM16) {
+			pNormal[0] = FloatToSnorm16(vertex.normal.x);
+			pNormal[1] = FloatToSnorm16(vertex.normal.y);
+			pNormal[2] = FloatToSnorm16(vertex.normal.z);
+			pNormal[3] = 0;
+		}
+	}
+}
+
+void CPackedVertexFormat::SetAttributes()
+{
+	// Vertex positions
+	glEnableVertexAttribArray(0);
+	if (m_positionFormat == VERTEX_POSITION_SNORM16)
+		glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, m_stride, 0);
+	else
+		glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, m_stride, 0);
+	// Texture coordinates
+	glEnableVertexAttribArray(1);
+	if (m_texCoordUnorm)
+		glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, m_stride, (void*)PACKED_POSITION_SIZE);
+	else
+		glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, m_stride, (void*)PACKED_POSITION_SIZE);
+	// Normal vectors
+	if (m_normalFormat == VERTEX_NORMAL_OCTAHEDRAL) {
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, m_stride, (void*)(PACKED_POSITION_SIZE + PACKED_TEXCOORD_SIZE));
+	}
+	else if (m_normalFormat == VERTEX_NORMAL_SNORM16) {
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 3, GL_SHORT, GL_TRUE, m_stride, (void*)(PACKED_POSITION_SIZE + PACKED_TEXCOORD_SIZE));
+	}
+	else
+		glDisableVertexAttribArray(2);
+}
+
+void CPackedVertexFormat::SetConstantAttributes()
+{
+	if (m_normalFormat == VERTEX_NORMAL_CONSTANT)
+		glVertexAttrib3f(2, m_constantNormal.x, m_constantNormal.y, m_constantNormal.z);
+}
+
+glm::mat4 CPackedVertexFormat::GetDecodeMatrix()
+{
+	if (m_positionFormat != VERTEX_POSITION_SNORM16)
+		return glm::mat4(1.0f);
+	return glm::scale(glm::translate(glm::mat4(1.0f), m_origin), glm::vec3(m_scale));
+}
+
+glm::vec3 CPackedVertexFormat::GetOrigin()
+{
+	return m_origin;
+}
+
+float CPackedVertexFormat::GetScale()
+{
+	return m_scale;
+}
+
+unsigned int CPackedVertexFormat::GetStride()
+{
+	return m_stride;
+}
+
+VertexNormalFormat CPackedVertexFormat::GetNormalFormat()
+{
+	return m_normalFormat;
+}
+
+// Round to nearest; values too small for a half become zero and values too large become infinity
+unsigned short CPackedVertexFormat::FloatToHalf(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	unsigned short sign = (unsigned short)((bits >> 16) & 0x8000);
+	int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+	unsigned int mantissa = bits & 0x7fffff;
+
+	if (exponent <= 0)
+		return sign;
+	if (exponent >= 31)
+		return sign | 0x7c00;
+
+	unsigned int half = ((unsigned int)exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000)
+		half++;								// May carry into the exponent, which is still the right rounding
+	return sign | (unsigned short)half;
+}
+
+// Project the normal onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper one
+void CPackedVertexFormat::EncodeOctahedral(const glm::vec3 &normal, short encoded[2])
+{
+	float length = fabs(normal.x) + fabs(normal.y) + fabs(normal.z);
+	if (length <= 0.0f) {
+		encoded[0] = encoded[1] = 0;
+		return;
+	}
+
+	glm::vec3 n = normal / length;
+	glm::vec2 e(n.x, n.y);
+	if (n.z < 0.0f) {
+		e.x = (1.0f - fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		e.y = (1.0f - fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	encoded[0] = FloatToSnorm16(e.x);
+	encoded[1] = FloatToSnorm16(e.y);
+}
+
+glm::vec3 CPackedVertexFormat::DecodeOctahedral(const short encoded[2])
+{
+	glm::vec3 n(std::max(encoded[0] / 32767.0f, -1.0f), std::max(encoded[1] / 32767.0f, -1.0f), 0.0f);
+	n.z = 1.0f - fabs(n.x) - fabs(n.y);
+	float t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "Common.h"
+#include "MeshSimplifier.h"
+
+enum VertexPositionFormat
+{
+	VERTEX_POSITION_HALF,					// Half floats, used as they are
+	VERTEX_POSITION_SNORM16,				// Relative to the bounds; the draw must apply GetDecodeMatrix
+};
+
+enum VertexNormalFormat
+{
+	VERTEX_NORMAL_OCTAHEDRAL,				// Two snorm16, decoded by DecodeOctahedral in resources\shaders\vertexFormat.glsl
+	VERTEX_NORMAL_SNORM16,					// Three snorm16 and padding, for shaders that read the normal as a vec3
+	VERTEX_NORMAL_CONSTANT,					// Not stored; the same normal for every vertex, set as a generic attribute
+};
+
+// Packs MeshVertex data (32 bytes) into 16 bit attributes, for geometry generated at load time.  A vertex is a position
+// of four halves or snorm16s, a texture coordinate of two unorm16s (or halves, if it goes outside [0, 1]), and an
+// octahedral normal of two snorm16s unless the normal is constant: 16 bytes, or 12 without a normal.  The attributes
+// keep their locations (0, 1 and 2), so shaders only change to decode octahedral normals; a shader that has not changed
+// reads snorm16 normals instead, in 20 bytes.
+class CPackedVertexFormat
+{
+public:
+	CPackedVertexFormat();
+
+	// Choose the ranges from the vertices that will be packed
+	void Create(const MeshVertex *pVertices, unsigned int numVertices, VertexPositionFormat positionFormat,
+		VertexNormalFormat normalFormat);
+	// For vertices written on the GPU, which must fall within the bounds and have texture coordinates within [0, 1]
+	void Create(const glm::vec3 &minimum, const glm::vec3 &maximum, VertexPositionFormat positionFormat,
+		VertexNormalFormat normalFormat, const glm::vec3 &constantNormal);
+	void Pack(const MeshVertex *pVertices, unsigned int numVertices, vector<BYTE> &data);
+
+	// Point attributes 0 to 2 at the buffer bound to GL_ARRAY_BUFFER, in the bound VAO
+	void SetAttributes();
+	// Set the generic values of the attributes that are not stored.  These are not part of the VAO, so call it before
+	// each draw.
+	void SetConstantAttributes();
+
+	glm::mat4 GetDecodeMatrix();			// Model space from snorm16 positions (identity for halves)
+	glm::vec3 GetOrigin();					// Encode a position as (position - GetOrigin()) / GetScale()
+	float GetScale();
+	unsigned int GetStride();
+	VertexNormalFormat GetNormalFormat();
+
+	static unsigned short FloatToHalf(float value);
+	static void EncodeOctahedral(const glm::vec3 &normal, short encoded[2]);
+	static glm::vec3 DecodeOctahedral(const short encoded[2]);
+
+private:
+	void SetBounds(const glm::vec3 &minimum, const glm::vec3 &maximum);
+
+	VertexPositionFormat m_positionFormat;
+	VertexNormalFormat m_normalFormat;
+	bool m_texCoordUnorm;
+	glm::vec3 m_origin;
+	float m_scale;
+	glm::vec3 m_constantNormal;
+	unsigned int m_stride;
+};
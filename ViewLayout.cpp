@@ -0,0 +1,137 @@
+#include "ViewLayout.h"
+#include <algorithm>
+
+static const char *s_modeNames[VIEW_LAYOUT_MODES] = { "single", "two", "four", "mirror" };
+
+CViewLayout::CViewLayout()
+{
+	m_mode = VIEW_LAYOUT_SINGLE;
+	for (int i = 0; i < VIEW_CAMERA_ROLES; i++) {
+		m_cameras[i].position = glm::vec3(0.0f, 0.0f, 1.0f);
+		m_cameras[i].viewPoint = glm::vec3(0.0f);
+		m_cameras[i].upVector = glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+	m_numViews = 0;
+}
+
+void CViewLayout::SetMode(ViewLayoutMode mode)
+{
+	m_mode = mode;
+}
+
+void CViewLayout::NextMode()
+{
+	m_mode = (ViewLayoutMode)((m_mode + 1) % VIEW_LAYOUT_MODES);
+}
+
+ViewLayoutMode CViewLayout::GetMode()
+{
+	return m_mode;
+}
+
+const char *CViewLayout::GetModeName()
+{
+	return s_modeNames[m_mode];
+}
+
+bool CViewLayout::ParseMode(const string &name, ViewLayoutMode &mode)
+{
+	for (int i = 0; i < VIEW_LAYOUT_MODES; i++) {
+		if (name == s_modeNames[i]) {
+			mode = (ViewLayoutMode)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void CViewLayout::SetCamera(ViewCameraRole role, const glm::vec3 &position, const glm::vec3 &viewPoint,
+	const glm::vec3 &upVector)
+{
+	m_cameras[role].position = position;
+	m_cameras[role].viewPoint = viewPoint;
+	m_cameras[role].upVector = upVector;
+}
+
+void CViewLayout::Build(int width, int height, const glm::mat4 &projectionMatrix)
+{
+	m_numViews = 0;
+	int halfWidth = width / 2;
+	int halfHeight = height / 2;
+	switch (m_mode) {
+	case VIEW_LAYOUT_SINGLE:
+		AddView(VIEW_CAMERA_MAIN, 0, 0, width, height, projectionMatrix, false, false);
+		break;
+	case VIEW_LAYOUT_SPLIT_TWO:
+		AddView(VIEW_CAMERA_MAIN, 0, halfHeight, width, height - halfHeight, projectionMatrix, false, false);
+		AddView(VIEW_CAMERA_SECOND, 0, 0, width, halfHeight, projectionMatrix, false, false);
+		break;
+	case VIEW_LAYOUT_SPLIT_FOUR:
+		AddView(VIEW_CAMERA_MAIN, 0, halfHeight, halfWidth, height - halfHeight, projectionMatrix, false, false);
+		AddView(VIEW_CAMERA_SECOND, halfWidth, halfHeight, width - halfWidth, height - halfHeight, projectionMatrix, false, false);
+		AddView(VIEW_CAMERA_OVERHEAD, 0, 0, halfWidth, halfHeight, projectionMatrix, false, false);
+		AddView(VIEW_CAMERA_REAR, halfWidth, 0, width - halfWidth, halfHeight, projectionMatrix, false, false);
+		break;
+	case VIEW_LAYOUT_MIRROR: {
+		// A wide strip centred at the top, a little below the edge
+		int mirrorWidth = width / 3;
+		int mirrorHeight = height / 6;
+		AddView(VIEW_CAMERA_MAIN, 0, 0, width, height, projectionMatrix, false, false);
+		AddView(VIEW_CAMERA_REAR, (width - mirrorWidth) / 2, height - mirrorHeight - height / 40, mirrorWidth, mirrorHeight,
+			projectionMatrix, true, true);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void CViewLayout::AddView(ViewCameraRole role, int x, int y, int width, int height, const glm::mat4 &projectionMatrix,
+	bool mirrored, bool inset)
+{
+	if (m_numViews == VIEW_LAYOUT_MAX_VIEWS)
+		return;
+	width = std::max(width, 1);
+	height = std::max(height, 1);
+
+	const Camera &camera = m_cameras[role];
+	glm::mat4 viewMatrix = glm::lookAt(camera.position, camera.viewPoint, camera.upVector);
+	if (mirrored)
+		viewMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(-1.0f, 1.0f, 1.0f)) * viewMatrix;
+
+	// Keep the vertical field of view, and widen or narrow the horizontal one to the viewport
+	glm::mat4 projection = projectionMatrix;
+	projection[0][0] = projection[1][1] * height / width;
+
+	m_views[m_numViews].viewMatrix = viewMatrix;
+	m_views[m_numViews].projectionMatrix = projection;
+	m_viewports[m_numViews] = glm::ivec4(x, y, width, height);
+	m_eyePositions[m_numViews] = camera.position;
+	m_insets[m_numViews] = inset;
+	m_numViews++;
+}
+
+int CViewLayout::GetNumViews()
+{
+	return m_numViews;
+}
+
+const GeometryView *CViewLayout::GetViews()
+{
+	return m_views;
+}
+
+const glm::ivec4 &CViewLayout::GetViewport(int view)
+{
+	return m_viewports[view];
+}
+
+const glm::vec3 &CViewLayout::GetEyePosition(int view)
+{
+	return m_eyePositions[view];
+}
+
+bool CViewLayout::IsInset(int view)
+{
+	return m_insets[view];
+}
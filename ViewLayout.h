@@ -0,0 +1,73 @@
+#pragma once
+#include "Common.h"
+#include "GeometryPool.h"
+
+// Views in the largest layout
+#define VIEW_LAYOUT_MAX_VIEWS 4
+
+enum ViewLayoutMode
+{
+	VIEW_LAYOUT_SINGLE,
+	VIEW_LAYOUT_SPLIT_TWO,					// Two players, one above the other
+	VIEW_LAYOUT_SPLIT_FOUR,					// Four players, one in each quarter
+	VIEW_LAYOUT_MIRROR,						// The main view with a rear view mirror inset at the top
+	VIEW_LAYOUT_MODES
+};
+
+// The cameras a layout draws from, set each frame by the game
+enum ViewCameraRole
+{
+	VIEW_CAMERA_MAIN,
+	VIEW_CAMERA_SECOND,
+	VIEW_CAMERA_OVERHEAD,
+	VIEW_CAMERA_REAR,
+	VIEW_CAMERA_ROLES
+};
+
+// How the scene's viewport is divided between views for split screen and picture in picture, and the camera and
+// projection of each view.  Every view shares the main projection's field of view and depth range, with the aspect
+// ratio of its own viewport.  The mirror is drawn through a view matrix flipped left to right, so that the projection
+// stays an ordinary perspective one for the frustum and light clustering code.
+class CViewLayout
+{
+public:
+	CViewLayout();
+
+	void SetMode(ViewLayoutMode mode);
+	void NextMode();
+	ViewLayoutMode GetMode();
+	const char *GetModeName();
+	// From a name as GetModeName returns it, for the command line
+	static bool ParseMode(const string &name, ViewLayoutMode &mode);
+
+	void SetCamera(ViewCameraRole role, const glm::vec3 &position, const glm::vec3 &viewPoint, const glm::vec3 &upVector);
+
+	// Lay the views out in a viewport of the given size, and compute their matrices
+	void Build(int width, int height, const glm::mat4 &projectionMatrix);
+
+	int GetNumViews();
+	const GeometryView *GetViews();
+	const glm::ivec4 &GetViewport(int view);	// x, y, width and height
+	const glm::vec3 &GetEyePosition(int view);
+	bool IsInset(int view);					// Drawn over another view, so its area must be cleared first
+
+private:
+	struct Camera
+	{
+		glm::vec3 position;
+		glm::vec3 viewPoint;
+		glm::vec3 upVector;
+	};
+
+	void AddView(ViewCameraRole role, int x, int y, int width, int height, const glm::mat4 &projectionMatrix,
+		bool mirrored, bool inset);
+
+	ViewLayoutMode m_mode;
+	Camera m_cameras[VIEW_CAMERA_ROLES];
+
+	int m_numViews;
+	GeometryView m_views[VIEW_LAYOUT_MAX_VIEWS];
+	glm::ivec4 m_viewports[VIEW_LAYOUT_MAX_VIEWS];
+	glm::vec3 m_eyePositions[VIEW_LAYOUT_MAX_VIEWS];
+	bool m_insets[VIEW_LAYOUT_MAX_VIEWS];
+};
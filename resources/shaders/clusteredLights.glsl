@@ -0,0 +1,55 @@
+// Clustered point lights, binned by CClusteredLights.  Add #include "clusteredLights.glsl" to a fragment shader (CShaderCache
+// expands it) and add ClusteredLighting to the colour.  Positions are in eye coordinates, as for light1.
+
+struct ClusterLight
+{
+	vec4 positionRadius;
+	vec4 colour;
+};
+
+layout(std430, binding = 0) readonly buffer ClusterLights
+{
+	ClusterLight clusterLights[];
+};
+
+layout(std430, binding = 1) readonly buffer ClusterGrid
+{
+	ivec4 clusterDims;		// Tiles across, tiles down, depth slices, lights
+	vec4 clusterParams;		// Tile width and height in pixels, depth slice scale and bias
+	vec4 clusterOrigin;		// Corner of the viewport in pixels
+	uvec2 clusterCells[];	// Offset into clusterIndices and number of lights
+};
+
+layout(std430, binding = 2) readonly buffer ClusterIndices
+{
+	uint clusterIndices[];
+};
+
+vec3 ClusteredLighting(vec3 position, vec3 normal, vec3 Md, vec3 Ms, float shininess)
+{
+	ivec3 cluster;
+	cluster.xy = ivec2((gl_FragCoord.xy - clusterOrigin.xy) / clusterParams.xy);
+	cluster.z = int(floor(log(-position.z) * clusterParams.z + clusterParams.w));
+	cluster = clamp(cluster, ivec3(0), clusterDims.xyz - 1);
+	uvec2 cell = clusterCells[(cluster.z * clusterDims.y + cluster.y) * clusterDims.x + cluster.x];
+
+	vec3 n = normalize(normal);
+	vec3 v = normalize(-position);
+	vec3 colour = vec3(0.0);
+	for (uint i = 0u; i < cell.y; i++) {
+		ClusterLight light = clusterLights[clusterIndices[cell.x + i]];
+		vec3 toLight = light.positionRadius.xyz - position;
+		float d = length(toLight);
+		if (d >= light.positionRadius.w)
+			continue;
+
+		// Falls off smoothly to nothing at the light's radius
+		float attenuation = 1.0 - d / light.positionRadius.w;
+		attenuation *= attenuation;
+		vec3 s = toLight / d;
+		vec3 h = normalize(v + s);
+		float specular = pow(max(dot(h, n), 0.0), shininess);
+		colour += light.colour.rgb * attenuation * (Md * max(dot(s, n), 0.0) + Ms * specular);
+	}
+	return colour;
+}
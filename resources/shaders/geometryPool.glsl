@@ -0,0 +1,34 @@
+// Matrices of draws queued in CGeometryPool.  Include in a vertex shader with #include "geometryPool.glsl" and, for those
+// draws, use these in place of matrices.modelViewMatrix and matrices.normalMatrix.
+
+// Per draw, shared by every view
+struct GeometryDraw
+{
+	mat4 modelMatrix;
+	mat4 normalMatrix;
+};
+
+layout(std430, binding = 3) readonly buffer GeometryDraws
+{
+	GeometryDraw geometryDraws[];
+};
+
+// The view being drawn, bound by CGeometryPool::Draw
+layout(std430, binding = 4) readonly buffer GeometryView
+{
+	mat4 geometryViewMatrix;
+	mat4 geometryViewNormalMatrix;
+};
+
+// The pool sets each draw's base instance to its index, and this attribute reads 0, 1, 2, ... per instance
+layout(location = 3) in uint inDrawIndex;
+
+mat4 GetDrawModelViewMatrix()
+{
+	return geometryViewMatrix * geometryDraws[inDrawIndex].modelMatrix;
+}
+
+mat3 GetDrawNormalMatrix()
+{
+	return mat3(geometryViewNormalMatrix) * mat3(geometryDraws[inDrawIndex].normalMatrix);
+}
@@ -0,0 +1,10 @@
+#version 430
+
+uniform vec4 colour;
+
+out vec4 outColour;
+
+void main()
+{
+	outColour = colour;
+}
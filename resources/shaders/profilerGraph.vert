@@ -0,0 +1,12 @@
+#version 430
+
+// Lines of the profiler overlay's graphs (see CProfilerOverlay), in pixels from the bottom left of the window
+
+uniform mat4 projMatrix;
+
+layout(location = 0) in vec2 inPosition;
+
+void main()
+{
+	gl_Position = projMatrix * vec4(inPosition, 0.0, 1.0);
+}
@@ -0,0 +1,15 @@
+// Reflections from the nearest dynamic environment probe (see CReflectionProbes).  Include in a fragment shader with
+// #include "reflectionProbe.glsl" under FEATURE_reflective.  The probe's cube map is in world space, so the reflected
+// eye vector is turned back out of eye space with the inverse of the view matrix's rotation.  Rougher surfaces read
+// further down the mip chain, where the faces were filtered down from the level above.
+
+uniform samplerCube probeCubeMap;
+uniform mat3 probeInverseViewMatrix;
+uniform float probeMipLevels;
+
+vec3 ProbeReflection(vec3 eyePosition, vec3 eyeNormal, float roughness)
+{
+	vec3 reflected = reflect(normalize(eyePosition), normalize(eyeNormal));
+	vec3 direction = probeInverseViewMatrix * reflected;
+	return textureLod(probeCubeMap, direction, roughness * (probeMipLevels - 1.0)).rgb;
+}
@@ -0,0 +1,12 @@
+// Decoding for attributes packed by CPackedVertexFormat.  Include in a vertex shader with #include "vertexFormat.glsl".
+// With FEATURE_packedNormal, the normal at location 2 is declared as a vec2 and passed to DecodeOctahedral.  Positions and
+// texture coordinates need no decoding: they are normalized by the vertex fetch, and snorm16 positions are scaled back
+// by the modelview matrix.
+
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+	return normalize(n);
+}
@@ -0,0 +1,5 @@
+@echo off
+rem Compile the textures loaded through CCompiledTexture.  Run from the project directory with TextureCompiler.exe on the path.
+rem The track keeps its road markings sharper in BC7; the rest use the default (BC1, or BC3 with alpha).
+TextureCompiler -bc7 resources\textures\r2.jpg
+TextureCompiler resources\textures\wallg.jpg resources\textures\grass.jpg resources\textures\bolt.jpg resources\textures\dirtpile01.jpg
@@ -0,0 +1,84 @@
+// Offline texture compiler.  For each source image, writes a .ctex container next to it with the full mip chain in a GPU
+// format, which CCompiledTexture loads in place of the source.  Build as a console application together with
+// TextureCompressor.cpp and the game's TextureCache.cpp, MeshCache.cpp, MappedFile.cpp, ImageData.cpp and Log.cpp.
+//
+// Usage: TextureCompiler [-bc1 | -bc3 | -bc7 | -rgba8] image...
+// Without a format option, opaque images are compiled to BC1 and images with alpha to BC3.
+
+#include "TextureCompressor.h"
+#include <stdio.h>
+
+static const char *FORMAT_NAMES[] = { "RGBA8", "BC1", "BC3", "BC7" };
+
+static bool CompileTexture(const string &filename, bool autoFormat, TextureFormat format)
+{
+	unsigned long long key;
+	CImageData image;
+	RgbaImage rgba;
+	if (!CTextureCache::GetSourceKey(filename, key) || !image.Load(filename) || !CTextureCompressor::FromImage(image, rgba)) {
+		printf("%s: cannot read image\n", filename.c_str());
+		return false;
+	}
+	image.Release();
+
+	if (autoFormat)
+		format = CTextureCompressor::HasAlpha(rgba) ? TEXTURE_FORMAT_BC3 : TEXTURE_FORMAT_BC1;
+
+	vector<RgbaImage> mipChain;
+	CTextureCompressor::BuildMipChain(rgba, mipChain);
+
+	vector<vector<BYTE> > data(mipChain.size());
+	vector<TextureLevel> levels(mipChain.size());
+	unsigned int totalSize = 0;
+	for (unsigned int i = 0; i < mipChain.size(); i++) {
+		CTextureCompressor::Compress(mipChain[i], format, data[i]);
+		levels[i].pData = &data[i][0];
+		levels[i].size = (unsigned int)data[i].size();
+		levels[i].width = mipChain[i].width;
+		levels[i].height = mipChain[i].height;
+		totalSize += levels[i].size;
+	}
+
+	string compiledFilename = CTextureCache::GetCompiledFilename(filename);
+	if (!CTextureCache::Write(compiledFilename, key, format, levels)) {
+		printf("%s: cannot write %s\n", filename.c_str(), compiledFilename.c_str());
+		return false;
+	}
+
+	printf("%s: %dx%d, %d levels, %s, %u KB\n", compiledFilename.c_str(), rgba.width, rgba.height, (int)levels.size(),
+		FORMAT_NAMES[format], (totalSize + 1023) / 1024);
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	bool autoFormat = true;
+	TextureFormat format = TEXTURE_FORMAT_BC1;
+	int numFailed = 0, numFiles = 0;
+
+	for (int i = 1; i < argc; i++) {
+		string argument = argv[i];
+		if (argument == "-bc1" || argument == "-bc3" || argument == "-bc7" || argument == "-rgba8") {
+			autoFormat = false;
+			if (argument == "-bc1")
+				format = TEXTURE_FORMAT_BC1;
+			else if (argument == "-bc3")
+				format = TEXTURE_FORMAT_BC3;
+			else if (argument == "-bc7")
+				format = TEXTURE_FORMAT_BC7;
+			else
+				format = TEXTURE_FORMAT_RGBA8;
+			continue;
+		}
+
+		numFiles++;
+		if (!CompileTexture(argument, autoFormat, format))
+			numFailed++;
+	}
+
+	if (numFiles == 0) {
+		printf("Usage: TextureCompiler [-bc1 | -bc3 | -bc7 | -rgba8] image...\n");
+		return 1;
+	}
+	return numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,352 @@
+#include "TextureCompressor.h"
+#include <math.h>
+#include <algorithm>
+
+// Interpolation weights (out of 64) of BC7's 4-bit indices
+static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static int Clamp(int value, int minimum, int maximum)
+{
+	return value < minimum ? minimum : (value > maximum ? maximum : value);
+}
+
+static int SquaredDistance(const int *a, const BYTE *b, int numChannels)
+{
+	int sum = 0;
+	for (int c = 0; c < numChannels; c++)
+		sum += (a[c] - b[c]) * (a[c] - b[c]);
+	return sum;
+}
+
+// Writes a block least significant bit first, as BC7 is laid out
+struct BlockWriter
+{
+	BYTE *pOut;
+	int position;
+
+	void Write(unsigned int value, int numBits)
+	{
+		for (int i = 0; i < numBits; i++, position++) {
+			if (value & (1u << i))
+				pOut[position >> 3] |= (BYTE)(1 << (position & 7));
+		}
+	}
+};
+
+// Convert a decoded 24 or 32 bit BGR(A) image, whose rows are padded to four bytes, to tightly packed RGBA
+bool CTextureCompressor::FromImage(CImageData &image, RgbaImage &result)
+{
+	const BYTE *pBits = image.GetBits();
+	int bytesPerPixel = image.GetBPP() / 8;
+	if (pBits == NULL || (bytesPerPixel != 3 && bytesPerPixel != 4))
+		return false;
+
+	result.width = image.GetWidth();
+	result.height = image.GetHeight();
+	result.pixels.resize(result.width * result.height * 4);
+	int pitch = (result.width * bytesPerPixel + 3) & ~3;
+
+	for (int y = 0; y < result.height; y++) {
+		const BYTE *pRow = pBits + y * pitch;
+		BYTE *pOut = &result.pixels[y * result.width * 4];
+		for (int x = 0; x < result.width; x++, pRow += bytesPerPixel, pOut += 4) {
+			pOut[0] = pRow[2];
+			pOut[1] = pRow[1];
+			pOut[2] = pRow[0];
+			pOut[3] = bytesPerPixel == 4 ? pRow[3] : 255;
+		}
+	}
+	return true;
+}
+
+bool CTextureCompressor::HasAlpha(const RgbaImage &image)
+{
+	for (unsigned int i = 3; i < image.pixels.size(); i += 4) {
+		if (image.pixels[i] != 255)
+			return true;
+	}
+	return false;
+}
+
+// Box filter down to 1x1, as glGenerateMipmap would do at runtime
+void CTextureCompressor::BuildMipChain(const RgbaImage &image, vector<RgbaImage> &levels)
+{
+	levels.clear();
+	levels.push_back(image);
+	while (levels.back().width > 1 || levels.back().height > 1) {
+		RgbaImage level;
+		HalveImage(levels.back(), level);
+		levels.push_back(level);
+	}
+}
+
+void CTextureCompressor::HalveImage(const RgbaImage &image, RgbaImage &result)
+{
+	result.width = std::max(1, image.width / 2);
+	result.height = std::max(1, image.height / 2);
+	result.pixels.resize(result.width * result.height * 4);
+
+	for (int y = 0; y < result.height; y++) {
+		int y0 = std::min(2 * y, image.height - 1);
+		int y1 = std::min(2 * y + 1, image.height - 1);
+		for (int x = 0; x < result.width; x++) {
+			int x0 = std::min(2 * x, image.width - 1);
+			int x1 = std::min(2 * x + 1, image.width - 1);
+			for (int c = 0; c < 4; c++) {
+				int sum = image.pixels[(y0 * image.width + x0) * 4 + c] + image.pixels[(y0 * image.width + x1) * 4 + c]
+					+ image.pixels[(y1 * image.width + x0) * 4 + c] + image.pixels[(y1 * image.width + x1) * 4 + c];
+				result.pixels[(y * result.width + x) * 4 + c] = (BYTE)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+void CTextureCompressor::Compress(const RgbaImage &image, TextureFormat format, vector<BYTE> &result)
+{
+	result.assign(CTextureCache::GetLevelSize(format, image.width, image.height), 0);
+	if (format == TEXTURE_FORMAT_RGBA8) {
+		result = image.pixels;
+		return;
+	}
+
+	BYTE *pOut = &result[0];
+	for (int y = 0; y < image.height; y += 4) {
+		for (int x = 0; x < image.width; x += 4) {
+			BYTE block[64];
+			FetchBlock(image, x, y, block);
+			if (format == TEXTURE_FORMAT_BC1) {
+				CompressBlockBC1(block, pOut);
+				pOut += 8;
+			}
+			else if (format == TEXTURE_FORMAT_BC3) {
+				CompressBlockAlpha(block, pOut);
+				CompressBlockBC1(block, pOut + 8);
+				pOut += 16;
+			}
+			else {
+				CompressBlockBC7(block, pOut);
+				pOut += 16;
+			}
+		}
+	}
+}
+
+// Blocks that overhang the edge of the image repeat its last row and column
+void CTextureCompressor::FetchBlock(const RgbaImage &image, int x, int y, BYTE block[64])
+{
+	for (int j = 0; j < 4; j++) {
+		int sy = std::min(y + j, image.height - 1);
+		for (int i = 0; i < 4; i++) {
+			int sx = std::min(x + i, image.width - 1);
+			memcpy(&block[(j * 4 + i) * 4], &image.pixels[(sy * image.width + sx) * 4], 4);
+		}
+	}
+}
+
+// Fit a line through the block's colours (principal axis by power iteration) and return the extremes of the projections
+void CTextureCompressor::FindEndpoints(const BYTE block[64], int numChannels, float minimum[4], float maximum[4])
+{
+	float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int p = 0; p < 16; p++) {
+		for (int c = 0; c < numChannels; c++)
+			mean[c] += block[p * 4 + c] / 16.0f;
+	}
+
+	float covariance[4][4] = { { 0.0f } };
+	for (int p = 0; p < 16; p++) {
+		for (int a = 0; a < numChannels; a++) {
+			for (int b = 0; b < numChannels; b++)
+				covariance[a][b] += (block[p * 4 + a] - mean[a]) * (block[p * 4 + b] - mean[b]);
+		}
+	}
+
+	float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float length = 0.0f;
+		for (int a = 0; a < numChannels; a++) {
+			for (int b = 0; b < numChannels; b++)
+				next[a] += covariance[a][b] * axis[b];
+			length = std::max(length, fabsf(next[a]));
+		}
+		if (length < 1e-6f)
+			break;
+		for (int a = 0; a < numChannels; a++)
+			axis[a] = next[a] / length;
+	}
+
+	float lowest = 1e30f, highest = -1e30f;
+	for (int p = 0; p < 16; p++) {
+		float t = 0.0f;
+		for (int c = 0; c < numChannels; c++)
+			t += (block[p * 4 + c] - mean[c]) * axis[c];
+		lowest = std::min(lowest, t);
+		highest = std::max(highest, t);
+	}
+
+	float axisLengthSquared = 0.0f;
+	for (int c = 0; c < numChannels; c++)
+		axisLengthSquared += axis[c] * axis[c];
+	for (int c = 0; c < numChannels; c++) {
+		minimum[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * lowest / axisLengthSquared));
+		maximum[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * highest / axisLengthSquared));
+	}
+}
+
+// BC1 colour block in four-colour mode (colour0 > colour1), also used for the colour half of BC3
+void CTextureCompressor::CompressBlockBC1(const BYTE block[64], BYTE *pOut)
+{
+	float minimum[4], maximum[4];
+	FindEndpoints(block, 3, minimum, maximum);
+
+	unsigned int colours[2];
+	int palette[4][3];
+	const float *endpoints[2] = { maximum, minimum };
+	for (int e = 0; e < 2; e++) {
+		int r = Clamp((int)(endpoints[e][0] * 31.0f / 255.0f + 0.5f), 0, 31);
+		int g = Clamp((int)(endpoints[e][1] * 63.0f / 255.0f + 0.5f), 0, 63);
+		int b = Clamp((int)(endpoints[e][2] * 31.0f / 255.0f + 0.5f), 0, 31);
+		colours[e] = (r << 11) | (g << 5) | b;
+	}
+	if (colours[0] < colours[1])
+		std::swap(colours[0], colours[1]);
+
+	for (int e = 0; e < 2; e++) {
+		int r = (colours[e] >> 11) & 31, g = (colours[e] >> 5) & 63, b = colours[e] & 31;
+		palette[e][0] = (r << 3) | (r >> 2);
+		palette[e][1] = (g << 2) | (g >> 4);
+		palette[e][2] = (b << 3) | (b >> 2);
+	}
+	for (int c = 0; c < 3; c++) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	unsigned int indices = 0;
+	if (colours[0] != colours[1]) {
+		for (int p = 0; p < 16; p++) {
+			int best = 0, bestError = SquaredDistance(palette[0], &block[p * 4], 3);
+			for (int i = 1; i < 4; i++) {
+				int error = SquaredDistance(palette[i], &block[p * 4], 3);
+				if (error < bestError) {
+					best = i;
+					bestError = error;
+				}
+			}
+			indices |= best << (2 * p);
+		}
+	}
+
+	pOut[0] = (BYTE)(colours[0] & 0xFF);
+	pOut[1] = (BYTE)(colours[0] >> 8);
+	pOut[2] = (BYTE)(colours[1] & 0xFF);
+	pOut[3] = (BYTE)(colours[1] >> 8);
+	for (int i = 0; i < 4; i++)
+		pOut[4 + i] = (BYTE)(indices >> (8 * i));
+}
+
+// BC3 alpha block in eight-value mode (alpha0 > alpha1)
+void CTextureCompressor::CompressBlockAlpha(const BYTE block[64], BYTE *pOut)
+{
+	int alpha0 = 0, alpha1 = 255;
+	for (int p = 0; p < 16; p++) {
+		alpha0 = std::max(alpha0, (int)block[p * 4 + 3]);
+		alpha1 = std::min(alpha1, (int)block[p * 4 + 3]);
+	}
+
+	int palette[8];
+	palette[0] = alpha0;
+	palette[1] = alpha1;
+	for (int i = 2; i < 8; i++)
+		palette[i] = ((8 - i) * alpha0 + (i - 1) * alpha1) / 7;
+
+	unsigned long long indices = 0;
+	if (alpha0 != alpha1) {
+		for (int p = 0; p < 16; p++) {
+			int alpha = block[p * 4 + 3];
+			int best = 0;
+			for (int i = 1; i < 8; i++) {
+				if (abs(palette[i] - alpha) < abs(palette[best] - alpha))
+					best = i;
+			}
+			indices |= (unsigned long long)best << (3 * p);
+		}
+	}
+
+	pOut[0] = (BYTE)alpha0;
+	pOut[1] = (BYTE)alpha1;
+	for (int i = 0; i < 6; i++)
+		pOut[2 + i] = (BYTE)(indices >> (8 * i));
+}
+
+// BC7 mode 6: 7-bit RGBA endpoints, each with a shared low bit, and 4-bit indices
+void CTextureCompressor::CompressBlockBC7(const BYTE block[64], BYTE *pOut)
+{
+	float minimum[4], maximum[4];
+	FindEndpoints(block, 4, minimum, maximum);
+
+	// Quantise each endpoint with whichever low bit reproduces it more closely
+	int quantised[2][4], pBits[2], endpoints[2][4];
+	const float *targets[2] = { minimum, maximum };
+	for (int e = 0; e < 2; e++) {
+		float bestError = 1e30f;
+		for (int p = 0; p < 2; p++) {
+			int values[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; c++) {
+				values[c] = Clamp((int)((targets[e][c] - p) / 2.0f + 0.5f), 0, 127);
+				float difference = (float)((values[c] << 1) | p) - targets[e][c];
+				error += difference * difference;
+			}
+			if (error < bestError) {
+				bestError = error;
+				pBits[e] = p;
+				memcpy(quantised[e], values, sizeof(values));
+			}
+		}
+		for (int c = 0; c < 4; c++)
+			endpoints[e][c] = (quantised[e][c] << 1) | pBits[e];
+	}
+
+	int palette[16][4];
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 4; c++)
+			palette[i][c] = ((64 - BC7_WEIGHTS[i]) * endpoints[0][c] + BC7_WEIGHTS[i] * endpoints[1][c] + 32) >> 6;
+	}
+
+	int indices[16];
+	for (int p = 0; p < 16; p++) {
+		int best = 0, bestError = SquaredDistance(palette[0], &block[p * 4], 4);
+		for (int i = 1; i < 16; i++) {
+			int error = SquaredDistance(palette[i], &block[p * 4], 4);
+			if (error < bestError) {
+				best = i;
+				bestError = error;
+			}
+		}
+		indices[p] = best;
+	}
+
+	// The first index is stored without its top bit, so it must be below 8; the weights are symmetric, so swapping the
+	// endpoints and inverting the indices encodes the same colours
+	if (indices[0] >= 8) {
+		for (int c = 0; c < 4; c++)
+			std::swap(quantised[0][c], quantised[1][c]);
+		std::swap(pBits[0], pBits[1]);
+		for (int p = 0; p < 16; p++)
+			indices[p] = 15 - indices[p];
+	}
+
+	memset(pOut, 0, 16);
+	BlockWriter writer = { pOut, 0 };
+	writer.Write(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		writer.Write(quantised[0][c], 7);
+		writer.Write(quantised[1][c], 7);
+	}
+	writer.Write(pBits[0], 1);
+	writer.Write(pBits[1], 1);
+	writer.Write(indices[0], 3);
+	for (int p = 1; p < 16; p++)
+		writer.Write(indices[p], 4);
+}
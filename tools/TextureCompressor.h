@@ -0,0 +1,30 @@
+#pragma once
+#include "../TextureCache.h"
+
+// An uncompressed RGBA8 image, rows bottom to top as OpenGL expects
+struct RgbaImage
+{
+	int width;
+	int height;
+	vector<BYTE> pixels;
+};
+
+// Offline mip chain generation and block compression for the texture compiler.  Compression is a range fit along the
+// principal axis of each 4x4 block, which is fast and close to what a driver would produce; BC7 uses mode 6 only (one
+// subset, RGBA endpoints with 4-bit indices).
+class CTextureCompressor
+{
+public:
+	static bool FromImage(CImageData &image, RgbaImage &result);
+	static bool HasAlpha(const RgbaImage &image);
+	static void BuildMipChain(const RgbaImage &image, vector<RgbaImage> &levels);
+	static void Compress(const RgbaImage &image, TextureFormat format, vector<BYTE> &result);
+
+private:
+	static void HalveImage(const RgbaImage &image, RgbaImage &result);
+	static void FetchBlock(const RgbaImage &image, int x, int y, BYTE block[64]);
+	static void FindEndpoints(const BYTE block[64], int numChannels, float minimum[4], float maximum[4]);
+	static void CompressBlockBC1(const BYTE block[64], BYTE *pOut);
+	static void CompressBlockAlpha(const BYTE block[64], BYTE *pOut);
+	static void CompressBlockBC7(const BYTE block[64], BYTE *pOut);
+};